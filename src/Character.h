@@ -25,6 +25,7 @@
 
 // Konsole
 #include "CharacterColor.h"
+#include "CharacterStyleTable.h"
 
 namespace Konsole
 {
@@ -35,6 +36,52 @@ const int LINE_WRAPPED      = (1 << 0);
 const int LINE_DOUBLEWIDTH  = (1 << 1);
 const int LINE_DOUBLEHEIGHT = (1 << 2);
 
+/**
+ * Describes the range of columns in a line of the terminal which has
+ * changed since the line was last drawn.  See Screen::lineDamage()
+ */
+class LineDamage
+{
+public:
+    /** Constructs an empty range, for a line which has not changed */
+    LineDamage()
+        : startColumn(-1)
+        , endColumn(-1) {
+    }
+    /** Constructs a range from @p start to @p end inclusive */
+    LineDamage(int start, int end)
+        : startColumn(start)
+        , endColumn(end) {
+    }
+
+    /** Returns true if no part of the line has changed */
+    bool isEmpty() const {
+        return startColumn < 0;
+    }
+
+    /** Extends the range to include the columns from @p start to @p end inclusive */
+    void add(int start, int end) {
+        if (isEmpty()) {
+            startColumn = start;
+            endColumn = end;
+        } else {
+            startColumn = qMin(startColumn, start);
+            endColumn = qMax(endColumn, end);
+        }
+    }
+
+    /** Extends the range to include @p other */
+    void add(const LineDamage& other) {
+        if (!other.isEmpty())
+            add(other.startColumn, other.endColumn);
+    }
+
+    /** The first changed column */
+    int startColumn;
+    /** The last changed column */
+    int endColumn;
+};
+
 const int DEFAULT_RENDITION = 0;
 const int RE_BOLD           = (1 << 0);
 const int RE_BLINK          = (1 << 1);
@@ -53,9 +100,9 @@ const int RE_EXTENDED_CHAR  = (1 << 6);
  * pixel matrix. Typical examples are ╳(U+2573) and ╰(U+2570). So those
  * unsupported line characters should be drawn in the normal way .
  */
-inline bool isSupportedLineChar(quint16 codePoint)
+inline bool isSupportedLineChar(quint32 codePoint)
 {
-    if ((codePoint & 0xFF80) != 0x2500) {
+    if ((codePoint & 0xFFFFFF80) != 0x2500) {
         return false;
     }
 
@@ -69,14 +116,43 @@ inline bool isSupportedLineChar(quint16 codePoint)
     }
 }
 
+/**
+ * Appends the unicode character @p codePoint to @p text, encoded as a
+ * surrogate pair if it lies outside of the Basic Multilingual Plane.
+ */
+inline void appendCodePoint(QString& text, quint32 codePoint)
+{
+    if (codePoint > 0xFFFF) {
+        text.append(QChar(QChar::highSurrogate(codePoint)));
+        text.append(QChar(QChar::lowSurrogate(codePoint)));
+    } else {
+        text.append(QChar(codePoint));
+    }
+}
+
 /**
  * A single character in the terminal which consists of a unicode character
  * value, foreground and background colors and a set of rendition attributes
  * which specify how it should be drawn.
+ *
+ * The colors and rendition are not stored in the character itself, instead
+ * each character holds the index of an entry in the CharacterStyleTable.
+ * This keeps a Character at 8 bytes, which reduces the amount of memory
+ * touched when screen images and history lines are copied around.
  */
 class Character
 {
 public:
+    /**
+     * Constructs a new character using the default colors and rendition.
+     *
+     * @param _c The unicode character value of this character.
+     */
+    explicit inline Character(quint32 _c = ' ')
+        : character(_c)
+        , isRealCharacter(true)
+        , _style(0) { }
+
     /**
      * Constructs a new character.
      *
@@ -88,16 +164,14 @@ public:
      * @param _real Indicate whether this character really exists, or exists
      *              simply as place holder.
      */
-    explicit inline Character(quint16 _c = ' ',
-                              CharacterColor  _f = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR),
-                              CharacterColor  _b = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
-                              quint8  _r = DEFAULT_RENDITION,
-                              bool _real = true)
+    inline Character(quint32 _c,
+                     const CharacterColor& _f,
+                     const CharacterColor& _b,
+                     quint8  _r = DEFAULT_RENDITION,
+                     bool _real = true)
         : character(_c)
-        , rendition(_r)
-        , foregroundColor(_f)
-        , backgroundColor(_b)
-        , isRealCharacter(_real) { }
+        , isRealCharacter(_real)
+        , _style(CharacterStyleTable::styleIndex(_f, _b, _r)) { }
 
     /** The unicode character value for this character.
      *
@@ -105,16 +179,7 @@ public:
      * look up the unicode character sequence in the ExtendedCharTable used to
      * create the sequence.
      */
-    quint16 character;
-
-    /** A combination of RENDITION flags which specify options for drawing the character. */
-    quint8  rendition;
-
-    /** The foreground color used to draw this character. */
-    CharacterColor  foregroundColor;
-
-    /** The color used to draw this character's background. */
-    CharacterColor  backgroundColor;
+    quint32 character : 21;
 
     /** Indicate whether this character really exists, or exists simply as place holder.
      *
@@ -125,7 +190,61 @@ public:
      *    PlaceHolderCharacter: a character which exists as place holder
      *    TabStopCharacter: a special place holder for HT("\t")
      */
-    bool isRealCharacter;
+    quint32 isRealCharacter : 1;
+
+    /** Returns the colors and rendition used to draw this character. */
+    inline const CharacterStyle& style() const {
+        return CharacterStyleTable::instance.style(_style);
+    }
+
+    /**
+     * Returns the index of this character's style in the CharacterStyleTable.
+     * Two characters are drawn with the same colors and rendition if and
+     * only if their style indexes are equal.
+     */
+    inline quint32 styleIndex() const {
+        return _style;
+    }
+    /** Sets the index of this character's style in the CharacterStyleTable. */
+    inline void setStyleIndex(quint32 index) {
+        _style = index;
+    }
+
+    /** Returns a combination of RENDITION flags which specify options for drawing the character. */
+    inline quint8 rendition() const {
+        return style().rendition;
+    }
+    /** Returns the foreground color used to draw this character. */
+    inline const CharacterColor& foregroundColor() const {
+        return style().foregroundColor;
+    }
+    /** Returns the color used to draw this character's background. */
+    inline const CharacterColor& backgroundColor() const {
+        return style().backgroundColor;
+    }
+
+    /** Sets the colors and rendition used to draw this character. */
+    inline void setFormat(const CharacterColor& foreground,
+                          const CharacterColor& background,
+                          quint8 renditionFlags) {
+        _style = CharacterStyleTable::styleIndex(foreground, background, renditionFlags);
+    }
+    /** Sets the rendition flags of this character, keeping its colors. */
+    inline void setRendition(quint8 renditionFlags) {
+        const CharacterStyle& current = style();
+        if (current.rendition != renditionFlags)
+            setFormat(current.foregroundColor, current.backgroundColor, renditionFlags);
+    }
+    /** Sets the foreground color of this character. */
+    inline void setForegroundColor(const CharacterColor& color) {
+        const CharacterStyle& current = style();
+        setFormat(color, current.backgroundColor, current.rendition);
+    }
+    /** Sets the background color of this character. */
+    inline void setBackgroundColor(const CharacterColor& color) {
+        const CharacterStyle& current = style();
+        setFormat(current.foregroundColor, color, current.rendition);
+    }
 
     /**
      * Returns true if this character should always be drawn in bold when
@@ -152,7 +271,7 @@ public:
     friend bool operator != (const Character& a, const Character& b);
 
     inline bool isLineChar() const {
-        if (rendition & RE_EXTENDED_CHAR) {
+        if (rendition() & RE_EXTENDED_CHAR) {
             return false;
         } else {
             return isSupportedLineChar(character);
@@ -160,12 +279,16 @@ public:
     }
 
     inline bool isSpace() const {
-        if (rendition & RE_EXTENDED_CHAR) {
+        if (rendition() & RE_EXTENDED_CHAR) {
             return false;
         } else {
-            return QChar(character).isSpace();
+            return character <= 0xFFFF && QChar(character).isSpace();
         }
     }
+
+private:
+    // index of this character's entry in CharacterStyleTable::instance
+    quint32 _style;
 };
 
 inline bool operator == (const Character& a, const Character& b)
@@ -180,17 +303,16 @@ inline bool operator != (const Character& a, const Character& b)
 
 inline bool Character::equalsFormat(const Character& other) const
 {
-    return backgroundColor == other.backgroundColor &&
-           foregroundColor == other.foregroundColor &&
-           rendition == other.rendition;
+    return _style == other._style;
 }
 
 inline ColorEntry::FontWeight Character::fontWeight(const ColorEntry* base) const
 {
-    if (foregroundColor._colorSpace == COLOR_SPACE_DEFAULT)
-        return base[foregroundColor._u + 0 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
-    else if (foregroundColor._colorSpace == COLOR_SPACE_SYSTEM)
-        return base[foregroundColor._u + 2 + (foregroundColor._v ? BASE_COLORS : 0)].fontWeight;
+    const CharacterColor& foreground = foregroundColor();
+    if (foreground._colorSpace == COLOR_SPACE_DEFAULT)
+        return base[foreground._u + 0 + (foreground._v ? BASE_COLORS : 0)].fontWeight;
+    else if (foreground._colorSpace == COLOR_SPACE_SYSTEM)
+        return base[foreground._u + 2 + (foreground._v ? BASE_COLORS : 0)].fontWeight;
     else
         return ColorEntry::UseCurrentFormat;
 }
@@ -206,6 +206,26 @@ public:
      */
     friend bool operator != (const CharacterColor& a, const CharacterColor& b);
 
+    /** Returns a hash value for @p color, for use as a QHash key. */
+    friend uint qHash(const CharacterColor& color);
+
+    /**
+     * Returns the color space and color value packed into a single number,
+     * which can be stored and turned back into a color with fromPackedValue()
+     */
+    quint32 packedValue() const {
+        return (quint32(_colorSpace) << 24) | (quint32(_u) << 16) | (quint32(_v) << 8) | _w;
+    }
+    /** Returns the color described by a value returned by packedValue() */
+    static CharacterColor fromPackedValue(quint32 value) {
+        CharacterColor color;
+        color._colorSpace = value >> 24;
+        color._u = value >> 16;
+        color._v = value >> 8;
+        color._w = value;
+        return color;
+    }
+
 private:
     quint8 _colorSpace;
 
@@ -226,6 +246,11 @@ inline bool operator != (const CharacterColor& a, const CharacterColor& b)
 {
     return !operator==(a, b);
 }
+inline uint qHash(const CharacterColor& color)
+{
+    return (uint(color._colorSpace) << 24) | (uint(color._u) << 16) |
+           (uint(color._v) << 8) | color._w;
+}
 
 inline const QColor color256(quint8 u, const ColorEntry* base)
 {
@@ -0,0 +1,165 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterStyleTable.h"
+
+// Qt
+#include <QtCore/QMutexLocker>
+
+// KDE
+#include <KDebug>
+
+using namespace Konsole;
+
+CharacterStyleTable::CharacterStyleTable(int capacity)
+    : _count(1)
+    , _capacity(capacity)
+    , _rgbCapacity(capacity / 4 * 3)
+{
+    Q_ASSERT(capacity > 0 && capacity <= ChunkCount * ChunkSize);
+
+    for (int i = 0; i < ChunkCount; i++)
+        _chunks[i] = 0;
+
+    // entry 0 is the default style
+    _chunks[0] = new CharacterStyle[ChunkSize];
+    _indexes.insert(CharacterStyle(), 0);
+}
+
+CharacterStyleTable::~CharacterStyleTable()
+{
+    for (int i = 0; i < ChunkCount; i++)
+        delete[] _chunks[i];
+}
+
+// global instance
+CharacterStyleTable CharacterStyleTable::instance;
+
+// returns the level of the 6x6x6 color cube of the 256 color palette
+// which is closest to the color component 'value'
+static int cubeLevel(int value)
+{
+    return value < 48 ? 0 : (value < 115 ? 1 : (value - 35) / 40);
+}
+
+static int cubeValue(int level)
+{
+    return level ? 40 * level + 55 : 0;
+}
+
+static int square(int value)
+{
+    return value * value;
+}
+
+// returns the color of the 256 color palette which is closest to 'color'
+// if it is an RGB color, see color256()
+static CharacterColor paletteColor(const CharacterColor& color)
+{
+    const quint32 value = color.packedValue();
+    if ((value >> 24) != COLOR_SPACE_RGB)
+        return color;
+
+    const int red = (value >> 16) & 0xff;
+    const int green = (value >> 8) & 0xff;
+    const int blue = value & 0xff;
+
+    const int r = cubeLevel(red);
+    const int g = cubeLevel(green);
+    const int b = cubeLevel(blue);
+    const int cubeDistance = square(red - cubeValue(r)) + square(green - cubeValue(g)) +
+                             square(blue - cubeValue(b));
+
+    // the gray ramp runs from 8 to 238 in steps of 10
+    const int grayLevel = qBound(0, ((red + green + blue) / 3 - 3) / 10, 23);
+    const int gray = 8 + 10 * grayLevel;
+    const int grayDistance = square(red - gray) + square(green - gray) + square(blue - gray);
+
+    if (grayDistance < cubeDistance)
+        return CharacterColor(COLOR_SPACE_256, 232 + grayLevel);
+    else
+        return CharacterColor(COLOR_SPACE_256, 16 + 36 * r + 6 * g + b);
+}
+
+quint32 CharacterStyleTable::createStyle(const CharacterStyle& style)
+{
+    QMutexLocker locker(&_mutex);
+
+    QHash<CharacterStyle, quint32>::const_iterator iter = _indexes.constFind(style);
+    if (iter != _indexes.constEnd())
+        return iter.value();
+
+    if (_count < _rgbCapacity)
+        return addStyle(style);
+
+    // entries are never reclaimed (see the class documentation), so once
+    // most of the table is used, new RGB styles are mapped to the palette
+
+    const CharacterStyle paletteStyle(paletteColor(style.foregroundColor),
+                                      paletteColor(style.backgroundColor),
+                                      style.rendition);
+    if (!(paletteStyle == style)) {
+        static bool warned = false;
+        if (!warned) {
+            kWarning() << "Character style table is nearly full, using palette colors instead of RGB colors"
+                       << "for new styles until Konsole is restarted.";
+            warned = true;
+        }
+
+        iter = _indexes.constFind(paletteStyle);
+        if (iter != _indexes.constEnd())
+            return iter.value();
+    }
+
+    return addStyle(paletteStyle);
+}
+
+quint32 CharacterStyleTable::addStyle(const CharacterStyle& style)
+{
+    if (_count == _capacity) {
+        // only happens if an application uses an extraordinary number of
+        // distinct palette colors and renditions
+        static bool warned = false;
+        if (!warned) {
+            kWarning() << "Character style table is full, using the default style.";
+            warned = true;
+        }
+        return 0;
+    }
+
+    const quint32 index = _count;
+    CharacterStyle*& chunk = _chunks[index >> ChunkBits];
+    if (!chunk)
+        chunk = new CharacterStyle[ChunkSize];
+
+    chunk[index & (ChunkSize - 1)] = style;
+    _indexes.insert(style, index);
+    _count++;
+
+    return index;
+}
+
+int CharacterStyleTable::count() const
+{
+    QMutexLocker locker(&_mutex);
+    return _count;
+}
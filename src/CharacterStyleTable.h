@@ -0,0 +1,183 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef CHARACTERSTYLETABLE_H
+#define CHARACTERSTYLETABLE_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+// Konsole
+#include "CharacterColor.h"
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * The colors and rendition flags used to draw a character.
+ *
+ * Characters do not store their style directly, instead they refer to an
+ * entry in the CharacterStyleTable so that each cell only needs a single
+ * index in addition to its unicode character value.
+ */
+class CharacterStyle
+{
+public:
+    CharacterStyle(const CharacterColor& foreground = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR),
+                   const CharacterColor& background = CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
+                   quint8 renditionFlags = 0)
+        : foregroundColor(foreground)
+        , backgroundColor(background)
+        , rendition(renditionFlags) { }
+
+    /** The foreground color used to draw the character. */
+    CharacterColor foregroundColor;
+    /** The color used to draw the character's background. */
+    CharacterColor backgroundColor;
+    /** A combination of RENDITION flags which specify options for drawing the character. */
+    quint8 rendition;
+};
+
+inline bool operator == (const CharacterStyle& a, const CharacterStyle& b)
+{
+    return a.rendition == b.rendition &&
+           a.foregroundColor == b.foregroundColor &&
+           a.backgroundColor == b.backgroundColor;
+}
+
+inline uint qHash(const CharacterStyle& style)
+{
+    return (qHash(style.foregroundColor) * 31 + qHash(style.backgroundColor)) * 31 + style.rendition;
+}
+
+/**
+ * A table which interns the distinct character styles used in the terminal.
+ *
+ * Each style is stored only once and is identified by its index in the
+ * table, which remains valid for the lifetime of the application.  Index 0
+ * always refers to the default style, so characters using the default
+ * colors and rendition never need to consult the table when they are
+ * created.
+ *
+ * Adding styles is thread-safe.  Looking up a style by index does not lock,
+ * since entries are never moved or removed once they have been added.
+ *
+ * Styles are never removed from the table, even after no character uses
+ * them any more.  Style indexes are copied into screen images, the in-memory
+ * and on-disk history and the search thread, so finding out which entries
+ * are still referenced would require sweeping all of them.  The table
+ * therefore only grows during the lifetime of the application, by the size
+ * of a CharacterStyle plus a hash entry per distinct style.
+ *
+ * As a result, applications which use many RGB colors (for example image
+ * viewers drawing with 24-bit colors) could eventually fill the table.  Once
+ * three quarters of it are used, a warning is printed once and RGB colors
+ * are from then on replaced by the closest color of the 256 color palette,
+ * so that the rest of the table remains for the far fewer styles which use
+ * palette colors.  Text drawn with such colors keeps its palette
+ * approximation until the application is restarted.
+ */
+class KONSOLEPRIVATE_EXPORT CharacterStyleTable
+{
+public:
+    /**
+     * Constructs a new style table containing only the default style, which
+     * can hold up to @p capacity styles.  The largest capacity, which is
+     * the default, is about a million styles.
+     */
+    explicit CharacterStyleTable(int capacity = ChunkCount * ChunkSize);
+    ~CharacterStyleTable();
+
+    /**
+     * Returns the index of the style with the given colors and rendition,
+     * adding it to the global table if it is not already present.
+     */
+    static inline quint32 styleIndex(const CharacterColor& foreground,
+                                     const CharacterColor& background,
+                                     quint8 rendition);
+
+    /**
+     * Adds a style to the table and returns its index.  If the same style
+     * already exists in the table, the index of the existing entry is returned.
+     *
+     * If most of the table is used, RGB colors in @p style are replaced by
+     * the closest palette colors.  If the table is full, a warning is
+     * printed and the default style is returned instead.
+     */
+    quint32 createStyle(const CharacterStyle& style);
+
+    /**
+     * Returns the style at @p index, which must have been returned by
+     * createStyle() or styleIndex().
+     */
+    inline const CharacterStyle& style(quint32 index) const;
+
+    /** Returns the number of distinct styles in the table. */
+    int count() const;
+
+    /** The global CharacterStyleTable instance. */
+    static CharacterStyleTable instance;
+
+private:
+    Q_DISABLE_COPY(CharacterStyleTable)
+
+    // adds a style which is not in the table yet
+    quint32 addStyle(const CharacterStyle& style);
+
+    // styles are stored in fixed-size chunks which are allocated on demand,
+    // so that existing entries never move and can be read without locking
+    enum {
+        ChunkBits = 12,
+        ChunkSize = 1 << ChunkBits,
+        ChunkCount = 256
+    };
+
+    CharacterStyle* _chunks[ChunkCount];
+    int _count;
+    int _capacity;
+    // styles with RGB colors are only added while the table holds fewer styles
+    int _rgbCapacity;
+    QHash<CharacterStyle, quint32> _indexes;
+    mutable QMutex _mutex;
+};
+
+inline quint32 CharacterStyleTable::styleIndex(const CharacterColor& foreground,
+                                               const CharacterColor& background,
+                                               quint8 rendition)
+{
+    // the default style is checked first without touching the global table,
+    // so that default characters can be created during static initialization
+    if (rendition == 0 &&
+            foreground == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR) &&
+            background == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR))
+        return 0;
+
+    return instance.createStyle(CharacterStyle(foreground, background, rendition));
+}
+
+inline const CharacterStyle& CharacterStyleTable::style(quint32 index) const
+{
+    return _chunks[index >> ChunkBits][index & (ChunkSize - 1)];
+}
+}
+
+#endif // CHARACTERSTYLETABLE_H
@@ -22,6 +22,9 @@
 // Own
 #include "Emulation.h"
 
+// System
+#include <string.h>
+
 // Qt
 #include <QtGui/QKeyEvent>
 
@@ -39,15 +42,20 @@ Emulation::Emulation() :
     _decoder(0),
     _keyTranslator(0),
     _usesMouse(false),
+    _utf8CodePoint(0),
+    _utf8Remaining(0),
+    _utf8Minimum(0),
     _imageSizeInitialized(false)
 {
     // create screens with a default size
     _screen[0] = new Screen(40, 80);
     _screen[1] = new Screen(40, 80);
+    // full-screen applications redraw the alternate screen themselves
+    _screen[0]->setReflowLines(true);
     _currentScreen = _screen[0];
 
-    QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()));
-    QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()));
+    _bulkTimer.setSingleShot(true);
+    QObject::connect(&_bulkTimer, SIGNAL(timeout()), this, SLOT(showBulk()));
 
     // listen for mouse status changes
     connect(this , SIGNAL(programUsesMouseChanged(bool)) ,
@@ -134,6 +142,16 @@ const HistoryType& Emulation::history() const
     return _screen[0]->getScroll();
 }
 
+qint64 Emulation::historyMemoryUsage() const
+{
+    return _screen[0]->historyMemoryUsage();
+}
+
+void Emulation::setHistoryIndexEnabled(bool enable)
+{
+    _screen[0]->setHistoryIndexEnabled(enable);
+}
+
 void Emulation::setCodec(const QTextCodec * codec)
 {
     if (codec) {
@@ -141,6 +159,7 @@ void Emulation::setCodec(const QTextCodec * codec)
 
         delete _decoder;
         _decoder = _codec->makeDecoder();
+        resetUtf8Decoder();
 
         emit useUtf8Request(utf8());
     } else {
@@ -184,6 +203,12 @@ void Emulation::receiveChar(int c)
     }
 }
 
+void Emulation::receiveChars(const uint* chars, int count)
+{
+    for (int i = 0; i < count; i++)
+        receiveChar(chars[i]);
+}
+
 void Emulation::sendKeyEvent(QKeyEvent* ev)
 {
     emit stateSet(NOTIFYNORMAL);
@@ -208,29 +233,159 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
 
 /*
    We are doing code conversion from locale to unicode first.
+
+   UTF-8, which is what almost every terminal program produces nowadays,
+   is decoded directly into _receiveBuffer by decodeUtf8().  Other
+   encodings are converted using the QTextDecoder for the current codec.
 */
 
+// returns true if the CAN character at text[i] starts a ZModem
+// transfer request ( '\030' followed by "B00" )
+static inline bool isZModemStart(const char* text, int i, int length)
+{
+    return (length - i - 1 > 3) && (qstrncmp(text + i + 1, "B00", 3) == 0);
+}
+
+// returns a value with the high bit of each byte set for each byte
+// in 'word' which is equal to 'byte'
+static inline quint64 matchBytes(quint64 word, uchar byte)
+{
+    const quint64 ones = Q_UINT64_C(0x0101010101010101);
+    const quint64 highBits = Q_UINT64_C(0x8080808080808080);
+    const quint64 x = word ^ (ones * byte);
+    return (x - ones) & ~x & highBits;
+}
+
+void Emulation::resetUtf8Decoder()
+{
+    _utf8CodePoint = 0;
+    _utf8Remaining = 0;
+    _utf8Minimum = 0;
+}
+
+int Emulation::decodeUtf8(const char* text, int length, bool* zmodemDetected)
+{
+    const uchar* const begin = reinterpret_cast<const uchar*>(text);
+    const uchar* const end = begin + length;
+    const uchar* p = begin;
+
+    // a truncated sequence left over from the previous block produces
+    // a replacement character in addition to the current byte
+    if (_receiveBuffer.size() < length + 1)
+        _receiveBuffer.resize(length + 1);
+    uint* const output = _receiveBuffer.data();
+    uint* out = output;
+
+    while (p < end) {
+        if (_utf8Remaining == 0) {
+            // ASCII fast path, eight bytes at a time.  Falls through to the
+            // byte-by-byte loop below on anything which is not plain ASCII
+            // or which might start a ZModem transfer.
+            while (end - p >= 8) {
+                quint64 word;
+                memcpy(&word, p, sizeof(word));
+                if ((word & Q_UINT64_C(0x8080808080808080)) || matchBytes(word, '\030'))
+                    break;
+                for (int i = 0; i < 8; i++)
+                    out[i] = p[i];
+                out += 8;
+                p += 8;
+            }
+            if (p == end)
+                break;
+
+            const uchar c = *p++;
+            if (c < 0x80) {
+                *out++ = c;
+                if (c == '\030' && isZModemStart(text, p - begin - 1, length))
+                    *zmodemDetected = true;
+            } else if (c >= 0xc2 && c <= 0xdf) {
+                _utf8CodePoint = c & 0x1f;
+                _utf8Remaining = 1;
+                _utf8Minimum = 0x80;
+            } else if (c >= 0xe0 && c <= 0xef) {
+                _utf8CodePoint = c & 0x0f;
+                _utf8Remaining = 2;
+                _utf8Minimum = 0x800;
+            } else if (c >= 0xf0 && c <= 0xf4) {
+                _utf8CodePoint = c & 0x07;
+                _utf8Remaining = 3;
+                _utf8Minimum = 0x10000;
+            } else {
+                // stray continuation byte or invalid lead byte
+                *out++ = QChar::ReplacementCharacter;
+            }
+        } else {
+            const uchar c = *p;
+            if ((c & 0xc0) != 0x80) {
+                // truncated sequence, the current byte starts
+                // something new and is decoded again
+                *out++ = QChar::ReplacementCharacter;
+                _utf8Remaining = 0;
+                continue;
+            }
+            ++p;
+
+            _utf8CodePoint = (_utf8CodePoint << 6) | (c & 0x3f);
+            if (--_utf8Remaining > 0)
+                continue;
+
+            const uint codePoint = _utf8CodePoint;
+            if (codePoint < _utf8Minimum || codePoint > 0x10ffff ||
+                    (codePoint >= 0xd800 && codePoint <= 0xdfff)) {
+                *out++ = QChar::ReplacementCharacter;
+            } else {
+                *out++ = codePoint;
+            }
+        }
+    }
+
+    return out - output;
+}
+
 void Emulation::receiveData(const char* text, int length)
 {
     emit stateSet(NOTIFYACTIVITY);
 
     bufferedUpdate();
 
-    QString unicodeText = _decoder->toUnicode(text, length);
+    bool zmodem = false;
+    int count = 0;
 
-    //send characters to terminal emulator
-    for (int i = 0; i < unicodeText.length(); i++)
-        receiveChar(unicodeText[i].unicode());
-
-    //look for z-modem indicator
-    //-- someone who understands more about z-modems that I do may be able to move
-    //this check into the above for loop?
-    for (int i = 0; i < length; i++) {
-        if (text[i] == '\030') {
-            if ((length - i - 1 > 3) && (qstrncmp(text + i + 1, "B00", 3) == 0))
-                emit zmodemDetected();
+    if (utf8()) {
+        count = decodeUtf8(text, length, &zmodem);
+    } else {
+        const QString unicodeText = _decoder->toUnicode(text, length);
+        const ushort* utf16 = unicodeText.utf16();
+        const int utf16Length = unicodeText.length();
+
+        if (_receiveBuffer.size() < utf16Length)
+            _receiveBuffer.resize(utf16Length);
+        uint* chars = _receiveBuffer.data();
+        for (int i = 0; i < utf16Length; i++) {
+            if (QChar(utf16[i]).isHighSurrogate() && i + 1 < utf16Length &&
+                    QChar(utf16[i + 1]).isLowSurrogate()) {
+                chars[count++] = QChar::surrogateToUcs4(utf16[i], utf16[i + 1]);
+                i++;
+            } else {
+                chars[count++] = utf16[i];
+            }
+        }
+
+        //look for z-modem indicator
+        const char* can = static_cast<const char*>(memchr(text, '\030', length));
+        while (can && !zmodem) {
+            const int i = can - text;
+            zmodem = isZModemStart(text, i, length);
+            can = static_cast<const char*>(memchr(can + 1, '\030', length - i - 1));
         }
     }
+
+    //send characters to terminal emulator
+    receiveChars(_receiveBuffer.constData(), count);
+
+    if (zmodem)
+        emit zmodemDetected();
 }
 
 //OLDER VERSION
@@ -296,26 +451,41 @@ int Emulation::lineCount() const
 
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    _bulkTimer.stop();
+    _lastBulk.start();
 
     emit outputChanged();
 
     _currentScreen->resetScrolledLines();
     _currentScreen->resetDroppedLines();
+    _currentScreen->resetDamage();
 }
 
 void Emulation::bufferedUpdate()
 {
-    static const int BULK_TIMEOUT1 = 10;
-    static const int BULK_TIMEOUT2 = 40;
+    // the minimum time in milliseconds between two outputChanged() signals,
+    // one frame at 60 frames per second
+    static const int BULK_INTERVAL = 16;
+
+    // all changes made before control returns to the event loop are
+    // announced by a single outputChanged() signal.  The timer is not
+    // restarted by further changes, so a steady stream of output cannot
+    // postpone the update indefinitely.
+    //
+    // everything which listens for outputChanged(), such as the filters,
+    // the search and the activity monitor, does its work once per signal,
+    // so while output keeps arriving it is announced once per frame rather
+    // than after every read.  The first change after a quiet period is
+    // announced straight away so that typing remains responsive.  How often
+    // the views actually repaint is decided by each view, see UpdateScheduler.
+    if (_bulkTimer.isActive())
+        return;
 
-    _bulkTimer1.setSingleShot(true);
-    _bulkTimer1.start(BULK_TIMEOUT1);
-    if (!_bulkTimer2.isActive()) {
-        _bulkTimer2.setSingleShot(true);
-        _bulkTimer2.start(BULK_TIMEOUT2);
-    }
+    int delay = 0;
+    if (_lastBulk.isValid())
+        delay = static_cast<int>(qBound(qint64(0), BULK_INTERVAL - _lastBulk.elapsed(), qint64(BULK_INTERVAL)));
+
+    _bulkTimer.start(delay);
 }
 
 char Emulation::eraseChar() const
@@ -24,9 +24,11 @@
 #define EMULATION_H
 
 // Qt
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QSize>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTimer>
+#include <QtCore/QVector>
 
 // Konsole
 #include "konsole_export.h"
@@ -149,6 +151,13 @@ public:
     void setHistory(const HistoryType&);
     /** Returns the history store used by this emulation.  See setHistory() */
     const HistoryType& history() const;
+    /** Returns the approximate number of bytes of memory used by the history store. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Sets whether the text in the history store is indexed to speed up
+     * searches for literal text.  See Screen::setHistoryIndexEnabled()
+     */
+    void setHistoryIndexEnabled(bool enable);
     /** Clears the history scroll. */
     void clearHistory();
 
@@ -249,12 +258,13 @@ public slots:
 
     /**
      * Processes an incoming stream of characters.  receiveData() decodes the incoming
-     * character buffer using the current codec(), and then calls receiveChar() for
-     * each unicode character in the resulting buffer.
+     * character buffer using the current codec(), and then passes the resulting
+     * unicode characters to receiveChars().
      *
-     * receiveData() also starts a timer which causes the outputChanged() signal
-     * to be emitted when it expires.  The timer allows multiple updates in quick
-     * succession to be buffered into a single outputChanged() signal emission.
+     * receiveData() also schedules the emission of the outputChanged() signal
+     * once control returns to the event loop.  This allows multiple updates in
+     * quick succession to be buffered into a single outputChanged() signal emission.
+     * While output keeps arriving the signal is emitted at most once per frame.
      *
      * @param buffer A string of characters received from the terminal program.
      * @param len The length of @p buffer
@@ -317,8 +327,10 @@ signals:
     /**
      * Emitted when the contents of the screen image change.
      * The emulation buffers the updates from successive image changes,
-     * and only emits outputChanged() at sensible intervals when
-     * there is a lot of terminal activity.
+     * and emits outputChanged() once control returns to the event loop,
+     * but no more than once per frame while there is a lot of terminal
+     * activity.  Views may limit how often they repaint further, see
+     * UpdateScheduler.
      *
      * Normally there is no need for objects other than the screen windows
      * created with createWindow() to listen for this signal.
@@ -420,6 +432,18 @@ protected:
      */
     virtual void receiveChar(int ch);
 
+    /**
+     * Processes a buffer of incoming characters.  See receiveData()
+     *
+     * The default implementation calls receiveChar() for each character in
+     * the buffer.  Emulations should reimplement this to process whole runs
+     * of characters at once.
+     *
+     * @p chars An array of unicode character codes.
+     * @p count The number of characters in @p chars
+     */
+    virtual void receiveChars(const uint* chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -475,9 +499,23 @@ private slots:
     void usesMouseChanged(bool usesMouse);
 
 private:
+    // decodes a block of UTF-8 encoded output into _receiveBuffer and
+    // returns the number of characters decoded.  Incomplete sequences at
+    // the end of the block are completed by the next call.
+    int decodeUtf8(const char* text, int length, bool* zmodemDetected);
+    void resetUtf8Decoder();
+
     bool _usesMouse;
-    QTimer _bulkTimer1;
-    QTimer _bulkTimer2;
+    // decoded characters passed to receiveChars(), kept between calls
+    // to receiveData() to avoid reallocating it for each block of output
+    QVector<uint> _receiveBuffer;
+    // state of the UTF-8 decoder, see decodeUtf8()
+    uint _utf8CodePoint;
+    int _utf8Remaining;
+    uint _utf8Minimum;
+    QTimer _bulkTimer;
+    // time since outputChanged() was last emitted, see bufferedUpdate()
+    QElapsedTimer _lastBulk;
     bool _imageSizeInitialized;
 };
 }
@@ -40,7 +40,7 @@ ExtendedCharTable::ExtendedCharTable()
 ExtendedCharTable::~ExtendedCharTable()
 {
     // free all allocated character buffers
-    QHashIterator<ushort, ushort*> iter(extendedCharTable);
+    QHashIterator<ushort, uint*> iter(extendedCharTable);
     while (iter.hasNext()) {
         iter.next();
         delete[] iter.value();
@@ -50,7 +50,7 @@ ExtendedCharTable::~ExtendedCharTable()
 // global instance
 ExtendedCharTable ExtendedCharTable::instance;
 
-ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushort length)
+ushort ExtendedCharTable::createExtendedChar(const uint* unicodePoints , ushort length)
 {
     // look for this sequence of points in the table
     ushort hash = extendedCharHash(unicodePoints, length);
@@ -81,8 +81,8 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
                         }
                     }
 
-                    QHash<ushort, ushort*>::iterator it = extendedCharTable.begin();
-                    QHash<ushort, ushort*>::iterator itEnd = extendedCharTable.end();
+                    QHash<ushort, uint*>::iterator it = extendedCharTable.begin();
+                    QHash<ushort, uint*>::iterator itEnd = extendedCharTable.end();
                     while (it != itEnd) {
                         if (usedExtendedChars.contains(it.key())) {
                             ++it;
@@ -100,7 +100,7 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
 
     // add the new sequence to the table and
     // return that index
-    ushort* buffer = new ushort[length + 1];
+    uint* buffer = new uint[length + 1];
     buffer[0] = length;
     for (int i = 0 ; i < length ; i++)
         buffer[i + 1] = unicodePoints[i];
@@ -110,12 +110,12 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
     return hash;
 }
 
-ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
+uint* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
 {
     // look up index in table and if found, set the length
     // argument and return a pointer to the character sequence
 
-    ushort* buffer = extendedCharTable[hash];
+    uint* buffer = extendedCharTable[hash];
     if (buffer) {
         length = buffer[0];
         return buffer + 1;
@@ -125,7 +125,7 @@ ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) cons
     }
 }
 
-ushort ExtendedCharTable::extendedCharHash(const ushort* unicodePoints , ushort length) const
+ushort ExtendedCharTable::extendedCharHash(const uint* unicodePoints , ushort length) const
 {
     ushort hash = 0;
     for (ushort i = 0 ; i < length ; i++) {
@@ -134,11 +134,11 @@ ushort ExtendedCharTable::extendedCharHash(const ushort* unicodePoints , ushort
     return hash;
 }
 
-bool ExtendedCharTable::extendedCharMatch(ushort hash , const ushort* unicodePoints , ushort length) const
+bool ExtendedCharTable::extendedCharMatch(ushort hash , const uint* unicodePoints , ushort length) const
 {
-    ushort* entry = extendedCharTable[hash];
+    uint* entry = extendedCharTable[hash];
 
-    // compare given length with stored sequence length ( given as the first ushort in the
+    // compare given length with stored sequence length ( given as the first uint in the
     // stored buffer )
     if (entry == 0 || entry[0] != length)
         return false;
@@ -25,7 +25,7 @@
 #include <QApplication>
 #include <QtGui/QClipboard>
 #include <QtCore/QString>
-#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
 
 // KDE
 #include <KLocalizedString>
@@ -50,6 +50,9 @@ FilterChain::~FilterChain()
 
 void FilterChain::addFilter(Filter* filter)
 {
+    // the filter may have hotspots from text it processed before it was
+    // removed from the chain, or from another chain
+    filter->setOutdated(true);
     append(filter);
 }
 void FilterChain::removeFilter(Filter* filter)
@@ -108,15 +111,13 @@ QList<Filter::HotSpot*> FilterChain::hotSpots() const
 }
 
 TerminalImageFilterChain::TerminalImageFilterChain()
-    : _buffer(0)
-    , _linePositions(0)
+    : _lines(0)
+    , _columns(0)
 {
 }
 
 TerminalImageFilterChain::~TerminalImageFilterChain()
 {
-    delete _buffer;
-    delete _linePositions;
 }
 
 void TerminalImageFilterChain::setImage(const Character* const image , int lines , int columns, const QVector<LineProperty>& lineProperties)
@@ -124,50 +125,238 @@ void TerminalImageFilterChain::setImage(const Character* const image , int lines
     if (empty())
         return;
 
-    // reset all filters and hotspots
-    reset();
-
-    PlainTextDecoder decoder;
-    decoder.setTrailingWhitespace(false);
-
-    // setup new shared buffers for the filters to process on
-    QString* newBuffer = new QString();
-    QList<int>* newLinePositions = new QList<int>();
-    setBuffer(newBuffer , newLinePositions);
-
-    // free the old buffers
-    delete _buffer;
-    delete _linePositions;
-
-    _buffer = newBuffer;
-    _linePositions = newLinePositions;
-
-    QTextStream lineStream(_buffer);
-    decoder.begin(&lineStream);
-
-    for (int i = 0 ; i < lines ; i++) {
-        _linePositions->append(_buffer->length());
-        decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
-
-        // pretend that each line ends with a newline character.
-        // this prevents a link that occurs at the end of one line
-        // being treated as part of a link that occurs at the start of the next line
-        //
-        // the downside is that links which are spread over more than one line are not
-        // highlighted.
-        //
-        // TODO - Use the "line wrapped" attribute associated with lines in a
-        // terminal image to avoid adding this imaginary character for wrapped
-        // lines
-        if (!(lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED))
-            lineStream << QChar('\n');
+    QVector<Segment> segments;
+    findSegments(image, lines, columns, lineProperties, segments);
+
+    // find the lines of the previous image which are still in the new one
+    QVector<int> newLines(_lines, -1);
+    QBitArray changedLines(lines, true);
+    if (columns == _columns) {
+        QMultiHash<uint, int> oldSegments;
+        for (int i = 0; i < _segments.size(); i++)
+            oldSegments.insert(_segments[i].hash, i);
+
+        foreach(const Segment& segment, segments) {
+            QMultiHash<uint, int>::const_iterator iter = oldSegments.constFind(segment.hash);
+            for (; iter != oldSegments.constEnd() && iter.key() == segment.hash; ++iter) {
+                const Segment& oldSegment = _segments[iter.value()];
+                if (newLines[oldSegment.firstLine] != -1 || !isSameText(image, segment, oldSegment))
+                    continue;
+
+                for (int i = 0; i < segment.lineCount; i++) {
+                    newLines[oldSegment.firstLine + i] = segment.firstLine + i;
+                    changedLines.clearBit(segment.firstLine + i);
+                }
+                break;
+            }
+        }
+    }
+
+    // filters which are up to date keep the hotspots in the lines which
+    // are still there, outdated ones find all of their hotspots again
+    bool outdated = false;
+    bool upToDate = false;
+    bool lazyOutdated = false;
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext()) {
+        Filter* filter = iter.next();
+        if (!filter->isOutdated())
+            filter->moveHotSpots(newLines);
+        else if (filter->isLazy())
+            lazyOutdated = true;
+        else
+            outdated = true;
+
+        if (!filter->isOutdated() && !filter->isLazy())
+            upToDate = true;
+    }
+
+    // the lines which lazy filters have processed are those which they
+    // had processed in the previous image, unless one of them is outdated,
+    // in which case they all process the lines again so that none of
+    // them finds the same hotspot twice
+    QBitArray pendingLines(changedLines);
+    if (lazyOutdated) {
+        pendingLines.fill(true);
+
+        iter.toFront();
+        while (iter.hasNext()) {
+            Filter* filter = iter.next();
+            if (filter->isLazy()) {
+                filter->reset();
+                filter->setOutdated(false);
+            }
+        }
+    } else {
+        for (int i = 0; i < newLines.size(); i++) {
+            if (newLines[i] != -1)
+                pendingLines.setBit(newLines[i], _pendingLines.testBit(i));
+        }
+    }
+
+    // the text of the lines which are still there is kept
+    QVector<QString> lineTexts(lines);
+    for (int i = 0; i < newLines.size(); i++) {
+        if (newLines[i] != -1)
+            lineTexts[newLines[i]] = _lineTexts[i];
+    }
+
+    _image.resize(lines * columns);
+    qCopy(image, image + lines * columns, _image.begin());
+    _lines = lines;
+    _columns = columns;
+    _lineProperties = lineProperties;
+    _segments = segments;
+    _pendingLines = pendingLines;
+    _lineTexts = lineTexts;
+
+    // only decode the text which is needed by the filters processed in
+    // process(), lazy filters decode their lines in processLine()
+    if (upToDate) {
+        decodeLines(changedLines, _buffer, _linePositions);
+    } else {
+        _buffer.clear();
+        _linePositions.clear();
+    }
+    if (outdated) {
+        decodeLines(QBitArray(lines, true), _fullBuffer, _fullLinePositions);
+    } else {
+        _fullBuffer.clear();
+        _fullLinePositions.clear();
+    }
+}
+
+void TerminalImageFilterChain::process()
+{
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext()) {
+        Filter* filter = iter.next();
+        if (filter->isLazy()) {
+            continue;
+        } else if (filter->isOutdated()) {
+            filter->reset();
+            filter->setBuffer(&_fullBuffer, &_fullLinePositions);
+            filter->process();
+            filter->setOutdated(false);
+        } else {
+            filter->setBuffer(&_buffer, &_linePositions);
+            filter->process();
+        }
+    }
+}
+
+void TerminalImageFilterChain::processLine(int line)
+{
+    if (line < 0 || line >= _lines || !_pendingLines.testBit(line))
+        return;
+
+    // a link may be spread over the lines which are joined by wrapping
+    int firstLine = line;
+    while (firstLine > 0 && (_lineProperties.value(firstLine - 1, LINE_DEFAULT) & LINE_WRAPPED))
+        firstLine--;
+    int lastLine = line;
+    while (lastLine < _lines - 1 && (_lineProperties.value(lastLine, LINE_DEFAULT) & LINE_WRAPPED))
+        lastLine++;
+
+    QBitArray lines(_lines);
+    lines.fill(true, firstLine, lastLine + 1);
+    decodeLines(lines, _lazyBuffer, _lazyLinePositions);
+
+    QListIterator<Filter*> iter(*this);
+    while (iter.hasNext()) {
+        Filter* filter = iter.next();
+        if (filter->isLazy()) {
+            filter->setBuffer(&_lazyBuffer, &_lazyLinePositions);
+            filter->process();
+        }
+    }
+
+    _pendingLines.fill(false, firstLine, lastLine + 1);
+}
+
+void TerminalImageFilterChain::findSegments(const Character* image, int lines, int columns,
+        const QVector<LineProperty>& lineProperties,
+        QVector<Segment>& segments) const
+{
+    Segment segment = { 0, 0, 0, false };
+    for (int line = 0; line < lines; line++) {
+        const Character* characters = image + line * columns;
+        for (int column = 0; column < columns; column++)
+            segment.hash = segment.hash * 31 + characters[column].character;
+        segment.lineCount++;
+
+        // the last line of the image may be wrapped, in which case its
+        // text is not followed by a new line
+        segment.wrapped = lineProperties.value(line, LINE_DEFAULT) & LINE_WRAPPED;
+        if (!segment.wrapped || line == lines - 1) {
+            segments << segment;
+
+            segment.firstLine = line + 1;
+            segment.lineCount = 0;
+            segment.hash = 0;
+        }
+    }
+}
+
+bool TerminalImageFilterChain::isSameText(const Character* image, const Segment& segment,
+        const Segment& oldSegment) const
+{
+    if (segment.lineCount != oldSegment.lineCount || segment.wrapped != oldSegment.wrapped)
+        return false;
+
+    const Character* characters = image + segment.firstLine * _columns;
+    const Character* oldCharacters = _image.constData() + oldSegment.firstLine * _columns;
+    for (int i = 0; i < segment.lineCount * _columns; i++) {
+        if (characters[i].character != oldCharacters[i].character ||
+                characters[i].isRealCharacter != oldCharacters[i].isRealCharacter)
+            return false;
+    }
+    return true;
+}
+
+void TerminalImageFilterChain::decodeLines(const QBitArray& lines,
+        QString& buffer, QList<int>& linePositions)
+{
+    buffer.clear();
+    linePositions.clear();
+
+    // lines which are not decoded are left empty, so that the positions
+    // of hotspots found in the buffer are still on the right lines
+    for (int i = 0 ; i < lines.size() ; i++) {
+        linePositions.append(buffer.length());
+        if (!lines.testBit(i))
+            continue;
+
+        // the text of a line is decoded the first time it is needed and kept
+        // until the line changes
+        if (_lineTexts[i].isNull()) {
+            const bool wrapped = _lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED;
+            const Character* characters = _image.constData() + i * _columns;
+
+            // a line which is wrapped is joined to the next one, so that text
+            // such as a link which is spread over both is found as a whole.
+            // the trailing whitespace of a wrapped line is kept, since it
+            // separates the words on either side of the wrap.
+            //
+            // a line which is not wrapped ends with a newline, which
+            // prevents a link at its end being joined to the start of the next
+            // line.
+            QString text = PlainTextDecoder::plainText(characters, _columns, wrapped);
+            if (!wrapped)
+                text.append(QChar('\n'));
+            else if (text.isNull())
+                text = QLatin1String("");
+            _lineTexts[i] = text;
+        }
+        buffer.append(_lineTexts[i]);
     }
-    decoder.end();
 }
 
 Filter::Filter() :
     _linePositions(0),
-    _buffer(0)
+    _buffer(0),
+    _outdated(true),
+    _lazy(false)
 {
 }
 
@@ -180,10 +369,54 @@ Filter::~Filter()
 }
 void Filter::reset()
 {
+    qDeleteAll(_hotspotList);
     _hotspots.clear();
     _hotspotList.clear();
 }
 
+void Filter::moveHotSpots(const QVector<int>& newLines)
+{
+    _hotspots.clear();
+
+    QMutableListIterator<HotSpot*> iter(_hotspotList);
+    while (iter.hasNext()) {
+        HotSpot* spot = iter.next();
+        const int startLine = newLines.value(spot->_startLine, -1);
+        const int endLine = newLines.value(spot->_endLine, -1);
+
+        if (startLine < 0 || endLine - startLine != spot->_endLine - spot->_startLine) {
+            delete spot;
+            iter.remove();
+            continue;
+        }
+
+        spot->_startLine = startLine;
+        spot->_endLine = endLine;
+        for (int line = startLine ; line <= endLine ; line++)
+            _hotspots.insert(line, spot);
+    }
+}
+
+bool Filter::isOutdated() const
+{
+    return _outdated;
+}
+void Filter::setOutdated(bool outdated)
+{
+    _outdated = outdated;
+}
+
+bool Filter::isLazy() const
+{
+    return _lazy;
+}
+void Filter::setLazy(bool lazy)
+{
+    if (lazy != _lazy)
+        _outdated = true;
+    _lazy = lazy;
+}
+
 void Filter::setBuffer(const QString* buffer , const QList<int>* linePositions)
 {
     _buffer = buffer;
@@ -195,19 +428,14 @@ void Filter::getLineColumn(int position , int& startLine , int& startColumn)
     Q_ASSERT(_linePositions);
     Q_ASSERT(_buffer);
 
-    for (int i = 0 ; i < _linePositions->count() ; i++) {
-        int nextLine = 0;
-
-        if (i == _linePositions->count() - 1)
-            nextLine = _buffer->length() + 1;
-        else
-            nextLine = _linePositions->value(i + 1);
-
-        if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
-            startColumn = string_width(buffer()->mid(_linePositions->value(i), position - _linePositions->value(i)));
-            return;
-        }
+    // find the last line which starts at or before the position.  lines
+    // which are left out of the buffer are empty and start at the same
+    // position as the next line
+    const int line = qUpperBound(_linePositions->constBegin(), _linePositions->constEnd(), position)
+                     - _linePositions->constBegin() - 1;
+    if (line >= 0) {
+        startLine = line;
+        startColumn = string_width(buffer()->mid(_linePositions->value(line), position - _linePositions->value(line)));
     }
 }
 
@@ -320,6 +548,7 @@ QStringList RegExpFilter::HotSpot::capturedTexts() const
 void RegExpFilter::setRegExp(const QRegExp& regExp)
 {
     _searchText = regExp;
+    setOutdated(true);
 }
 QRegExp RegExpFilter::regExp() const
 {
@@ -374,29 +603,16 @@ RegExpFilter::HotSpot* RegExpFilter::newHotSpot(int startLine, int startColumn,
     return new RegExpFilter::HotSpot(startLine, startColumn,
                                      endLine, endColumn);
 }
-RegExpFilter::HotSpot* UrlFilter::newHotSpot(int startLine, int startColumn, int endLine,
-        int endColumn)
-{
-    return new UrlFilter::HotSpot(startLine, startColumn,
-                                  endLine, endColumn);
-}
 UrlFilter::HotSpot::HotSpot(int startLine, int startColumn, int endLine, int endColumn)
     : RegExpFilter::HotSpot(startLine, startColumn, endLine, endColumn)
-    , _urlObject(new FilterObject(this))
+    , _urlType(Unknown)
 {
     setType(Link);
 }
 
 UrlFilter::HotSpot::UrlType UrlFilter::HotSpot::urlType() const
 {
-    const QString url = capturedTexts().first();
-
-    if (FullUrlRegExp.exactMatch(url))
-        return StandardUrl;
-    else if (EmailAddressRegExp.exactMatch(url))
-        return Email;
-    else
-        return Unknown;
+    return _urlType;
 }
 
 void UrlFilter::HotSpot::activate(QObject* object)
@@ -427,39 +643,238 @@ void UrlFilter::HotSpot::activate(QObject* object)
     }
 }
 
-// Note:  Altering these regular expressions can have a major effect on the performance of the filters
-// used for finding URLs in the text, especially if they are very general and could match very long
-// pieces of text.
-// Please be careful when altering them.
-
-//regexp matches:
+// Note:  The URL filter used to match these regular expressions:
+//
 // full url:
 // protocolname:// or www. followed by anything other than whitespaces, <, >, ' or ", and ends before whitespaces, <, >, ', ", ], !, ), :, comma and dot
-const QRegExp UrlFilter::FullUrlRegExp("(www\\.(?!\\.)|[a-z][a-z0-9+.-]*://)[^\\s<>'\"]+[^!,\\.\\s<>'\"\\]\\)\\:]");
+//     (www\.(?!\.)|[a-z][a-z0-9+.-]*://)[^\s<>'"]+[^!,\.\s<>'"\]\)\:]
 // email address:
 // [word chars, dots or dashes]@[word chars, dots or dashes].[word chars]
-const QRegExp UrlFilter::EmailAddressRegExp("\\b(\\w|\\.|-)+@(\\w|\\.|-)+\\.\\w+\\b");
+//     \b(\w|\.|-)+@(\w|\.|-)+\.\w+\b
+//
+// QRegExp tries to match them at each position of the text in turn and backtracks
+// when a match fails, which takes time quadratic in the length of long lines without
+// spaces.  The functions below find the same matches, preferring a URL to an email
+// address which starts at the same position, by scanning the text once.
+//
+// Neither kind of match contains a separator, so the text is split into runs of
+// characters between separators and each run is scanned separately.
+
+static inline bool isUrlSeparator(const QChar& c)
+{
+    return c.isSpace() || c == '<' || c == '>' || c == '\'' || c == '"';
+}
+
+// returns true if 'c' may not be the last character of a URL
+static inline bool isUrlTrailer(const QChar& c)
+{
+    return c == '!' || c == ',' || c == '.' || c == ']' || c == ')' || c == ':';
+}
+
+static inline bool isSchemeLetter(const QChar& c)
+{
+    return c.unicode() >= 'a' && c.unicode() <= 'z';
+}
+
+static inline bool isSchemeCharacter(const QChar& c)
+{
+    return isSchemeLetter(c) || (c.unicode() >= '0' && c.unicode() <= '9') ||
+           c == '+' || c == '.' || c == '-';
+}
 
-// matches full url or email address
-const QRegExp UrlFilter::CompleteUrlRegExp('(' + FullUrlRegExp.pattern() + '|' +
-        EmailAddressRegExp.pattern() + ')');
+// characters matched by \w in a regular expression
+static inline bool isWordCharacter(const QChar& c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == '_';
+}
+
+static inline bool isEmailCharacter(const QChar& c)
+{
+    return isWordCharacter(c) || c == '.' || c == '-';
+}
+
+static inline bool isSchemeSeparator(const QChar* text, int position, int end)
+{
+    return position + 2 < end && text[position] == ':' &&
+           text[position + 1] == '/' && text[position + 2] == '/';
+}
+
+// returns the position of the first URL in 'text' which starts between 'from' and 'end',
+// or -1 if there is none.  URLs end at 'urlEnd' and have at least two characters after
+// their www. or protocol name and ://, so if one is too short then so are any which
+// start after it
+static int findUrlStart(const QChar* text, int from, int end, int urlEnd)
+{
+    // the first letter of the protocol name which would end at the current position
+    int schemeStart = -1;
+
+    for (int i = from; i < end; i++) {
+        if (schemeStart != -1 && isSchemeSeparator(text, i, end))
+            return (urlEnd >= i + 5) ? schemeStart : -1;
+
+        if (!isSchemeCharacter(text[i])) {
+            schemeStart = -1;
+            continue;
+        }
+        if (schemeStart == -1 && isSchemeLetter(text[i]))
+            schemeStart = i;
+
+        if (text[i] == 'w' && i + 3 < end && text[i + 1] == 'w' && text[i + 2] == 'w' &&
+                text[i + 3] == '.' && (i + 4 == end || text[i + 4] != '.')) {
+            // a protocol name which starts before the www. is matched first
+            if (schemeStart < i) {
+                int schemeEnd = i + 4;
+                while (schemeEnd < end && isSchemeCharacter(text[schemeEnd]))
+                    schemeEnd++;
+
+                if (isSchemeSeparator(text, schemeEnd, end) && urlEnd >= schemeEnd + 5)
+                    return schemeStart;
+            }
+
+            return (urlEnd >= i + 6) ? i : -1;
+        }
+    }
+
+    return -1;
+}
+
+// returns the position of the first email address in 'text' which starts between 'from'
+// and 'end', and sets 'addressEnd' to the position after it, or returns -1 if there is
+// no email address
+static int findEmailAddress(const QChar* text, int from, int end, int& addressEnd)
+{
+    int userStart = from;
+
+    while (userStart < end) {
+        // the user name is a run of word characters, dots or dashes followed by @
+        int at = userStart;
+        while (at < end && isEmailCharacter(text[at]))
+            at++;
+
+        if (at == end)
+            return -1;
+        if (at == userStart || text[at] != '@') {
+            userStart = at + 1;
+            continue;
+        }
+
+        // the domain is a run of word characters, dots or dashes which ends with
+        // a dot and word characters.  the last such dot is used
+        int domainEnd = at + 1;
+        while (domainEnd < end && isEmailCharacter(text[domainEnd]))
+            domainEnd++;
+
+        int dot = domainEnd - 2;
+        while (dot > at + 1 && !(text[dot] == '.' && isWordCharacter(text[dot + 1])))
+            dot--;
+
+        if (dot > at + 1) {
+            // the address starts at a word boundary
+            for (int start = userStart; start < at; start++) {
+                const bool wordBefore = start > 0 && isWordCharacter(text[start - 1]);
+                if (wordBefore != isWordCharacter(text[start])) {
+                    addressEnd = dot + 1;
+                    while (addressEnd < domainEnd && isWordCharacter(text[addressEnd]))
+                        addressEnd++;
+
+                    return start;
+                }
+            }
+        }
+
+        // the domain may be the user name of another address
+        userStart = at + 1;
+    }
+
+    return -1;
+}
 
 UrlFilter::UrlFilter()
 {
-    setRegExp(CompleteUrlRegExp);
 }
-UrlFilter::HotSpot::~HotSpot()
+
+void UrlFilter::process()
+{
+    const QString* text = buffer();
+
+    Q_ASSERT(text);
+
+    const QChar* data = text->constData();
+    const int length = text->length();
+
+    int runStart = 0;
+    while (runStart < length) {
+        if (isUrlSeparator(data[runStart])) {
+            runStart++;
+            continue;
+        }
+
+        int runEnd = runStart;
+        while (runEnd < length && !isUrlSeparator(data[runEnd]))
+            runEnd++;
+
+        // URLs extend to the end of the run, apart from trailing punctuation
+        int urlEnd = runEnd;
+        while (urlEnd > runStart && isUrlTrailer(data[urlEnd - 1]))
+            urlEnd--;
+
+        int urlStart = findUrlStart(data, runStart, runEnd, urlEnd);
+
+        int position = runStart;
+        forever {
+            int addressEnd = 0;
+            const int addressStart = findEmailAddress(data, position, runEnd, addressEnd);
+
+            if (urlStart != -1 && (addressStart == -1 || urlStart <= addressStart)) {
+                addUrl(urlStart, urlEnd, HotSpot::StandardUrl);
+                break;
+            }
+            if (addressStart == -1)
+                break;
+
+            addUrl(addressStart, addressEnd, HotSpot::Email);
+            position = addressEnd;
+
+            // a URL which starts inside the email address is part of it
+            if (urlStart != -1 && urlStart < position)
+                urlStart = findUrlStart(data, position, runEnd, urlEnd);
+        }
+
+        runStart = runEnd;
+    }
+}
+
+void UrlFilter::addUrl(int start, int end, HotSpot::UrlType type)
 {
-    delete _urlObject;
+    int startLine = 0;
+    int endLine = 0;
+    int startColumn = 0;
+    int endColumn = 0;
+
+    getLineColumn(start, startLine, startColumn);
+    getLineColumn(end, endLine, endColumn);
+
+    UrlFilter::HotSpot* spot = new UrlFilter::HotSpot(startLine, startColumn,
+            endLine, endColumn);
+    spot->setCapturedTexts(QStringList() << buffer()->mid(start, end - start));
+    spot->_urlType = type;
+
+    addHotSpot(spot);
 }
+
 void FilterObject::activated()
 {
     _filter->activate(sender());
 }
 QList<QAction*> UrlFilter::HotSpot::actions()
 {
-    QAction* openAction = new QAction(_urlObject);
-    QAction* copyAction = new QAction(_urlObject);
+    QAction* openAction = new QAction(0);
+    QAction* copyAction = new QAction(0);
+
+    // the actions activate a copy of this hotspot, because the filter deletes
+    // its hotspots when the output changes, which can happen while the actions
+    // are shown in a menu
+    FilterObject* urlObject = new FilterObject(new UrlFilter::HotSpot(*this), openAction);
 
     const UrlType kind = urlType();
     Q_ASSERT(kind == StandardUrl || kind == Email);
@@ -478,8 +893,8 @@ QList<QAction*> UrlFilter::HotSpot::actions()
     openAction->setObjectName(QLatin1String("open-action"));
     copyAction->setObjectName(QLatin1String("copy-action"));
 
-    QObject::connect(openAction , SIGNAL(triggered()) , _urlObject , SLOT(activated()));
-    QObject::connect(copyAction , SIGNAL(triggered()) , _urlObject , SLOT(activated()));
+    QObject::connect(openAction , SIGNAL(triggered()) , urlObject , SLOT(activated()));
+    QObject::connect(copyAction , SIGNAL(triggered()) , urlObject , SLOT(activated()));
 
     QList<QAction*> actions;
     actions << openAction;
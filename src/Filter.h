@@ -21,14 +21,17 @@
 #define FILTER_H
 
 // Qt
+#include <QtCore/QBitArray>
 #include <QtCore/QList>
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 #include <QtCore/QRegExp>
 #include <QtCore/QMultiHash>
+#include <QtCore/QVector>
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 class QAction;
 
@@ -52,7 +55,7 @@ namespace Konsole
  * When processing the text they should create instances of Filter::HotSpot subclasses for sections of interest
  * and add them to the filter's list of hotspots using addHotSpot()
  */
-class Filter
+class KONSOLEPRIVATE_EXPORT Filter
 {
 public:
     /**
@@ -110,7 +113,8 @@ public:
         virtual void activate(QObject* object = 0) = 0;
         /**
          * Returns a list of actions associated with the hotspot which can be used in a
-         * menu or toolbar
+         * menu or toolbar.  The caller takes ownership of the actions, which keep
+         * working after the hotspot has been deleted.
          */
         virtual QList<QAction*> actions();
 
@@ -124,6 +128,9 @@ public:
         int    _endLine;
         int    _endColumn;
         Type _type;
+
+        // moves hotspots when the text scrolls, see Filter::moveHotSpots()
+        friend class Filter;
     };
 
     /** Constructs a new filter. */
@@ -139,6 +146,43 @@ public:
      */
     void reset();
 
+    /**
+     * Moves the hotspots to follow the lines of text they were found in,
+     * after those lines have moved, for example because the text scrolled.
+     * The hotspots on line i are moved to line @p newLines[i], or deleted
+     * if it is -1.  Hotspots which span lines that do not move together
+     * are deleted.
+     *
+     * This lets the filter keep the hotspots in lines of text which have not
+     * changed and only process the lines which have.
+     */
+    void moveHotSpots(const QVector<int>& newLines);
+
+    /**
+     * Returns true if the hotspots were found with different settings from
+     * those the filter has now, so that it must process all of the text
+     * again instead of only the lines which have changed.
+     * Filters are outdated until setOutdated(false) is called.
+     */
+    bool isOutdated() const;
+    /** Sets whether the filter is outdated.  See isOutdated() */
+    void setOutdated(bool outdated);
+
+    /**
+     * Returns true if the filter only processes the lines of text in which
+     * its hotspots are looked for, rather than all of the text as soon as
+     * it changes.  This suits filters whose hotspots are only needed when
+     * the user points at them, such as links.
+     *
+     * Filters are not lazy by default.  See TerminalImageFilterChain::processLine()
+     */
+    bool isLazy() const;
+    /**
+     * Sets whether the filter is lazy.  See isLazy()
+     * Changing this makes the filter outdated, see isOutdated()
+     */
+    void setLazy(bool lazy);
+
     /** Adds a new line of text to the filter and increments the line count */
     //void addLine(const QString& string);
 
@@ -170,6 +214,9 @@ private:
 
     const QList<int>* _linePositions;
     const QString* _buffer;
+
+    bool _outdated;
+    bool _lazy;
 };
 
 /**
@@ -179,7 +226,7 @@ private:
  * Subclasses can reimplement newHotSpot() to return custom hotspot types when matches for the regular expression
  * are found.
  */
-class RegExpFilter : public Filter
+class KONSOLEPRIVATE_EXPORT RegExpFilter : public Filter
 {
 public:
     /**
@@ -205,6 +252,7 @@ public:
 
     /**
      * Sets the regular expression which the filter searches for in blocks of text.
+     * This makes the filter outdated, see isOutdated()
      *
      * Regular expressions which match the empty string are treated as not matching
      * anything.
@@ -235,8 +283,14 @@ private:
 
 class FilterObject;
 
-/** A filter which matches URLs in blocks of text */
-class UrlFilter : public RegExpFilter
+/**
+ * A filter which matches URLs and email addresses in blocks of text
+ *
+ * The text is scanned once, in time linear in its length, rather than
+ * matched with a regular expression, which backtracks and takes much
+ * longer on long lines without spaces.
+ */
+class KONSOLEPRIVATE_EXPORT UrlFilter : public RegExpFilter
 {
 public:
     /**
@@ -247,7 +301,6 @@ public:
     {
     public:
         HotSpot(int startLine, int startColumn, int endLine, int endColumn);
-        virtual ~HotSpot();
 
         virtual QList<QAction*> actions();
 
@@ -265,27 +318,36 @@ public:
         };
         UrlType urlType() const;
 
-        FilterObject* _urlObject;
+        UrlType _urlType;
+
+        // sets the type of the URL, see UrlFilter::process()
+        friend class UrlFilter;
     };
 
     UrlFilter();
 
-protected:
-    virtual RegExpFilter::HotSpot* newHotSpot(int, int, int, int);
+    /**
+     * Reimplemented to search the filter's text buffer for URLs, which start
+     * with www. or a protocol name followed by ://, and email addresses.
+     */
+    virtual void process();
 
 private:
-    static const QRegExp FullUrlRegExp;
-    static const QRegExp EmailAddressRegExp;
-
-    // combined OR of FullUrlRegExp and EmailAddressRegExp
-    static const QRegExp CompleteUrlRegExp;
+    // adds a hotspot for the URL of 'type' between the positions 'start'
+    // and 'end' in the buffer
+    void addUrl(int start, int end, HotSpot::UrlType type);
 };
 
+// activates a hotspot, which it owns, when one of the hotspot's actions is triggered
 class FilterObject : public QObject
 {
     Q_OBJECT
 public:
-    explicit FilterObject(Filter::HotSpot* filter) : _filter(filter) {}
+    FilterObject(Filter::HotSpot* filter, QObject* parent)
+        : QObject(parent), _filter(filter) {}
+    virtual ~FilterObject() {
+        delete _filter;
+    }
 private slots:
     void activated();
 private:
@@ -309,12 +371,15 @@ private:
  * The hotSpots() and hotSpotsAtLine() method return all of the hotspots in the text and on
  * a given line respectively.
  */
-class FilterChain : protected QList<Filter*>
+class KONSOLEPRIVATE_EXPORT FilterChain : protected QList<Filter*>
 {
 public:
     virtual ~FilterChain();
 
-    /** Adds a new filter to the chain.  The chain will delete this filter when it is destroyed */
+    /**
+     * Adds a new filter to the chain.  The chain will delete this filter when it is destroyed.
+     * The filter is made outdated, so that its hotspots are found in all of the text.
+     */
     void addFilter(Filter* filter);
     /** Removes a filter from the chain.  The chain will no longer delete the filter when destroyed */
     void removeFilter(Filter* filter);
@@ -328,7 +393,7 @@ public:
     /**
      * Processes each filter in the chain
      */
-    void process();
+    virtual void process();
 
     /** Sets the buffer for each filter in the chain to process. */
     void setBuffer(const QString* buffer , const QList<int>* linePositions);
@@ -341,8 +406,21 @@ public:
     QList<Filter::HotSpot> hotSpotsAtLine(int line) const;
 };
 
-/** A filter chain which processes character images from terminal displays */
-class TerminalImageFilterChain : public FilterChain
+/**
+ * A filter chain which processes character images from terminal displays
+ *
+ * The image usually changes only in a few lines between updates, or scrolls,
+ * so the chain remembers the previous image.  Lines whose text is still in
+ * the new image, possibly on different lines, keep their hotspots, and the
+ * filters only process the lines whose text has changed.  Lines which are
+ * joined by wrapping are processed together, as one line of text, so that
+ * links which are spread over several lines are found.  The text of each
+ * line is kept until the line changes.
+ *
+ * Lazy filters, see Filter::isLazy(), are not processed by process().  They
+ * process a line of the image only when processLine() is called for it.
+ */
+class KONSOLEPRIVATE_EXPORT TerminalImageFilterChain : public FilterChain
 {
 public:
     TerminalImageFilterChain();
@@ -359,9 +437,65 @@ public:
     void setImage(const Character* const image , int lines , int columns,
                   const QVector<LineProperty>& lineProperties);
 
+    /**
+     * Reimplemented to process only the lines which have changed since the
+     * previous image, except for filters which are outdated, which process
+     * all of the lines.  See Filter::isOutdated()
+     *
+     * Lazy filters are not processed.
+     */
+    virtual void process();
+
+    /**
+     * Processes the lazy filters in the chain for @p line of the current
+     * image, and the lines which are joined to it by wrapping, unless they
+     * have already processed it.  Call this before looking for hotspots
+     * at a position in the image.
+     */
+    void processLine(int line);
+
 private:
-    QString* _buffer;
-    QList<int>* _linePositions;
+    // lines of the image which are joined by wrapping
+    struct Segment {
+        int firstLine;
+        int lineCount;
+        uint hash;
+        // whether the last line is wrapped, which is only possible at the
+        // end of the image
+        bool wrapped;
+    };
+
+    void findSegments(const Character* image, int lines, int columns,
+                      const QVector<LineProperty>& lineProperties,
+                      QVector<Segment>& segments) const;
+    // returns true if the text of 'segment' in 'image' is the same as the
+    // text of 'oldSegment' in the previous image
+    bool isSameText(const Character* image, const Segment& segment,
+                    const Segment& oldSegment) const;
+    // decodes the lines of the current image which are set in 'lines'
+    void decodeLines(const QBitArray& lines, QString& buffer, QList<int>& linePositions);
+
+    // text of the lines which have changed
+    QString _buffer;
+    QList<int> _linePositions;
+    // text of all lines, for outdated filters
+    QString _fullBuffer;
+    QList<int> _fullLinePositions;
+    // text of the lines processed by lazy filters
+    QString _lazyBuffer;
+    QList<int> _lazyLinePositions;
+
+    // the current image
+    QVector<Character> _image;
+    int _lines;
+    int _columns;
+    QVector<LineProperty> _lineProperties;
+    QVector<Segment> _segments;
+    // lines which the lazy filters have not processed yet
+    QBitArray _pendingLines;
+    // the text of each line of the current image, or a null string if it
+    // has not been decoded yet
+    QVector<QString> _lineTexts;
 };
 }
 #endif //FILTER_H
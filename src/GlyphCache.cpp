@@ -0,0 +1,192 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphCache.h"
+
+// Qt
+#include <QtGui/QPainter>
+#include <QtCore/QVarLengthArray>
+
+// Konsole
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+GlyphCache::GlyphCache()
+    : _cellWidth(1)
+    , _cellHeight(1)
+{
+}
+
+void GlyphCache::setFont(const QFont& font, int cellWidth, int cellHeight)
+{
+    _font = font;
+    _cellWidth = cellWidth;
+    _cellHeight = cellHeight;
+    clear();
+}
+
+bool GlyphCache::canCache(const QChar& character)
+{
+    const ushort code = character.unicode();
+
+    // scripts which are laid out one character at a time: Latin, Greek,
+    // Cyrillic and Armenian, and the blocks of punctuation and symbols.
+    // Scripts from Hebrew onwards may need shaping or reordering
+    if (!(code >= 0x20 && code < 0x0590) &&
+            !(code >= 0x1D00 && code < 0x2C00))
+        return false;
+
+    // combining marks and invisible formatting characters such as
+    // directional overrides change the characters around them
+    switch (character.category()) {
+    case QChar::Mark_NonSpacing:
+    case QChar::Mark_SpacingCombining:
+    case QChar::Mark_Enclosing:
+    case QChar::Other_Control:
+    case QChar::Other_Format:
+        return false;
+    default:
+        break;
+    }
+
+    switch (character.direction()) {
+    case QChar::DirL:
+    case QChar::DirEN:
+    case QChar::DirES:
+    case QChar::DirET:
+    case QChar::DirCS:
+    case QChar::DirWS:
+    case QChar::DirON:
+        break;
+    default:
+        return false;
+    }
+
+    return konsole_wcwidth(code) == 1;
+}
+
+void GlyphCache::drawText(QPainter& painter, const QPoint& position, const QString& text,
+                          int style, const QColor& color)
+{
+    QVarLengthArray<QPainter::PixmapFragment, 256> fragments;
+    int page = -1;
+
+    // the fragments are drawn with one call for each page of the atlas
+    // which the glyphs come from, which is usually just one
+    const qreal centerX = position.x() - padding() + (_cellWidth + 2 * padding()) / 2.0;
+    const qreal centerY = position.y() + _cellHeight / 2.0;
+
+    for (int i = 0; i < text.length(); i++) {
+        Q_ASSERT(canCache(text[i]));
+
+        // nothing needs to be drawn for a space unless it is underlined
+        if (text[i] == QLatin1Char(' ') && !(style & Underline))
+            continue;
+
+        int slot = glyphSlot(text[i], style, color);
+        if (slot < 0) {
+            // the glyphs drawn so far are still needed when the atlas is full
+            if (!fragments.isEmpty())
+                painter.drawPixmapFragments(fragments.constData(), fragments.size(), _pages[page]);
+            fragments.clear();
+            clear();
+            slot = glyphSlot(text[i], style, color);
+        }
+
+        const int slotPage = slot / SLOTS_PER_PAGE;
+        if (slotPage != page && !fragments.isEmpty()) {
+            painter.drawPixmapFragments(fragments.constData(), fragments.size(), _pages[page]);
+            fragments.clear();
+        }
+        page = slotPage;
+
+        fragments.append(QPainter::PixmapFragment::create(QPointF(centerX + i * _cellWidth, centerY),
+                         slotRect(slot)));
+    }
+
+    if (!fragments.isEmpty())
+        painter.drawPixmapFragments(fragments.constData(), fragments.size(), _pages[page]);
+}
+
+int GlyphCache::glyphSlot(const QChar& character, int style, const QColor& color)
+{
+    const quint64 key = (quint64(color.rgba()) << 32) | (quint64(style) << 16) | character.unicode();
+
+    QHash<quint64, int>::const_iterator iter = _slots.constFind(key);
+    if (iter != _slots.constEnd())
+        return iter.value();
+
+    const int slot = _slots.count();
+    if (slot == _pages.count() * SLOTS_PER_PAGE) {
+        if (_pages.count() == MAX_PAGES)
+            return -1;
+
+        QPixmap page(PAGE_COLUMNS * (_cellWidth + 2 * padding()), PAGE_ROWS * _cellHeight);
+        page.fill(Qt::transparent);
+        _pages << page;
+    }
+
+    drawGlyph(slot, character, style, color);
+    _slots.insert(key, slot);
+    return slot;
+}
+
+void GlyphCache::drawGlyph(int slot, const QChar& character, int style, const QColor& color)
+{
+    QFont font = _font;
+    font.setBold(style & Bold);
+    font.setItalic(style & Italic);
+    font.setUnderline(style & Underline);
+
+    const QRect rect = slotRect(slot);
+
+    QPainter painter(&_pages[slot / SLOTS_PER_PAGE]);
+    painter.setClipRect(rect);
+    painter.setFont(font);
+    painter.setPen(color);
+    painter.setLayoutDirection(Qt::LeftToRight);
+
+    // the glyph is placed in its cell in the same way as
+    // TerminalDisplay::drawCharacters() places text
+    painter.drawText(rect.adjusted(padding(), 0, -padding(), 0), Qt::AlignBottom, QString(character));
+}
+
+QRect GlyphCache::slotRect(int slot) const
+{
+    const int index = slot % SLOTS_PER_PAGE;
+    const int width = _cellWidth + 2 * padding();
+
+    return QRect((index % PAGE_COLUMNS) * width, (index / PAGE_COLUMNS) * _cellHeight,
+                 width, _cellHeight);
+}
+
+void GlyphCache::clear()
+{
+    _slots.clear();
+    _pages.clear();
+}
+
+int GlyphCache::glyphCount() const
+{
+    return _slots.count();
+}
@@ -0,0 +1,129 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtGui/QFont>
+#include <QtGui/QPixmap>
+
+// Konsole
+#include "konsole_export.h"
+
+class QColor;
+class QPainter;
+class QPoint;
+class QString;
+
+namespace Konsole
+{
+/**
+ * Draws text in a grid of character cells by copying the glyphs of the
+ * characters from a cache, instead of laying out and rasterizing the text
+ * each time it is drawn.
+ *
+ * Each combination of character, font style and color is drawn once into
+ * an atlas, a large pixmap which holds many glyphs, from which runs of text
+ * are then copied with a single QPainter::drawPixmapFragments() call.  The
+ * glyphs are drawn on a transparent background, so the cache works with
+ * any background, including translucent ones and wallpapers.  As a result
+ * they are anti-aliased in grayscale only, never with sub-pixel rendering.
+ *
+ * Only characters which are drawn the same regardless of the characters
+ * around them can be cached, see canCache().  Text in scripts which need
+ * shaping or bidirectional layout must be drawn with QPainter::drawText().
+ */
+class KONSOLEPRIVATE_EXPORT GlyphCache
+{
+public:
+    /** Flags which select the variant of the font a glyph is drawn with */
+    enum FontStyle {
+        Bold = 1 << 0,
+        Italic = 1 << 1,
+        Underline = 1 << 2
+    };
+
+    GlyphCache();
+
+    /**
+     * Sets the font which glyphs are drawn with and the size of the
+     * character cells which they are drawn in.  This clears the cache.
+     */
+    void setFont(const QFont& font, int cellWidth, int cellHeight);
+
+    /**
+     * Returns true if @p character can be drawn from the cache, which is
+     * the case for characters which take up one cell and which are drawn
+     * the same wherever they appear, without shaping or reordering.
+     */
+    static bool canCache(const QChar& character);
+
+    /**
+     * Draws @p text with @p painter, one character per cell, starting at
+     * @p position, which is the top left corner of the first cell.
+     * All characters in @p text must be cacheable, see canCache().
+     *
+     * @param style A combination of FontStyle flags
+     * @param color The color to draw the text in
+     */
+    void drawText(QPainter& painter, const QPoint& position, const QString& text,
+                  int style, const QColor& color);
+
+    /** Discards all cached glyphs. */
+    void clear();
+
+    /** Returns the number of glyphs in the cache. */
+    int glyphCount() const;
+
+private:
+    // returns the position of the glyph in the atlas, drawing it first
+    // if it is not in the cache yet.  Returns -1 if the atlas is full
+    int glyphSlot(const QChar& character, int style, const QColor& color);
+    void drawGlyph(int slot, const QChar& character, int style, const QColor& color);
+    QRect slotRect(int slot) const;
+
+    // glyphs are drawn with this much space on each side of their cell,
+    // to leave room for parts of italic and bold glyphs which overhang it
+    int padding() const {
+        return _cellWidth;
+    }
+
+    QFont _font;
+    int _cellWidth;
+    int _cellHeight;
+
+    // glyphs of the cache, by character, style and color
+    QHash<quint64, int> _slots;
+    // atlas pages, each of which holds SLOTS_PER_PAGE glyphs
+    QList<QPixmap> _pages;
+
+    static const int PAGE_COLUMNS = 16;
+    static const int PAGE_ROWS = 16;
+    static const int SLOTS_PER_PAGE = PAGE_COLUMNS * PAGE_ROWS;
+    // the cache is cleared once this many pages are full
+    static const int MAX_PAGES = 8;
+};
+}
+
+#endif // GLYPHCACHE_H
@@ -23,17 +23,31 @@
 
 // System
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 
+// Qt
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
+#include <QtCore/QVarLengthArray>
+
 // KDE
 #include <kde_file.h>
 #include <KDebug>
 #include <KStandardDirs>
 
+// Konsole
+#include "ExtendedCharTable.h"
+
 // Reasonable line size
 static const int LINE_SIZE = 1024;
 
@@ -58,7 +72,10 @@ using namespace Konsole;
 HistoryFile::HistoryFile()
     : _fd(-1),
       _length(0),
+      _fileLength(0),
       _fileMap(0),
+      _mapLength(0),
+      _tailStart(0),
       _readWriteBalance(0)
 {
     const QString tmpFormat = KStandardDirs::locateLocal("tmp", QString())
@@ -70,6 +87,30 @@ HistoryFile::HistoryFile()
     }
 }
 
+HistoryFile::HistoryFile(const QString& fileName)
+    : _fd(-1),
+      _length(0),
+      _fileLength(0),
+      _file(fileName),
+      _fileMap(0),
+      _mapLength(0),
+      _tailStart(0),
+      _readWriteBalance(0)
+{
+    // the history holds the output of a session, so the file is created
+    // readable only by its owner before anything is written to it
+    const int fd = KDE_open(QFile::encodeName(fileName), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd != -1)
+        ::close(fd);
+
+    if (_file.open(QIODevice::ReadWrite)) {
+        _fd = _file.handle();
+        _length = _fileLength = _tailStart = _file.size();
+    } else {
+        kWarning() << "Unable to open history file" << fileName << ":" << _file.errorString();
+    }
+}
+
 HistoryFile::~HistoryFile()
 {
     if (_fileMap)
@@ -83,23 +124,35 @@ void HistoryFile::map()
 {
     Q_ASSERT(_fileMap == 0);
 
-    _fileMap = (char*)mmap(0 , _length , PROT_READ , MAP_PRIVATE , _fd , 0);
+    // nothing has been written to the file yet
+    if (_fileLength == 0)
+        return;
+
+    _fileMap = (char*)mmap(0 , _fileLength , PROT_READ , MAP_PRIVATE , _fd , 0);
+    _mapLength = _fileLength;
 
     //if mmap'ing fails, fall back to the read-lseek combination
     if (_fileMap == MAP_FAILED) {
         _readWriteBalance = 0;
         _fileMap = 0;
+        _mapLength = 0;
         kWarning() << "mmap'ing history failed.  errno = " << errno;
     }
 }
 
 void HistoryFile::unmap()
 {
-    int result = munmap(_fileMap , _length);
+    int result = munmap(_fileMap , _mapLength);
     Q_ASSERT(result == 0);
     Q_UNUSED(result);
 
     _fileMap = 0;
+    _mapLength = 0;
+}
+
+qint64 HistoryFile::memoryUsage() const
+{
+    return _tail.capacity();
 }
 
 bool HistoryFile::isMapped() const
@@ -109,28 +162,60 @@ bool HistoryFile::isMapped() const
 
 void HistoryFile::add(const unsigned char* buffer, int count)
 {
-    if (_fileMap)
-        unmap();
-
     _readWriteBalance++;
 
+    _tail.append((const char*)buffer, count);
+    _length += count;
+
+    if (_length - _fileLength >= WRITE_BUFFER_SIZE)
+        flush();
+}
+
+void HistoryFile::flush()
+{
+    const int unwritten = _length - _fileLength;
+    if (unwritten == 0)
+        return;
+
     int rc = 0;
 
-    rc = KDE_lseek(_fd, _length, SEEK_SET);
+    rc = KDE_lseek(_fd, _fileLength, SEEK_SET);
     if (rc < 0) {
-        perror("HistoryFile::add.seek");
+        perror("HistoryFile::flush.seek");
         return;
     }
-    rc = write(_fd, buffer, count);
+    rc = write(_fd, _tail.constData() + (_fileLength - _tailStart), unwritten);
     if (rc < 0) {
-        perror("HistoryFile::add.write");
+        perror("HistoryFile::flush.write");
         return;
     }
-    _length += rc;
+    _fileLength += rc;
+
+    // keep roughly the last WRITE_BUFFER_SIZE bytes which have been written
+    // in memory, discarding older data in large steps
+    if (_tail.size() >= 2 * WRITE_BUFFER_SIZE) {
+        const int discard = qMin(_tail.size() - WRITE_BUFFER_SIZE, _fileLength - _tailStart);
+        _tail.remove(0, discard);
+        _tailStart += discard;
+    }
 }
 
 void HistoryFile::get(unsigned char* buffer, int size, int loc)
 {
+    if (loc < 0 || size < 0 || loc + size > _length) {
+        fprintf(stderr, "getHist(...,%d,%d): invalid args.\n", size, loc);
+        return;
+    }
+
+    // recently added data is read from memory
+    if (loc + size > _tailStart) {
+        const int tailLoc = qMax(loc, _tailStart);
+        memcpy(buffer + (tailLoc - loc), _tail.constData() + (tailLoc - _tailStart), loc + size - tailLoc);
+        size = tailLoc - loc;
+        if (size == 0)
+            return;
+    }
+
     //count number of get() calls vs. number of add() calls.
     //If there are many more get() calls compared with add()
     //calls (decided by using MAP_THRESHOLD) then mmap the log
@@ -139,14 +224,17 @@ void HistoryFile::get(unsigned char* buffer, int size, int loc)
     if (!_fileMap && _readWriteBalance < MAP_THRESHOLD)
         map();
 
+    // extend the mapping if the data has been written since it was made
+    if (_fileMap && loc + size > _mapLength) {
+        unmap();
+        map();
+    }
+
     if (_fileMap) {
-        for (int i = 0; i < size; i++)
-            buffer[i] = _fileMap[loc + i];
+        memcpy(buffer, _fileMap + loc, size);
     } else {
         int rc = 0;
 
-        if (loc < 0 || size < 0 || loc + size > _length)
-            fprintf(stderr, "getHist(...,%d,%d): invalid args.\n", size, loc);
         rc = KDE_lseek(_fd, loc, SEEK_SET);
         if (rc < 0) {
             perror("HistoryFile::get.seek");
@@ -248,11 +336,13 @@ void HistoryScrollFile::addCells(const Character text[], int count)
     _cells.add((unsigned char*)text, count * sizeof(Character));
 }
 
-void HistoryScrollFile::addLine(bool previousWrapped)
+qint64 HistoryScrollFile::memoryUsage()
 {
-    if (_index.isMapped())
-        _index.unmap();
+    return _index.memoryUsage() + _cells.memoryUsage() + _lineflags.memoryUsage();
+}
 
+void HistoryScrollFile::addLine(bool previousWrapped)
+{
     int locn = _cells.len();
     _index.add((unsigned char*)&locn, sizeof(int));
     unsigned char flags = previousWrapped ? 0x01 : 0x00;
@@ -302,12 +392,19 @@ void HistoryScrollNone::addLine(bool)
 {
 }
 
+qint64 HistoryScrollNone::memoryUsage()
+{
+    return 0;
+}
+
 ////////////////////////////////////////////////////////////////
 // Compact History Scroll //////////////////////////////////////
 ////////////////////////////////////////////////////////////////
 void* CompactHistoryBlock::allocate(size_t size)
 {
     Q_ASSERT(size > 0);
+    // keep every allocation aligned for the history lines stored in the block
+    size = (size + 7) & ~size_t(7);
     if (_tail - _blockStart + size > _blockLength)
         return 0;
 
@@ -328,7 +425,12 @@ void* CompactHistoryBlockList::allocate(size_t size)
 {
     CompactHistoryBlock* block;
     if (list.isEmpty() || list.last()->remaining() < size) {
-        block = new CompactHistoryBlock();
+        if (_spareBlock) {
+            block = _spareBlock;
+            _spareBlock = 0;
+        } else {
+            block = new CompactHistoryBlock();
+        }
         list.append(block);
         //kDebug() << "new block created, remaining " << block->remaining() << "number of blocks=" << list.size();
     } else {
@@ -338,25 +440,24 @@ void* CompactHistoryBlockList::allocate(size_t size)
     return block->allocate(size);
 }
 
-void CompactHistoryBlockList::deallocate(void* ptr)
+void CompactHistoryBlockList::deallocate(CompactHistoryBlock* block)
 {
-    Q_ASSERT(!list.isEmpty());
-
-    int i = 0;
-    CompactHistoryBlock* block = list.at(i);
-    while (i < list.size() && !block->contains(ptr)) {
-        i++;
-        block = list.at(i);
-    }
-
-    Q_ASSERT(i < list.size());
+    Q_ASSERT(block);
 
     block->deallocate();
 
     if (!block->isInUse()) {
-        list.removeAt(i);
-        delete block;
-        //kDebug() << "block deleted, new size = " << list.size();
+        // blocks are normally released oldest first, so this only
+        // has to look at the start of the list
+        list.removeOne(block);
+
+        if (_spareBlock) {
+            delete block;
+        } else {
+            block->reset();
+            _spareBlock = block;
+        }
+        //kDebug() << "block released, new size = " << list.size();
     }
 }
 
@@ -364,6 +465,16 @@ CompactHistoryBlockList::~CompactHistoryBlockList()
 {
     qDeleteAll(list.begin(), list.end());
     list.clear();
+    delete _spareBlock;
+}
+
+qint64 CompactHistoryBlockList::memoryUsage() const
+{
+    qint64 usage = _spareBlock ? _spareBlock->length() : 0;
+    foreach(CompactHistoryBlock* block, list) {
+        usage += block->length();
+    }
+    return usage;
 }
 
 void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blockList)
@@ -373,7 +484,13 @@ void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blo
 
 CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlockList& bList)
     : _blockListRef(bList),
-      _formatLength(0)
+      // the line itself has just been allocated by operator new
+      _block(bList.currentBlock()),
+      _dataBlock(0),
+      _text(0),
+      _formatLength(0),
+      _wrapped(false),
+      _isWide(false)
 {
     _length = line.size();
 
@@ -391,11 +508,22 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
             k++;
         }
 
+        for (int i = 0; i < line.size() && !_isWide; i++)
+            _isWide = line[i].character > 0xFFFF;
+
+        // the formats and the characters share a single allocation
         //kDebug() << "number of different formats in string: " << _formatLength;
-        _formatArray = (CharacterFormat*) _blockListRef.allocate(sizeof(CharacterFormat) * _formatLength);
-        Q_ASSERT(_formatArray != 0);
-        _text = (quint16*) _blockListRef.allocate(sizeof(quint16) * line.size());
-        Q_ASSERT(_text != 0);
+        const size_t formatSize = sizeof(CharacterFormat) * _formatLength;
+        const size_t textSize = (_isWide ? sizeof(quint32) : sizeof(quint16)) * line.size();
+        quint8* data = (quint8*) _blockListRef.allocate(formatSize + textSize);
+        Q_ASSERT(data != 0);
+        _dataBlock = _blockListRef.currentBlock();
+
+        _formatArray = (CharacterFormat*) data;
+        if (_isWide)
+            _wideText = (quint32*)(data + formatSize);
+        else
+            _text = (quint16*)(data + formatSize);
 
         _length = line.size();
         _wrapped = false;
@@ -419,9 +547,14 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
         }
 
         // copy character values
-        for (int i = 0; i < line.size(); i++) {
-            _text[i] = line[i].character;
-            //kDebug() << "char " << i << " at mem " << &(text[i]);
+        if (_isWide) {
+            for (int i = 0; i < line.size(); i++)
+                _wideText[i] = line[i].character;
+        } else {
+            for (int i = 0; i < line.size(); i++) {
+                _text[i] = line[i].character;
+                //kDebug() << "char " << i << " at mem " << &(text[i]);
+            }
         }
     }
     //kDebug() << "line created, length " << length << " at " << &(length);
@@ -429,24 +562,34 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
 
 CompactHistoryLine::~CompactHistoryLine()
 {
-    if (_length > 0) {
-        _blockListRef.deallocate(_text);
-        _blockListRef.deallocate(_formatArray);
+    if (_length > 0)
+        _blockListRef.deallocate(_dataBlock);
+    _blockListRef.deallocate(_block);
+}
+
+// returns the index of the entry in _formatArray which applies to 'index'
+int CompactHistoryLine::formatIndex(int index) const
+{
+    // binary search for the last format starting at or before 'index'
+    int first = 0;
+    int last = _formatLength - 1;
+    while (first < last) {
+        const int middle = (first + last + 1) / 2;
+        if (_formatArray[middle].startPos <= index)
+            first = middle;
+        else
+            last = middle - 1;
     }
-    _blockListRef.deallocate(this);
+    return first;
 }
 
 void CompactHistoryLine::getCharacter(int index, Character& r)
 {
     Q_ASSERT(index < _length);
-    int formatPos = 0;
-    while ((formatPos + 1) < _formatLength && index >= _formatArray[formatPos + 1].startPos)
-        formatPos++;
+    const int formatPos = formatIndex(index);
 
-    r.character = _text[index];
-    r.rendition = _formatArray[formatPos].rendition;
-    r.foregroundColor = _formatArray[formatPos].fgColor;
-    r.backgroundColor = _formatArray[formatPos].bgColor;
+    r.character = _isWide ? _wideText[index] : _text[index];
+    r.setStyleIndex(_formatArray[formatPos].styleIndex);
     r.isRealCharacter = _formatArray[formatPos].isRealCharacter;
 }
 
@@ -455,14 +598,44 @@ void CompactHistoryLine::getCharacters(Character* array, int size, int startColu
     Q_ASSERT(startColumn >= 0 && size >= 0);
     Q_ASSERT(startColumn + size <= static_cast<int>(getLength()));
 
-    for (int i = startColumn; i < size + startColumn; i++) {
-        getCharacter(i, array[i - startColumn]);
+    if (size == 0)
+        return;
+
+    // walk through the runs of characters sharing a format, rather than
+    // looking up the format of every character
+    const int endColumn = startColumn + size;
+    int formatPos = formatIndex(startColumn);
+    int column = startColumn;
+    Character* output = array;
+
+    while (column < endColumn) {
+        const CharacterFormat& format = _formatArray[formatPos];
+        formatPos++;
+        const int runEnd = formatPos < _formatLength ?
+                           qMin(endColumn, static_cast<int>(_formatArray[formatPos].startPos)) :
+                           endColumn;
+
+        if (_isWide) {
+            for (; column < runEnd; column++, output++) {
+                output->character = _wideText[column];
+                output->setStyleIndex(format.styleIndex);
+                output->isRealCharacter = format.isRealCharacter;
+            }
+        } else {
+            for (; column < runEnd; column++, output++) {
+                output->character = _text[column];
+                output->setStyleIndex(format.styleIndex);
+                output->isRealCharacter = format.isRealCharacter;
+            }
+        }
     }
 }
 
 CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
     : HistoryScroll(new CompactHistoryType(maxLineCount))
     , _lines()
+    , _firstLine(0)
+    , _lineCount(0)
     , _blockList()
 {
     //kDebug() << "scroll of length " << maxLineCount << " created";
@@ -471,19 +644,53 @@ CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
 
 CompactHistoryScroll::~CompactHistoryScroll()
 {
-    qDeleteAll(_lines.begin(), _lines.end());
-    _lines.clear();
+    while (_lineCount > 0)
+        removeFirstLine();
 }
 
-void CompactHistoryScroll::addCellsVector(const TextLine& cells)
+void CompactHistoryScroll::removeFirstLine()
 {
-    CompactHistoryLine* line;
-    line = new(_blockList) CompactHistoryLine(cells, _blockList);
+    Q_ASSERT(_lineCount > 0);
+
+    delete line(0);
+
+    _firstLine++;
+    if (_firstLine == _lines.size())
+        _firstLine = 0;
+    _lineCount--;
+}
+
+// moves the lines into a ring buffer with room for 'capacity' lines
+void CompactHistoryScroll::setLineCapacity(int capacity)
+{
+    Q_ASSERT(capacity >= _lineCount);
+
+    HistoryArray lines(capacity);
+    for (int i = 0; i < _lineCount; i++)
+        lines[i] = line(i);
+
+    _lines = lines;
+    _firstLine = 0;
+}
 
-    if (_lines.size() > static_cast<int>(_maxLineCount)) {
-        delete _lines.takeAt(0);
+void CompactHistoryScroll::addCellsVector(const TextLine& cells)
+{
+    // the history keeps up to one more line than its maximum line count
+    if (_lineCount > static_cast<int>(_maxLineCount))
+        removeFirstLine();
+
+    // the ring buffer only grows as far as it needs to, so that a large
+    // maximum line count does not cost anything until it is used
+    if (_lineCount == _lines.size()) {
+        const int maxCapacity = _maxLineCount < INT_MAX ? static_cast<int>(_maxLineCount) + 1 : INT_MAX;
+        setLineCapacity(qMin(qMax(_lines.size() * 2, 64), maxCapacity));
     }
-    _lines.append(line);
+
+    CompactHistoryLine* newLine = new(_blockList) CompactHistoryLine(cells, _blockList);
+
+    const int index = _firstLine + _lineCount;
+    _lines[index < _lines.size() ? index : index - _lines.size()] = newLine;
+    _lineCount++;
 }
 
 void CompactHistoryScroll::addCells(const Character a[], int count)
@@ -495,155 +702,1633 @@ void CompactHistoryScroll::addCells(const Character a[], int count)
 
 void CompactHistoryScroll::addLine(bool previousWrapped)
 {
-    CompactHistoryLine* line = _lines.last();
-    //kDebug() << "last line at address " << line;
-    line->setWrapped(previousWrapped);
+    CompactHistoryLine* lastLine = line(_lineCount - 1);
+    //kDebug() << "last line at address " << lastLine;
+    lastLine->setWrapped(previousWrapped);
 }
 
 int CompactHistoryScroll::getLines()
 {
-    return _lines.size();
+    return _lineCount;
 }
 
 int CompactHistoryScroll::getLineLen(int lineNumber)
 {
-    Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
-    //kDebug() << "request for line at address " << line;
-    return line->getLength();
+    Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
+    //kDebug() << "request for line at address " << line(lineNumber);
+    return line(lineNumber)->getLength();
 }
 
 void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
 {
     if (count == 0) return;
-    Q_ASSERT(lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
+    Q_ASSERT(lineNumber < _lineCount);
+    CompactHistoryLine* historyLine = line(lineNumber);
     Q_ASSERT(startColumn >= 0);
-    Q_ASSERT((unsigned int)startColumn <= line->getLength() - count);
-    line->getCharacters(buffer, count, startColumn);
+    Q_ASSERT((unsigned int)startColumn <= historyLine->getLength() - count);
+    historyLine->getCharacters(buffer, count, startColumn);
 }
 
 void CompactHistoryScroll::setMaxNbLines(unsigned int lineCount)
 {
     _maxLineCount = lineCount;
 
-    while (_lines.size() > static_cast<int>(lineCount)) {
-        delete _lines.takeAt(0);
+    while (_lineCount > static_cast<int>(lineCount)) {
+        removeFirstLine();
     }
+
+    // release the part of the ring buffer which can no longer be used
+    if (_lines.size() > 0 && static_cast<unsigned int>(_lines.size() - 1) > lineCount)
+        setLineCapacity(_lineCount);
     //kDebug() << "set max lines to: " << _maxLineCount;
 }
 
+qint64 CompactHistoryScroll::memoryUsage()
+{
+    return _blockList.memoryUsage() + qint64(_lines.capacity()) * sizeof(CompactHistoryLine*);
+}
+
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _lines.size());
-    return _lines[lineNumber]->isWrapped();
+    Q_ASSERT(lineNumber < _lineCount);
+    return line(lineNumber)->isWrapped();
 }
 
 //////////////////////////////////////////////////////////////////////
-// History Types
+// Compressed file-based history
 //////////////////////////////////////////////////////////////////////
 
-HistoryType::HistoryType()
+// lines are encoded as a sequence of numbers, each of which is stored in as
+// few bytes as possible, using the high bit of each byte to mark that more
+// bytes follow
+static inline void appendNumber(QByteArray& data, quint32 value)
 {
+    while (value >= 0x80) {
+        data.append(char(value | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
 }
 
-HistoryType::~HistoryType()
+static inline quint32 readNumber(const uchar*& data)
 {
+    quint32 value = 0;
+    int shift = 0;
+    while (*data & 0x80) {
+        value |= quint32(*data++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= quint32(*data++) << shift;
+    return value;
 }
 
-//////////////////////////////
+// a line is encoded as its length and wrapped flag, followed by the runs of
+// characters which share the same format and then the text.  runs of three
+// or more identical characters, such as the spaces at the end of a line,
+// are written as a zero followed by the length of the run and the character.
+static void encodeLine(QByteArray& data, const TextLine& line, bool wrapped)
+{
+    const int length = line.size();
+    appendNumber(data, (length << 1) | (wrapped ? 1 : 0));
+
+    int start = 0;
+    while (start < length) {
+        const Character& first = line[start];
+        int end = start + 1;
+        while (end < length && line[end].styleIndex() == first.styleIndex() &&
+                line[end].isRealCharacter == first.isRealCharacter)
+            end++;
+
+        appendNumber(data, (first.styleIndex() << 1) | first.isRealCharacter);
+        appendNumber(data, end - start);
+        start = end;
+    }
 
-HistoryTypeNone::HistoryTypeNone()
+    start = 0;
+    while (start < length) {
+        const quint32 character = line[start].character;
+        int end = start + 1;
+        while (end < length && line[end].character == character)
+            end++;
+
+        if (end - start >= 3 || character == 0) {
+            appendNumber(data, 0);
+            appendNumber(data, end - start);
+            appendNumber(data, character);
+            start = end;
+        } else {
+            appendNumber(data, character);
+            start++;
+        }
+    }
+}
+
+static void decodeLine(const uchar*& data, TextLine& line, bool& wrapped)
 {
+    const quint32 header = readNumber(data);
+    const int length = header >> 1;
+    wrapped = header & 1;
+
+    line.resize(length);
+    Character* output = line.data();
+
+    int column = 0;
+    while (column < length) {
+        const quint32 format = readNumber(data);
+        const int end = column + readNumber(data);
+        for (; column < end; column++) {
+            output[column].setStyleIndex(format >> 1);
+            output[column].isRealCharacter = format & 1;
+        }
+    }
+
+    column = 0;
+    while (column < length) {
+        const quint32 value = readNumber(data);
+        if (value == 0) {
+            const int end = column + readNumber(data);
+            const quint32 character = readNumber(data);
+            for (; column < end; column++)
+                output[column].character = character;
+        } else {
+            output[column++].character = value;
+        }
+    }
 }
 
-bool HistoryTypeNone::isEnabled() const
+CompressedHistoryScroll::CompressedHistoryScroll(int maxNbLines)
+    : HistoryScroll(new CompressedHistoryType(maxNbLines))
+    , _blocks(new HistoryFile)
+    , _blockCache(BLOCK_CACHE_SIZE)
+    , _firstLine(0)
+    , _maxLineCount(maxNbLines)
 {
-    return false;
+    _blockOffsets.append(0);
 }
 
-HistoryScroll* HistoryTypeNone::scroll(HistoryScroll* old) const
+CompressedHistoryScroll::~CompressedHistoryScroll()
 {
-    delete old;
-    return new HistoryScrollNone();
+    delete _blocks;
 }
 
-int HistoryTypeNone::maximumLineCount() const
+int CompressedHistoryScroll::compressedSize() const
 {
-    return 0;
+    return _blocks->len();
 }
 
-//////////////////////////////
+// returns the number of bytes used by the characters in a block
+static int blockSize(const CompressedHistoryBlock& block)
+{
+    int size = sizeof(CompressedHistoryBlock);
+    foreach(const TextLine& line, block.lines) {
+        size += line.size() * sizeof(Character);
+    }
+    return size;
+}
 
-HistoryTypeFile::HistoryTypeFile(const QString& fileName)
-    : _fileName(fileName)
+qint64 CompressedHistoryScroll::memoryUsage()
 {
+    return _blocks->memoryUsage() +
+           qint64(_blockOffsets.capacity()) * sizeof(int) +
+           _blockCache.totalCost() +
+           blockSize(_currentBlock) +
+           _currentLine.capacity() * sizeof(Character);
 }
 
-bool HistoryTypeFile::isEnabled() const
+const CompressedHistoryBlock* CompressedHistoryScroll::block(int line)
+{
+    Q_ASSERT(line >= _firstLine && line - _firstLine < getLines());
+
+    const int index = line / LINES_PER_BLOCK;
+    if (index == _blockOffsets.size() - 1)
+        return &_currentBlock;
+
+    CompressedHistoryBlock* cachedBlock = _blockCache.object(index);
+    if (cachedBlock)
+        return cachedBlock;
+
+    const int size = _blockOffsets[index + 1] - _blockOffsets[index];
+    QByteArray data(size, 0);
+    _blocks->get(reinterpret_cast<unsigned char*>(data.data()), size, _blockOffsets[index]);
+
+    CompressedHistoryBlock* newBlock = new CompressedHistoryBlock;
+    newBlock->lines.resize(LINES_PER_BLOCK);
+    newBlock->wrapped.resize(LINES_PER_BLOCK);
+
+    const uchar* input = reinterpret_cast<const uchar*>(data.constData());
+    for (int i = 0; i < LINES_PER_BLOCK; i++) {
+        bool wrapped = false;
+        decodeLine(input, newBlock->lines[i], wrapped);
+        newBlock->wrapped.setBit(i, wrapped);
+    }
+    Q_ASSERT(input == reinterpret_cast<const uchar*>(data.constData()) + size);
+
+    // the cost is limited so that a block with very long lines is still
+    // accepted by the cache, which would otherwise delete it immediately
+    _blockCache.insert(index, newBlock, qMin(blockSize(*newBlock), _blockCache.maxCost()));
+    return newBlock;
+}
+
+void CompressedHistoryScroll::writeCurrentBlock()
+{
+    Q_ASSERT(_currentBlock.lines.size() == LINES_PER_BLOCK);
+
+    QByteArray data;
+    for (int i = 0; i < LINES_PER_BLOCK; i++)
+        encodeLine(data, _currentBlock.lines[i], _currentBlock.wrapped.testBit(i));
+
+    _blocks->add(reinterpret_cast<const unsigned char*>(data.constData()), data.size());
+    _blockOffsets.append(_blocks->len());
+
+    // the most recent lines are the most likely to be viewed, so the block
+    // is kept in the cache rather than decoded again when it is next read
+    _blockCache.insert(_blockOffsets.size() - 2, new CompressedHistoryBlock(_currentBlock),
+                       qMin(blockSize(_currentBlock), _blockCache.maxCost()));
+    _currentBlock = CompressedHistoryBlock();
+}
+
+void CompressedHistoryScroll::setMaxNbLines(int nbLines)
+{
+    if (nbLines != _maxLineCount) {
+        _maxLineCount = nbLines;
+        delete _historyType;
+        _historyType = new CompressedHistoryType(nbLines);
+    }
+
+    removeExcessLines();
+}
+
+void CompressedHistoryScroll::removeExcessLines()
+{
+    if (_maxLineCount < 0 || getLines() <= _maxLineCount)
+        return;
+
+    _firstLine += getLines() - _maxLineCount;
+
+    const int firstBlock = qMin(_firstLine / LINES_PER_BLOCK, _blockOffsets.size() - 1);
+    const int unused = _blockOffsets[firstBlock];
+    if (unused >= COMPACT_THRESHOLD && unused >= _blocks->len() - unused)
+        compact();
+}
+
+void CompressedHistoryScroll::compact()
+{
+    const int firstBlock = qMin(_firstLine / LINES_PER_BLOCK, _blockOffsets.size() - 1);
+    const int start = _blockOffsets[firstBlock];
+    const int end = _blocks->len();
+
+    HistoryFile* blocks = new HistoryFile;
+    QByteArray buffer(COMPACT_THRESHOLD, 0);
+    for (int position = start; position < end; position += buffer.size()) {
+        const int count = qMin(buffer.size(), end - position);
+        _blocks->get(reinterpret_cast<unsigned char*>(buffer.data()), count, position);
+        blocks->add(reinterpret_cast<const unsigned char*>(buffer.constData()), count);
+    }
+    delete _blocks;
+    _blocks = blocks;
+
+    _blockOffsets.remove(0, firstBlock);
+    for (int i = 0; i < _blockOffsets.size(); i++)
+        _blockOffsets[i] -= start;
+    _firstLine -= firstBlock * LINES_PER_BLOCK;
+
+    // the cached blocks are numbered from the start of the old file
+    _blockCache.clear();
+}
+
+int CompressedHistoryScroll::getLines()
+{
+    return (_blockOffsets.size() - 1) * LINES_PER_BLOCK + _currentBlock.lines.size() - _firstLine;
+}
+
+int CompressedHistoryScroll::getLineLen(int lineno)
+{
+    const int line = _firstLine + lineno;
+    return block(line)->lines[line % LINES_PER_BLOCK].size();
+}
+
+bool CompressedHistoryScroll::isWrappedLine(int lineno)
+{
+    const int line = _firstLine + lineno;
+    return block(line)->wrapped.testBit(line % LINES_PER_BLOCK);
+}
+
+void CompressedHistoryScroll::getCells(int lineno, int colno, int count, Character res[])
+{
+    if (count == 0) return;
+
+    const int line = _firstLine + lineno;
+    const TextLine& text = block(line)->lines[line % LINES_PER_BLOCK];
+    Q_ASSERT(colno >= 0 && colno + count <= text.size());
+    qCopy(text.constBegin() + colno, text.constBegin() + colno + count, res);
+}
+
+void CompressedHistoryScroll::addCells(const Character text[], int count)
+{
+    const int oldSize = _currentLine.size();
+    _currentLine.resize(oldSize + count);
+    qCopy(text, text + count, _currentLine.begin() + oldSize);
+}
+
+void CompressedHistoryScroll::addLine(bool previousWrapped)
+{
+    const int index = _currentBlock.lines.size();
+    _currentBlock.lines.append(_currentLine);
+    _currentBlock.wrapped.resize(index + 1);
+    _currentBlock.wrapped.setBit(index, previousWrapped);
+    _currentLine.clear();
+
+    if (_currentBlock.lines.size() == LINES_PER_BLOCK)
+        writeCurrentBlock();
+
+    removeExcessLines();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Persistent file-based history
+//////////////////////////////////////////////////////////////////////
+
+static const quint32 HISTORY_FILE_MAGIC = 0x4B484953;
+static const quint32 HISTORY_FILE_VERSION = 1;
+static const quint32 HISTORY_FILE_BYTE_ORDER = 0x01020304;
+
+// lines in history files are never longer than this, see CompactHistoryLine
+static const quint32 MAX_HISTORY_FILE_LINE_LENGTH = 0xFFFF;
+
+static QByteArray historyFileHeader(quint32 generation)
+{
+    const quint32 header[] = { HISTORY_FILE_MAGIC, HISTORY_FILE_VERSION, HISTORY_FILE_BYTE_ORDER, generation };
+    return QByteArray(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+// returns true and sets 'generation' if 'file' starts with a valid header
+static bool readHistoryFileHeader(QFile& file, quint32& generation)
 {
+    quint32 header[4];
+    if (file.read(reinterpret_cast<char*>(header), sizeof(header)) != sizeof(header))
+        return false;
+    if (header[0] != HISTORY_FILE_MAGIC || header[1] != HISTORY_FILE_VERSION ||
+            header[2] != HISTORY_FILE_BYTE_ORDER)
+        return false;
+
+    generation = header[3];
     return true;
 }
 
-HistoryScroll* HistoryTypeFile::scroll(HistoryScroll* old) const
+// reads a number written by appendNumber() from data which may be damaged.
+// returns false if the number does not end before 'end'
+static inline bool readNumber(const uchar*& data, const uchar* end, quint32& value)
 {
-    if (dynamic_cast<HistoryFile *>(old))
-        return old; // Unchanged.
+    value = 0;
+    for (int shift = 0; data < end && shift < 32; shift += 7) {
+        const uchar byte = *data++;
+        value |= quint32(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
 
-    HistoryScroll* newScroll = new HistoryScrollFile(_fileName);
+// lines in history files are encoded like those in the compressed history,
+// except that each run of characters which share the same format stores its
+// length, colors and rendition flags, and the text of a combining character
+// sequence is written as the length of the sequence followed by its characters.
+static void encodePersistentLine(QByteArray& data, const TextLine& line, bool wrapped)
+{
+    const int length = line.size();
+    appendNumber(data, (length << 1) | (wrapped ? 1 : 0));
+
+    int start = 0;
+    while (start < length) {
+        const Character& first = line[start];
+        int end = start + 1;
+        while (end < length && line[end].styleIndex() == first.styleIndex() &&
+                line[end].isRealCharacter == first.isRealCharacter)
+            end++;
+
+        const CharacterStyle& style = first.style();
+        appendNumber(data, end - start);
+        appendNumber(data, style.foregroundColor.packedValue());
+        appendNumber(data, style.backgroundColor.packedValue());
+        appendNumber(data, style.rendition | (first.isRealCharacter << 8));
+        start = end;
+    }
 
-    Character line[LINE_SIZE];
-    int lines = (old != 0) ? old->getLines() : 0;
-    for (int i = 0; i < lines; i++) {
-        int size = old->getLineLen(i);
-        if (size > LINE_SIZE) {
-            Character* tmp_line = new Character[size];
-            old->getCells(i, 0, size, tmp_line);
-            newScroll->addCells(tmp_line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-            delete [] tmp_line;
+    start = 0;
+    while (start < length) {
+        const Character& cell = line[start];
+        if (cell.rendition() & RE_EXTENDED_CHAR) {
+            ushort sequenceLength = 0;
+            const uint* sequence = ExtendedCharTable::instance.lookupExtendedChar(cell.character, sequenceLength);
+            if (!sequence)
+                sequenceLength = 0;
+            appendNumber(data, sequenceLength);
+            for (int i = 0; i < sequenceLength; i++)
+                appendNumber(data, sequence[i]);
+            start++;
+            continue;
+        }
+
+        int end = start + 1;
+        while (end < length && line[end].character == cell.character &&
+                !(line[end].rendition() & RE_EXTENDED_CHAR))
+            end++;
+
+        if (end - start >= 3 || cell.character == 0) {
+            appendNumber(data, 0);
+            appendNumber(data, end - start);
+            appendNumber(data, cell.character);
+            start = end;
         } else {
-            old->getCells(i, 0, size, line);
-            newScroll->addCells(line, size);
-            newScroll->addLine(old->isWrappedLine(i));
+            appendNumber(data, cell.character);
+            start++;
         }
     }
+}
 
-    delete old;
-    return newScroll;
+static inline bool isValidColor(quint32 packedColor)
+{
+    return (packedColor >> 24) <= COLOR_SPACE_RGB;
 }
 
-int HistoryTypeFile::maximumLineCount() const
+// decodes a line written by encodePersistentLine(), returning false if the
+// data is damaged
+static bool decodePersistentLine(const uchar* data, const uchar* end, TextLine& line, bool& wrapped)
 {
-    return -1;
+    quint32 header = 0;
+    if (!readNumber(data, end, header) || (header >> 1) > MAX_HISTORY_FILE_LINE_LENGTH)
+        return false;
+
+    const int length = header >> 1;
+    wrapped = header & 1;
+
+    line.resize(length);
+    Character* output = line.data();
+
+    int column = 0;
+    while (column < length) {
+        quint32 count = 0;
+        quint32 foreground = 0;
+        quint32 background = 0;
+        quint32 flags = 0;
+        if (!readNumber(data, end, count) || !readNumber(data, end, foreground) ||
+                !readNumber(data, end, background) || !readNumber(data, end, flags))
+            return false;
+
+        if (count == 0 || count > quint32(length - column) ||
+                !isValidColor(foreground) || !isValidColor(background))
+            return false;
+
+        Character format;
+        format.setFormat(CharacterColor::fromPackedValue(foreground),
+                         CharacterColor::fromPackedValue(background),
+                         flags & 0xFF);
+
+        for (const int runEnd = column + count; column < runEnd; column++) {
+            output[column].setStyleIndex(format.styleIndex());
+            output[column].isRealCharacter = (flags >> 8) & 1;
+        }
+    }
+
+    column = 0;
+    while (column < length) {
+        quint32 value = 0;
+        if (!readNumber(data, end, value))
+            return false;
+
+        if (output[column].rendition() & RE_EXTENDED_CHAR) {
+            if (value == 0 || value > 0xFFFF || value > quint32(end - data))
+                return false;
+
+            QVarLengthArray<uint, 8> sequence(value);
+            for (int i = 0; i < sequence.size(); i++) {
+                if (!readNumber(data, end, sequence[i]))
+                    return false;
+            }
+            output[column++].character = ExtendedCharTable::instance.createExtendedChar(sequence.constData(), sequence.size());
+        } else if (value == 0) {
+            quint32 count = 0;
+            quint32 character = 0;
+            if (!readNumber(data, end, count) || !readNumber(data, end, character) ||
+                    count == 0 || count > quint32(length - column) || character > 0x10FFFF)
+                return false;
+
+            for (const int runEnd = column + count; column < runEnd; column++) {
+                if (output[column].rendition() & RE_EXTENDED_CHAR)
+                    return false;
+                output[column].character = character;
+            }
+        } else {
+            if (value > 0x10FFFF)
+                return false;
+            output[column++].character = value;
+        }
+    }
+
+    return data == end;
 }
 
-//////////////////////////////
+PersistentHistoryScroll::PersistentHistoryScroll(const QString& fileName, int maxNbLines)
+    : HistoryScroll(new PersistentHistoryType(fileName, maxNbLines))
+    , _fileName(fileName)
+    , _lines(0)
+    , _index(0)
+    , _generation(0)
+    , _lockFd(-1)
+    , _compactLines(0)
+    , _compactIndex(0)
+    , _compactFirstLine(0)
+    , _compactStart(0)
+    , _compactLine(0)
+    , _firstLine(0)
+    , _maxLineCount(maxNbLines)
+    , _unflushedLines(0)
+    , _decodedLineNumber(-1)
+    , _decodedLineWrapped(false)
+{
+    if (QFile::exists(fileName + ".index")) {
+        openFiles(false);
+        removeExcessLines();
+    }
+}
 
-CompactHistoryType::CompactHistoryType(unsigned int nbLines)
-    : _maxLines(nbLines)
+PersistentHistoryScroll::~PersistentHistoryScroll()
 {
+    flush();
+    cancelCompaction();
+
+    delete _lines;
+    delete _index;
+
+    if (_lockFd >= 0)
+        ::close(_lockFd);
 }
 
-bool CompactHistoryType::isEnabled() const
+QString PersistentHistoryScroll::fileName() const
 {
-    return true;
+    return _fileName;
 }
 
-int CompactHistoryType::maximumLineCount() const
+void PersistentHistoryScroll::removeFiles(const QString& fileName)
 {
-    return _maxLines;
+    QFile::remove(fileName + ".index");
+    QFile::remove(fileName + ".lines");
+    QFile::remove(fileName + ".index.new");
+    QFile::remove(fileName + ".lines.new");
 }
 
-HistoryScroll* CompactHistoryType::scroll(HistoryScroll* old) const
+// returns true if a history in another process has locked the files with
+// 'fileName', see PersistentHistoryScroll::lockFiles()
+static bool filesInUse(const QString& fileName)
 {
-    if (old) {
-        CompactHistoryScroll* oldBuffer = dynamic_cast<CompactHistoryScroll*>(old);
-        if (oldBuffer) {
-            oldBuffer->setMaxNbLines(_maxLines);
-            return oldBuffer;
-        }
-        delete old;
+    const int fd = KDE_open(QFile::encodeName(fileName + ".index"), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    const bool inUse = ::flock(fd, LOCK_EX | LOCK_NB) != 0;
+    ::close(fd);
+    return inUse;
+}
+
+void PersistentHistoryScroll::removeUnusedFiles(const QString& directory, const QStringList& fileNames)
+{
+    QSet<QString> usedNames;
+    foreach(const QString& fileName, fileNames)
+        usedNames << QFileInfo(fileName).fileName();
+
+    // the files of a history are named after it, followed by their extensions
+    const QDir dir(directory);
+    foreach(const QString& file, dir.entryList(QDir::Files)) {
+        const QString name = file.section('.', 0, 0);
+        if (usedNames.contains(name))
+            continue;
+
+        usedNames << name;
+        if (!filesInUse(dir.filePath(name)))
+            removeFiles(dir.filePath(name));
     }
-    return new CompactHistoryScroll(_maxLines);
+}
+
+void PersistentHistoryScroll::lockFiles()
+{
+    if (_lockFd >= 0)
+        ::close(_lockFd);
+
+    // the lock is shared, it only keeps other processes from removing the files
+    _lockFd = KDE_open(QFile::encodeName(_fileName + ".index"), O_RDONLY);
+    if (_lockFd >= 0)
+        ::flock(_lockFd, LOCK_SH);
+}
+
+void PersistentHistoryScroll::openFiles(bool create)
+{
+    const QString indexName = _fileName + ".index";
+    const QString linesName = _fileName + ".lines";
+
+    if (create) {
+        // the history holds the output of the session, so only the owner may
+        // list or read the files in the directory
+        const QString directory = QFileInfo(_fileName).absolutePath();
+        if (!QFile::exists(directory))
+            KStandardDirs::makeDir(directory, 0700);
+        QFile::setPermissions(directory, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+        removeFiles(_fileName);
+    } else {
+        // check that the files were written together, and drop the lines
+        // which were not completely written
+        QFile index(indexName);
+        QFile lines(linesName);
+        quint32 indexGeneration = 0;
+        quint32 linesGeneration = 0;
+        if (!index.open(QIODevice::ReadOnly) || !lines.open(QIODevice::ReadOnly) ||
+                !readHistoryFileHeader(index, indexGeneration) ||
+                !readHistoryFileHeader(lines, linesGeneration) ||
+                indexGeneration != linesGeneration) {
+            kWarning() << "Discarding damaged history files" << _fileName;
+            removeFiles(_fileName);
+            return;
+        }
+
+        const qint64 linesSize = lines.size();
+        const int lineCount = (index.size() - HEADER_SIZE) / sizeof(quint32);
+        quint32 end = HEADER_SIZE;
+        int validLines = 0;
+        if (lineCount > 0) {
+            const quint32* entries = reinterpret_cast<const quint32*>(index.map(HEADER_SIZE, lineCount * sizeof(quint32)));
+            if (!entries) {
+                kWarning() << "Unable to read history file" << indexName << ":" << index.errorString();
+                return;
+            }
+
+            // the entries are in increasing order, so the lines which were
+            // completely written can be found with a binary search
+            int low = 0;
+            int high = lineCount;
+            while (low < high) {
+                const int middle = (low + high) / 2;
+                if (entries[middle] <= linesSize)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            validLines = low;
+            if (validLines > 0)
+                end = entries[validLines - 1];
+        }
+        index.close();
+        lines.close();
+
+        QFile::resize(indexName, HEADER_SIZE + validLines * sizeof(quint32));
+        QFile::resize(linesName, end);
+        _generation = indexGeneration;
+    }
+
+    _lines = new HistoryFile(linesName);
+    _index = new HistoryFile(indexName);
+
+    if (create) {
+        const QByteArray header = historyFileHeader(_generation);
+        _lines->add(reinterpret_cast<const unsigned char*>(header.constData()), header.size());
+        _index->add(reinterpret_cast<const unsigned char*>(header.constData()), header.size());
+        flush();
+    } else {
+        // mapping the files makes the existing lines available without reading them
+        _lines->map();
+        _index->map();
+    }
+
+    lockFiles();
+}
+
+int PersistentHistoryScroll::lineEnd(int line)
+{
+    quint32 end = 0;
+    _index->get(reinterpret_cast<unsigned char*>(&end), sizeof(end), HEADER_SIZE + line * sizeof(quint32));
+    return end;
+}
+
+int PersistentHistoryScroll::lineStart(int line)
+{
+    return line == 0 ? HEADER_SIZE : lineEnd(line - 1);
+}
+
+void PersistentHistoryScroll::decodeLine(int line)
+{
+    if (line == _decodedLineNumber)
+        return;
+
+    const int start = lineStart(line);
+    const int end = lineEnd(line);
+
+    bool valid = false;
+    if (start < end && end <= _lines->len()) {
+        QByteArray data(end - start, 0);
+        _lines->get(reinterpret_cast<unsigned char*>(data.data()), data.size(), start);
+
+        const uchar* input = reinterpret_cast<const uchar*>(data.constData());
+        valid = decodePersistentLine(input, input + data.size(), _decodedLine, _decodedLineWrapped);
+    }
+
+    // a damaged line is shown as an empty line
+    if (!valid) {
+        _decodedLine.clear();
+        _decodedLineWrapped = false;
+    }
+    _decodedLineNumber = line;
+}
+
+int PersistentHistoryScroll::getLines()
+{
+    if (!_index)
+        return 0;
+
+    return (_index->len() - HEADER_SIZE) / sizeof(quint32) - _firstLine;
+}
+
+int PersistentHistoryScroll::getLineLen(int lineno)
+{
+    decodeLine(_firstLine + lineno);
+    return _decodedLine.size();
+}
+
+bool PersistentHistoryScroll::isWrappedLine(int lineno)
+{
+    decodeLine(_firstLine + lineno);
+    return _decodedLineWrapped;
+}
+
+void PersistentHistoryScroll::getCells(int lineno, int colno, int count, Character res[])
+{
+    if (count == 0) return;
+
+    decodeLine(_firstLine + lineno);
+    Q_ASSERT(colno >= 0 && colno + count <= _decodedLine.size());
+    qCopy(_decodedLine.constBegin() + colno, _decodedLine.constBegin() + colno + count, res);
+}
+
+void PersistentHistoryScroll::addCells(const Character text[], int count)
+{
+    const int oldSize = _currentLine.size();
+    _currentLine.resize(oldSize + count);
+    qCopy(text, text + count, _currentLine.begin() + oldSize);
+}
+
+void PersistentHistoryScroll::addLine(bool previousWrapped)
+{
+    if (!_index)
+        openFiles(true);
+
+    if (_currentLine.size() > static_cast<int>(MAX_HISTORY_FILE_LINE_LENGTH))
+        _currentLine.resize(MAX_HISTORY_FILE_LINE_LENGTH);
+
+    QByteArray data;
+    encodePersistentLine(data, _currentLine, previousWrapped);
+    _currentLine.clear();
+
+    // the line is written before its index entry, see openFiles()
+    _lines->add(reinterpret_cast<const unsigned char*>(data.constData()), data.size());
+    const quint32 end = _lines->len();
+    _index->add(reinterpret_cast<const unsigned char*>(&end), sizeof(end));
+
+    if (++_unflushedLines >= FLUSH_INTERVAL)
+        flush();
+
+    removeExcessLines();
+}
+
+void PersistentHistoryScroll::flush()
+{
+    if (_lines) {
+        _lines->flush();
+        _index->flush();
+    }
+    _unflushedLines = 0;
+}
+
+qint64 PersistentHistoryScroll::memoryUsage()
+{
+    qint64 usage = qint64(_currentLine.capacity() + _decodedLine.capacity()) * sizeof(Character);
+    if (_lines)
+        usage += _lines->memoryUsage() + _index->memoryUsage();
+    if (_compactLines)
+        usage += _compactLines->memoryUsage() + _compactIndex->memoryUsage();
+    return usage;
+}
+
+void PersistentHistoryScroll::setMaxNbLines(int nbLines)
+{
+    if (nbLines != _maxLineCount) {
+        _maxLineCount = nbLines;
+        delete _historyType;
+        _historyType = new PersistentHistoryType(_fileName, nbLines);
+    }
+
+    removeExcessLines();
+}
+
+void PersistentHistoryScroll::removeExcessLines()
+{
+    if (!_index)
+        return;
+
+    const int lineCount = _firstLine + getLines();
+    if (_maxLineCount >= 0)
+        _firstLine = qMax(_firstLine, lineCount - _maxLineCount);
+
+    const int end = _lines->len();
+    while (_firstLine < lineCount && end - lineStart(_firstLine) > MAXIMUM_SIZE)
+        _firstLine++;
+
+    const int unused = lineStart(_firstLine) - HEADER_SIZE;
+    if (!_compactLines && unused >= COMPACT_THRESHOLD && unused >= end - unused)
+        startCompaction();
+
+    if (_compactLines)
+        compact();
+}
+
+void PersistentHistoryScroll::startCompaction()
+{
+    const QString indexName = _fileName + ".index.new";
+    const QString linesName = _fileName + ".lines.new";
+
+    QFile::remove(linesName);
+    QFile::remove(indexName);
+    _compactLines = new HistoryFile(linesName);
+    _compactIndex = new HistoryFile(indexName);
+
+    const QByteArray header = historyFileHeader(_generation + 1);
+    _compactLines->add(reinterpret_cast<const unsigned char*>(header.constData()), header.size());
+    _compactIndex->add(reinterpret_cast<const unsigned char*>(header.constData()), header.size());
+
+    _compactFirstLine = _firstLine;
+    _compactStart = lineStart(_firstLine);
+    _compactLine = _firstLine;
+}
+
+void PersistentHistoryScroll::compact()
+{
+    const QString indexName = _fileName + ".index";
+    const QString linesName = _fileName + ".lines";
+    const int lineCount = _firstLine + getLines();
+    const int end = _lines->len();
+
+    // much more is copied each time than a line adds, so the copy soon
+    // catches up with the end of the files
+    int position = _compactStart + _compactLines->len() - HEADER_SIZE;
+    const int count = qMin(int(COMPACT_STEP), end - position);
+    if (count > 0) {
+        QByteArray buffer(count, 0);
+        _lines->get(reinterpret_cast<unsigned char*>(buffer.data()), count, position);
+        _compactLines->add(reinterpret_cast<const unsigned char*>(buffer.constData()), count);
+        position += count;
+    }
+
+    // the index entries follow the lines which have been copied
+    while (_compactLine < lineCount && lineEnd(_compactLine) <= position) {
+        const quint32 lineEnd = this->lineEnd(_compactLine) - _compactStart + HEADER_SIZE;
+        _compactIndex->add(reinterpret_cast<const unsigned char*>(&lineEnd), sizeof(lineEnd));
+        _compactLine++;
+    }
+
+    if (position < end || _compactLine < lineCount)
+        return;
+
+    _compactLines->flush();
+    _compactIndex->flush();
+
+    // if only one of the files is replaced, their generations differ and
+    // they are discarded when they are next opened
+    if (::rename(QFile::encodeName(linesName + ".new"), QFile::encodeName(linesName)) != 0 ||
+            ::rename(QFile::encodeName(indexName + ".new"), QFile::encodeName(indexName)) != 0) {
+        kWarning() << "Unable to replace history files" << _fileName << ": errno =" << errno;
+        cancelCompaction();
+        return;
+    }
+
+    delete _lines;
+    delete _index;
+    _lines = _compactLines;
+    _index = _compactIndex;
+    _compactLines = 0;
+    _compactIndex = 0;
+
+    _generation++;
+    _firstLine -= _compactFirstLine;
+    _decodedLineNumber = -1;
+
+    // the lock is held on the index file which was replaced
+    lockFiles();
+}
+
+void PersistentHistoryScroll::cancelCompaction()
+{
+    if (!_compactLines)
+        return;
+
+    delete _compactLines;
+    delete _compactIndex;
+    _compactLines = 0;
+    _compactIndex = 0;
+    QFile::remove(_fileName + ".lines.new");
+    QFile::remove(_fileName + ".index.new");
+}
+
+//////////////////////////////////////////////////////////////////////
+// Reflowed history
+//////////////////////////////////////////////////////////////////////
+
+ReflowedHistory::ReflowedHistory(HistoryScroll* history)
+    : _history(history)
+    , _columns(0)
+    , _visibleLines(0)
+    , _historyLines(0)
+    , _droppedLines(0)
+    , _firstReflowedLine(0)
+    , _firstLogicalLine(0)
+    , _cachedLogicalLine(-1)
+    , _cachedLine(0)
+    , _cachedPosition(0)
+    , _rowStartsLine(-1)
+    , _rowStartsLength(0)
+    , _rowStartsColumns(0)
+{
+}
+
+// returns true if 'cell' holds the second half of a double width character
+static inline bool isWidePlaceholder(const Character& cell)
+{
+    return cell.character == 0 && !cell.isRealCharacter;
+}
+
+static bool hasWideCharacters(const Character* cells, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (isWidePlaceholder(cells[i]))
+            return true;
+    }
+    return false;
+}
+
+// returns the end of the rewrapped line which starts at 'start' in 'cells'.
+// A double width character which does not fit at the end of the line starts
+// the next line, as in Screen::reflowScreen()
+static int rowEnd(const QVector<Character>& cells, int start, int columns)
+{
+    int end = qMin(start + columns, cells.size());
+    if (end < cells.size() && end - start > 1 && isWidePlaceholder(cells[end]))
+        end--;
+    return end;
+}
+
+void ReflowedHistory::setHistory(HistoryScroll* history)
+{
+    _history = history;
+    _cachedLogicalLine = -1;
+
+    if (_columns > 0 && _history->getLines() != _historyLines)
+        reset();
+}
+
+void ReflowedHistory::reset()
+{
+    _historyLines = _history->getLines();
+    _droppedLines = 0;
+    _firstReflowedLine = _historyLines;
+    _logicalLines.clear();
+    _firstLogicalLine = 0;
+    _cachedLogicalLine = -1;
+    _rowStartsLine = -1;
+
+    reflowFrom(_historyLines - _visibleLines);
+}
+
+void ReflowedHistory::setColumns(int columns, int visibleLines)
+{
+    Q_ASSERT(columns > 0);
+
+    _visibleLines = visibleLines;
+
+    // lines which are added from now on already have the right width
+    if (_columns == 0 && _history->getLines() == 0)
+        return;
+
+    if (_columns == 0) {
+        _columns = columns;
+        reset();
+        return;
+    }
+
+    // the logical lines stay the same, only the number of lines each
+    // one is split into changes
+    _columns = columns;
+    int row = 0;
+    for (int i = _firstLogicalLine; i < _logicalLines.size(); i++) {
+        _logicalLines[i].firstRow = row;
+        layoutRows(_logicalLines[i]);
+        row += rowCount(_logicalLines[i]);
+    }
+
+    const int storedLineCount = storedLines();
+    if (storedLineCount > 0 && row < visibleLines)
+        reflowFrom(_droppedLines + storedLineCount - (visibleLines - row));
+}
+
+int ReflowedHistory::storedLines() const
+{
+    if (_columns == 0)
+        return _history->getLines();
+
+    return qMax(0, _firstReflowedLine - _droppedLines);
+}
+
+void ReflowedHistory::reflowFrom(int line)
+{
+    line = qMax(line, _droppedLines);
+    if (line >= _firstReflowedLine)
+        return;
+
+    // start at the beginning of a logical line
+    while (line > _droppedLines && _history->isWrappedLine(line - 1 - _droppedLines))
+        line--;
+
+    QVector<LogicalLine> lines;
+    QVector<Character> cells;
+    LogicalLine current = { 0, 0, 0, 0, 0, 1, 0, false };
+    for (int i = line; i < _firstReflowedLine; i++) {
+        const int length = _history->getLineLen(i - _droppedLines);
+        if (current.lineCount == 0) {
+            current.firstLine = i;
+            current.firstLength = length;
+            current.wide = false;
+        }
+        current.lineCount++;
+        current.length += length;
+
+        if (!current.wide && length > 0) {
+            cells.resize(length);
+            _history->getCells(i - _droppedLines, 0, length, cells.data());
+            current.wide = hasWideCharacters(cells.constData(), length);
+        }
+
+        // the last line of the history may be continued by the next one added
+        if (!_history->isWrappedLine(i - _droppedLines) || i == _firstReflowedLine - 1) {
+            layoutRows(current);
+            lines << current;
+            current.lineCount = 0;
+            current.length = 0;
+        }
+    }
+
+    int row = _firstLogicalLine < _logicalLines.size() ? _logicalLines[_firstLogicalLine].firstRow : 0;
+    for (int i = lines.size() - 1; i >= 0; i--) {
+        row -= rowCount(lines[i]);
+        lines[i].firstRow = row;
+    }
+
+    _logicalLines = lines + _logicalLines.mid(_firstLogicalLine);
+    _firstLogicalLine = 0;
+    _firstReflowedLine = line;
+    _cachedLogicalLine = -1;
+}
+
+int ReflowedHistory::reflow(int line, int* column)
+{
+    if (_columns == 0 || line < 0 || line >= storedLines())
+        return line;
+
+    reflowFrom(_droppedLines + line - REFLOW_BATCH_SIZE);
+    return rewrappedPosition(line, column);
+}
+
+int ReflowedHistory::rewrappedPosition(int line, int* column) const
+{
+    const int historyLine = _droppedLines + line;
+    Q_ASSERT(_columns > 0 && historyLine >= _firstReflowedLine);
+
+    // find the logical line which now holds the line
+    int low = _firstLogicalLine;
+    int high = _logicalLines.size() - 1;
+    while (low < high) {
+        const int middle = (low + high + 1) / 2;
+        if (_logicalLines[middle].firstLine <= historyLine)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    const LogicalLine& logicalLine = _logicalLines[low];
+
+    int position = column ? *column : 0;
+    for (int i = logicalLine.firstLine; i < historyLine; i++)
+        position += _history->getLineLen(i - _droppedLines);
+
+    int start = 0;
+    const int row = rowAt(low, position, start);
+    if (column)
+        *column = position - start;
+    return storedLines() + logicalLine.firstRow - _logicalLines[_firstLogicalLine].firstRow + row;
+}
+
+void ReflowedHistory::dropLines(int count)
+{
+    const int droppedLines = _droppedLines + count;
+    // whether the first logical line lost some of its lines but not all
+    bool shortened = false;
+    bool lengthKnown = true;
+
+    for (; _droppedLines < droppedLines; _droppedLines++) {
+        // lines which were not rewrapped are simply no longer shown
+        if (_droppedLines < _firstReflowedLine || _firstLogicalLine >= _logicalLines.size())
+            continue;
+
+        LogicalLine& line = _logicalLines[_firstLogicalLine];
+        Q_ASSERT(line.firstLine == _droppedLines);
+
+        line.firstLine++;
+        line.lineCount--;
+        line.length -= line.firstLength;
+        if (line.lineCount == 0) {
+            _firstLogicalLine++;
+            shortened = false;
+            lengthKnown = true;
+            continue;
+        }
+
+        shortened = true;
+        if (line.firstLine >= droppedLines) {
+            line.firstLength = _history->getLineLen(line.firstLine - droppedLines);
+        } else {
+            // the line is dropped as well, before its length could be read
+            line.firstLength = 0;
+            lengthKnown = false;
+        }
+    }
+
+    if (shortened) {
+        LogicalLine& line = _logicalLines[_firstLogicalLine];
+        if (!lengthKnown) {
+            line.length = 0;
+            for (int i = line.firstLine; i < line.firstLine + line.lineCount; i++)
+                line.length += _history->getLineLen(i - _droppedLines);
+        }
+
+        // the following lines keep their positions
+        const int oldRowCount = rowCount(line);
+        layoutRows(line);
+        line.firstRow += oldRowCount - rowCount(line);
+    }
+
+    // reclaim the space used by dropped lines once it is a large part of the total
+    if (_firstLogicalLine > 1024 && _firstLogicalLine > _logicalLines.size() / 2) {
+        _logicalLines.remove(0, _firstLogicalLine);
+        _firstLogicalLine = 0;
+    }
+    _cachedLogicalLine = -1;
+}
+
+void ReflowedHistory::addLine(const TextLine& cells, bool wrapped)
+{
+    _history->addCellsVector(cells);
+    _history->addLine(wrapped);
+
+    if (_columns == 0)
+        return;
+
+    // a history with a limited size drops its oldest lines once it is full
+    const int historyLines = _history->getLines();
+    if (historyLines == 0) {
+        reset();
+        return;
+    }
+    if (historyLines <= _historyLines)
+        dropLines(_historyLines + 1 - historyLines);
+    _historyLines = historyLines;
+
+    const int line = _droppedLines + historyLines - 1;
+    const int length = _history->getLineLen(historyLines - 1);
+
+    if (_firstLogicalLine < _logicalLines.size()) {
+        LogicalLine& last = _logicalLines.last();
+        const int lastLine = last.firstLine + last.lineCount - 1;
+        if (lastLine == line - 1 && _history->isWrappedLine(lastLine - _droppedLines)) {
+            last.lineCount++;
+            last.length += length;
+            if (!last.wide)
+                last.wide = hasWideCharacters(cells.constData(), cells.size());
+            layoutRows(last, true);
+            return;
+        }
+    }
+
+    LogicalLine newLine = { line, 1, length, length, 0, 1, 0,
+                            hasWideCharacters(cells.constData(), cells.size())
+                          };
+    layoutRows(newLine);
+    if (_firstLogicalLine < _logicalLines.size())
+        newLine.firstRow = _logicalLines.last().firstRow + rowCount(_logicalLines.last());
+    _logicalLines << newLine;
+}
+
+int ReflowedHistory::getLines() const
+{
+    if (_columns == 0 || _firstLogicalLine >= _logicalLines.size())
+        return storedLines();
+
+    const LogicalLine& last = _logicalLines.last();
+    return storedLines() + last.firstRow + rowCount(last) - _logicalLines[_firstLogicalLine].firstRow;
+}
+
+int ReflowedHistory::findLogicalLine(int lineno, int& row) const
+{
+    const int target = lineno - storedLines() + _logicalLines[_firstLogicalLine].firstRow;
+
+    int low = _firstLogicalLine;
+    int high = _logicalLines.size() - 1;
+    while (low < high) {
+        const int middle = (low + high + 1) / 2;
+        if (_logicalLines[middle].firstRow <= target)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    row = target - _logicalLines[low].firstRow;
+    return low;
+}
+
+int ReflowedHistory::getLineLen(int lineno) const
+{
+    if (lineno < storedLines())
+        return _history->getLineLen(lineno);
+
+    int row = 0;
+    const int index = findLogicalLine(lineno, row);
+    int length = 0;
+    rowStart(index, row, length);
+    return length;
+}
+
+bool ReflowedHistory::isWrappedLine(int lineno) const
+{
+    if (lineno < storedLines())
+        return _history->isWrappedLine(lineno);
+
+    int row = 0;
+    const LogicalLine& line = _logicalLines[findLogicalLine(lineno, row)];
+    if (row < rowCount(line) - 1)
+        return true;
+
+    // the last line of the history may be continued on the screen
+    return _history->isWrappedLine(line.firstLine + line.lineCount - 1 - _droppedLines);
+}
+
+void ReflowedHistory::getCells(int lineno, int colno, int count, Character res[]) const
+{
+    if (lineno < storedLines()) {
+        _history->getCells(lineno, colno, count, res);
+        return;
+    }
+
+    int row = 0;
+    const int index = findLogicalLine(lineno, row);
+    const LogicalLine& logicalLine = _logicalLines[index];
+
+    // copy the cells from the stored lines which the line is made of
+    int length = 0;
+    int start = rowStart(index, row, length) + colno;
+    int line = logicalLine.firstLine;
+    int position = 0;
+    if (_cachedLogicalLine == index && _cachedPosition <= start) {
+        line = _cachedLine;
+        position = _cachedPosition;
+    }
+
+    const int end = logicalLine.firstLine + logicalLine.lineCount;
+    while (count > 0 && line < end) {
+        const int length = _history->getLineLen(line - _droppedLines);
+        if (start < position + length) {
+            const int copied = qMin(count, position + length - start);
+            _history->getCells(line - _droppedLines, start - position, copied, res);
+            res += copied;
+            start += copied;
+            count -= copied;
+            if (count == 0)
+                break;
+        }
+        position += length;
+        line++;
+    }
+    Q_ASSERT(count == 0);
+
+    _cachedLogicalLine = index;
+    _cachedLine = line;
+    _cachedPosition = position;
+}
+
+void ReflowedHistory::storedLineRange(int lineno, int& firstLine, int& lastLine) const
+{
+    if (lineno < storedLines()) {
+        firstLine = lineno;
+        lastLine = lineno;
+        return;
+    }
+
+    int row = 0;
+    const LogicalLine& line = _logicalLines[findLogicalLine(lineno, row)];
+    firstLine = line.firstLine - _droppedLines;
+    lastLine = firstLine + line.lineCount - 1;
+}
+
+void ReflowedHistory::layoutRows(LogicalLine& line, bool extend) const
+{
+    if (!line.wide) {
+        line.rows = line.length <= 0 ? 1 : (line.length + _columns - 1) / _columns;
+        line.lastRowStart = (line.rows - 1) * _columns;
+        return;
+    }
+
+    // cells added to the end can only move the end of the last row
+    const int start = extend ? line.lastRowStart : 0;
+    QVector<Character> cells;
+    readCells(line, start, cells);
+
+    int rows = extend ? line.rows - 1 : 0;
+    int position = 0;
+    do {
+        line.lastRowStart = start + position;
+        position = rowEnd(cells, position, _columns);
+        rows++;
+    } while (position < cells.size());
+
+    line.rows = rows;
+}
+
+void ReflowedHistory::readCells(const LogicalLine& line, int start, QVector<Character>& cells) const
+{
+    cells.resize(qMax(0, line.length - start));
+
+    int position = 0;
+    for (int i = line.firstLine; i < line.firstLine + line.lineCount; i++) {
+        const int length = _history->getLineLen(i - _droppedLines);
+        const int from = qMax(start, position);
+        if (from < position + length) {
+            _history->getCells(i - _droppedLines, from - position, position + length - from,
+                               cells.data() + from - start);
+        }
+        position += length;
+    }
+}
+
+const QVector<int>& ReflowedHistory::rowStarts(int index) const
+{
+    const LogicalLine& line = _logicalLines[index];
+    Q_ASSERT(line.wide);
+
+    if (_rowStartsLine != line.firstLine || _rowStartsLength != line.length ||
+            _rowStartsColumns != _columns) {
+        QVector<Character> cells;
+        readCells(line, 0, cells);
+
+        _rowStarts.clear();
+        int position = 0;
+        do {
+            _rowStarts << position;
+            position = rowEnd(cells, position, _columns);
+        } while (position < cells.size());
+
+        _rowStartsLine = line.firstLine;
+        _rowStartsLength = line.length;
+        _rowStartsColumns = _columns;
+    }
+
+    Q_ASSERT(_rowStarts.size() == line.rows);
+    return _rowStarts;
+}
+
+int ReflowedHistory::rowStart(int index, int row, int& length) const
+{
+    const LogicalLine& line = _logicalLines[index];
+    if (!line.wide) {
+        length = qBound(0, line.length - row * _columns, _columns);
+        return row * _columns;
+    }
+
+    const QVector<int>& starts = rowStarts(index);
+    const int end = row + 1 < starts.size() ? starts[row + 1] : line.length;
+    length = end - starts[row];
+    return starts[row];
+}
+
+int ReflowedHistory::rowAt(int index, int position, int& start) const
+{
+    const LogicalLine& line = _logicalLines[index];
+    if (!line.wide) {
+        const int row = qMin(position / _columns, rowCount(line) - 1);
+        start = row * _columns;
+        return row;
+    }
+
+    const QVector<int>& starts = rowStarts(index);
+    const int row = qMax(0, int(qUpperBound(starts, position) - starts.constBegin()) - 1);
+    start = starts[row];
+    return row;
+}
+
+qint64 ReflowedHistory::memoryUsage() const
+{
+    return qint64(_logicalLines.capacity()) * sizeof(LogicalLine) +
+           qint64(_rowStarts.capacity()) * sizeof(int);
+}
+
+//////////////////////////////////////////////////////////////////////
+// History Types
+//////////////////////////////////////////////////////////////////////
+
+HistoryType::HistoryType()
+{
+}
+
+HistoryType::~HistoryType()
+{
+}
+
+//////////////////////////////
+
+HistoryTypeNone::HistoryTypeNone()
+{
+}
+
+bool HistoryTypeNone::isEnabled() const
+{
+    return false;
+}
+
+HistoryScroll* HistoryTypeNone::scroll(HistoryScroll* old) const
+{
+    delete old;
+    return new HistoryScrollNone();
+}
+
+int HistoryTypeNone::maximumLineCount() const
+{
+    return 0;
+}
+
+//////////////////////////////
+
+HistoryTypeFile::HistoryTypeFile(const QString& fileName)
+    : _fileName(fileName)
+{
+}
+
+bool HistoryTypeFile::isEnabled() const
+{
+    return true;
+}
+
+// copies the lines of an existing history into a new one
+static void copyHistory(HistoryScroll* old, HistoryScroll* newScroll)
+{
+    Character line[LINE_SIZE];
+    int lines = (old != 0) ? old->getLines() : 0;
+    for (int i = 0; i < lines; i++) {
+        int size = old->getLineLen(i);
+        if (size > LINE_SIZE) {
+            Character* tmp_line = new Character[size];
+            old->getCells(i, 0, size, tmp_line);
+            newScroll->addCells(tmp_line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+            delete [] tmp_line;
+        } else {
+            old->getCells(i, 0, size, line);
+            newScroll->addCells(line, size);
+            newScroll->addLine(old->isWrappedLine(i));
+        }
+    }
+}
+
+HistoryScroll* HistoryTypeFile::scroll(HistoryScroll* old) const
+{
+    if (dynamic_cast<HistoryFile *>(old))
+        return old; // Unchanged.
+
+    HistoryScroll* newScroll = new HistoryScrollFile(_fileName);
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
+}
+
+int HistoryTypeFile::maximumLineCount() const
+{
+    return -1;
+}
+
+//////////////////////////////
+
+CompressedHistoryType::CompressedHistoryType(int maxLines)
+    : _maxLines(maxLines)
+{
+}
+
+bool CompressedHistoryType::isEnabled() const
+{
+    return true;
+}
+
+int CompressedHistoryType::maximumLineCount() const
+{
+    return _maxLines < 0 ? -1 : _maxLines;
+}
+
+HistoryScroll* CompressedHistoryType::scroll(HistoryScroll* old) const
+{
+    CompressedHistoryScroll* oldBuffer = dynamic_cast<CompressedHistoryScroll*>(old);
+    if (oldBuffer) {
+        oldBuffer->setMaxNbLines(_maxLines);
+        return oldBuffer;
+    }
+
+    HistoryScroll* newScroll = new CompressedHistoryScroll(_maxLines);
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
+}
+
+//////////////////////////////
+
+PersistentHistoryType::PersistentHistoryType(const QString& fileName, int maxLines)
+    : _fileName(fileName)
+    , _maxLines(maxLines)
+{
+}
+
+bool PersistentHistoryType::isEnabled() const
+{
+    return true;
+}
+
+int PersistentHistoryType::maximumLineCount() const
+{
+    return _maxLines < 0 ? -1 : _maxLines;
+}
+
+QString PersistentHistoryType::fileName() const
+{
+    return _fileName;
+}
+
+HistoryScroll* PersistentHistoryType::scroll(HistoryScroll* old) const
+{
+    PersistentHistoryScroll* oldBuffer = dynamic_cast<PersistentHistoryScroll*>(old);
+    if (oldBuffer && oldBuffer->fileName() == _fileName) {
+        oldBuffer->setMaxNbLines(_maxLines);
+        return oldBuffer;
+    }
+
+    // lines which are already in the files, from a session which is being
+    // restored, come before the lines of the old history
+    HistoryScroll* newScroll = new PersistentHistoryScroll(_fileName, _maxLines);
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
+}
+
+//////////////////////////////
+
+CompactHistoryType::CompactHistoryType(unsigned int nbLines)
+    : _maxLines(nbLines)
+{
+}
+
+bool CompactHistoryType::isEnabled() const
+{
+    return true;
+}
+
+int CompactHistoryType::maximumLineCount() const
+{
+    return _maxLines;
+}
+
+HistoryScroll* CompactHistoryType::scroll(HistoryScroll* old) const
+{
+    if (old) {
+        CompactHistoryScroll* oldBuffer = dynamic_cast<CompactHistoryScroll*>(old);
+        if (oldBuffer) {
+            oldBuffer->setMaxNbLines(_maxLines);
+            return oldBuffer;
+        }
+    }
+
+    // lines are kept when the history is moved back into memory from a
+    // file, see HistoryMemoryManager
+    CompactHistoryScroll* newScroll = new CompactHistoryScroll(_maxLines);
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
 }
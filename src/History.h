@@ -25,30 +25,49 @@
 #include <sys/mman.h>
 
 // Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QFile>
 #include <QtCore/QList>
+#include <QtCore/QStringList>
 #include <QtCore/QVector>
 #include <QtCore/QTemporaryFile>
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 namespace Konsole
 {
 /*
    An extendable tmpfile(1) based buffer.
+
+   Data added to the buffer is collected in memory and written to the file
+   in large chunks.  The most recently added data is also kept in memory
+   after it has been written, so that reading recent lines does not need
+   to access the file.
 */
 
 class HistoryFile
 {
 public:
     HistoryFile();
+    // uses the file 'fileName', creating it if it does not exist yet, readable
+    // only by its owner.  data is added after the existing contents of the file.
+    explicit HistoryFile(const QString& fileName);
     virtual ~HistoryFile();
 
     virtual void add(const unsigned char* bytes, int len);
     virtual void get(unsigned char* bytes, int len, int loc);
     virtual int  len() const;
 
-    //mmaps the file in read-only mode
+    //writes any data which is only held in memory to the file
+    void flush();
+    //returns the number of bytes of memory used to hold data added to the file
+    qint64 memoryUsage() const;
+
+    //mmaps the part of the file which has been written in read-only mode
     void map();
     //un-mmaps the file
     void unmap();
@@ -58,11 +77,21 @@ public:
 
 private:
     int  _fd;
-    int  _length;
+    int  _length;     // length of the data, including data not yet written to the file
+    int  _fileLength; // length of the data written to the file
     QTemporaryFile _tmpFile;
+    QFile _file;      // used instead of _tmpFile for a named file
 
     //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
     char* _fileMap;
+    //number of bytes of the file which are mmap'ed.  the mapping stays valid
+    //as the file grows and is only extended when data beyond it is read.
+    int _mapLength;
+
+    //the most recently added data, from position _tailStart onwards.
+    //the part after _fileLength has not been written to the file yet.
+    QByteArray _tail;
+    int _tailStart;
 
     //incremented whenever 'add' is called and decremented whenever
     //'get' is called.
@@ -72,6 +101,9 @@ private:
 
     //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
     static const int MAP_THRESHOLD = -1000;
+
+    //data is written to the file once this many bytes have been added
+    static const int WRITE_BUFFER_SIZE = 64 * 1024;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -105,6 +137,9 @@ public:
 
     virtual void addLine(bool previousWrapped = false) = 0;
 
+    // returns the approximate number of bytes of memory used by the history
+    virtual qint64 memoryUsage() = 0;
+
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -122,7 +157,7 @@ protected:
 // File-based history (e.g. file log, no limitation in length)
 //////////////////////////////////////////////////////////////////////
 
-class HistoryScrollFile : public HistoryScroll
+class KONSOLEPRIVATE_EXPORT HistoryScrollFile : public HistoryScroll
 {
 public:
     explicit HistoryScrollFile(const QString& logFileName);
@@ -136,6 +171,8 @@ public:
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
 
+    virtual qint64 memoryUsage();
+
 private:
     int startOfLine(int lineno);
 
@@ -162,6 +199,8 @@ public:
 
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
+
+    virtual qint64 memoryUsage();
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -175,24 +214,29 @@ class CharacterFormat
 {
 public:
     bool equalsFormat(const CharacterFormat& other) const {
-        return (other.rendition & ~RE_EXTENDED_CHAR) == (rendition & ~RE_EXTENDED_CHAR) && other.fgColor == fgColor && other.bgColor == bgColor;
+        return equalsStyle(CharacterStyleTable::instance.style(other.styleIndex));
     }
 
     bool equalsFormat(const Character& c) const {
-        return (c.rendition & ~RE_EXTENDED_CHAR) == (rendition & ~RE_EXTENDED_CHAR) && c.foregroundColor == fgColor && c.backgroundColor == bgColor;
+        return equalsStyle(c.style());
     }
 
     void setFormat(const Character& c) {
-        rendition = c.rendition;
-        fgColor = c.foregroundColor;
-        bgColor = c.backgroundColor;
+        styleIndex = c.styleIndex();
         isRealCharacter = c.isRealCharacter;
     }
 
-    CharacterColor fgColor, bgColor;
+    quint32 styleIndex;
     quint16 startPos;
-    quint8 rendition;
     bool isRealCharacter;
+
+private:
+    bool equalsStyle(const CharacterStyle& other) const {
+        const CharacterStyle& style = CharacterStyleTable::instance.style(styleIndex);
+        return (other.rendition & ~RE_EXTENDED_CHAR) == (style.rendition & ~RE_EXTENDED_CHAR) &&
+               other.foregroundColor == style.foregroundColor &&
+               other.backgroundColor == style.backgroundColor;
+    }
 };
 
 class CompactHistoryBlock
@@ -226,6 +270,11 @@ public:
     virtual bool isInUse() {
         return _allocCount != 0;
     };
+    // makes the whole block available again, once nothing in it is in use
+    virtual void reset() {
+        Q_ASSERT(!isInUse());
+        _tail = _blockStart;
+    }
 
 private:
     size_t _blockLength;
@@ -238,16 +287,27 @@ private:
 class CompactHistoryBlockList
 {
 public:
-    CompactHistoryBlockList() {}
+    CompactHistoryBlockList() : _spareBlock(0) {}
     ~CompactHistoryBlockList();
 
     void* allocate(size_t size);
-    void deallocate(void *);
+    // releases an allocation made from 'block', see currentBlock()
+    void deallocate(CompactHistoryBlock* block);
+    // returns the block which the last allocation was made from
+    CompactHistoryBlock* currentBlock() const {
+        return list.last();
+    }
     int length() {
         return list.size();
     }
+    // returns the number of bytes reserved by the blocks in the list
+    qint64 memoryUsage() const;
 private:
     QList<CompactHistoryBlock*> list;
+    // an unused block which is kept for reuse.  history lines are released
+    // in the order they were added, so a block is typically freed just
+    // before a new one is needed.
+    CompactHistoryBlock* _spareBlock;
 };
 
 class CompactHistoryLine
@@ -275,17 +335,27 @@ public:
     };
 
 protected:
+    int formatIndex(int index) const;
+
     CompactHistoryBlockList& _blockListRef;
+    CompactHistoryBlock* _block;     // the block holding this line
+    CompactHistoryBlock* _dataBlock; // the block holding _formatArray and _text
     CharacterFormat* _formatArray;
     quint16 _length;
-    quint16* _text;
+    // characters are stored using 16 bits each unless the line contains
+    // characters outside of the Basic Multilingual Plane
+    union {
+        quint16* _text;
+        quint32* _wideText;
+    };
     quint16 _formatLength;
     bool _wrapped;
+    bool _isWide;
 };
 
-class CompactHistoryScroll : public HistoryScroll
+class KONSOLEPRIVATE_EXPORT CompactHistoryScroll : public HistoryScroll
 {
-    typedef QList<CompactHistoryLine*> HistoryArray;
+    typedef QVector<CompactHistoryLine*> HistoryArray;
 
 public:
     explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
@@ -300,16 +370,416 @@ public:
     virtual void addCellsVector(const TextLine& cells);
     virtual void addLine(bool previousWrapped = false);
 
+    virtual qint64 memoryUsage();
+
     void setMaxNbLines(unsigned int nbLines);
 
 private:
     bool hasDifferentColors(const TextLine& line) const;
+
+    // the lines form a ring buffer starting at _firstLine, so that the
+    // oldest line can be dropped in constant time once the history is full
+    CompactHistoryLine* line(int lineNumber) const {
+        Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
+        const int index = _firstLine + lineNumber;
+        return _lines[index < _lines.size() ? index : index - _lines.size()];
+    }
+    void removeFirstLine();
+    void setLineCapacity(int capacity);
+
     HistoryArray _lines;
+    int _firstLine;
+    int _lineCount;
     CompactHistoryBlockList _blockList;
 
     unsigned int _maxLineCount;
 };
 
+//////////////////////////////////////////////////////////////////////
+// Compressed file-based history (no limitation in length)
+// Lines are collected into blocks of a fixed number of lines, which are
+// run-length encoded and written to a temporary file once they are full.
+//////////////////////////////////////////////////////////////////////
+
+/** A block of history lines in decoded form. */
+class CompressedHistoryBlock
+{
+public:
+    QVector<TextLine> lines;
+    QBitArray wrapped;
+};
+
+class KONSOLEPRIVATE_EXPORT CompressedHistoryScroll : public HistoryScroll
+{
+public:
+    /**
+     * Constructs a new history which keeps up to @p maxNbLines lines,
+     * or an unlimited number of lines if @p maxNbLines is negative.
+     */
+    explicit CompressedHistoryScroll(int maxNbLines = -1);
+    virtual ~CompressedHistoryScroll();
+
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
+
+    virtual void addCells(const Character a[], int count);
+    virtual void addLine(bool previousWrapped = false);
+
+    virtual qint64 memoryUsage();
+
+    void setMaxNbLines(int nbLines);
+
+    /** Returns the number of bytes used by the lines written to the file. */
+    int compressedSize() const;
+
+private:
+    // returns the block containing @p line, decoding it if necessary.
+    // 'line' counts from the start of the file rather than from _firstLine.
+    const CompressedHistoryBlock* block(int line);
+    // encodes the current block and writes it to the file
+    void writeCurrentBlock();
+    // drops the oldest lines which exceed the maximum line count
+    void removeExcessLines();
+    // copies the blocks which are still in use into a new file
+    void compact();
+
+    static const int LINES_PER_BLOCK = 64;
+    // number of bytes of decoded blocks which are kept in memory for scrolling
+    static const int BLOCK_CACHE_SIZE = 256 * 1024;
+    // the file is compacted once this many bytes of it are no longer used
+    // and they make up more than half of the file
+    static const int COMPACT_THRESHOLD = 1024 * 1024;
+
+    HistoryFile* _blocks;
+    // position of each written block in _blocks, followed by the end of the last one
+    QVector<int> _blockOffsets;
+    QCache<int, CompressedHistoryBlock> _blockCache;
+
+    // lines before _firstLine have been dropped from the history
+    int _firstLine;
+    int _maxLineCount;
+
+    // lines which have not been written to the file yet
+    CompressedHistoryBlock _currentBlock;
+    TextLine _currentLine;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Persistent file-based history
+//
+// The history is kept in a pair of files which can be opened again later,
+// so that the output of a session can be restored along with the session.
+//
+// <fileName>.lines holds the encoded lines one after another, following a
+// 16 byte header.  Lines are encoded as for the compressed history, except
+// that the colors and rendition of each run of characters are stored
+// directly rather than as an index into the CharacterStyleTable, and that
+// combining character sequences are stored in full.
+//
+// <fileName>.index holds a 16 byte header followed by one quint32 for each
+// line, which is the position in the lines file where the line ends.
+//
+// Both headers consist of four quint32 values in the byte order of the
+// machine which wrote them:
+//     magic number (0x4B484953), format version (1),
+//     byte order mark (0x01020304), generation
+//
+// Lines are only ever appended.  A line is written to the lines file before
+// its entry is written to the index, and when the files are opened again,
+// index entries which refer to data beyond the end of the lines file are
+// discarded, so that lines which were only partially written by a process
+// which crashed are dropped.  Once enough lines have been dropped from the
+// start of the history, the remaining lines are copied into new files which
+// then replace the old ones.  The lines are copied a part at a time as
+// further lines are added, so that adding a line never takes long.  The
+// generation number in the headers is incremented each time this happens,
+// so that a lines file and an index which were not written together are
+// never used together.  The number of lines which have been dropped is not
+// recorded in the files, the limit on the number of lines is applied again
+// when they are opened.
+//
+// The files are only readable by their owner.
+//////////////////////////////////////////////////////////////////////
+
+class KONSOLEPRIVATE_EXPORT PersistentHistoryScroll : public HistoryScroll
+{
+public:
+    /**
+     * Constructs a history which is stored in files starting with @p fileName,
+     * reading any lines which are already in them.  Up to @p maxNbLines lines
+     * are kept, or an unlimited number of lines if @p maxNbLines is negative.
+     * The files are only created once the first line is added.
+     */
+    PersistentHistoryScroll(const QString& fileName, int maxNbLines);
+    virtual ~PersistentHistoryScroll();
+
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
+
+    virtual void addCells(const Character a[], int count);
+    virtual void addLine(bool previousWrapped = false);
+
+    virtual qint64 memoryUsage();
+
+    void setMaxNbLines(int nbLines);
+
+    /** Writes any lines which are only held in memory to the files. */
+    void flush();
+
+    /** Returns the file name which was passed to the constructor. */
+    QString fileName() const;
+
+    /** Removes the files used to store the history with the given @p fileName */
+    static void removeFiles(const QString& fileName);
+
+    /**
+     * Removes the files of histories in @p directory, apart from those of the
+     * histories in @p fileNames and those which are in use by other
+     * processes.  This removes the files which were left behind by
+     * sessions which ended without removing them, such as when Konsole
+     * crashed.
+     */
+    static void removeUnusedFiles(const QString& directory, const QStringList& fileNames);
+
+private:
+    // opens the files, creating them and their directory if 'create' is true
+    void openFiles(bool create);
+    // locks the files while they are in use, see removeUnusedFiles()
+    void lockFiles();
+    // returns the position in the lines file where 'line' ends, counting
+    // lines from the start of the file rather than from _firstLine
+    int lineEnd(int line);
+    int lineStart(int line);
+    // decodes 'line' into _decodedLine, if it is not there already
+    void decodeLine(int line);
+    void removeExcessLines();
+    // starts copying the lines which are still in use into new files
+    void startCompaction();
+    // copies the next part of the lines which are still in use, and replaces
+    // the files with the new ones once all of them have been copied
+    void compact();
+    // stops copying the lines and removes the new files
+    void cancelCompaction();
+
+    static const int HEADER_SIZE = 16;
+    // lines are written to the files each time this many lines have been added
+    static const int FLUSH_INTERVAL = 64;
+    // the oldest lines are dropped once the lines file grows beyond this size,
+    // even if the history is unlimited
+    static const int MAXIMUM_SIZE = 256 * 1024 * 1024;
+    // the files are compacted once this many bytes of the lines file are no
+    // longer used and they make up more than half of the file
+    static const int COMPACT_THRESHOLD = 1024 * 1024;
+    // the number of bytes of the lines file which are copied into the new
+    // file each time a line is added while the files are being compacted
+    static const int COMPACT_STEP = 64 * 1024;
+
+    QString _fileName;
+    HistoryFile* _lines;
+    HistoryFile* _index;
+    quint32 _generation;
+    // descriptor of the index file which holds the lock, see lockFiles()
+    int _lockFd;
+
+    // the new files while the files are being compacted, the first line which
+    // is copied and its position in the lines file, and the next line whose
+    // index entry is to be copied
+    HistoryFile* _compactLines;
+    HistoryFile* _compactIndex;
+    int _compactFirstLine;
+    int _compactStart;
+    int _compactLine;
+
+    // lines before _firstLine have been dropped from the history
+    int _firstLine;
+    int _maxLineCount;
+    int _unflushedLines;
+    TextLine _currentLine;
+
+    // the most recently read line
+    int _decodedLineNumber;
+    TextLine _decodedLine;
+    bool _decodedLineWrapped;
+};
+
+//////////////////////////////////////////////////////////////////////
+// Reflowed history
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * Presents the lines of a HistoryScroll rewrapped to a given width.
+ *
+ * Lines are stored in the history as they were wrapped on the screen when
+ * they were added.  A line of output which was too long to fit on the
+ * screen is split over several lines, all but the last of which are marked
+ * as wrapped.  After the number of columns of the screen changes, this
+ * class joins those lines up again and presents them rewrapped to the new
+ * width, without changing the history itself.
+ *
+ * Lines are rewrapped as the screen rewraps its own lines, so a double
+ * width character which does not fit at the end of a line starts the next
+ * line instead of being split from its second half.
+ *
+ * Rewrapping the whole history each time the width changes would make
+ * resizing slow when the history is large, so the lines are rewrapped from
+ * the end of the history backwards as they are needed, see reflow().  The
+ * lines before the first rewrapped line are presented as they were stored.
+ */
+class KONSOLEPRIVATE_EXPORT ReflowedHistory
+{
+public:
+    /** Constructs a view of @p history which presents lines as they were stored. */
+    explicit ReflowedHistory(HistoryScroll* history);
+
+    /**
+     * Changes the history which is presented.  If @p history holds as many
+     * lines as the previous history, as it does after the type of history
+     * is changed, the lines which have been rewrapped stay rewrapped.
+     */
+    void setHistory(HistoryScroll* history);
+
+    /**
+     * Rewraps the lines to @p columns wide.  The last lines of the history,
+     * enough to fill @p visibleLines lines, are rewrapped straight away, as
+     * are lines which have already been rewrapped to a different width.
+     */
+    void setColumns(int columns, int visibleLines);
+
+    /**
+     * Rewraps the lines from @p line onwards, together with some of the lines
+     * before them, if they are still presented as they were stored.  This
+     * changes the number of lines, so the position which the line at
+     * @p line has afterwards is returned.
+     *
+     * If @p column is not null, it is the column of a position on @p line.
+     * The line which holds that position afterwards is returned instead,
+     * and @p column is set to the column of the position on it.
+     */
+    int reflow(int line, int* column = 0);
+
+    /**
+     * Returns the position which the line at @p line has, after it has been
+     * rewrapped by reflow() while it was presented as it was stored.  This
+     * only holds until further lines are added or dropped.  If @p column is
+     * not null, it is mapped as for reflow().
+     */
+    int rewrappedPosition(int line, int* column = 0) const;
+
+    /** Returns the number of lines before the first rewrapped line. */
+    int storedLines() const;
+
+    /** Adds a line to the history, see HistoryScroll::addLine() */
+    void addLine(const TextLine& cells, bool wrapped);
+
+    int  getLines() const;
+    int  getLineLen(int lineno) const;
+    void getCells(int lineno, int colno, int count, Character res[]) const;
+    bool isWrappedLine(int lineno) const;
+
+    /**
+     * Returns the range of lines of the history itself, from @p firstLine
+     * to @p lastLine inclusive, which the text presented on line @p lineno
+     * is stored in.
+     */
+    void storedLineRange(int lineno, int& firstLine, int& lastLine) const;
+
+    /**
+     * Returns the approximate number of bytes of memory used to keep track
+     * of the rewrapped lines, not including the history itself.
+     */
+    qint64 memoryUsage() const;
+
+private:
+    // a line of output, stored as one or more lines of the history.  lines
+    // of the history are counted from the first line there was when
+    // rewrapping began, see _droppedLines
+    struct LogicalLine {
+        int firstLine;
+        int lineCount;
+        int length;
+        // length of the first line, needed once it is dropped
+        int firstLength;
+        // position of the first rewrapped line, relative to an arbitrary
+        // origin so that lines can be added at either end
+        int firstRow;
+        // the number of rewrapped lines and the position of the last one
+        // within the line, see layoutRows()
+        int rows;
+        int lastRowStart;
+        // whether the line holds double width characters.  The rewrapped
+        // lines of other lines are simply _columns long
+        bool wide;
+    };
+
+    void reset();
+    // rewraps the lines from 'line' up to _firstReflowedLine
+    void reflowFrom(int line);
+    // updates the logical lines after 'count' lines are dropped from the
+    // start of the history
+    void dropLines(int count);
+
+    int rowCount(const LogicalLine& line) const {
+        return line.rows;
+    }
+    // updates the number of rewrapped lines of 'line' after its length or
+    // _columns changed.  If 'extend' is true, cells have only been added to
+    // its end, so the rewrapped lines before the last one stay the same
+    void layoutRows(LogicalLine& line, bool extend = false) const;
+    // copies the cells of 'line' from position 'start' to its end into 'cells'
+    void readCells(const LogicalLine& line, int start, QVector<Character>& cells) const;
+    // returns the position of 'row' within the logical line at 'index',
+    // and sets 'length' to its length
+    int rowStart(int index, int row, int& length) const;
+    // returns the row within the logical line at 'index' which holds
+    // 'position', and sets 'start' to the position of that row
+    int rowAt(int index, int position, int& start) const;
+    // returns the positions of the rewrapped lines of the logical line at
+    // 'index', which must hold double width characters
+    const QVector<int>& rowStarts(int index) const;
+    // returns the index in _logicalLines of the logical line shown on
+    // 'lineno', which must be a rewrapped line, and its row within it
+    int findLogicalLine(int lineno, int& row) const;
+
+    // lines are rewrapped in batches of at least this many lines as
+    // they are scrolled into view
+    static const int REFLOW_BATCH_SIZE = 1000;
+
+    HistoryScroll* _history;
+    // the width lines are rewrapped to, or 0 if they are shown as they were stored
+    int _columns;
+    int _visibleLines;
+    // the number of lines in _history when it was last checked
+    int _historyLines;
+    // the number of lines dropped from the start of the history since
+    // rewrapping began
+    int _droppedLines;
+    // lines of the history from this one onwards are rewrapped
+    int _firstReflowedLine;
+
+    QVector<LogicalLine> _logicalLines;
+    // entries of _logicalLines before this one have been dropped
+    int _firstLogicalLine;
+
+    // position reached by the last call to getCells(), which lets lines of
+    // a long logical line be read one after another without going back to
+    // its start each time
+    mutable int _cachedLogicalLine;
+    mutable int _cachedLine;
+    mutable int _cachedPosition;
+
+    // positions of the rewrapped lines of the last logical line with double
+    // width characters which was read, identified by its first line, length
+    // and width, see rowStarts()
+    mutable QVector<int> _rowStarts;
+    mutable int _rowStartsLine;
+    mutable int _rowStartsLength;
+    mutable int _rowStartsColumns;
+};
+
 //////////////////////////////////////////////////////////////////////
 // History type
 //////////////////////////////////////////////////////////////////////
@@ -367,7 +837,48 @@ protected:
     QString _fileName;
 };
 
-class CompactHistoryType : public HistoryType
+class KONSOLEPRIVATE_EXPORT CompressedHistoryType : public HistoryType
+{
+public:
+    /**
+     * Constructs a history type which keeps up to @p maxLines lines, or an
+     * unlimited number of lines if @p maxLines is negative.
+     */
+    explicit CompressedHistoryType(int maxLines = -1);
+
+    virtual bool isEnabled() const;
+    virtual int maximumLineCount() const;
+
+    virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+    int _maxLines;
+};
+
+class KONSOLEPRIVATE_EXPORT PersistentHistoryType : public HistoryType
+{
+public:
+    /**
+     * Constructs a history type which keeps up to @p maxLines lines, or an
+     * unlimited number of lines if @p maxLines is negative, in files starting
+     * with @p fileName.  See PersistentHistoryScroll
+     */
+    PersistentHistoryType(const QString& fileName, int maxLines);
+
+    virtual bool isEnabled() const;
+    virtual int maximumLineCount() const;
+
+    virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+    /** Returns the name of the files used to store the history */
+    QString fileName() const;
+
+protected:
+    QString _fileName;
+    int _maxLines;
+};
+
+class KONSOLEPRIVATE_EXPORT CompactHistoryType : public HistoryType
 {
 public:
     explicit CompactHistoryType(unsigned int size);
@@ -0,0 +1,136 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryIndex.h"
+
+// Konsole
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+// the index is pruned once this many of the indexed lines have been dropped
+// and they are at least a quarter of the lines which the history keeps
+static const int MIN_PRUNED_LINES = 4 * HistoryIndex::LINES_PER_BUCKET;
+
+HistoryIndex::HistoryIndex(int lines)
+    : _entryCount(0)
+    , _addedLines(lines)
+    , _firstLine(0)
+    , _firstIndexedLine(lines)
+    , _prunedLine(lines)
+{
+}
+
+quint64 HistoryIndex::trigram(const QChar* characters)
+{
+    // case is ignored in the same way as by QRegExp
+    return (quint64(characters[0].toLower().unicode()) << 32) |
+           (quint64(characters[1].toLower().unicode()) << 16) |
+           quint64(characters[2].toLower().unicode());
+}
+
+void HistoryIndex::addLine(const Character* characters, int count, bool wrapped, int lines)
+{
+    const int line = _addedLines++;
+    const int bucket = line / LINES_PER_BUCKET;
+
+    // the text is the same as PlainTextDecoder produces when the history
+    // is searched, where wrapped lines are joined together
+    const QString text = _wrappedText + PlainTextDecoder::plainText(characters, count);
+    const QChar* data = text.constData();
+    for (int i = 0; i + 3 <= text.length(); i++) {
+        QVector<int>& buckets = _buckets[trigram(data + i)];
+        if (buckets.isEmpty() || buckets.last() != bucket) {
+            buckets << bucket;
+            _entryCount++;
+        }
+    }
+    _wrappedText = wrapped ? text.right(2) : QString();
+
+    setLineCount(lines);
+}
+
+void HistoryIndex::setLineCount(int lines)
+{
+    _firstLine = _addedLines - lines;
+
+    const int droppedLines = _firstLine - _prunedLine;
+    if (droppedLines >= MIN_PRUNED_LINES && droppedLines >= lines / 4)
+        prune();
+}
+
+void HistoryIndex::prune()
+{
+    const int firstBucket = _firstLine / LINES_PER_BUCKET;
+
+    QMutableHashIterator<quint64, QVector<int> > iter(_buckets);
+    while (iter.hasNext()) {
+        QVector<int>& buckets = iter.next().value();
+        const int removed = qLowerBound(buckets.constBegin(), buckets.constEnd(), firstBucket) - buckets.constBegin();
+        if (removed == 0)
+            continue;
+
+        _entryCount -= removed;
+        if (removed == buckets.size()) {
+            iter.remove();
+        } else {
+            buckets.remove(0, removed);
+            buckets.squeeze();
+        }
+    }
+    _prunedLine = _firstLine;
+}
+
+bool HistoryIndex::mayContain(const QString& text, int firstLine, int lastLine) const
+{
+    firstLine += _firstLine;
+    lastLine += _firstLine;
+    if (text.length() < 3 || text.contains('\n') ||
+            firstLine < _firstIndexedLine || lastLine < firstLine)
+        return true;
+
+    const int firstBucket = firstLine / LINES_PER_BUCKET;
+    const int lastBucket = lastLine / LINES_PER_BUCKET;
+
+    // every trigram of the text must be found in one of the buckets
+    const QChar* data = text.constData();
+    for (int i = 0; i + 3 <= text.length(); i++) {
+        QHash<quint64, QVector<int> >::const_iterator iter = _buckets.constFind(trigram(data + i));
+        if (iter == _buckets.constEnd())
+            return false;
+
+        const QVector<int>& buckets = iter.value();
+        QVector<int>::const_iterator bucket = qLowerBound(buckets.constBegin(), buckets.constEnd(), firstBucket);
+        if (bucket == buckets.constEnd() || *bucket > lastBucket)
+            return false;
+    }
+    return true;
+}
+
+qint64 HistoryIndex::memoryUsage() const
+{
+    // each trigram has a hash node and a vector header besides its entries
+    static const int TRIGRAM_OVERHEAD = 48;
+
+    return qint64(_buckets.size()) * TRIGRAM_OVERHEAD + qint64(_entryCount) * sizeof(int) +
+           qint64(_buckets.capacity()) * sizeof(void*);
+}
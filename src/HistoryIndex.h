@@ -0,0 +1,114 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+// Konsole
+#include "Character.h"
+#include "konsole_export.h"
+
+class QString;
+
+namespace Konsole
+{
+/**
+ * An index of the trigrams (sequences of three characters) in the lines of
+ * a history, which quickly rules out the parts of the history which can not
+ * contain a piece of text, so that searching for the text does not have to
+ * read them.
+ *
+ * Lines are added to the index as they are added to the history, see
+ * addLine(), and the index is told how many lines the history keeps so that
+ * lines dropped from its start can be forgotten.  Lines are identified by
+ * their position in the history at the time of the query.
+ *
+ * To keep the index small, lines are indexed in buckets of LINES_PER_BUCKET
+ * lines, so a query can only tell whether the text may be found somewhere
+ * in the buckets covering a range of lines.  Trigrams are indexed without
+ * regard to case, so the answer holds for case sensitive and insensitive
+ * searches alike.
+ */
+class KONSOLEPRIVATE_EXPORT HistoryIndex
+{
+public:
+    /**
+     * Constructs an index of a history which already holds @p lines lines.
+     * Those lines are not indexed, so queries which include any of them
+     * always report that the text may be found.
+     */
+    explicit HistoryIndex(int lines = 0);
+
+    /**
+     * Indexes a line of @p count characters which has been added to the end
+     * of the history, after which the history holds @p lines lines.  If
+     * @p wrapped is true, the line is continued by the next one.
+     */
+    void addLine(const Character* characters, int count, bool wrapped, int lines);
+
+    /**
+     * Tells the index that the history now holds @p lines lines, after lines
+     * have been dropped from its start without any being added.
+     */
+    void setLineCount(int lines);
+
+    /**
+     * Returns false if @p text is certain not to be found in the lines of the
+     * history from @p firstLine to @p lastLine inclusive.  Text of fewer than
+     * three characters, or which spans several lines, may be found anywhere.
+     */
+    bool mayContain(const QString& text, int firstLine, int lastLine) const;
+
+    /** Returns the approximate number of bytes of memory used by the index. */
+    qint64 memoryUsage() const;
+
+    /** The number of lines indexed together in one bucket. */
+    static const int LINES_PER_BUCKET = 64;
+
+private:
+    static quint64 trigram(const QChar* characters);
+    // forgets the buckets which only hold dropped lines
+    void prune();
+
+    // buckets which contain each trigram, in increasing order
+    QHash<quint64, QVector<int> > _buckets;
+    // total number of entries in _buckets
+    int _entryCount;
+
+    // lines are numbered from the first line ever added to the history.
+    // _firstLine is the number of the first line the history still keeps
+    int _addedLines;
+    int _firstLine;
+    int _firstIndexedLine;
+    // the first line which was kept when the index was last pruned
+    int _prunedLine;
+
+    // the end of the previous line, if it was wrapped, which forms
+    // trigrams with the start of the next line
+    QString _wrappedText;
+};
+}
+
+#endif // HISTORYINDEX_H
@@ -0,0 +1,165 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryMemoryManager.h"
+
+// KDE
+#include <KGlobal>
+
+// Konsole
+#include "Session.h"
+#include "History.h"
+
+using namespace Konsole;
+
+// how often the memory used by the histories is checked, in milliseconds
+static const int CHECK_INTERVAL = 5000;
+
+HistoryMemoryManager::HistoryMemoryManager()
+    : _budget(Q_INT64_C(1024) * 1024 * 1024)
+{
+    _timer.setInterval(CHECK_INTERVAL);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(enforceBudget()));
+}
+
+HistoryMemoryManager::~HistoryMemoryManager()
+{
+}
+
+K_GLOBAL_STATIC(HistoryMemoryManager , theHistoryMemoryManager)
+HistoryMemoryManager* HistoryMemoryManager::instance()
+{
+    return theHistoryMemoryManager;
+}
+
+void HistoryMemoryManager::addSession(Session* session)
+{
+    if (_sessions.contains(session))
+        return;
+
+    _sessions.append(session);
+    connect(session, SIGNAL(destroyed(QObject*)), this, SLOT(sessionDestroyed(QObject*)));
+
+    if (_budget > 0 && !_timer.isActive())
+        _timer.start();
+}
+
+void HistoryMemoryManager::sessionDestroyed(QObject* session)
+{
+    // the session has already been destroyed, so only its address is used
+    _sessions.removeAll(static_cast<Session*>(session));
+    _movedHistories.remove(static_cast<Session*>(session));
+
+    if (_sessions.isEmpty())
+        _timer.stop();
+}
+
+void HistoryMemoryManager::sessionViewed(Session* session)
+{
+    if (_sessions.removeAll(session) > 0)
+        _sessions.append(session);
+}
+
+void HistoryMemoryManager::setMemoryBudget(qint64 bytes)
+{
+    _budget = qMax(Q_INT64_C(0), bytes);
+
+    if (_budget > 0 && !_sessions.isEmpty()) {
+        _timer.start();
+        enforceBudget();
+    } else {
+        _timer.stop();
+        restoreHistories(memoryUsage());
+    }
+}
+
+qint64 HistoryMemoryManager::memoryBudget() const
+{
+    return _budget;
+}
+
+qint64 HistoryMemoryManager::memoryUsage() const
+{
+    qint64 usage = 0;
+    foreach(Session* session, _sessions) {
+        usage += session->historyMemoryUsage();
+    }
+    return usage;
+}
+
+void HistoryMemoryManager::enforceBudget()
+{
+    if (_budget <= 0)
+        return;
+
+    qint64 usage = memoryUsage();
+
+    foreach(Session* session, _sessions) {
+        if (usage <= _budget)
+            break;
+
+        // only fixed-size histories are held in memory, unlimited histories
+        // are already stored on disk
+        const CompactHistoryType* history = dynamic_cast<const CompactHistoryType*>(&session->historyType());
+        if (!history)
+            continue;
+
+        const MovedHistory moved = { history->maximumLineCount(), session->historyMemoryUsage() };
+        session->setHistoryType(CompressedHistoryType(moved.lineCount));
+        usage -= moved.memoryUsage - session->historyMemoryUsage();
+        _movedHistories.insert(session, moved);
+    }
+
+    restoreHistories(usage);
+}
+
+void HistoryMemoryManager::restoreHistories(qint64 usage)
+{
+    // histories are only moved back once they fit comfortably, so that they
+    // are not moved back and forth while the usage is close to the budget
+    const qint64 limit = _budget > 0 ? _budget / 4 * 3 : -1;
+
+    for (int i = _sessions.count() - 1; i >= 0 && !_movedHistories.isEmpty(); i--) {
+        Session* session = _sessions[i];
+        if (!_movedHistories.contains(session))
+            continue;
+
+        // the history may have been changed since it was moved, for
+        // example by editing the profile
+        const MovedHistory moved = _movedHistories.value(session);
+        const CompressedHistoryType* history = dynamic_cast<const CompressedHistoryType*>(&session->historyType());
+        if (!history || history->maximumLineCount() != moved.lineCount) {
+            _movedHistories.remove(session);
+            continue;
+        }
+
+        if (limit >= 0 && usage + moved.memoryUsage > limit)
+            continue;
+
+        const qint64 oldUsage = session->historyMemoryUsage();
+        session->setHistoryType(CompactHistoryType(moved.lineCount));
+        usage += session->historyMemoryUsage() - oldUsage;
+        _movedHistories.remove(session);
+    }
+}
+
+#include "HistoryMemoryManager.moc"
@@ -0,0 +1,119 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYMEMORYMANAGER_H
+#define HISTORYMEMORYMANAGER_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+class Session;
+
+/**
+ * Keeps the memory used by the output history of all sessions within
+ * a budget.
+ *
+ * The memory used by each session's history is checked periodically.  When
+ * the total exceeds the budget, the in-memory histories of the sessions
+ * which were viewed least recently are moved into compressed storage on
+ * disk, keeping their line limit, until the total is within the budget
+ * again.  Once there is room for them, they are moved back into memory,
+ * starting with the most recently viewed.  The selection in a session is
+ * kept when its history is moved.
+ *
+ * Sessions are added by the SessionManager.  The memory used by
+ * each session's history is available over D-Bus through
+ * Session::historyMemoryUsage().
+ */
+class KONSOLEPRIVATE_EXPORT HistoryMemoryManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    HistoryMemoryManager();
+    virtual ~HistoryMemoryManager();
+
+    /** Returns the history memory manager instance. */
+    static HistoryMemoryManager* instance();
+
+    /**
+     * Starts tracking the memory used by the history of @p session, until
+     * the session is destroyed.
+     */
+    void addSession(Session* session);
+    /**
+     * Records that @p session has been viewed.  The histories of sessions
+     * which were viewed least recently are moved to disk first.
+     */
+    void sessionViewed(Session* session);
+
+    /**
+     * Sets the number of bytes which the histories of all sessions may use
+     * together.  A budget of 0 means that there is no limit, in which case
+     * histories which were moved to disk are moved back into memory.
+     */
+    void setMemoryBudget(qint64 bytes);
+    /** Returns the budget set with setMemoryBudget() */
+    qint64 memoryBudget() const;
+
+    /** Returns the number of bytes used by the histories of all sessions. */
+    qint64 memoryUsage() const;
+
+public slots:
+    /**
+     * Moves the histories of the least recently viewed sessions to disk
+     * until the memory used by all histories is within the budget, and
+     * moves histories which were moved to disk earlier back into memory
+     * if there is room for them.
+     */
+    void enforceBudget();
+
+private slots:
+    void sessionDestroyed(QObject* session);
+
+private:
+    // a history which was moved to disk to stay within the budget
+    struct MovedHistory {
+        int lineCount;
+        // the memory which the history used before it was moved
+        qint64 memoryUsage;
+    };
+
+    // moves histories from disk back into memory while there is room
+    void restoreHistories(qint64 usage);
+
+    // sessions ordered from least to most recently viewed
+    QList<Session*> _sessions;
+    QHash<Session*, MovedHistory> _movedHistories;
+    qint64 _budget;
+    QTimer _timer;
+};
+}
+
+#endif // HISTORYMEMORYMANAGER_H
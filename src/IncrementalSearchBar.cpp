@@ -23,6 +23,7 @@
 // Qt
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QProgressBar>
 #include <QtGui/QKeyEvent>
 #include <QtCore/QTimer>
 #include <QToolButton>
@@ -42,6 +43,9 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     , _caseSensitive(0)
     , _regExpression(0)
     , _highlightMatches(0)
+    , _findAll(0)
+    , _matchCount(0)
+    , _searchProgress(0)
 {
     QHBoxLayout* barLayout = new QHBoxLayout(this);
 
@@ -102,6 +106,20 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     barLayout->addWidget(closeButton);
     barLayout->addWidget(findLabel);
     barLayout->addWidget(_searchEdit);
+    _matchCount = new QLabel(this);
+    _matchCount->setObjectName(QLatin1String("match-count"));
+    _matchCount->hide();
+
+    _searchProgress = new QProgressBar(this);
+    _searchProgress->setObjectName(QLatin1String("search-progress"));
+    _searchProgress->setRange(0, 100);
+    _searchProgress->setTextVisible(false);
+    _searchProgress->setMaximumWidth(maxWidth * 4);
+    _searchProgress->setToolTip(i18nc("@info:tooltip", "Progress of the search through the output"));
+    _searchProgress->hide();
+
+    barLayout->addWidget(_matchCount);
+    barLayout->addWidget(_searchProgress);
     barLayout->addWidget(findNext);
     barLayout->addWidget(findPrev);
     barLayout->addWidget(optionsButton);
@@ -128,6 +146,12 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     connect(_highlightMatches, SIGNAL(toggled(bool)),
             this, SIGNAL(highlightMatchesToggled(bool)));
 
+    _findAll = optionsMenu->addAction(i18nc("@item:inmenu", "Find and count all matches"));
+    _findAll->setCheckable(true);
+    _findAll->setToolTip(i18nc("@info:tooltip", "Sets whether all matches are found and marked in the scroll bar"));
+    connect(_findAll, SIGNAL(toggled(bool)),
+            this, SIGNAL(findAllToggled(bool)));
+
     barLayout->addStretch();
 
     barLayout->setContentsMargins(4, 4, 4, 4);
@@ -207,6 +231,31 @@ void IncrementalSearchBar::setFoundMatch(bool match)
     }
 }
 
+void IncrementalSearchBar::setMatchCount(int current, int count)
+{
+    if (count < 0) {
+        _matchCount->hide();
+        return;
+    }
+
+    if (current >= 0 && count > 0)
+        _matchCount->setText(i18nc("@info:status", "%1 of %2", current + 1, count));
+    else
+        _matchCount->setText(i18ncp("@info:status", "1 match", "%1 matches", count));
+
+    _matchCount->show();
+}
+
+void IncrementalSearchBar::setSearchProgress(int percent)
+{
+    if (percent < 0) {
+        _searchProgress->hide();
+    } else {
+        _searchProgress->setValue(percent);
+        _searchProgress->show();
+    }
+}
+
 void IncrementalSearchBar::clearLineEdit()
 {
     _searchEdit->setStyleSheet(QString());
@@ -214,11 +263,12 @@ void IncrementalSearchBar::clearLineEdit()
 
 const QBitArray IncrementalSearchBar::optionsChecked()
 {
-    QBitArray options(3, 0);
+    QBitArray options(4, 0);
 
     if (_caseSensitive->isChecked()) options.setBit(MatchCase);
     if (_regExpression->isChecked()) options.setBit(RegExp);
     if (_highlightMatches->isChecked()) options.setBit(HighlightMatches);
+    if (_findAll->isChecked()) options.setBit(FindAll);
 
     return options;
 }
@@ -26,6 +26,7 @@
 
 class QAction;
 class QLabel;
+class QProgressBar;
 class QTimer;
 class KLineEdit;
 
@@ -66,7 +67,9 @@ public:
         /** Searches are case-sensitive or not */
         MatchCase        = 1,
         /** Searches use regular expressions */
-        RegExp           = 2
+        RegExp           = 2,
+        /** All matches are found and counted */
+        FindAll          = 3
     };
 
     /**
@@ -90,6 +93,16 @@ public:
      */
     void setFoundMatch(bool match);
 
+    /**
+     * Shows the number of matches for the current search text which
+     * were found in the document.
+     *
+     * @param current The position of the selected match among them,
+     * starting from 0, or -1 if no match is selected.
+     * @param count The number of matches, or -1 to hide the count.
+     */
+    void setMatchCount(int current, int count);
+
     /** Returns the current search text */
     QString searchText();
 
@@ -119,6 +132,11 @@ signals:
      * the search text should be treated as a plain string or a regular expression
      */
     void matchRegExpToggled(bool);
+    /**
+     * Emitted when the user toggles the checkbox to indicate whether
+     * all of the matches for the search text should be found and counted
+     */
+    void findAllToggled(bool);
     /** Emitted when the close button is clicked */
     void closeClicked();
     /** Emitted when the return button is pressed in the search box */
@@ -132,6 +150,14 @@ protected:
 public slots:
     void clearLineEdit();
 
+    /**
+     * Shows how far a search which is running in the background has got.
+     *
+     * @param percent The percentage of the document which has been searched,
+     * or -1 to hide the indicator once the search has finished.
+     */
+    void setSearchProgress(int percent);
+
 private slots:
     void notifySearchChanged();
 
@@ -140,6 +166,9 @@ private:
     QAction* _caseSensitive;
     QAction* _regExpression;
     QAction* _highlightMatches;
+    QAction* _findAll;
+    QLabel* _matchCount;
+    QProgressBar* _searchProgress;
 
     QTimer* _searchTimer;
 };
@@ -51,6 +51,7 @@
 #include "Session.h"
 #include "ViewManager.h"
 #include "SessionManager.h"
+#include "HistoryMemoryManager.h"
 #include "ProfileManager.h"
 #include "KonsoleSettings.h"
 #include "settings/GeneralSettings.h"
@@ -673,6 +674,8 @@ void MainWindow::applyKonsoleSettings()
     setNavigationBehavior(KonsoleSettings::newTabBehavior());
     setShowQuickButtons(KonsoleSettings::showQuickButtons());
 
+    HistoryMemoryManager::instance()->setMemoryBudget(Q_INT64_C(1024) * 1024 * KonsoleSettings::historyMemoryBudget());
+
     // setAutoSaveSettings("MainWindow", KonsoleSettings::saveGeometryOnExit());
 
     updateWindowCaption();
@@ -78,6 +78,8 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { ColorScheme , "colors" , 0 , QVariant::String }
     , { AntiAliasFonts, "AntiAliasFonts" , APPEARANCE_GROUP , QVariant::Bool }
     , { BoldIntense, "BoldIntense", APPEARANCE_GROUP, QVariant::Bool }
+    , { CacheGlyphs, "CacheGlyphs", APPEARANCE_GROUP, QVariant::Bool }
+    , { WallpaperTextLayer, "WallpaperTextLayer", APPEARANCE_GROUP, QVariant::Bool }
     , { LineSpacing , "LineSpacing" , APPEARANCE_GROUP , QVariant::Int }
 
     // Keyboard
@@ -86,6 +88,8 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     // Scrolling
     , { HistoryMode , "HistoryMode" , SCROLLING_GROUP , QVariant::Int }
     , { HistorySize , "HistorySize" , SCROLLING_GROUP , QVariant::Int }
+    , { PersistentHistory , "PersistentHistory" , SCROLLING_GROUP , QVariant::Bool }
+    , { IndexHistory , "IndexHistory" , SCROLLING_GROUP , QVariant::Bool }
     , { ScrollBarPosition , "ScrollBarPosition" , SCROLLING_GROUP , QVariant::Int }
     , { ScrollFullPage , "ScrollFullPage" , SCROLLING_GROUP , QVariant::Bool }
 
@@ -95,6 +99,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { BidiRenderingEnabled , "BidiRenderingEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BlinkingCursorEnabled , "BlinkingCursorEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BellMode , "BellMode" , TERMINAL_GROUP , QVariant::Int }
+    , { OutputTimeSlicingEnabled , "OutputTimeSlicingEnabled" , TERMINAL_GROUP , QVariant::Bool }
 
     // Cursor
     , { UseCustomCursorColor , "UseCustomCursorColor" , CURSOR_GROUP , QVariant::Bool}
@@ -169,10 +174,13 @@ FallbackProfile::FallbackProfile()
 
     setProperty(HistoryMode, Enum::FixedSizeHistory);
     setProperty(HistorySize, 1000);
+    setProperty(PersistentHistory, false);
+    setProperty(IndexHistory, true);
     setProperty(ScrollBarPosition, Enum::ScrollBarRight);
     setProperty(ScrollFullPage, false);
 
     setProperty(FlowControlEnabled, true);
+    setProperty(OutputTimeSlicingEnabled, true);
     setProperty(BlinkingTextEnabled, true);
     setProperty(UnderlineLinksEnabled, true);
     setProperty(OpenLinksByDirectClickEnabled, false);
@@ -195,6 +203,8 @@ FallbackProfile::FallbackProfile()
     setProperty(DefaultEncoding, QString(QTextCodec::codecForLocale()->name()));
     setProperty(AntiAliasFonts, true);
     setProperty(BoldIntense, true);
+    setProperty(CacheGlyphs, false);
+    setProperty(WallpaperTextLayer, false);
 
     // default taken from KDE 3
     setProperty(WordCharacters, ":@-./_~?&=%+#");
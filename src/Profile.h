@@ -145,6 +145,19 @@ public:
          * FixedSizeHistory
          */
         HistorySize,
+        /** (bool) Specifies whether the output of terminal sessions using
+         * this profile is kept in files, so that it is still available
+         * when the sessions are restored after Konsole is restarted.
+         * Has no effect if the HistoryMode property is NoHistory
+         */
+        PersistentHistory,
+        /** (bool) Specifies whether the text in the history of terminal
+         * sessions using this profile is indexed, so that searches for
+         * literal text can skip the parts of the history which do not
+         * contain it.  The index uses some memory, so it is only kept for
+         * sessions whose history can grow large.
+         */
+        IndexHistory,
         /** (ScrollBarPositionEnum) Specifies the position of the scroll bar
          * in terminal displays using this profile.
          *
@@ -228,6 +241,19 @@ public:
         /** (bool) Whether character with intense colors should be rendered
          * in bold font or just in bright color. */
         BoldIntense,
+        /** (bool) Whether text is drawn by copying the glyphs of its
+         * characters from a cache instead of laying it out each time.
+         * Cached glyphs lose sub-pixel anti-aliasing, so this is off by
+         * default.  See TerminalDisplay::setGlyphCacheEnabled()
+         */
+        CacheGlyphs,
+        /** (bool) Whether the text over a wallpaper is drawn into a layer
+         * which is moved when the text scrolls, instead of drawing the
+         * scrolled lines again.  Text in the layer loses sub-pixel
+         * anti-aliasing, so this is off by default.
+         * See TerminalDisplay::setWallpaperTextLayerEnabled()
+         */
+        WallpaperTextLayer,
         /** (bool) Whether new sessions should be started in the same
          * directory as the currently active session.
          */
@@ -253,7 +279,12 @@ public:
         /** (bool) If true, mouse wheel scroll with Ctrl key pressed
          * increases/decreases the terminal font size.
          */
-        MouseWheelZoomEnabled
+        MouseWheelZoomEnabled,
+        /** (bool) If true, large amounts of output from the terminal
+         * program are processed a slice at a time, so that the window stays
+         * responsive while a session is flooded with output.
+         */
+        OutputTimeSlicingEnabled
     };
 
     /**
@@ -446,6 +477,11 @@ public:
         return property<bool>(Profile::FlowControlEnabled);
     }
 
+    /** Convenience method for property<bool>(Profile::OutputTimeSlicingEnabled) */
+    bool outputTimeSlicingEnabled() const {
+        return property<bool>(Profile::OutputTimeSlicingEnabled);
+    }
+
     /** Convenience method for property<bool>(Profile::UseCustomCursorColor) */
     bool useCustomCursorColor() const {
         return property<bool>(Profile::UseCustomCursorColor);
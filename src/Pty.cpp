@@ -119,6 +119,11 @@ void Pty::setFlowControlEnabled(bool enable)
     }
 }
 
+void Pty::setReadingSuspended(bool suspended)
+{
+    pty()->setSuspended(suspended);
+}
+
 bool Pty::flowControlEnabled() const
 {
     if (pty()->masterFd() >= 0) {
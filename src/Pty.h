@@ -103,6 +103,13 @@ public:
     /** Queries the terminal state and returns true if Xon/Xoff flow control is enabled. */
     bool flowControlEnabled() const;
 
+    /**
+     * Stops or resumes reading output from the terminal program.  While
+     * reading is suspended, the program is blocked once the pty's buffer
+     * is full, rather than output piling up in memory.
+     */
+    void setReadingSuspended(bool suspended);
+
     /**
      * Sets the size of the window (in columns and lines of characters)
      * used by this teletype.
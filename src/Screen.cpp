@@ -30,6 +30,7 @@
 #include "konsole_wcwidth.h"
 #include "TerminalCharacterDecoder.h"
 #include "History.h"
+#include "HistoryIndex.h"
 #include "ExtendedCharTable.h"
 
 using namespace Konsole;
@@ -61,10 +62,20 @@ Screen::Screen(int lines, int columns):
     _lines(lines),
     _columns(columns),
     _screenLines(new ImageLine[_lines + 1]),
-    _screenLinesSize(_lines),
+    _screenLinesSize(_lines + 1),
+    _screenLinesOffset(0),
     _scrolledLines(0),
     _droppedLines(0),
+    _historyGeneration(0),
+    _lineDamage(lines),
+    _damagedTopLine(0),
+    _damagedBottomLine(lines - 1),
+    _damagedCursorX(0),
+    _damagedCursorY(0),
     _history(new HistoryScrollNone()),
+    _reflowedHistory(new ReflowedHistory(_history)),
+    _reflowLines(false),
+    _historyIndex(0),
     _cuX(0),
     _cuY(0),
     _currentRendition(DEFAULT_RENDITION),
@@ -74,14 +85,23 @@ Screen::Screen(int lines, int columns):
     _selTopLeft(0),
     _selBottomRight(0),
     _blockSelectionMode(false),
-    _effectiveForeground(CharacterColor()),
-    _effectiveBackground(CharacterColor()),
-    _effectiveRendition(DEFAULT_RENDITION),
+    _effectiveStyle(0),
+    _reversedStyleSource(~0u),
+    _reversedStyle(0),
     _lastPos(-1)
 {
+    _lastHistoryReflow.generation = -1;
+    _lastHistoryReflow.firstLine = 0;
+    _lastHistoryReflow.endLine = 0;
+    _lastHistoryReflow.lineDelta = 0;
+
     _lineProperties.resize(_lines + 1);
-    for (int i = 0; i < _lines + 1; i++)
+    for (int i = 0; i < _lines + 1; i++) {
         _lineProperties[i] = LINE_DEFAULT;
+        // reserving the capacity lets cleared lines keep their memory,
+        // so that scrolling reuses lines instead of reallocating them
+        _screenLines[i].reserve(_columns);
+    }
 
     initTabStops();
     clearSelection();
@@ -91,6 +111,8 @@ Screen::Screen(int lines, int columns):
 Screen::~Screen()
 {
     delete[] _screenLines;
+    delete _historyIndex;
+    delete _reflowedHistory;
     delete _history;
 }
 
@@ -194,29 +216,32 @@ void Screen::deleteChars(int n)
         n = 1;
 
     // if cursor is beyond the end of the line there is nothing to do
-    if (_cuX >= _screenLines[_cuY].count())
+    if (_cuX >= screenLine(_cuY).count())
         return;
 
-    if (_cuX + n > _screenLines[_cuY].count())
-        n = _screenLines[_cuY].count() - _cuX;
+    if (_cuX + n > screenLine(_cuY).count())
+        n = screenLine(_cuY).count() - _cuX;
 
     Q_ASSERT(n >= 0);
-    Q_ASSERT(_cuX + n <= _screenLines[_cuY].count());
+    Q_ASSERT(_cuX + n <= screenLine(_cuY).count());
 
-    _screenLines[_cuY].remove(_cuX, n);
+    screenLine(_cuY).remove(_cuX, n);
+    addDamage(_cuY, _cuX, _columns - 1);
 }
 
 void Screen::insertChars(int n)
 {
     if (n == 0) n = 1; // Default
 
-    if (_screenLines[_cuY].size() < _cuX)
-        _screenLines[_cuY].resize(_cuX);
+    if (screenLine(_cuY).size() < _cuX)
+        screenLine(_cuY).resize(_cuX);
+
+    screenLine(_cuY).insert(_cuX, n, Character(' '));
 
-    _screenLines[_cuY].insert(_cuX, n, Character(' '));
+    if (screenLine(_cuY).count() > _columns)
+        screenLine(_cuY).resize(_columns);
 
-    if (_screenLines[_cuY].count() > _columns)
-        _screenLines[_cuY].resize(_columns);
+    addDamage(_cuY, qMin(_cuX, _columns - 1), _columns - 1);
 }
 
 void Screen::deleteLines(int n)
@@ -239,6 +264,9 @@ void Screen::setMode(int m)
         _cuX = 0;
         _cuY = _topMargin;
         break; //FIXME: home
+    case MODE_Screen :
+        damageAll();
+        break;
     }
 }
 
@@ -250,6 +278,9 @@ void Screen::resetMode(int m)
         _cuX = 0;
         _cuY = 0;
         break; //FIXME: home
+    case MODE_Screen :
+        damageAll();
+        break;
     }
 }
 
@@ -261,6 +292,8 @@ void Screen::saveMode(int m)
 void Screen::restoreMode(int m)
 {
     _currentModes[m] = _savedModes[m];
+    if (m == MODE_Screen)
+        damageAll();
 }
 
 bool Screen::getMode(int m) const
@@ -291,6 +324,12 @@ void Screen::resizeImage(int new_lines, int new_columns)
 {
     if ((new_lines == _lines) && (new_columns == _columns)) return;
 
+    if (_reflowLines && new_columns != _columns) {
+        _reflowedHistory->setColumns(new_columns, new_lines);
+        reflowScreen(new_columns);
+        _historyGeneration++;
+    }
+
     if (_cuY > new_lines - 1) {
         // attempt to preserve focus and _lines
         _bottomMargin = _lines - 1; //FIXME: margin lost
@@ -304,19 +343,27 @@ void Screen::resizeImage(int new_lines, int new_columns)
 
     ImageLine* newScreenLines = new ImageLine[new_lines + 1];
     for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
-        newScreenLines[i] = _screenLines[i];
+        qSwap(newScreenLines[i], screenLine(i));
     for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
         newScreenLines[i].resize(new_columns);
+    for (int i = 0; i < new_lines + 1; i++)
+        newScreenLines[i].reserve(new_columns);
 
-    _lineProperties.resize(new_lines + 1);
+    QVarLengthArray<LineProperty, 64> newLineProperties(new_lines + 1);
+    for (int i = 0; i < qMin(_lines, new_lines + 1); i++)
+        newLineProperties[i] = lineProperty(i);
     for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        _lineProperties[i] = LINE_DEFAULT;
+        newLineProperties[i] = LINE_DEFAULT;
+    _lineProperties = newLineProperties;
+
+    _lineDamage.fill(LineDamage(), new_lines);
 
     clearSelection();
 
     delete[] _screenLines;
     _screenLines = newScreenLines;
-    _screenLinesSize = new_lines;
+    _screenLinesSize = new_lines + 1;
+    _screenLinesOffset = 0;
 
     _lines = new_lines;
     _columns = new_columns;
@@ -328,6 +375,163 @@ void Screen::resizeImage(int new_lines, int new_columns)
     _bottomMargin = _lines - 1;
     initTabStops();
     clearSelection();
+    damageAll();
+}
+
+void Screen::setReflowLines(bool reflow)
+{
+    _reflowLines = reflow;
+}
+
+void Screen::reflowScreen(int newColumns)
+{
+    // empty lines after the cursor are not kept
+    int lastLine = _cuY;
+    for (int line = _lines - 1; line > _cuY; line--) {
+        if (!screenLine(line).isEmpty()) {
+            lastLine = line;
+            break;
+        }
+    }
+
+    QVector<ImageLine> rows;
+    QVector<LineProperty> rowProperties;
+    int cursorRow = 0;
+    int cursorColumn = 0;
+
+    int line = 0;
+    while (line <= lastLine) {
+        // join the lines which make up one line of output
+        const LineProperty properties = lineProperty(line) & ~LINE_WRAPPED;
+        ImageLine text;
+        int cursorOffset = -1;
+        bool wrapped = false;
+        do {
+            // wrapped lines fill the width of the screen, except for the last
+            // column when a double width character did not fit into it
+            const ImageLine& lineText = screenLine(line);
+            const bool wideStart = lineText.size() > 1 && !lineText[1].isRealCharacter &&
+                                   lineText[1].character == 0;
+            while (text.size() % _columns != 0 &&
+                    !(wideStart && text.size() % _columns == _columns - 1))
+                text.append(Screen::DefaultChar);
+
+            if (line == _cuY)
+                cursorOffset = text.size() + _cuX;
+            text += screenLine(line);
+            wrapped = lineProperty(line) & LINE_WRAPPED;
+            line++;
+        } while (wrapped && line <= lastLine);
+
+        // a double width character which does not fit at the end of a row
+        // starts the next row, as it does when it is written
+        QVector<int> rowStarts;
+        int start = 0;
+        do {
+            int end = qMin(start + newColumns, text.size());
+            if (end < text.size() && end - start > 1 &&
+                    !text[end].isRealCharacter && text[end].character == 0)
+                end--;
+
+            rowStarts << start;
+            start = end;
+        } while (start < text.size());
+
+        const int rowCount = rowStarts.size();
+        for (int row = 0; row < rowCount; row++) {
+            const int end = (row < rowCount - 1) ? rowStarts[row + 1] : text.size();
+            rows << text.mid(rowStarts[row], end - rowStarts[row]);
+            const bool lastRow = (row == rowCount - 1);
+            rowProperties << LineProperty(properties | ((!lastRow || wrapped) ? LINE_WRAPPED : 0));
+        }
+
+        if (cursorOffset >= 0) {
+            int row = rowCount - 1;
+            while (row > 0 && rowStarts[row] > cursorOffset)
+                row--;
+            cursorRow = rows.size() - rowCount + row;
+            cursorColumn = qMin(cursorOffset - rowStarts[row], newColumns - 1);
+        }
+    }
+
+    // move the lines which no longer fit into the history, keeping the
+    // line with the cursor on the screen
+    const int movedLines = qMin(qMax(0, rows.size() - _lines), cursorRow);
+    if (hasScroll()) {
+        for (int row = 0; row < movedLines; row++)
+            addToHistory(rows[row], rowProperties[row] & LINE_WRAPPED);
+    }
+
+    for (int line = 0; line < _lines; line++) {
+        const int row = line + movedLines;
+        if (row < rows.size()) {
+            screenLine(line) = rows[row];
+            lineProperty(line) = rowProperties[row];
+        } else {
+            screenLine(line).clear();
+            lineProperty(line) = LINE_DEFAULT;
+        }
+    }
+
+    _cuX = cursorColumn;
+    _cuY = cursorRow - movedLines;
+}
+
+int Screen::reflowHistory(int line, int* column)
+{
+    const int historyLines = _reflowedHistory->getLines();
+    const int storedLines = _reflowedHistory->storedLines();
+    const int reflowedLine = _reflowedHistory->reflow(line, column);
+
+    if (_reflowedHistory->storedLines() != storedLines) {
+        _historyGeneration++;
+
+        _lastHistoryReflow.generation = _historyGeneration;
+        _lastHistoryReflow.firstLine = _reflowedHistory->storedLines();
+        _lastHistoryReflow.endLine = storedLines;
+        _lastHistoryReflow.lineDelta = _reflowedHistory->getLines() - historyLines;
+
+        // the selection refers to lines by their position, so it is moved
+        // along with them.  A block selection no longer covers the same
+        // text once its lines are rewrapped
+        if (_selBegin != -1 && _blockSelectionMode) {
+            clearSelection();
+        } else if (_selBegin != -1) {
+            const bool beginIsTL = (_selBegin == _selTopLeft);
+            _selTopLeft = rewrappedLocation(_selTopLeft, _lastHistoryReflow.firstLine,
+                                            storedLines, _lastHistoryReflow.lineDelta);
+            _selBottomRight = rewrappedLocation(_selBottomRight, _lastHistoryReflow.firstLine,
+                                                storedLines, _lastHistoryReflow.lineDelta);
+            _selBegin = beginIsTL ? _selTopLeft : _selBottomRight;
+        }
+    }
+
+    return reflowedLine;
+}
+
+int Screen::rewrappedLocation(int location, int firstLine, int endLine, int lineDelta) const
+{
+    const int line = location / _columns;
+    int column = location % _columns;
+
+    if (line < firstLine)
+        return location;
+    if (line >= endLine)
+        return loc(column, line + lineDelta);
+
+    // past the end of the line of output the column may not fit
+    const int rewrappedLine = _reflowedHistory->rewrappedPosition(line, &column);
+    return loc(qMin(column, _columns - 1), rewrappedLine);
+}
+
+Screen::HistoryReflow Screen::lastHistoryReflow() const
+{
+    return _lastHistoryReflow;
+}
+
+int Screen::rewrappedHistoryLine(int line, int* column) const
+{
+    return _reflowedHistory->rewrappedPosition(line, column);
 }
 
 void Screen::setDefaultMargins()
@@ -372,37 +576,49 @@ void Screen::setDefaultMargins()
 
 void Screen::reverseRendition(Character& p) const
 {
-    CharacterColor f = p.foregroundColor;
-    CharacterColor b = p.backgroundColor;
+    // neighbouring cells usually share a style, so remember the last
+    // reversed style instead of looking it up for every cell
+    if (p.styleIndex() != _reversedStyleSource) {
+        const CharacterStyle& style = p.style();
+        _reversedStyleSource = p.styleIndex();
+        _reversedStyle = CharacterStyleTable::styleIndex(style.backgroundColor,
+                         style.foregroundColor,
+                         style.rendition); //p->r &= ~RE_TRANSPARENT;
+    }
 
-    p.foregroundColor = b;
-    p.backgroundColor = f; //p->r &= ~RE_TRANSPARENT;
+    p.setStyleIndex(_reversedStyle);
 }
 
 void Screen::updateEffectiveRendition()
 {
-    _effectiveRendition = _currentRendition;
+    CharacterColor effectiveForeground;
+    CharacterColor effectiveBackground;
+
     if (_currentRendition & RE_REVERSE) {
-        _effectiveForeground = _currentBackground;
-        _effectiveBackground = _currentForeground;
+        effectiveForeground = _currentBackground;
+        effectiveBackground = _currentForeground;
     } else {
-        _effectiveForeground = _currentForeground;
-        _effectiveBackground = _currentBackground;
+        effectiveForeground = _currentForeground;
+        effectiveBackground = _currentBackground;
     }
 
     if (_currentRendition & RE_BOLD)
-        _effectiveForeground.setIntensive();
+        effectiveForeground.setIntensive();
+
+    _effectiveStyle = CharacterStyleTable::styleIndex(effectiveForeground,
+                      effectiveBackground,
+                      _currentRendition);
 }
 
 void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 {
-    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _history->getLines());
+    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _reflowedHistory->getLines());
 
     for (int line = startLine; line < startLine + count; line++) {
-        const int length = qMin(_columns, _history->getLineLen(line));
+        const int length = qMin(_columns, _reflowedHistory->getLineLen(line));
         const int destLineOffset  = (line - startLine) * _columns;
 
-        _history->getCells(line, 0, length, dest + destLineOffset);
+        _reflowedHistory->getCells(line, 0, length, dest + destLineOffset);
 
         for (int column = length; column < _columns; column++)
             dest[destLineOffset + column] = Screen::DefaultChar;
@@ -423,18 +639,21 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
     Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _lines);
 
     for (int line = startLine; line < (startLine + count) ; line++) {
-        int srcLineStartIndex  = line * _columns;
-        int destLineStartIndex = (line - startLine) * _columns;
-
-        for (int column = 0; column < _columns; column++) {
-            int srcIndex = srcLineStartIndex + column;
-            int destIndex = destLineStartIndex + column;
+        const ImageLine& sourceLine = screenLine(line);
+        const int length = qMin(_columns, sourceLine.count());
+        Character* const destLine = dest + (line - startLine) * _columns;
 
-            dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, Screen::DefaultChar);
+        // lines only extend as far as their last written character
+        memcpy(destLine, sourceLine.constData(), length * sizeof(Character));
+        for (int column = length; column < _columns; column++)
+            destLine[column] = Screen::DefaultChar;
 
-            // invert selected text
-            if (_selBegin != -1 && isSelected(column, line + _history->getLines()))
-                reverseRendition(dest[destIndex]);
+        // invert selected text
+        if (_selBegin != -1) {
+            for (int column = 0; column < _columns; column++) {
+                if (isSelected(column, line + _reflowedHistory->getLines()))
+                    reverseRendition(destLine[column]);
+            }
         }
     }
 }
@@ -442,14 +661,14 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
 void Screen::getImage(Character* dest, int size, int startLine, int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _reflowedHistory->getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
 
     Q_ASSERT(size >= mergedLines * _columns);
     Q_UNUSED(size);
 
-    const int linesInHistoryBuffer = qBound(0, _history->getLines() - startLine, mergedLines);
+    const int linesInHistoryBuffer = qBound(0, _reflowedHistory->getLines() - startLine, mergedLines);
     const int linesInScreenBuffer = mergedLines - linesInHistoryBuffer;
 
     // copy _lines from history buffer
@@ -459,7 +678,7 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
     // copy _lines from screen buffer
     if (linesInScreenBuffer > 0)
         copyFromScreen(dest + linesInHistoryBuffer * _columns,
-                       startLine + linesInHistoryBuffer - _history->getLines(),
+                       startLine + linesInHistoryBuffer - _reflowedHistory->getLines(),
                        linesInScreenBuffer);
 
     // invert display when in screen mode
@@ -468,19 +687,22 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
             reverseRendition(dest[i]); // for reverse display
     }
 
-    // mark the character at the current cursor position
-    int cursorIndex = loc(_cuX, _cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines)
-        dest[cursorIndex].rendition |= RE_CURSOR;
+    // mark the character at the current cursor position, if the cursor
+    // is within the requested lines
+    const int cursorLine = _reflowedHistory->getLines() + _cuY - startLine;
+    if (getMode(MODE_Cursor) && cursorLine >= 0 && cursorLine < mergedLines) {
+        const int cursorIndex = loc(qMin(_cuX, _columns - 1), cursorLine);
+        dest[cursorIndex].setRendition(dest[cursorIndex].rendition() | RE_CURSOR);
+    }
 }
 
 QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _reflowedHistory->getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
-    const int linesInHistory = qBound(0, _history->getLines() - startLine, mergedLines);
+    const int linesInHistory = qBound(0, _reflowedHistory->getLines() - startLine, mergedLines);
     const int linesInScreen = mergedLines - linesInHistory;
 
     QVector<LineProperty> result(mergedLines);
@@ -489,16 +711,16 @@ QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) con
     // copy properties for _lines in history
     for (int line = startLine; line < startLine + linesInHistory; line++) {
         //TODO Support for line properties other than wrapped _lines
-        if (_history->isWrappedLine(line)) {
+        if (_reflowedHistory->isWrappedLine(line)) {
             result[index] = (LineProperty)(result[index] | LINE_WRAPPED);
         }
         index++;
     }
 
     // copy properties for _lines in screen buffer
-    const int firstScreenLine = startLine + linesInHistory - _history->getLines();
+    const int firstScreenLine = startLine + linesInHistory - _reflowedHistory->getLines();
     for (int line = firstScreenLine; line < firstScreenLine + linesInScreen; line++) {
-        result[index] = _lineProperties[line];
+        result[index] = lineProperty(line);
         index++;
     }
 
@@ -541,13 +763,14 @@ void Screen::backspace()
     _cuX = qMin(_columns - 1, _cuX); // nowrap!
     _cuX = qMax(0, _cuX - 1);
 
-    if (_screenLines[_cuY].size() < _cuX + 1)
-        _screenLines[_cuY].resize(_cuX + 1);
+    if (screenLine(_cuY).size() < _cuX + 1)
+        screenLine(_cuY).resize(_cuX + 1);
 
     if (BS_CLEARS) {
-        _screenLines[_cuY][_cuX].character = ' ';
-        _screenLines[_cuY][_cuX].rendition = _screenLines[_cuY][_cuX].rendition & ~RE_EXTENDED_CHAR;
+        screenLine(_cuY)[_cuX].character = ' ';
+        screenLine(_cuY)[_cuX].setRendition(screenLine(_cuY)[_cuX].rendition() & ~RE_EXTENDED_CHAR);
     }
+    addDamage(_cuY, _cuX, _cuX);
 }
 
 void Screen::tab(int n)
@@ -612,13 +835,13 @@ void Screen::checkSelection(int from, int to)
 {
     if (_selBegin == -1)
         return;
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _reflowedHistory->getLines());
     //Clear entire selection if it overlaps region [from, to]
     if ((_selBottomRight >= (from + scr_TL)) && (_selTopLeft <= (to + scr_TL)))
         clearSelection();
 }
 
-void Screen::displayCharacter(unsigned short c)
+void Screen::displayCharacter(uint c)
 {
     // Note that VT100 does wrapping BEFORE putting the character.
     // This has impact on the assumption of valid cursor positions.
@@ -629,14 +852,14 @@ void Screen::displayCharacter(unsigned short c)
     if (w < 0)
         return;
     else if (w == 0) {
-        if (QChar(c).category() != QChar::Mark_NonSpacing)
+        if (QChar::category(c) != QChar::Mark_NonSpacing)
             return;
         int charToCombineWithX = -1;
         int charToCombineWithY = -1;
         if (_cuX == 0) {
             // We are at the beginning of a line, check
             // if previous line has a character at the end we can combine with
-            if (_cuY > 0 && _columns == _screenLines[_cuY - 1].size()) {
+            if (_cuY > 0 && _columns == screenLine(_cuY - 1).size()) {
                 charToCombineWithX = _columns - 1;
                 charToCombineWithY = _cuY - 1;
             } else {
@@ -651,35 +874,36 @@ void Screen::displayCharacter(unsigned short c)
         }
 
         // Prevent "cat"ing binary files from causing crashes.
-        if (charToCombineWithX >= _screenLines[charToCombineWithY].size()) {
+        if (charToCombineWithX >= screenLine(charToCombineWithY).size()) {
             return;
         }
 
-        Character& currentChar = _screenLines[charToCombineWithY][charToCombineWithX];
-        if ((currentChar.rendition & RE_EXTENDED_CHAR) == 0) {
-            const ushort chars[2] = { currentChar.character, c };
-            currentChar.rendition |= RE_EXTENDED_CHAR;
+        Character& currentChar = screenLine(charToCombineWithY)[charToCombineWithX];
+        if ((currentChar.rendition() & RE_EXTENDED_CHAR) == 0) {
+            const uint chars[2] = { currentChar.character, c };
+            currentChar.setRendition(currentChar.rendition() | RE_EXTENDED_CHAR);
             currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, 2);
         } else {
             ushort extendedCharLength;
-            const ushort* oldChars = ExtendedCharTable::instance.lookupExtendedChar(currentChar.character, extendedCharLength);
+            const uint* oldChars = ExtendedCharTable::instance.lookupExtendedChar(currentChar.character, extendedCharLength);
             Q_ASSERT(oldChars);
             if (oldChars) {
                 Q_ASSERT(extendedCharLength > 1);
                 Q_ASSERT(extendedCharLength < 65535);
-                ushort* chars = new ushort[extendedCharLength + 1];
-                memcpy(chars, oldChars, sizeof(ushort) * extendedCharLength);
+                uint* chars = new uint[extendedCharLength + 1];
+                memcpy(chars, oldChars, sizeof(uint) * extendedCharLength);
                 chars[extendedCharLength] = c;
                 currentChar.character = ExtendedCharTable::instance.createExtendedChar(chars, extendedCharLength + 1);
                 delete[] chars;
             }
         }
+        addDamage(charToCombineWithY, charToCombineWithX, charToCombineWithX);
         return;
     }
 
     if (_cuX + w > _columns) {
         if (getMode(MODE_Wrap)) {
-            _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | LINE_WRAPPED);
+            lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | LINE_WRAPPED);
             nextLine();
         } else {
             _cuX = _columns - w;
@@ -687,8 +911,8 @@ void Screen::displayCharacter(unsigned short c)
     }
 
     // ensure current line vector has enough elements
-    if (_screenLines[_cuY].size() < _cuX + w) {
-        _screenLines[_cuY].resize(_cuX + w);
+    if (screenLine(_cuY).size() < _cuX + w) {
+        screenLine(_cuY).resize(_cuX + w);
     }
 
     if (getMode(MODE_Insert)) insertChars(w);
@@ -698,12 +922,10 @@ void Screen::displayCharacter(unsigned short c)
     // check if selection is still valid.
     checkSelection(_lastPos, _lastPos);
 
-    Character& currentChar = _screenLines[_cuY][_cuX];
+    Character& currentChar = screenLine(_cuY)[_cuX];
 
     currentChar.character = c;
-    currentChar.foregroundColor = _effectiveForeground;
-    currentChar.backgroundColor = _effectiveBackground;
-    currentChar.rendition = _effectiveRendition;
+    currentChar.setStyleIndex(_effectiveStyle);
     currentChar.isRealCharacter = true;
 
     int i = 0;
@@ -711,21 +933,80 @@ void Screen::displayCharacter(unsigned short c)
     while (w) {
         i++;
 
-        if (_screenLines[_cuY].size() < _cuX + i + 1)
-            _screenLines[_cuY].resize(_cuX + i + 1);
+        if (screenLine(_cuY).size() < _cuX + i + 1)
+            screenLine(_cuY).resize(_cuX + i + 1);
 
-        Character& ch = _screenLines[_cuY][_cuX + i];
+        Character& ch = screenLine(_cuY)[_cuX + i];
         ch.character = 0;
-        ch.foregroundColor = _effectiveForeground;
-        ch.backgroundColor = _effectiveBackground;
-        ch.rendition = _effectiveRendition;
+        ch.setStyleIndex(_effectiveStyle);
         ch.isRealCharacter = false;
 
         w--;
     }
+    addDamage(_cuY, _cuX, newCursorX - 1);
     _cuX = newCursorX;
 }
 
+void Screen::displayCharacters(const uint* chars, int count)
+{
+    // Insert mode is rare enough that it is not worth a separate fast path
+    if (getMode(MODE_Insert)) {
+        for (int i = 0; i < count; i++)
+            displayCharacter(chars[i]);
+        return;
+    }
+
+    int i = 0;
+    while (i < count) {
+        // wrap before putting the next character, as displayCharacter() does
+        if (_cuX >= _columns) {
+            if (getMode(MODE_Wrap)) {
+                lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | LINE_WRAPPED);
+                nextLine();
+            } else {
+                _cuX = _columns - 1;
+            }
+        }
+
+        // find the run of single-width characters which fits on the current line
+        const int available = qMin(_columns - _cuX, count - i);
+        int runLength = 0;
+        while (runLength < available) {
+            const uint c = chars[i + runLength];
+            if ((c < 0x20 || c >= 0x7f) && konsole_wcwidth(c) != 1)
+                break;
+            runLength++;
+        }
+
+        // wide characters, combining characters and the like
+        if (runLength == 0) {
+            displayCharacter(chars[i]);
+            i++;
+            continue;
+        }
+
+        ImageLine& line = screenLine(_cuY);
+        if (line.size() < _cuX + runLength)
+            line.resize(_cuX + runLength);
+
+        _lastPos = loc(_cuX + runLength - 1, _cuY);
+
+        // check if selection is still valid.
+        checkSelection(loc(_cuX, _cuY), _lastPos);
+
+        Character* cell = line.data() + _cuX;
+        for (int j = 0; j < runLength; j++) {
+            cell[j].character = chars[i + j];
+            cell[j].setStyleIndex(_effectiveStyle);
+            cell[j].isRealCharacter = true;
+        }
+        addDamage(_cuY, _cuX, _cuX + runLength - 1);
+
+        _cuX += runLength;
+        i += runLength;
+    }
+}
+
 int Screen::scrolledLines() const
 {
     return _scrolledLines;
@@ -743,6 +1024,36 @@ void Screen::resetScrolledLines()
     _scrolledLines = 0;
 }
 
+LineDamage Screen::lineDamage(int line) const
+{
+    Q_ASSERT(line >= 0 && line < _lines);
+
+    if (line >= _damagedTopLine && line <= _damagedBottomLine)
+        return LineDamage(0, _columns - 1);
+
+    LineDamage damage = _lineDamage[line];
+
+    // the cursor is drawn as part of the image, see getImage()
+    if (line == _damagedCursorY)
+        damage.add(_damagedCursorX, _damagedCursorX);
+    if (line == _cuY) {
+        const int cursorX = qMin(_cuX, _columns - 1);
+        damage.add(cursorX, cursorX);
+    }
+
+    return damage;
+}
+
+void Screen::resetDamage()
+{
+    _lineDamage.fill(LineDamage());
+    _damagedTopLine = _lines;
+    _damagedBottomLine = -1;
+
+    _damagedCursorX = qMin(_cuX, _columns - 1);
+    _damagedCursorY = _cuY;
+}
+
 void Screen::scrollUp(int n)
 {
     if (n == 0) n = 1; // Default
@@ -831,7 +1142,7 @@ int Screen::getCursorY() const
 
 void Screen::clearImage(int loca, int loce, char c)
 {
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _reflowedHistory->getLines());
     //FIXME: check positions
 
     //Clear entire selection if it overlaps region to be moved...
@@ -849,12 +1160,14 @@ void Screen::clearImage(int loca, int loce, char c)
     const bool isDefaultCh = (clearCh == Screen::DefaultChar);
 
     for (int y = topLine; y <= bottomLine; y++) {
-        _lineProperties[y] = 0;
+        lineProperty(y) = 0;
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
 
-        QVector<Character>& line = _screenLines[y];
+        addDamage(y, startCol, endCol);
+
+        QVector<Character>& line = screenLine(y);
 
         if (isDefaultCh && endCol == _columns - 1) {
             line.resize(startCol);
@@ -875,20 +1188,40 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
     const int lines = (sourceEnd - sourceBegin) / _columns;
 
+    const int destLine = dest / _columns;
+    const int sourceLine = sourceBegin / _columns;
+
+    addLinesDamage(qMin(destLine, sourceLine), qMax(destLine, sourceLine) + lines);
+
     //move screen image and line properties:
-    //the source and destination areas of the image may overlap,
-    //so it matters that we do the copy in the right order -
-    //forwards if dest < sourceBegin or backwards otherwise.
-    //(search the web for 'memmove implementation' for details)
-    if (dest < sourceBegin) {
+    if (destLine == 0 && sourceLine + lines == _lines - 1) {
+        //the whole screen is scrolled up, which is by far the most common
+        //case, so rotate the circular line buffer instead of moving lines.
+        //the lines at the bottom then hold the lines which were scrolled
+        //off the top, which the caller clears and thereby reuses.
+        _screenLinesOffset = lineIndex(sourceLine);
+
+        //the spare line after the last screen line should stay where it
+        //was, so swap it back with the line that took its place
+        qSwap(screenLine(_lines), screenLine(_lines - sourceLine));
+        qSwap(lineProperty(_lines), lineProperty(_lines - sourceLine));
+    } else if (destLine < sourceLine) {
+        //the source and destination areas of the image may overlap,
+        //so it matters that we do the copy in the right order -
+        //forwards if dest < sourceBegin or backwards otherwise.
+        //(search the web for 'memmove implementation' for details)
+        //
+        //lines are swapped rather than assigned so that no line data is
+        //shared or reallocated.  the vacated lines end up holding the
+        //old contents of the destination area, which the caller clears.
         for (int i = 0; i <= lines; i++) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            qSwap(screenLine(destLine + i), screenLine(sourceLine + i));
+            lineProperty(destLine + i) = lineProperty(sourceLine + i);
         }
     } else {
         for (int i = lines; i >= 0; i--) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            qSwap(screenLine(destLine + i), screenLine(sourceLine + i));
+            lineProperty(destLine + i) = lineProperty(sourceLine + i);
         }
     }
 
@@ -903,7 +1236,7 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
     if (_selBegin != -1) {
         const bool beginIsTL = (_selBegin == _selTopLeft);
         const int diff = dest - sourceBegin; // Scroll by this amount
-        const int scr_TL = loc(0, _history->getLines());
+        const int scr_TL = loc(0, _reflowedHistory->getLines());
         const int srca = sourceBegin + scr_TL; // Translate index from screen to global
         const int srce = sourceEnd + scr_TL; // Translate index from screen to global
         const int desta = srca + diff;
@@ -1020,6 +1353,10 @@ void Screen::setBackColor(int space, int color)
 
 void Screen::clearSelection()
 {
+    // the selection is drawn as part of the image, see getImage()
+    if (_selBegin != -1)
+        damageAll();
+
     _selBottomRight = -1;
     _selTopLeft = -1;
     _selBegin = -1;
@@ -1054,6 +1391,8 @@ void Screen::setSelectionStart(const int x, const int y, const bool blockSelecti
     _selBottomRight = _selBegin;
     _selTopLeft = _selBegin;
     _blockSelectionMode = blockSelectionMode;
+
+    damageAll();
 }
 
 void Screen::setSelectionEnd(const int x, const int y)
@@ -1085,6 +1424,8 @@ void Screen::setSelectionEnd(const int x, const int y)
         _selTopLeft = loc(qMin(topColumn, bottomColumn), topRow);
         _selBottomRight = loc(qMax(topColumn, bottomColumn), bottomRow);
     }
+
+    damageAll();
 }
 
 bool Screen::isSelected(const int x, const int y) const
@@ -1196,8 +1537,8 @@ int Screen::copyLineToStream(int line ,
     LineProperty currentLineProperties = 0;
 
     //determine if the line is in the history buffer or the screen image
-    if (line < _history->getLines()) {
-        const int lineLength = _history->getLineLen(line);
+    if (line < _reflowedHistory->getLines()) {
+        const int lineLength = _reflowedHistory->getLineLen(line);
 
         // ensure that start position is before end of line
         start = qMin(start, qMax(0, lineLength - 1));
@@ -1214,11 +1555,11 @@ int Screen::copyLineToStream(int line ,
         // safety checks
         Q_ASSERT(start >= 0);
         Q_ASSERT(count >= 0);
-        Q_ASSERT((start + count) <= _history->getLineLen(line));
+        Q_ASSERT((start + count) <= _reflowedHistory->getLineLen(line));
 
-        _history->getCells(line, start, count, characterBuffer);
+        _reflowedHistory->getCells(line, start, count, characterBuffer);
 
-        if (_history->isWrappedLine(line))
+        if (_reflowedHistory->isWrappedLine(line))
             currentLineProperties |= LINE_WRAPPED;
     } else {
         if (count == -1)
@@ -1226,17 +1567,17 @@ int Screen::copyLineToStream(int line ,
 
         Q_ASSERT(count >= 0);
 
-        int screenLine = line - _history->getLines();
+        int lineInScreen = line - _reflowedHistory->getLines();
 
-        Q_ASSERT(screenLine <= _screenLinesSize);
+        Q_ASSERT(lineInScreen <= _lines);
 
-        screenLine = qMin(screenLine, _screenLinesSize);
+        lineInScreen = qMin(lineInScreen, _lines);
 
-        Character* data = _screenLines[screenLine].data();
-        int length = _screenLines[screenLine].count();
+        const Character* data = screenLine(lineInScreen).constData();
+        int length = screenLine(lineInScreen).count();
 
         // Don't remove end spaces in lines that wrap
-        if (trimTrailingSpaces && !(_lineProperties[screenLine] & LINE_WRAPPED))
+        if (trimTrailingSpaces && !(lineProperty(lineInScreen) & LINE_WRAPPED))
         {
             // ignore trailing white space at the end of the line
             for (int i = length-1; i >= 0; i--)
@@ -1256,8 +1597,8 @@ int Screen::copyLineToStream(int line ,
         // count cannot be any greater than length
         count = qBound(0, count, length - start);
 
-        Q_ASSERT(screenLine < _lineProperties.count());
-        currentLineProperties |= _lineProperties[screenLine];
+        Q_ASSERT(lineInScreen <= _lines);
+        currentLineProperties |= lineProperty(lineInScreen);
     }
 
     if (appendNewLine && (count + 1 < MAX_CHARS)) {
@@ -1290,19 +1631,31 @@ void Screen::addHistLine()
     // we have to take care about scrolling, too...
 
     if (hasScroll()) {
-        const int oldHistLines = _history->getLines();
+        const int oldHistLines = _reflowedHistory->getLines();
+        const int oldStoredLines = _history->getLines();
+
+        // rewrapped lines can no longer be mapped, see rewrappedHistoryLine()
+        _lastHistoryReflow.generation = -1;
+
+        addToHistory(screenLine(0), lineProperty(0) & LINE_WRAPPED);
 
-        _history->addCellsVector(_screenLines[0]);
-        _history->addLine(_lineProperties[0] & LINE_WRAPPED);
+        const int newHistLines = _reflowedHistory->getLines();
 
-        const int newHistLines = _history->getLines();
+        // the line was added to the last rewrapped line without dropping
+        // any, but it is counted below as dropped to keep the window steady
+        if (newHistLines <= oldHistLines && _history->getLines() > oldStoredLines)
+            _historyGeneration++;
 
         const bool beginIsTL = (_selBegin == _selTopLeft);
 
         // If the history is full, increment the count
-        // of dropped _lines
-        if (newHistLines == oldHistLines)
-            _droppedLines++;
+        // of dropped _lines.  A line added to a rewrapped line of the
+        // history may also not add a line, see ReflowedHistory
+        if (newHistLines <= oldHistLines) {
+            _droppedLines += oldHistLines + 1 - newHistLines;
+            if (newHistLines < oldHistLines)
+                clearSelection();
+        }
 
         // Adjust selection for the new point of reference
         if (newHistLines > oldHistLines) {
@@ -1337,15 +1690,27 @@ void Screen::addHistLine()
     }
 }
 
+void Screen::addToHistory(const ImageLine& line, bool wrapped)
+{
+    _reflowedHistory->addLine(line, wrapped);
+
+    if (_historyIndex)
+        _historyIndex->addLine(line.constData(), line.size(), wrapped, _history->getLines());
+}
+
 int Screen::getHistLines() const
 {
-    return _history->getLines();
+    return _reflowedHistory->getLines();
 }
 
-void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
+int Screen::historyGeneration() const
 {
-    clearSelection();
+    return _historyGeneration;
+}
 
+void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
+{
+    const int oldLines = _history->getLines();
     if (copyPreviousScroll) {
         _history = t.scroll(_history);
     } else {
@@ -1353,6 +1718,25 @@ void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
         _history = t.scroll(0);
         delete oldScroll;
     }
+
+    _reflowedHistory->setHistory(_history);
+    _historyGeneration++;
+
+    // the selection still holds if all of the lines were kept, as they are
+    // when the history is only moved to a different kind of storage
+    if (!copyPreviousScroll || _history->getLines() != oldLines)
+        clearSelection();
+
+    // the index still holds if the last lines of the history were kept
+    if (_historyIndex) {
+        const int lines = _history->getLines();
+        if (copyPreviousScroll && lines <= oldLines) {
+            _historyIndex->setLineCount(lines);
+        } else {
+            delete _historyIndex;
+            _historyIndex = new HistoryIndex(lines);
+        }
+    }
 }
 
 bool Screen::hasScroll() const
@@ -1365,12 +1749,49 @@ const HistoryType& Screen::getScroll() const
     return _history->getType();
 }
 
+qint64 Screen::historyMemoryUsage() const
+{
+    qint64 usage = _history->memoryUsage() + _reflowedHistory->memoryUsage();
+    if (_historyIndex)
+        usage += _historyIndex->memoryUsage();
+    return usage;
+}
+
+void Screen::setHistoryIndexEnabled(bool enable)
+{
+    if (enable == (_historyIndex != 0))
+        return;
+
+    if (enable) {
+        _historyIndex = new HistoryIndex(_history->getLines());
+    } else {
+        delete _historyIndex;
+        _historyIndex = 0;
+    }
+}
+
+bool Screen::historyMayContain(const QString& text, int startLine, int endLine) const
+{
+    if (!_historyIndex || endLine >= _reflowedHistory->getLines())
+        return true;
+
+    int firstLine = 0;
+    int lastLine = 0;
+    int unused = 0;
+    _reflowedHistory->storedLineRange(startLine, firstLine, unused);
+    _reflowedHistory->storedLineRange(endLine, unused, lastLine);
+
+    return _historyIndex->mayContain(text, firstLine, lastLine);
+}
+
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if (enable)
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | property);
+        lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) | property);
     else
-        _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] & ~property);
+        lineProperty(_cuY) = (LineProperty)(lineProperty(_cuY) & ~property);
+
+    addDamage(_cuY, 0, _columns - 1);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
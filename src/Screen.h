@@ -32,6 +32,7 @@
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 #define MODE_Origin    0
 #define MODE_Wrap      1
@@ -47,6 +48,8 @@ class TerminalCharacterDecoder;
 class TerminalDisplay;
 class HistoryType;
 class HistoryScroll;
+class ReflowedHistory;
+class HistoryIndex;
 
 /**
     \brief An image of characters with associated attributes.
@@ -71,7 +74,7 @@ class HistoryScroll;
     using selectedText().  When getImage() is used to retrieve the visible image,
     characters which are part of the selection have their colors inverted.
 */
-class Screen
+class KONSOLEPRIVATE_EXPORT Screen
 {
 public:
     /** Construct a new screen image of size @p lines by @p columns. */
@@ -344,7 +347,20 @@ public:
      * is inserted at the current cursor position, otherwise it will replace the
      * character already at the current cursor position.
      */
-    void displayCharacter(unsigned short c);
+    void displayCharacter(uint c);
+
+    /**
+     * Displays a run of @p count characters starting at the current cursor
+     * position, using the current rendition and colors.
+     *
+     * This is equivalent to calling displayCharacter() for each character
+     * in @p chars, but is considerably faster for runs of ordinary single-width
+     * text.  Each line touched by the run is resized and checked against the
+     * selection only once.
+     *
+     * @p chars must not contain control characters.
+     */
+    void displayCharacters(const uint* chars, int count);
 
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
@@ -355,9 +371,68 @@ public:
      * The top and bottom margins are reset to the top and bottom of the new
      * screen size.  Tab stops are also reset and the current selection is
      * cleared.
+     *
+     * If reflowing lines is enabled and the number of columns changes, the
+     * lines of the screen and the history are rewrapped to the new width
+     * instead, see setReflowLines()
      */
     void resizeImage(int new_lines, int new_columns);
 
+    /**
+     * Sets whether lines which were wrapped at the old width are joined up
+     * and wrapped again at the new width when the number of columns
+     * changes.  This is not wanted for screens used by full-screen
+     * applications, which redraw their output themselves.
+     *
+     * The lines of the screen are rewrapped as soon as it is resized, but
+     * those of the history are only rewrapped as they are scrolled into
+     * view, see reflowHistory()
+     */
+    void setReflowLines(bool reflow);
+
+    /**
+     * Rewraps the history lines from @p line onwards to the current width,
+     * if this has not been done already, and returns the position which
+     * the line at @p line has afterwards.  This changes the number of
+     * history lines and so the position of the lines after them.  The
+     * selection moves with the text it holds.
+     *
+     * If @p column is not null, the position of that column of @p line is
+     * returned instead, see ReflowedHistory::reflow()
+     */
+    int reflowHistory(int line, int* column = 0);
+
+    /**
+     * Describes how the last call to reflowHistory() which rewrapped any
+     * lines moved the lines of the history.
+     */
+    struct HistoryReflow {
+        /** The history generation afterwards, see historyGeneration() */
+        int generation;
+        /** The first line which was rewrapped */
+        int firstLine;
+        /** The line after the last line which was rewrapped, before they were rewrapped */
+        int endLine;
+        /** The number of lines which the lines from endLine onwards moved down by */
+        int lineDelta;
+    };
+
+    /**
+     * Returns how the last call to reflowHistory() which rewrapped any lines
+     * moved the lines, so that positions of lines can be updated rather than
+     * found again.  The generation is -1 if no lines have been rewrapped
+     * since lines were last added to the history.
+     */
+    HistoryReflow lastHistoryReflow() const;
+
+    /**
+     * Returns the position which @p line, one of the lines rewrapped by the
+     * last call to reflowHistory(), has afterwards.  This only holds until
+     * further output arrives.  If @p column is not null, it is mapped as
+     * for reflowHistory().
+     */
+    int rewrappedHistoryLine(int line, int* column = 0) const;
+
     /**
      * Returns the current screen image.
      * The result is an array of Characters of size [getLines()][getColumns()] which
@@ -388,14 +463,42 @@ public:
     }
     /** Return the number of lines in the history buffer. */
     int getHistLines() const;
+    /**
+     * Returns a number which changes whenever the lines of the history are
+     * renumbered other than by adding lines to its end or dropping lines
+     * from its start, for example when the history is replaced or its
+     * lines are rewrapped.  Positions of history lines which were found
+     * before the number changed can no longer be relied on.
+     */
+    int historyGeneration() const;
     /**
      * Sets the type of storage used to keep lines in the history.
      * If @p copyPreviousScroll is true then the contents of the previous
-     * history buffer are copied into the new scroll.
+     * history buffer are copied into the new scroll, and the selection is
+     * kept if all of the lines fit into it.
      */
     void setScroll(const HistoryType& , bool copyPreviousScroll = true);
     /** Returns the type of storage used to keep lines in the history. */
     const HistoryType& getScroll() const;
+    /** Returns the approximate number of bytes of memory used by the history. */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Sets whether an index of the text in the history is kept, which lets
+     * searches for literal text skip the parts of the history which do not
+     * contain it, at the cost of some memory.  See historyMayContain()
+     *
+     * Only lines which are added to the history after the index is enabled
+     * are indexed.
+     */
+    void setHistoryIndexEnabled(bool enable);
+    /**
+     * Returns false if @p text is certain not to be found in the lines from
+     * @p startLine to @p endLine inclusive, where lines are numbered as
+     * for getImage().  Always returns true if the history is not indexed,
+     * see setHistoryIndexEnabled(), or if the range includes lines of the
+     * screen.
+     */
+    bool historyMayContain(const QString& text, int startLine, int endLine) const;
     /**
      * Returns true if this screen keeps lines that are scrolled off the screen
      * in a history buffer.
@@ -556,6 +659,19 @@ public:
      */
     void resetDroppedLines();
 
+    /**
+     * Returns the range of columns in @p line which may have changed since
+     * the last call to resetDamage(), including changes to the selection
+     * and the cursor position.
+     *
+     * This allows views to avoid comparing and redrawing lines of the image
+     * which are known to be unchanged.
+     */
+    LineDamage lineDamage(int line) const;
+
+    /** Marks all lines of the screen as unchanged, see lineDamage() */
+    void resetDamage();
+
     /**
       * Fills the buffer @p dest with @p count instances of the default (ie. blank)
       * Character style.
@@ -573,9 +689,9 @@ public:
     QSet<ushort> usedExtendedChars() const {
         QSet<ushort> result;
         for (int i = 0; i < _lines; ++i) {
-            const ImageLine& il = _screenLines[i];
+            const ImageLine& il = screenLine(i);
             for (int j = 0; j < _columns; ++j) {
-                if (il[j].rendition & RE_EXTENDED_CHAR) {
+                if (il[j].rendition() & RE_EXTENDED_CHAR) {
                     result << il[j].character;
                 }
             }
@@ -625,6 +741,17 @@ private:
     TerminalDisplay* _currentTerminalDisplay;
 
     void addHistLine();
+    // adds a line to the end of the history and to its index
+    void addToHistory(const ImageLine& line, bool wrapped);
+
+    // rewraps the lines of the screen to 'newColumns' wide, keeping the
+    // cursor on the same character.  lines which no longer fit on the
+    // screen are moved into the history
+    void reflowScreen(int newColumns);
+    // returns where the selection position 'location' is after the history
+    // lines from 'firstLine' up to 'endLine' were rewrapped, which moved the
+    // lines after them by 'lineDelta', see reflowHistory()
+    int rewrappedLocation(int location, int firstLine, int endLine, int lineDelta) const;
 
     void initTabStops();
 
@@ -648,18 +775,75 @@ private:
     int _columns;
 
     typedef QVector<Character> ImageLine;      // [0..columns]
-    ImageLine*          _screenLines;    // [lines]
-    int _screenLinesSize;                // _screenLines.size()
+
+    // maps a line of the screen to its position in _screenLines and
+    // _lineProperties.  Both are circular buffers starting at
+    // _screenLinesOffset, so that scrolling the whole screen up only
+    // needs to advance the offset rather than move every line.
+    int lineIndex(int line) const {
+        Q_ASSERT(line >= 0 && line < _screenLinesSize);
+        const int index = _screenLinesOffset + line;
+        return index < _screenLinesSize ? index : index - _screenLinesSize;
+    }
+    ImageLine& screenLine(int line) {
+        return _screenLines[lineIndex(line)];
+    }
+    const ImageLine& screenLine(int line) const {
+        return _screenLines[lineIndex(line)];
+    }
+    LineProperty& lineProperty(int line) {
+        return _lineProperties[lineIndex(line)];
+    }
+    LineProperty lineProperty(int line) const {
+        return _lineProperties[lineIndex(line)];
+    }
+
+    ImageLine*          _screenLines;    // [lines + 1]
+    int _screenLinesSize;                // number of entries in _screenLines
+    int _screenLinesOffset;              // position of the first line in _screenLines
 
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    int _historyGeneration;
+    HistoryReflow _lastHistoryReflow;
+
+    // records that the columns from 'startColumn' to 'endColumn' of 'line'
+    // have changed, see lineDamage()
+    void addDamage(int line, int startColumn, int endColumn) {
+        _lineDamage[line].add(startColumn, endColumn);
+    }
+    // records that all lines from 'topLine' to 'bottomLine' have changed
+    void addLinesDamage(int topLine, int bottomLine) {
+        if (_damagedTopLine > _damagedBottomLine) {
+            _damagedTopLine = topLine;
+            _damagedBottomLine = bottomLine;
+        } else {
+            _damagedTopLine = qMin(_damagedTopLine, topLine);
+            _damagedBottomLine = qMax(_damagedBottomLine, bottomLine);
+        }
+    }
+    void damageAll() {
+        addLinesDamage(0, _lines - 1);
+    }
+
+    QVector<LineDamage> _lineDamage;  // changed columns of each line
+    int _damagedTopLine;              // range of lines which have changed entirely,
+    int _damagedBottomLine;           // usually because they have been scrolled
+    int _damagedCursorX;              // cursor position at the last resetDamage()
+    int _damagedCursorY;
 
     QVarLengthArray<LineProperty, 64> _lineProperties;
 
     // history buffer ---------------
     HistoryScroll* _history;
+    // the lines of _history rewrapped to the width of the screen, which
+    // is used to read the history
+    ReflowedHistory* _reflowedHistory;
+    bool _reflowLines;
+    // index of the text in _history, or 0 if it is not indexed
+    HistoryIndex* _historyIndex;
 
     // cursor location
     int _cuX;
@@ -689,9 +873,12 @@ private:
     bool _blockSelectionMode;  // Column selection mode
 
     // effective colors and rendition ------------
-    CharacterColor _effectiveForeground; // These are derived from
-    CharacterColor _effectiveBackground; // the cu_* variables above
-    quint8 _effectiveRendition;          // to speed up operation
+    quint32 _effectiveStyle;    // This is derived from the cu_* variables
+                                // above to speed up operation
+
+    // the most recent style swapped by reverseRendition() and the result
+    mutable quint32 _reversedStyleSource;
+    mutable quint32 _reversedStyle;
 
     class SavedState
     {
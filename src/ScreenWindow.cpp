@@ -20,6 +20,9 @@
 // Own
 #include "ScreenWindow.h"
 
+// System
+#include <string.h>
+
 // Konsole
 #include "Screen.h"
 
@@ -30,10 +33,14 @@ ScreenWindow::ScreenWindow(QObject* parent)
     , _windowBuffer(0)
     , _windowBufferSize(0)
     , _bufferNeedsUpdate(true)
+    , _bufferLine(-1)
+    , _bufferHistoryLines(0)
     , _windowLines(1)
     , _currentLine(0)
     , _trackOutput(true)
     , _scrollCount(0)
+    , _outputScrollCount(0)
+    , _allLinesDamaged(true)
 {
 }
 ScreenWindow::~ScreenWindow()
@@ -45,6 +52,8 @@ void ScreenWindow::setScreen(Screen* screen)
     Q_ASSERT(screen);
 
     _screen = screen;
+    _allLinesDamaged = true;
+    invalidateBuffer();
 }
 
 Screen* ScreenWindow::screen() const
@@ -60,24 +69,95 @@ Character* ScreenWindow::getImage()
         delete[] _windowBuffer;
         _windowBufferSize = size;
         _windowBuffer = new Character[size];
-        _bufferNeedsUpdate = true;
+        _allLinesDamaged = true;
+        invalidateBuffer();
     }
 
     if (!_bufferNeedsUpdate)
         return _windowBuffer;
 
-    _screen->getImage(_windowBuffer, size,
-                      currentLine(), endWindowLine());
+    const int lines = windowLines();
+    const int columns = windowColumns();
+    const int startLine = currentLine();
+    const int endLine = endWindowLine();
+
+    // lines in the history are only identified by their position, which
+    // changes when lines are added to or removed from the history
+    if (_bufferLine == -1 || _bufferHistoryLines != _screen->getHistLines() ||
+            _staleBufferLines.size() != lines) {
+        _staleBufferLines.fill(true, lines);
+    } else if (startLine != _bufferLine) {
+        moveBufferLines(startLine - _bufferLine);
+    }
+
+    // fetch each run of stale lines from the screen.  lines beyond
+    // the end of the screen are left to fillUnusedArea()
+    int line = 0;
+    while (line < lines) {
+        if (!_staleBufferLines.testBit(line)) {
+            line++;
+            continue;
+        }
+
+        int runEnd = line;
+        while (runEnd + 1 < lines && _staleBufferLines.testBit(runEnd + 1))
+            runEnd++;
+
+        const int lastLine = qMin(startLine + runEnd, endLine);
+        if (startLine + line <= lastLine) {
+            _screen->getImage(_windowBuffer + line * columns,
+                              (lastLine - startLine - line + 1) * columns,
+                              startLine + line, lastLine);
+        }
+
+        line = runEnd + 1;
+    }
+    _staleBufferLines.fill(false);
 
     // this window may look beyond the end of the screen, in which
     // case there will be an unused area which needs to be filled
     // with blank characters
     fillUnusedArea();
 
+    _bufferLine = startLine;
+    _bufferHistoryLines = _screen->getHistLines();
     _bufferNeedsUpdate = false;
     return _windowBuffer;
 }
 
+// moves the lines of the window buffer to reflect the window being scrolled
+// by 'lines' lines, and marks the lines which have been scrolled into view
+// as stale
+void ScreenWindow::moveBufferLines(int lines)
+{
+    const int count = windowLines();
+    const int columns = windowColumns();
+
+    if (qAbs(lines) >= count) {
+        _staleBufferLines.fill(true);
+        return;
+    }
+
+    const int linesToMove = count - qAbs(lines);
+    const int bytesToMove = linesToMove * columns * sizeof(Character);
+
+    if (lines > 0) {
+        memmove(_windowBuffer, _windowBuffer + lines * columns, bytesToMove);
+        for (int line = 0; line < count; line++)
+            _staleBufferLines.setBit(line, line < linesToMove ? _staleBufferLines.testBit(line + lines) : true);
+    } else {
+        memmove(_windowBuffer - lines * columns, _windowBuffer, bytesToMove);
+        for (int line = count - 1; line >= 0; line--)
+            _staleBufferLines.setBit(line, line >= -lines ? _staleBufferLines.testBit(line + lines) : true);
+    }
+}
+
+void ScreenWindow::invalidateBuffer()
+{
+    _bufferNeedsUpdate = true;
+    _bufferLine = -1;
+}
+
 void ScreenWindow::fillUnusedArea()
 {
     int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
@@ -136,7 +216,7 @@ void ScreenWindow::setSelectionStart(int column , int line , bool columnMode)
 {
     _screen->setSelectionStart(column , line + currentLine() , columnMode);
 
-    _bufferNeedsUpdate = true;
+    invalidateBuffer();
     emit selectionChanged();
 }
 
@@ -144,7 +224,7 @@ void ScreenWindow::setSelectionEnd(int column , int line)
 {
     _screen->setSelectionEnd(column , line + currentLine());
 
-    _bufferNeedsUpdate = true;
+    invalidateBuffer();
     emit selectionChanged();
 }
 
@@ -155,7 +235,7 @@ void ScreenWindow::setSelectionByLineRange(int start, int end)
     _screen->setSelectionStart(0 , start , false);
     _screen->setSelectionEnd(windowColumns() , end);
 
-    _bufferNeedsUpdate = true;
+    invalidateBuffer();
     emit selectionChanged();
 }
 
@@ -167,6 +247,7 @@ bool ScreenWindow::isSelected(int column , int line)
 void ScreenWindow::clearSelection()
 {
     _screen->clearSelection();
+    invalidateBuffer();
 
     emit selectionChanged();
 }
@@ -174,6 +255,8 @@ void ScreenWindow::clearSelection()
 void ScreenWindow::setWindowLines(int lines)
 {
     Q_ASSERT(lines > 0);
+    if (lines != _windowLines)
+        _allLinesDamaged = true;
     _windowLines = lines;
 }
 int ScreenWindow::windowLines() const
@@ -228,8 +311,18 @@ bool ScreenWindow::atEndOfOutput() const
     return currentLine() == (lineCount() - windowLines());
 }
 
-void ScreenWindow::scrollTo(int line)
+int ScreenWindow::scrollTo(int line, int* column)
 {
+    // history lines which are scrolled into view are rewrapped to the
+    // current width first, which moves the lines after them
+    const int historyLines = _screen->getHistLines();
+    const int reflowedLine = _screen->reflowHistory(line, column);
+    if (reflowedLine != line || _screen->getHistLines() != historyLines) {
+        _currentLine += reflowedLine - line;
+        _allLinesDamaged = true;
+        line = reflowedLine;
+    }
+
     int maxCurrentLineNumber = lineCount() - windowLines();
     line = qBound(0, line, maxCurrentLineNumber);
 
@@ -241,8 +334,12 @@ void ScreenWindow::scrollTo(int line)
     _scrollCount += delta;
 
     _bufferNeedsUpdate = true;
+    if (delta != 0)
+        _allLinesDamaged = true;
 
     emit scrolled(_currentLine);
+
+    return reflowedLine;
 }
 
 void ScreenWindow::setTrackOutput(bool trackOutput)
@@ -260,9 +357,15 @@ int ScreenWindow::scrollCount() const
     return _scrollCount;
 }
 
+int ScreenWindow::outputScrollCount() const
+{
+    return _outputScrollCount;
+}
+
 void ScreenWindow::resetScrollCount()
 {
     _scrollCount = 0;
+    _outputScrollCount = 0;
 }
 
 QRect ScreenWindow::scrollRegion() const
@@ -275,12 +378,32 @@ QRect ScreenWindow::scrollRegion() const
         return QRect(0, 0, windowColumns(), windowLines());
 }
 
+LineDamage ScreenWindow::lineDamage(int line) const
+{
+    if (_allLinesDamaged || line < 0 || line >= _lineDamage.count())
+        return LineDamage(0, windowColumns() - 1);
+    else
+        return _lineDamage[line];
+}
+
+void ScreenWindow::resetDamage()
+{
+    _lineDamage.fill(LineDamage(), windowLines());
+    _allLinesDamaged = false;
+}
+
+void ScreenWindow::damageAll()
+{
+    _allLinesDamaged = true;
+}
+
 void ScreenWindow::notifyOutputChanged()
 {
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if (_trackOutput) {
         _scrollCount -= _screen->scrolledLines();
+        _outputScrollCount -= _screen->scrolledLines();
         _currentLine = qMax(0, _screen->getHistLines() - (windowLines() - _screen->getLines()));
     } else {
         // if the history is not unlimited then it may
@@ -296,6 +419,29 @@ void ScreenWindow::notifyOutputChanged()
         _currentLine = qMin(_currentLine , _screen->getHistLines());
     }
 
+    // collect the lines which have changed since the last notification.
+    // this is only done when the window shows exactly the lines of the
+    // screen; otherwise the lines of the window do not correspond to
+    // lines of the screen and everything is assumed to have changed.
+    if (_trackOutput && windowLines() == _screen->getLines() &&
+            _staleBufferLines.size() == windowLines()) {
+        const bool collectDamage = !_allLinesDamaged && _lineDamage.count() == windowLines();
+        for (int line = 0; line < windowLines(); line++) {
+            const LineDamage damage = _screen->lineDamage(line);
+            if (damage.isEmpty())
+                continue;
+
+            _staleBufferLines.setBit(line);
+            if (collectDamage)
+                _lineDamage[line].add(damage);
+        }
+        if (!collectDamage)
+            _allLinesDamaged = true;
+    } else {
+        _allLinesDamaged = true;
+        invalidateBuffer();
+    }
+
     _bufferNeedsUpdate = true;
 
     emit outputChanged();
@@ -24,6 +24,8 @@
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
+#include <QtCore/QVector>
+#include <QtCore/QBitArray>
 
 // Konsole
 #include "Character.h"
@@ -77,6 +79,11 @@ public:
      *
      * The returned buffer is managed by the ScreenWindow instance and does not need to be
      * deleted by the caller.
+     *
+     * The buffer is kept between calls.  When the window has been scrolled, the lines
+     * which remain visible are moved within the buffer and only the newly exposed lines
+     * are fetched from the screen.  After output, only the lines which have changed
+     * are fetched again.
      */
     Character* getImage();
 
@@ -100,7 +107,16 @@ public:
     int scrollCount() const;
 
     /**
-     * Resets the count of scrolled lines returned by scrollCount()
+     * Returns the number of lines which the window has been scrolled by
+     * since the last call to resetScrollCount() to follow new output.
+     * Unlike scrollCount(), this does not include lines which the user
+     * scrolled by.
+     */
+    int outputScrollCount() const;
+
+    /**
+     * Resets the counts of scrolled lines returned by scrollCount() and
+     * outputScrollCount()
      */
     void resetScrollCount();
 
@@ -113,6 +129,26 @@ public:
      */
     QRect scrollRegion() const;
 
+    /**
+     * Returns the range of columns in @p line of the window which may have
+     * changed since the last call to resetDamage().
+     *
+     * Views can use this to avoid comparing lines of getImage() which
+     * are known to be unchanged.  Whenever the window cannot tell which
+     * lines have changed, for example after it has been scrolled or the
+     * screen has been switched, every line is reported as changed.
+     */
+    LineDamage lineDamage(int line) const;
+
+    /** Marks all lines of the window as unchanged, see lineDamage() */
+    void resetDamage();
+
+    /**
+     * Marks all lines of the window as changed.  This should be called
+     * by views which have discarded their copy of the image.
+     */
+    void damageAll();
+
     /**
      * Sets the start of the selection to the given @p line and @p column within
      * the window.
@@ -179,8 +215,17 @@ public:
      */
     bool atEndOfOutput() const;
 
-    /** Scrolls the window so that @p line is at the top of the window */
-    void scrollTo(int line);
+    /**
+     * Scrolls the window so that @p line is at the top of the window.
+     *
+     * Lines of the history which are scrolled into view are rewrapped to the
+     * current width first if the width has changed, which moves them.  The
+     * position which @p line has afterwards is returned, and should be used
+     * instead of @p line from then on.  If @p column is not null, it is the
+     * column of a position on @p line, and is updated to the column of that
+     * position on the returned line.
+     */
+    int scrollTo(int line, int* column = 0);
 
     /** Describes the units which scrollBy() moves the window by. */
     enum RelativeScrollMode {
@@ -254,17 +299,26 @@ signals:
 private:
     int endWindowLine() const;
     void fillUnusedArea();
+    void moveBufferLines(int lines);
+    void invalidateBuffer();
 
     Screen* _screen; // see setScreen() , screen()
     Character* _windowBuffer;
     int _windowBufferSize;
     bool _bufferNeedsUpdate;
+    int _bufferLine;         // line of the screen at the top of _windowBuffer, or -1
+    int _bufferHistoryLines; // number of lines in the history when _windowBuffer was filled
+    QBitArray _staleBufferLines; // lines of _windowBuffer which need to be fetched again
 
     int  _windowLines;
     int  _currentLine; // see scrollTo() , currentLine()
     bool _trackOutput; // see setTrackOutput() , trackOutput()
     int  _scrollCount; // count of lines which the window has been scrolled by since
     // the last call to resetScrollCount()
+    int  _outputScrollCount; // see outputScrollCount()
+
+    QVector<LineDamage> _lineDamage; // see lineDamage()
+    bool _allLinesDamaged;
 };
 }
 #endif // SCREENWINDOW_H
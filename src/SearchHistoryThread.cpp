@@ -0,0 +1,144 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SearchHistoryThread.h"
+
+// Qt
+#include <QtCore/QtAlgorithms>
+
+// Konsole
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+SearchHistoryThread::SearchHistoryThread(const QRegExp& regExp, bool forwards)
+    : _regExp(regExp)
+    , _forwards(forwards)
+    , _findAll(false)
+    , _cancelled(false)
+{
+}
+void SearchHistoryThread::setFindAll(bool findAll)
+{
+    Q_ASSERT(!isRunning());
+    _findAll = findAll;
+}
+void SearchHistoryThread::addBlock(int block, const QString& text, const QList<int>& linePositions, int firstLine)
+{
+    Block newBlock;
+    newBlock.block = block;
+    newBlock.text = text;
+    newBlock.linePositions = linePositions;
+    newBlock.firstLine = firstLine;
+
+    QMutexLocker locker(&_mutex);
+    _blocks.enqueue(newBlock);
+    _blockAdded.wakeOne();
+}
+QVector<SearchMatch> SearchHistoryThread::takeMatches(int block)
+{
+    QMutexLocker locker(&_mutex);
+    return _matches.take(block);
+}
+void SearchHistoryThread::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _cancelled = true;
+    _blocks.clear();
+    _blockAdded.wakeOne();
+}
+bool SearchHistoryThread::takeBlock(Block& block)
+{
+    QMutexLocker locker(&_mutex);
+    while (_blocks.isEmpty() && !_cancelled)
+        _blockAdded.wait(&_mutex);
+
+    if (_cancelled)
+        return false;
+
+    block = _blocks.dequeue();
+    return true;
+}
+int SearchHistoryThread::lineAt(const QList<int>& linePositions, int firstLine, int pos)
+{
+    // the new line at the start of the buffer is not counted
+    const QList<int>::const_iterator next = qUpperBound(linePositions.constBegin(),
+                                            linePositions.constEnd(),
+                                            pos);
+    return firstLine + (next - linePositions.constBegin()) - 1;
+}
+QVector<SearchMatch> SearchHistoryThread::findAll(const QRegExp& regExp, const QString& text,
+        const QList<int>& linePositions, int firstLine)
+{
+    QVector<SearchMatch> matches;
+    QRegExp matcher(regExp);
+
+    // the new line which ends the buffer is not part of the output
+    const int end = text.length() - 1;
+    int pos = matcher.indexIn(text);
+    while (pos != -1 && pos < end) {
+        const int length = matcher.matchedLength();
+
+        SearchMatch match;
+        match.line = lineAt(linePositions, firstLine, pos);
+        // wide characters take up two columns but only one character
+        const int lineStart = linePositions.value(match.line - firstLine);
+        match.column = string_width(text.mid(lineStart, pos - lineStart));
+        match.length = string_width(text.mid(pos, length));
+        matches << match;
+
+        // skip over empty matches to avoid finding them again
+        pos = matcher.indexIn(text, pos + qMax(1, length));
+    }
+
+    return matches;
+}
+void SearchHistoryThread::run()
+{
+    Block block;
+    while (takeBlock(block)) {
+        int matchLine = -1;
+
+        if (_findAll) {
+            const QVector<SearchMatch> matches = findAll(_regExp, block.text,
+                                                 block.linePositions, block.firstLine);
+            if (!matches.isEmpty())
+                matchLine = matches.first().line;
+
+            QMutexLocker locker(&_mutex);
+            _matches.insert(block.block, matches);
+        } else {
+            int pos = -1;
+            if (_forwards)
+                pos = block.text.indexOf(_regExp);
+            else
+                pos = block.text.lastIndexOf(_regExp);
+
+            if (pos != -1)
+                matchLine = lineAt(block.linePositions, block.firstLine, pos);
+        }
+
+        emit blockSearched(block.block, matchLine);
+    }
+}
+
+#include "SearchHistoryThread.moc"
@@ -0,0 +1,157 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SEARCHHISTORYTHREAD_H
+#define SEARCHHISTORYTHREAD_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QRegExp>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/** The position of a match for a search in the output of a session. */
+struct SearchMatch {
+    /** The line where the match begins */
+    int line;
+    /** The column in @p line where the match begins */
+    int column;
+    /** The number of columns which the match takes up */
+    int length;
+};
+
+/** Orders matches by their position in the output */
+inline bool operator<(const SearchMatch& a, const SearchMatch& b)
+{
+    return a.line < b.line || (a.line == b.line && a.column < b.column);
+}
+
+/**
+ * A thread which searches blocks of a session's output for matches for a
+ * regular expression.
+ *
+ * The blocks are decoded into plain text by the owner of the output and passed
+ * to the thread with addBlock().  The thread searches them in the order they
+ * were added and emits blockSearched() for each one, until it is cancelled.
+ * The thread does not touch the session's output itself, which may only be
+ * read from the GUI thread.
+ */
+class KONSOLEPRIVATE_EXPORT SearchHistoryThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructs a new search thread.
+     *
+     * @param regExp The regular expression to search for.
+     * @param forwards If true the first match in each block is reported,
+     * otherwise the last match in each block is reported.
+     */
+    SearchHistoryThread(const QRegExp& regExp, bool forwards);
+
+    /**
+     * Sets whether the position of every match in a block is recorded,
+     * rather than only the line of the first or last one.  The matches
+     * can be retrieved with takeMatches().  This must be called before
+     * the thread is started.
+     */
+    void setFindAll(bool findAll);
+
+    /**
+     * Adds a block of text to the queue of blocks to search.
+     *
+     * @param block An identifier for the block which is passed to blockSearched()
+     * @param text The text of the block, which must end with a new-line.
+     * @param linePositions The position in @p text at which each line begins.
+     * @param firstLine The number of the first line in @p text
+     */
+    void addBlock(int block, const QString& text, const QList<int>& linePositions, int firstLine);
+
+    /**
+     * Returns the matches found in @p block, in the order they occur, and
+     * forgets them.  Only available if setFindAll() is enabled, once
+     * blockSearched() has been emitted for the block.
+     */
+    QVector<SearchMatch> takeMatches(int block);
+
+    /**
+     * Stops the thread once the block which is being searched has been
+     * searched.  Blocks which have not been searched yet are discarded.
+     */
+    void cancel();
+
+    /**
+     * Returns the positions of all of the matches for @p regExp in
+     * @p text, which is laid out as for addBlock().
+     */
+    static QVector<SearchMatch> findAll(const QRegExp& regExp, const QString& text,
+                                        const QList<int>& linePositions, int firstLine);
+
+signals:
+    /**
+     * Emitted when a block has been searched.
+     *
+     * @param block The identifier passed to addBlock()
+     * @param matchLine The line in which the match was found, or -1 if
+     * there was no match in the block.
+     */
+    void blockSearched(int block, int matchLine);
+
+protected:
+    virtual void run();
+
+private:
+    struct Block {
+        int block;
+        QString text;
+        QList<int> linePositions;
+        int firstLine;
+    };
+
+    // waits for the next block to search, returns false if the thread was cancelled
+    bool takeBlock(Block& block);
+    // returns the line which contains the character at 'pos'
+    static int lineAt(const QList<int>& linePositions, int firstLine, int pos);
+
+    const QRegExp _regExp;
+    const bool _forwards;
+    bool _findAll;
+
+    QMutex _mutex;
+    QWaitCondition _blockAdded;
+    QQueue<Block> _blocks;
+    QHash<int, QVector<SearchMatch> > _matches;
+    bool _cancelled;
+};
+}
+Q_DECLARE_TYPEINFO(Konsole::SearchMatch, Q_PRIMITIVE_TYPE);
+
+#endif // SEARCHHISTORYTHREAD_H
@@ -0,0 +1,632 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SearchMatchIndex.h"
+
+// Qt
+#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
+
+// Konsole
+#include "Emulation.h"
+#include "Screen.h"
+#include "ScreenWindow.h"
+#include "Session.h"
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+SearchMatchIndex::SearchMatchIndex(Session* session, ScreenWindow* window, const QRegExp& regExp,
+                                   QObject* parent)
+    : QObject(parent)
+    , _session(session)
+    , _window(window)
+    , _regExp(regExp)
+    , _screen(0)
+    , _historyGeneration(0)
+    , _droppedLines(0)
+    , _droppedLinesCounted(false)
+    , _indexedLines(0)
+    , _thread(0)
+    , _nextBlock(0)
+    , _building(false)
+    , _buildLines(0)
+    , _searchedLines(0)
+    , _firstMatch(0)
+    , _tailValid(false)
+    , _tailScreenTop(0)
+    , _tailEnd(0)
+{
+    Q_ASSERT(session);
+    Q_ASSERT(window);
+
+    connect(session->emulation(), SIGNAL(outputChanged()), this, SLOT(outputChanged()));
+    // rewrapping history lines as they are scrolled into view moves the
+    // lines after them, see moveMatches()
+    connect(window, SIGNAL(scrolled(int)), this, SLOT(checkHistory()));
+
+    rebuild();
+}
+SearchMatchIndex::~SearchMatchIndex()
+{
+    stopThread();
+}
+QRegExp SearchMatchIndex::regExp() const
+{
+    return _regExp;
+}
+ScreenWindow* SearchMatchIndex::window() const
+{
+    return _window;
+}
+void SearchMatchIndex::startThread()
+{
+    _thread = new SearchHistoryThread(_regExp, true);
+    _thread->setFindAll(true);
+    connect(_thread, SIGNAL(blockSearched(int,int)), this, SLOT(blockSearched(int,int)));
+    connect(_thread, SIGNAL(finished()), _thread, SLOT(deleteLater()));
+    _thread->start(QThread::LowPriority);
+}
+void SearchMatchIndex::stopThread()
+{
+    if (_thread) {
+        disconnect(_thread, SIGNAL(blockSearched(int,int)), this, SLOT(blockSearched(int,int)));
+        // the thread deletes itself once it has finished
+        _thread->cancel();
+        _thread = 0;
+    }
+}
+void SearchMatchIndex::rebuild()
+{
+    const bool wasBuilding = _building;
+    stopThread();
+
+    _pendingBlocks.clear();
+    _decodedBlocks.clear();
+    _nextBlock = 0;
+    _matches.clear();
+    _firstMatch = 0;
+    _tailMatches.clear();
+    _tail.clear();
+    _tailValid = false;
+    _building = false;
+
+    if (!_session || !_window)
+        return;
+
+    _screen = _window->screen();
+    _historyGeneration = _screen->historyGeneration();
+    // lines which the screen has dropped since it last reported them are
+    // reported by the next outputChanged(), but the lines have already gone
+    _droppedLines = _droppedLinesCounted ? 0 : -_screen->droppedLines();
+    _indexedLines = lineOffset();
+
+    startThread();
+
+    _building = true;
+    _buildLines = 0;
+    _searchedLines = 0;
+
+    // the last line of the history may still be continued, see outputChanged()
+    extendIndex(lineOffset() + qMax(_screen->getHistLines() - 1, 0));
+    searchTail();
+
+    if (!_pendingBlocks.isEmpty() || !_decodedBlocks.isEmpty()) {
+        emit progress(0);
+    } else {
+        _building = false;
+        if (wasBuilding)
+            emit progress(-1);
+    }
+
+    emit matchesChanged();
+}
+int SearchMatchIndex::lineOffset() const
+{
+    if (!_screen || _droppedLinesCounted)
+        return _droppedLines;
+    else
+        return _droppedLines + _screen->droppedLines();
+}
+void SearchMatchIndex::checkHistory()
+{
+    if (!_window)
+        return;
+
+    if (_window->screen() != _screen) {
+        rebuild();
+        return;
+    }
+
+    const int generation = _screen->historyGeneration();
+    if (generation == _historyGeneration)
+        return;
+
+    // this is called as soon as lines have been rewrapped, before any
+    // further output can move them again
+    const Screen::HistoryReflow reflow = _screen->lastHistoryReflow();
+    if (reflow.generation == generation && generation == _historyGeneration + 1) {
+        moveMatches();
+        _historyGeneration = generation;
+        emit matchesChanged();
+    } else {
+        rebuild();
+    }
+}
+void SearchMatchIndex::moveMatches()
+{
+    const Screen::HistoryReflow reflow = _screen->lastHistoryReflow();
+    const int offset = lineOffset();
+    // the lines from 'firstLine' up to 'endLine' have been rewrapped into
+    // the lines up to 'endLine + delta', and the lines after them moved
+    const int firstLine = offset + reflow.firstLine;
+    const int endLine = offset + reflow.endLine;
+    const int delta = reflow.lineDelta;
+    const int indexedLines = _indexedLines;
+
+    // the first line which the search thread has not searched yet
+    int searchedEnd = _indexedLines;
+    if (!_decodedBlocks.isEmpty())
+        searchedEnd = _decodedBlocks.head().firstLine;
+    else if (!_pendingBlocks.isEmpty())
+        searchedEnd = _pendingBlocks.head().firstLine;
+
+    if (_indexedLines <= firstLine) {
+        // only the tail of the output has been rewrapped
+    } else if (searchedEnd >= endLine) {
+        // the rewrapped lines are searched again straight away, which takes
+        // far less time than searching the whole output again
+        const SearchMatch first = { firstLine, 0, 0 };
+        const SearchMatch end = { endLine, 0, 0 };
+        const int firstIndex = qLowerBound(_matches.constBegin() + _firstMatch, _matches.constEnd(), first)
+                               - _matches.constBegin();
+        const int endIndex = qLowerBound(_matches.constBegin() + firstIndex, _matches.constEnd(), end)
+                             - _matches.constBegin();
+
+        QString text;
+        QList<int> linePositions;
+        const int decodedLine = decodeLines(firstLine, endLine + delta - 1, text, linePositions);
+
+        QVector<SearchMatch> movedMatches = _matches.mid(endIndex);
+        for (int i = 0; i < movedMatches.size(); i++)
+            movedMatches[i].line += delta;
+
+        _matches = _matches.mid(0, firstIndex) +
+                   SearchHistoryThread::findAll(_regExp, text, linePositions, decodedLine) +
+                   movedMatches;
+
+        for (int i = 0; i < _pendingBlocks.size(); i++) {
+            _pendingBlocks[i].firstLine += delta;
+            _pendingBlocks[i].lastLine += delta;
+        }
+        // the matches in blocks which have been decoded already are moved
+        // once they have been found, see blockSearched()
+        for (int i = 0; i < _decodedBlocks.size(); i++) {
+            _decodedBlocks[i].firstLine += delta;
+            _decodedBlocks[i].lastLine += delta;
+            _decodedBlocks[i].lineShift += delta;
+        }
+        _indexedLines += delta;
+    } else {
+        // the search thread has not reached the rewrapped lines yet, so it
+        // searches them again from the first line which has changed
+        const int restartLine = qMin(searchedEnd, firstLine);
+        const int newIndexedLines = _indexedLines >= endLine ? _indexedLines + delta :
+                                    offset + _screen->rewrappedHistoryLine(_indexedLines - offset);
+
+        stopThread();
+        _pendingBlocks.clear();
+        _decodedBlocks.clear();
+        _nextBlock = 0;
+
+        const SearchMatch restart = { restartLine, 0, 0 };
+        _matches.resize(qLowerBound(_matches.constBegin() + _firstMatch, _matches.constEnd(), restart)
+                        - _matches.constBegin());
+        _indexedLines = restartLine;
+
+        startThread();
+        if (_building)
+            _buildLines = _searchedLines;
+        extendIndex(newIndexedLines);
+
+        if (_building && _pendingBlocks.isEmpty() && _decodedBlocks.isEmpty()) {
+            _building = false;
+            emit progress(-1);
+        }
+    }
+
+    if (indexedLines >= endLine) {
+        for (int i = 0; i < _tail.size(); i++) {
+            TailLine& line = _tail[i];
+            line.firstLine += delta;
+            for (int j = 0; j < line.matches.size(); j++)
+                line.matches[j].line += delta;
+        }
+        for (int i = 0; i < _tailMatches.size(); i++)
+            _tailMatches[i].line += delta;
+        _tailScreenTop += delta;
+        _tailEnd += delta;
+    } else {
+        _tailValid = false;
+        searchTail();
+    }
+}
+void SearchMatchIndex::outputChanged()
+{
+    if (!_window)
+        return;
+
+    // this is called before the screen resets its count of dropped lines
+    if (_window->screen() == _screen)
+        _droppedLines += _screen->droppedLines();
+    _droppedLinesCounted = true;
+
+    if (_window->screen() != _screen || _screen->historyGeneration() != _historyGeneration) {
+        rebuild();
+    } else {
+        dropMatches();
+
+        // lines do not change once they have been added to the history, except
+        // for the last one, which a line added to a rewrapped line continues
+        extendIndex(lineOffset() + qMax(_screen->getHistLines() - 1, 0));
+        searchTail();
+
+        emit matchesChanged();
+    }
+
+    _droppedLinesCounted = false;
+}
+void SearchMatchIndex::dropMatches()
+{
+    SearchMatch firstLine = { lineOffset(), 0, 0 };
+    _firstMatch = qLowerBound(_matches.constBegin() + _firstMatch, _matches.constEnd(), firstLine)
+                  - _matches.constBegin();
+
+    // free the space used by dropped matches once they make up half of it
+    if (_firstMatch > _matches.size() / 2) {
+        _matches.remove(0, _firstMatch);
+        _firstMatch = 0;
+    }
+}
+void SearchMatchIndex::extendIndex(int endLine)
+{
+    if (endLine <= _indexedLines)
+        return;
+
+    // a few new lines are searched straight away, unless the thread still
+    // has blocks to search which come before them
+    if (_pendingBlocks.isEmpty() && _decodedBlocks.isEmpty() &&
+            endLine - _indexedLines <= BLOCK_LINES) {
+        QString text;
+        QList<int> linePositions;
+        const int firstLine = decodeLines(_indexedLines, endLine - 1, text, linePositions);
+        _matches += SearchHistoryThread::findAll(_regExp, text, linePositions, firstLine);
+        _indexedLines = endLine;
+        return;
+    }
+
+    if (_building)
+        _buildLines += endLine - _indexedLines;
+
+    // add the new lines to the last block which has not been decoded yet
+    if (!_pendingBlocks.isEmpty()) {
+        BlockRange& last = _pendingBlocks.last();
+        last.lastLine = qMin(last.firstLine + BLOCK_LINES, endLine) - 1;
+        _indexedLines = last.lastLine + 1;
+    }
+
+    while (_indexedLines < endLine) {
+        BlockRange range;
+        range.firstLine = _indexedLines;
+        range.lastLine = qMin(_indexedLines + BLOCK_LINES, endLine) - 1;
+        range.lineShift = 0;
+        _pendingBlocks.enqueue(range);
+        _indexedLines = range.lastLine + 1;
+    }
+
+    decodeBlocks();
+}
+void SearchMatchIndex::decodeBlocks()
+{
+    while (_decodedBlocks.count() < BLOCKS_AHEAD && !_pendingBlocks.isEmpty()) {
+        const BlockRange range = _pendingBlocks.dequeue();
+
+        QString text;
+        QList<int> linePositions;
+        const int firstLine = decodeLines(range.firstLine, range.lastLine, text, linePositions);
+
+        _thread->addBlock(_nextBlock++, text, linePositions, firstLine);
+        _decodedBlocks.enqueue(range);
+    }
+}
+void SearchMatchIndex::blockSearched(int block, int /*matchLine*/)
+{
+    // ignore blocks searched by a thread which has since been stopped
+    if (sender() != _thread || !_window)
+        return;
+
+    const BlockRange range = _decodedBlocks.dequeue();
+
+    // the blocks are searched in order, so the matches stay in order
+    QVector<SearchMatch> matches = _thread->takeMatches(block);
+    for (int i = 0; i < matches.size() && range.lineShift != 0; i++)
+        matches[i].line += range.lineShift;
+    _matches += matches;
+    dropMatches();
+
+    decodeBlocks();
+
+    if (_building) {
+        _searchedLines += range.lastLine - range.firstLine + 1;
+
+        if (_pendingBlocks.isEmpty() && _decodedBlocks.isEmpty()) {
+            _building = false;
+            emit progress(-1);
+        } else {
+            emit progress(qMin(99, int(100LL * _searchedLines / qMax(_buildLines, 1))));
+        }
+    }
+
+    emit matchesChanged();
+}
+void SearchMatchIndex::searchTail()
+{
+    const int offset = lineOffset();
+    const int firstLine = qMax(_indexedLines, offset);
+    const int screenTop = offset + _screen->getHistLines();
+    const int endLine = offset + _window->lineCount();
+
+    if (_tailValid && screenTop == _tailScreenTop && endLine == _tailEnd &&
+            !_tail.isEmpty() && _tail.first().firstLine == firstLine) {
+        // the output has not scrolled since the tail was last searched, so
+        // only the lines of the screen which have changed are searched again
+        int top = -1;
+        int bottom = -1;
+        for (int line = 0; line < _screen->getLines(); line++) {
+            if (!_screen->lineDamage(line).isEmpty()) {
+                if (top == -1)
+                    top = line;
+                bottom = line;
+            }
+        }
+        if (top == -1)
+            return;
+
+        int first = 0;
+        while (first < _tail.size() - 1 &&
+                _tail[first].firstLine + _tail[first].lineCount <= screenTop + top)
+            first++;
+        int end = first + 1;
+        while (end < _tail.size() && _tail[end].firstLine <= screenTop + bottom)
+            end++;
+
+        // a changed line may now continue onto the next one
+        while (end < _tail.size()) {
+            const int lastLine = _tail[end].firstLine - 1 - offset;
+            if (!(_screen->getLineProperties(lastLine, lastLine)[0] & LINE_WRAPPED))
+                break;
+            end++;
+        }
+
+        const int changedEnd = end < _tail.size() ? _tail[end].firstLine : endLine;
+        const QVector<TailLine> lines = searchTailLines(_tail[first].firstLine, changedEnd,
+                                        _tail.mid(first, end - first));
+        _tail = _tail.mid(0, first) + lines + _tail.mid(end);
+    } else {
+        _tail = searchTailLines(firstLine, endLine, _tail);
+        _tailValid = true;
+        _tailScreenTop = screenTop;
+        _tailEnd = endLine;
+    }
+
+    _tailMatches.clear();
+    for (int i = 0; i < _tail.size(); i++)
+        _tailMatches += _tail[i].matches;
+}
+QVector<SearchMatchIndex::TailLine> SearchMatchIndex::searchTailLines(int firstLine, int endLine,
+        const QVector<TailLine>& oldLines) const
+{
+    QVector<TailLine> lines;
+    if (endLine <= firstLine)
+        return lines;
+
+    const int offset = lineOffset();
+    QString text;
+    QList<int> linePositions;
+    decodeText(firstLine - offset, endLine - 1 - offset, text, linePositions);
+    const QVector<LineProperty> properties = _screen->getLineProperties(firstLine - offset,
+            endLine - 1 - offset);
+
+    TailLine line;
+    line.firstLine = firstLine;
+    line.lineCount = 0;
+    int oldLine = 0;
+
+    for (int i = 0; i < properties.size(); i++) {
+        const int start = linePositions.value(i, text.length());
+        const int end = linePositions.value(i + 1, text.length());
+        line.linePositions << line.text.length();
+        line.text += text.mid(start, end - start);
+        line.lineCount++;
+
+        if ((properties[i] & LINE_WRAPPED) && i < properties.size() - 1)
+            continue;
+
+        // the search assumes that the buffer ends with a new-line
+        if (!line.text.endsWith('\n'))
+            line.text.append('\n');
+
+        // lines which have not changed do not need to be searched again
+        while (oldLine < oldLines.size() && oldLines[oldLine].firstLine < line.firstLine)
+            oldLine++;
+        if (oldLine < oldLines.size() && oldLines[oldLine].firstLine == line.firstLine &&
+                oldLines[oldLine].text == line.text &&
+                oldLines[oldLine].linePositions == line.linePositions) {
+            line.matches = oldLines[oldLine].matches;
+        } else {
+            line.matches = SearchHistoryThread::findAll(_regExp, line.text, line.linePositions,
+                           line.firstLine);
+        }
+        lines << line;
+
+        line.firstLine = firstLine + i + 1;
+        line.lineCount = 0;
+        line.text.clear();
+        line.linePositions.clear();
+        line.matches.clear();
+    }
+
+    return lines;
+}
+int SearchMatchIndex::decodeLines(int firstLine, int lastLine, QString& text, QList<int>& linePositions) const
+{
+    // lines which have been dropped can no longer be searched
+    const int offset = lineOffset();
+    const int first = qMax(firstLine - offset, 0);
+    const int last = qMin(lastLine - offset, _window->lineCount() - 1);
+
+    // the index of the history rules out lines which can not contain literal text
+    const bool mayContain = first <= last &&
+                            (_regExp.patternSyntax() != QRegExp::FixedString ||
+                             _screen->historyMayContain(_regExp.pattern(), first, last));
+
+    if (mayContain)
+        decodeText(first, last, text, linePositions);
+
+    // the search assumes that the buffer ends with a new-line
+    text.append('\n');
+
+    return first + offset;
+}
+void SearchMatchIndex::decodeText(int first, int last, QString& text, QList<int>& linePositions) const
+{
+    //text stream to read history into string for pattern or regular expression searching
+    QTextStream stream(&text);
+
+    PlainTextDecoder decoder;
+    decoder.setRecordLinePositions(true);
+
+    decoder.begin(&stream);
+    _session->emulation()->writeToStream(&decoder, first, last);
+    decoder.end();
+
+    linePositions = decoder.linePositions();
+}
+int SearchMatchIndex::matchCount() const
+{
+    return _matches.size() - _firstMatch + _tailMatches.size();
+}
+bool SearchMatchIndex::isComplete() const
+{
+    return !_building;
+}
+const SearchMatch& SearchMatchIndex::matchAt(int index) const
+{
+    const int indexedCount = _matches.size() - _firstMatch;
+    if (index < indexedCount)
+        return _matches[_firstMatch + index];
+    else
+        return _tailMatches[index - indexedCount];
+}
+int SearchMatchIndex::lowerBound(const SearchMatch& position) const
+{
+    const int indexedCount = _matches.size() - _firstMatch;
+    if (indexedCount > 0 && !(_matches.last() < position)) {
+        return qLowerBound(_matches.constBegin() + _firstMatch, _matches.constEnd(), position)
+               - (_matches.constBegin() + _firstMatch);
+    }
+
+    return indexedCount + (qLowerBound(_tailMatches.constBegin(), _tailMatches.constEnd(), position)
+                           - _tailMatches.constBegin());
+}
+int SearchMatchIndex::upperBound(const SearchMatch& position) const
+{
+    const int indexedCount = _matches.size() - _firstMatch;
+    if (indexedCount > 0 && position < _matches.last()) {
+        return qUpperBound(_matches.constBegin() + _firstMatch, _matches.constEnd(), position)
+               - (_matches.constBegin() + _firstMatch);
+    }
+
+    return indexedCount + (qUpperBound(_tailMatches.constBegin(), _tailMatches.constEnd(), position)
+                           - _tailMatches.constBegin());
+}
+SearchMatch SearchMatchIndex::toWindow(const SearchMatch& match) const
+{
+    SearchMatch result = match;
+    result.line -= lineOffset();
+    return result;
+}
+bool SearchMatchIndex::findNext(int line, int column, SearchMatch& match) const
+{
+    const int count = matchCount();
+    if (count == 0)
+        return false;
+
+    const SearchMatch position = { line + lineOffset(), column, 0 };
+    const int index = upperBound(position);
+
+    match = toWindow(matchAt(index < count ? index : 0));
+    return true;
+}
+bool SearchMatchIndex::findPrevious(int line, int column, SearchMatch& match) const
+{
+    const int count = matchCount();
+    if (count == 0)
+        return false;
+
+    const SearchMatch position = { line + lineOffset(), column, 0 };
+    const int index = lowerBound(position) - 1;
+
+    match = toWindow(matchAt(index >= 0 ? index : count - 1));
+    return true;
+}
+int SearchMatchIndex::matchIndex(const SearchMatch& match) const
+{
+    SearchMatch position = match;
+    position.line += lineOffset();
+    return lowerBound(position);
+}
+QBitArray SearchMatchIndex::lineMarkers(int parts) const
+{
+    QBitArray markers(parts);
+    if (!_window || parts <= 0)
+        return markers;
+
+    const int count = matchCount();
+    const qint64 lineCount = _window->lineCount();
+
+    for (int part = 0; part < parts && count > 0; part++) {
+        const int firstLine = int(lineCount * part / parts);
+        const int endLine = int(lineCount * (part + 1) / parts);
+        if (endLine <= firstLine)
+            continue;
+
+        const SearchMatch position = { lineOffset() + firstLine, 0, 0 };
+        const int index = lowerBound(position);
+        if (index < count && matchAt(index).line < lineOffset() + endLine)
+            markers.setBit(part);
+    }
+
+    return markers;
+}
+
+#include "SearchMatchIndex.moc"
@@ -0,0 +1,225 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SEARCHMATCHINDEX_H
+#define SEARCHMATCHINDEX_H
+
+// Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QQueue>
+#include <QtCore/QRegExp>
+#include <QtCore/QVector>
+
+// Konsole
+#include "SearchHistoryThread.h"
+
+namespace Konsole
+{
+class Screen;
+class ScreenWindow;
+class Session;
+
+/**
+ * Finds all of the matches for a regular expression in the output of a
+ * session, so that the number of matches can be shown and the next or
+ * previous match can be found without searching the output again.
+ *
+ * The output which already exists when the index is created is searched
+ * by a SearchHistoryThread, and progress() is emitted as it proceeds.
+ * After that, the index is kept up to date as new output arrives: lines
+ * which have been added to the history are searched once, and the lines
+ * at the end of the output, which may still change, are searched again
+ * when they change.  When history lines are rewrapped as they are
+ * scrolled into view, only those lines are searched again and the
+ * matches after them are moved.  matchesChanged() is emitted whenever
+ * the matches change.
+ *
+ * Lines are referred to by their position in the window's output, as
+ * elsewhere.  Internally they are counted from the first line there
+ * has been since the index was created, so that the matches which
+ * have been found do not need to be updated when lines are dropped
+ * from the start of the history.
+ */
+class SearchMatchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructs an index of the matches for @p regExp in the output of
+     * @p session, as shown by @p window, and begins searching the output.
+     */
+    SearchMatchIndex(Session* session, ScreenWindow* window, const QRegExp& regExp,
+                     QObject* parent = 0);
+    virtual ~SearchMatchIndex();
+
+    /** Returns the regular expression which is searched for */
+    QRegExp regExp() const;
+    /** Returns the window whose output is searched */
+    ScreenWindow* window() const;
+
+    /** Returns the number of matches which have been found so far */
+    int matchCount() const;
+    /** Returns true once all of the output has been searched */
+    bool isComplete() const;
+
+    /**
+     * Finds the first match which begins after @p column of @p line,
+     * continuing from the start of the output if there is none.
+     * Returns false if no matches have been found.
+     */
+    bool findNext(int line, int column, SearchMatch& match) const;
+    /**
+     * Finds the last match which begins before @p column of @p line,
+     * continuing from the end of the output if there is none.
+     * Returns false if no matches have been found.
+     */
+    bool findPrevious(int line, int column, SearchMatch& match) const;
+    /**
+     * Returns the position of @p match, which was returned by findNext()
+     * or findPrevious(), among all of the matches, starting from 0.
+     */
+    int matchIndex(const SearchMatch& match) const;
+
+    /**
+     * Divides the output into @p parts equal parts and returns an array
+     * which has a bit set for each part which contains a match.
+     */
+    QBitArray lineMarkers(int parts) const;
+
+signals:
+    /** Emitted when matches have been found or have been dropped */
+    void matchesChanged();
+    /**
+     * Emitted as the search through the existing output proceeds, with
+     * the percentage which has been searched, and with -1 once it has
+     * finished.
+     */
+    void progress(int percent);
+
+private slots:
+    void outputChanged();
+    void blockSearched(int block, int matchLine);
+    void checkHistory();
+
+private:
+    // a range of lines which is searched as one block
+    struct BlockRange {
+        int firstLine;
+        int lastLine;
+        // the number of lines which the lines have moved by since the
+        // block was passed to the search thread
+        int lineShift;
+    };
+
+    // a line at the end of the output, made up of the lines from 'firstLine'
+    // which are joined because they wrap, and the matches in it
+    struct TailLine {
+        int firstLine;
+        int lineCount;
+        QString text;
+        QList<int> linePositions;
+        QVector<SearchMatch> matches;
+    };
+
+    void rebuild();
+    void startThread();
+    void stopThread();
+    // updates the matches after history lines have been rewrapped, see
+    // Screen::lastHistoryReflow()
+    void moveMatches();
+    // adds the lines up to 'endLine' to the lines which have been searched
+    void extendIndex(int endLine);
+    void decodeBlocks();
+    void searchTail();
+    // searches the lines from 'firstLine' up to 'endLine', reusing the
+    // matches of those in 'oldLines' which have not changed
+    QVector<TailLine> searchTailLines(int firstLine, int endLine,
+                                      const QVector<TailLine>& oldLines) const;
+    void dropMatches();
+    // decodes the lines from 'firstLine' to 'lastLine' which have not been
+    // dropped and returns the line which 'text' begins with
+    int decodeLines(int firstLine, int lastLine, QString& text, QList<int>& linePositions) const;
+    // decodes the lines from 'first' to 'last' of the window
+    void decodeText(int first, int last, QString& text, QList<int>& linePositions) const;
+    // the number of lines to add to a line of the window to get the line
+    // it is referred to by here
+    int lineOffset() const;
+
+    // position among all matches of the first which is not before 'position'
+    int lowerBound(const SearchMatch& position) const;
+    // position among all matches of the first which is after 'position'
+    int upperBound(const SearchMatch& position) const;
+    const SearchMatch& matchAt(int index) const;
+    // converts a match to the window's line numbers
+    SearchMatch toWindow(const SearchMatch& match) const;
+
+    QPointer<Session> _session;
+    QPointer<ScreenWindow> _window;
+    const QRegExp _regExp;
+
+    // the screen and history generation which the matches were found in,
+    // see Screen::historyGeneration()
+    Screen* _screen;
+    int _historyGeneration;
+
+    // the number of lines dropped from the start of the output since the
+    // index was built
+    int _droppedLines;
+    // true while the lines which the screen has dropped since it last
+    // reported them have been added to _droppedLines, see outputChanged()
+    bool _droppedLinesCounted;
+    // lines before this one have been or are being searched, the lines
+    // from this one onwards make up the tail of the output
+    int _indexedLines;
+
+    SearchHistoryThread* _thread;
+    QQueue<BlockRange> _pendingBlocks;
+    QQueue<BlockRange> _decodedBlocks;
+    int _nextBlock;
+    bool _building;
+    int _buildLines;
+    int _searchedLines;
+
+    // matches in the lines before _indexedLines, in order, of which those
+    // before _firstMatch have been dropped
+    QVector<SearchMatch> _matches;
+    int _firstMatch;
+    // matches in the tail of the output
+    QVector<SearchMatch> _tailMatches;
+    // the lines of the tail of the output as they were last searched, and
+    // the positions of the first line of the screen and of the end of the
+    // output at the time
+    QVector<TailLine> _tail;
+    bool _tailValid;
+    int _tailScreenTop;
+    int _tailEnd;
+
+    // the number of lines in each block passed to the search thread
+    static const int BLOCK_LINES = 2000;
+    // the number of blocks which are decoded ahead of the search thread
+    static const int BLOCKS_AHEAD = 2;
+};
+}
+
+#endif // SEARCHMATCHINDEX_H
@@ -33,6 +33,7 @@
 #include <QApplication>
 #include <QtGui/QColor>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 #include <QtCore/QStringList>
 #include <QtDBus/QtDBus>
@@ -46,6 +47,7 @@
 #include <KProcess>
 #include <KStandardDirs>
 #include <KConfigGroup>
+#include <KGlobal>
 
 // Konsole
 #include <sessionadaptor.h>
@@ -62,6 +64,12 @@ using namespace Konsole;
 
 int Session::lastSessionId = 0;
 
+// the longest time in milliseconds spent processing output, by all sessions
+// together, before returning to the event loop, see OutputScheduler
+static const int OUTPUT_TIME_SLICE = 20;
+// the amount of output passed to the emulation between checks of the time
+static const int OUTPUT_BLOCK_SIZE = 4096;
+
 // HACK This is copied out of QUuid::createUuid with reseeding forced.
 // Required because color schemes repeatedly seed the RNG...
 // ...with a constant.
@@ -107,6 +115,7 @@ Session::Session(QObject* parent) :
     , _closePerUserRequest(false)
     , _addToUtmp(true)
     , _flowControlEnabled(true)
+    , _outputTimeSlicingEnabled(true)
     , _sessionId(0)
     , _sessionProcessInfo(0)
     , _foregroundProcessInfo(0)
@@ -160,6 +169,9 @@ Session::Session(QObject* parent) :
 
 Session::~Session()
 {
+    if (!_pendingOutput.isEmpty())
+        OutputScheduler::instance()->dequeue(this);
+
     delete _foregroundProcessInfo;
     delete _sessionProcessInfo;
     delete _emulation;
@@ -1062,6 +1074,11 @@ const HistoryType& Session::historyType() const
     return _emulation->history();
 }
 
+void Session::setHistoryIndexEnabled(bool enable)
+{
+    _emulation->setHistoryIndexEnabled(enable);
+}
+
 void Session::clearHistory()
 {
     _emulation->clearHistory();
@@ -1147,6 +1164,28 @@ void Session::setFlowControlEnabled(bool enabled)
 
     emit flowControlEnabledChanged(enabled);
 }
+void Session::setOutputTimeSlicingEnabled(bool enabled)
+{
+    // output which is still waiting for its time slice is processed now,
+    // otherwise output which arrives later and is passed straight to the
+    // emulation would overtake it
+    if (!enabled && !_pendingOutput.isEmpty()) {
+        OutputScheduler::instance()->dequeue(this);
+
+        const QByteArray pendingOutput = _pendingOutput;
+        _pendingOutput.clear();
+        _emulation->receiveData(pendingOutput.constData(), pendingOutput.size());
+
+        if (_shellProcess)
+            _shellProcess->setReadingSuspended(false);
+    }
+
+    _outputTimeSlicingEnabled = enabled;
+}
+bool Session::outputTimeSlicingEnabled() const
+{
+    return _outputTimeSlicingEnabled;
+}
 bool Session::flowControlEnabled() const
 {
     if (_shellProcess)
@@ -1267,7 +1306,63 @@ void Session::zmodemFinished()
 
 void Session::onReceiveBlock(const char* buf, int len)
 {
-    _emulation->receiveData(buf, len);
+    if (!_outputTimeSlicingEnabled) {
+        _emulation->receiveData(buf, len);
+        return;
+    }
+
+    // keep output in order behind any which is still waiting
+    if (!_pendingOutput.isEmpty()) {
+        _pendingOutput.append(buf, len);
+        return;
+    }
+
+    OutputScheduler* scheduler = OutputScheduler::instance();
+    scheduler->startSlice();
+
+    // if other sessions have used up the slice already, this session waits
+    // for its turn behind them
+    const int processed = scheduler->sliceUsedUp() ? 0 : processOutput(buf, len);
+    if (processed < len) {
+        _pendingOutput = QByteArray(buf + processed, len - processed);
+
+        // let the program wait instead of buffering ever more output,
+        // until the backlog has been dealt with
+        _shellProcess->setReadingSuspended(true);
+        scheduler->enqueue(this);
+    }
+}
+
+int Session::processOutput(const char* data, int length)
+{
+    const OutputScheduler* scheduler = OutputScheduler::instance();
+
+    int processed = 0;
+    while (processed < length) {
+        const int count = qMin(length - processed, OUTPUT_BLOCK_SIZE);
+        _emulation->receiveData(data + processed, count);
+        processed += count;
+
+        if (scheduler->sliceUsedUp())
+            break;
+    }
+
+    return processed;
+}
+
+bool Session::processPendingOutput()
+{
+    const int processed = processOutput(_pendingOutput.constData(), _pendingOutput.size());
+    _pendingOutput.remove(0, processed);
+
+    if (!_pendingOutput.isEmpty())
+        return true;
+
+    _pendingOutput.squeeze();
+    if (_shellProcess)
+        _shellProcess->setReadingSuspended(false);
+
+    return false;
 }
 
 QSize Session::size()
@@ -1355,7 +1450,7 @@ QString Session::tabTitleFormat(int context) const
 void Session::setHistorySize(int lines)
 {
     if (lines < 0) {
-        setHistoryType(HistoryTypeFile());
+        setHistoryType(CompressedHistoryType());
     } else if (lines == 0) {
         setHistoryType(HistoryTypeNone());
     } else {
@@ -1378,6 +1473,23 @@ int Session::historySize() const
     }
 }
 
+qint64 Session::historyMemoryUsage() const
+{
+    return _emulation->historyMemoryUsage();
+}
+
+QString Session::historyFileName() const
+{
+    return historyDirectory() + shellSessionId();
+}
+
+QString Session::historyDirectory()
+{
+    // the directory is created by PersistentHistoryScroll, with permissions
+    // which keep the output of sessions private
+    return KStandardDirs::locateLocal("data", "konsole/history/", false);
+}
+
 int Session::foregroundProcessId()
 {
     int pid;
@@ -1430,7 +1542,17 @@ void Session::restoreSession(KConfigGroup& group)
     value = group.readEntry("RemoteTab");
     if (!value.isEmpty()) setTabTitleFormat(RemoteTabTitle, value);
     value = group.readEntry("SessionGuid");
-    if (!value.isEmpty()) _uniqueIdentifier = QUuid(value);
+    if (!value.isEmpty()) {
+        const QString oldHistoryFileName = historyFileName();
+        _uniqueIdentifier = QUuid(value);
+
+        // pick up the history which was saved with the session
+        const PersistentHistoryType* persistentHistory = dynamic_cast<const PersistentHistoryType*>(&historyType());
+        if (persistentHistory && persistentHistory->fileName() != historyFileName()) {
+            setHistoryType(PersistentHistoryType(historyFileName(), persistentHistory->maximumLineCount()));
+            PersistentHistoryScroll::removeFiles(oldHistoryFileName);
+        }
+    }
     value = group.readEntry("Encoding");
     if (!value.isEmpty()) setCodec(value.toUtf8());
 }
@@ -1518,5 +1640,66 @@ void SessionGroup::forwardData(const char* data, int size)
     _inForwardData = false;
 }
 
+OutputScheduler::OutputScheduler()
+    : _timerId(0)
+{
+}
+
+K_GLOBAL_STATIC(OutputScheduler , theOutputScheduler)
+OutputScheduler* OutputScheduler::instance()
+{
+    return theOutputScheduler;
+}
+
+void OutputScheduler::startSlice()
+{
+    // the zero timer fires once control has returned to the event loop
+    if (_timerId == 0) {
+        _sliceTimer.start();
+        _timerId = startTimer(0);
+    }
+}
+
+bool OutputScheduler::sliceUsedUp() const
+{
+    return _timerId != 0 && _sliceTimer.elapsed() >= OUTPUT_TIME_SLICE;
+}
+
+void OutputScheduler::enqueue(Session* session)
+{
+    Q_ASSERT(!_queue.contains(session));
+    _queue.append(session);
+}
+
+void OutputScheduler::dequeue(Session* session)
+{
+    _queue.removeAll(session);
+}
+
+void OutputScheduler::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != _timerId)
+        return;
+
+    if (_queue.isEmpty()) {
+        killTimer(_timerId);
+        _timerId = 0;
+        return;
+    }
+
+    // the queued sessions continue in a new slice, taking turns so that the
+    // session which used up the last slice does not get the next one first.
+    // The timer keeps running, so the slice is shared with output arriving
+    // for other sessions before the next pass.
+    _sliceTimer.start();
+
+    const int count = _queue.count();
+    for (int i = 0; i < count && !_queue.isEmpty() && !sliceUsedUp(); i++) {
+        Session* session = _queue.takeFirst();
+        if (session->processPendingOutput())
+            _queue.append(session);
+    }
+}
+
 #include "Session.moc"
 
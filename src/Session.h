@@ -27,6 +27,7 @@
 // Qt
 #include <QtCore/QStringList>
 #include <QtCore/QHash>
+#include <QtCore/QElapsedTimer>
 //#include <QtCore/QByteRef>
 #include <QtCore/QUuid>
 #include <QtCore/QSize>
@@ -52,6 +53,7 @@ class ProcessInfo;
 class TerminalDisplay;
 class ZModemDialog;
 class HistoryType;
+class OutputScheduler;
 
 /**
  * Represents a terminal session consisting of a pseudo-teletype and a terminal emulation.
@@ -220,6 +222,12 @@ public:
      * Clears the history store used by this session.
      */
     void clearHistory();
+    /**
+     * Sets whether the text in the history store of this session is indexed,
+     * which makes searches for literal text in a large history faster at
+     * the cost of some memory.
+     */
+    void setHistoryIndexEnabled(bool enable);
 
     /**
      * Sets the key bindings used by this session.  The bindings
@@ -459,6 +467,25 @@ public slots:
     /** Returns whether flow control is enabled for this terminal session. */
     Q_SCRIPTABLE bool flowControlEnabled() const;
 
+    /**
+     * Sets whether output from the terminal program is processed a slice
+     * at a time.
+     *
+     * When enabled, a large block of output is only processed for a short
+     * time before control returns to the event loop, and reading from the
+     * program is suspended until the remaining output has been processed.
+     * This keeps the window, including the other sessions in it,
+     * responsive while this session is flooded with output.  The time
+     * slice is shared by all sessions, see OutputScheduler.
+     *
+     * When time slicing is disabled, output which is still waiting to be
+     * processed is processed straight away.
+     */
+    void setOutputTimeSlicingEnabled(bool enabled);
+
+    /** Returns whether output is processed a slice at a time. */
+    bool outputTimeSlicingEnabled() const;
+
     /**
      * Sends @p text to the current foreground terminal program.
      */
@@ -552,6 +579,25 @@ public slots:
      */
     Q_SCRIPTABLE int historySize() const;
 
+    /**
+     * Returns the approximate number of bytes of memory used by the
+     * history of this session.
+     */
+    Q_SCRIPTABLE qint64 historyMemoryUsage() const;
+
+    /**
+     * Returns the name of the files in which the history of this session
+     * is kept if the PersistentHistory profile property is enabled.
+     * The name is based on the session's unique identifier, so that
+     * the history can be found again when the session is restored.
+     * The files are in historyDirectory(), which is only created once
+     * a history is written to it.
+     */
+    QString historyFileName() const;
+
+    /** Returns the directory in which the history files of sessions are kept. */
+    static QString historyDirectory();
+
 signals:
 
     /** Emitted when the terminal process starts. */
@@ -684,6 +730,12 @@ private:
     static QString checkProgram(const QString& program);
 
     void updateTerminalSize();
+    // passes output to the emulation until it has all been processed or
+    // the time slice is used up, and returns the number of bytes processed
+    int processOutput(const char* data, int length);
+    // processes output which waits for its time slice, and returns true
+    // if some of it is still left afterwards
+    bool processPendingOutput();
     WId windowId() const;
     bool kill(int signal);
     // print a warning message in the terminal.  This is used
@@ -725,6 +777,9 @@ private:
     bool           _addToUtmp;
     bool           _flowControlEnabled;
 
+    bool           _outputTimeSlicingEnabled;
+    QByteArray     _pendingOutput; // output waiting for the next time slice
+
     QString        _program;
     QStringList    _arguments;
 
@@ -748,6 +803,8 @@ private:
     QSize _preferredSize;
 
     static int lastSessionId;
+
+    friend class OutputScheduler;
 };
 
 /**
@@ -823,6 +880,53 @@ private:
 
     int _masterMode;
 };
+
+/**
+ * Shares the time spent processing output between all sessions.
+ *
+ * Each pass of the event loop, sessions process output for at most one
+ * time slice in total, rather than one slice each, so that several sessions
+ * which are flooded with output at once keep the window as responsive as a
+ * single one.  Sessions whose output does not fit into the slice are queued
+ * and continue in turn in the following passes.
+ */
+class OutputScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    OutputScheduler();
+
+    /** Returns the global OutputScheduler instance. */
+    static OutputScheduler* instance();
+
+    /**
+     * Starts a time slice unless one is running already.  The slice ends
+     * once control has returned to the event loop.
+     */
+    void startSlice();
+
+    /** Returns true if the current time slice has been used up. */
+    bool sliceUsedUp() const;
+
+    /**
+     * Queues @p session, which has output waiting that did not fit into
+     * the current time slice.
+     */
+    void enqueue(Session* session);
+
+    /** Removes @p session from the queue, see enqueue() */
+    void dequeue(Session* session);
+
+protected:
+    virtual void timerEvent(QTimerEvent* event);
+
+private:
+    QElapsedTimer _sliceTimer;
+    int _timerId;
+    // sessions with output waiting, in the order in which they continue
+    QList<Session*> _queue;
+};
 }
 
 #endif
@@ -69,6 +69,9 @@
 #include "HistorySizeDialog.h"
 #include "IncrementalSearchBar.h"
 #include "RenameTabDialog.h"
+#include "Screen.h"
+#include "SearchHistoryThread.h"
+#include "SearchMatchIndex.h"
 #include "ScreenWindow.h"
 #include "Session.h"
 #include "ProfileList.h"
@@ -121,6 +124,7 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _keepIconUntilInteraction(false)
     , _showMenuAction(0)
     , _isSearchBarEnabled(false)
+    , _searchMatchIndex(0)
 {
     Q_ASSERT(session);
     Q_ASSERT(view);
@@ -491,8 +495,11 @@ bool SessionController::eventFilter(QObject* watched , QEvent* event)
                 connect(_view->screenWindow(), SIGNAL(outputChanged()), this,
                         SLOT(requireUrlFilterUpdate()));
 
-                // install filter on the view to highlight URLs
+                // install filter on the view to highlight URLs.  links are only
+                // needed under the mouse pointer, so the filter only looks for
+                // them in the lines which the pointer moves over
                 _viewUrlFilter = new UrlFilter();
+                _viewUrlFilter->setLazy(true);
                 _view->filterChain()->addFilter(_viewUrlFilter);
             }
 
@@ -530,6 +537,7 @@ void SessionController::setSearchBar(IncrementalSearchBar* searchBar)
         connect(_searchBar, SIGNAL(findPreviousClicked()), this, SLOT(findPreviousInHistory()));
         connect(_searchBar, SIGNAL(highlightMatchesToggled(bool)) , this , SLOT(highlightMatches(bool)));
         connect(_searchBar, SIGNAL(matchCaseToggled(bool)), this, SLOT(changeSearchMatch()));
+        connect(_searchBar, SIGNAL(findAllToggled(bool)), this, SLOT(changeSearchMatch()));
 
         // if the search bar was previously active
         // then re-enter search mode
@@ -1164,6 +1172,11 @@ void SessionController::searchHistory(bool showSearchBar)
         } else {
             setFindNextPrevEnabled(false);
 
+            if (_searchTask)
+                _searchTask->cancel();
+            _searchBar->setSearchProgress(-1);
+
+            removeSearchMatchIndex();
             removeSearchFilter();
 
             _view->setFocus(Qt::ActiveWindowFocusReason);
@@ -1193,8 +1206,10 @@ void SessionController::searchTextChanged(const QString& text)
 }
 void SessionController::searchCompleted(bool success)
 {
-    if (_searchBar)
+    if (_searchBar) {
         _searchBar->setFoundMatch(success);
+        _searchBar->setSearchProgress(-1);
+    }
 }
 
 void SessionController::beginSearch(const QString& text , int direction)
@@ -1210,10 +1225,33 @@ void SessionController::beginSearch(const QString& text , int direction)
     QRegExp regExp(text ,  caseHandling , syntax);
     _searchFilter->setRegExp(regExp);
 
-    if (!regExp.isEmpty()) {
+    // a search which is still running was started for the previous search text
+    if (_searchTask)
+        _searchTask->cancel();
+
+    if (options.at(IncrementalSearchBar::FindAll) && !regExp.isEmpty()) {
+        ScreenWindow* window = _view->screenWindow();
+        if (!_searchMatchIndex || _searchMatchIndex->regExp() != regExp ||
+                _searchMatchIndex->window() != window) {
+            removeSearchMatchIndex();
+
+            _searchMatchIndex = new SearchMatchIndex(_session, window, regExp, this);
+            connect(_searchMatchIndex, SIGNAL(matchesChanged()), this, SLOT(updateSearchMatches()));
+            connect(_searchMatchIndex, SIGNAL(progress(int)), _searchBar, SLOT(setSearchProgress(int)));
+        }
+    } else {
+        removeSearchMatchIndex();
+    }
+
+    // until all of the output has been indexed, the matches are searched for directly
+    if (_searchMatchIndex && _searchMatchIndex->isComplete()) {
+        findIndexedMatch(direction);
+    } else if (!regExp.isEmpty()) {
         SearchHistoryTask* task = new SearchHistoryTask(this);
+        _searchTask = task;
 
         connect(task, SIGNAL(completed(bool)), this, SLOT(searchCompleted(bool)));
+        connect(task, SIGNAL(progress(int)), _searchBar, SLOT(setSearchProgress(int)));
 
         task->setRegExp(regExp);
         task->setSearchDirection((SearchHistoryTask::SearchDirection)direction);
@@ -1224,8 +1262,100 @@ void SessionController::beginSearch(const QString& text , int direction)
         searchCompleted(false);
     }
 
+    updateSearchMatches();
     _view->processFilters();
 }
+void SessionController::findIndexedMatch(int direction)
+{
+    Q_ASSERT(_searchMatchIndex && _searchMatchIndex->isComplete());
+
+    ScreenWindow* window = _view->screenWindow();
+
+    int column = 0;
+    int line = 0;
+    SearchMatch match;
+    bool found = false;
+
+    if (direction == SearchHistoryTask::ForwardsSearch) {
+        window->getSelectionEnd(column, line);
+        found = _searchMatchIndex->findNext(line + window->currentLine(), column, match);
+    } else {
+        window->getSelectionStart(column, line);
+        found = _searchMatchIndex->findPrevious(line + window->currentLine(), column, match);
+    }
+
+    if (found) {
+        highlightSearchMatch(match);
+    } else {
+        // if no match was found, clear selection to indicate this
+        window->clearSelection();
+        window->notifyOutputChanged();
+    }
+
+    searchCompleted(found);
+}
+void SessionController::highlightSearchMatch(const SearchMatch& match)
+{
+    ScreenWindow* window = _view->screenWindow();
+
+    // scrolling to a line which has not been rewrapped since the window was
+    // resized rewraps it, which moves the match
+    int column = match.column;
+    const int line = window->scrollTo(match.line, &column);
+
+    // a match may continue on the following lines if they are wrapped
+    const int columns = window->columnCount();
+    const int end = column + qMax(match.length, 1) - 1;
+
+    window->setSelectionStart(column , line - window->currentLine() , false);
+    window->setSelectionEnd(end % columns , line + end / columns - window->currentLine());
+    window->setTrackOutput(false);
+    window->notifyOutputChanged();
+}
+void SessionController::updateSearchMatches()
+{
+    if (!_searchBar)
+        return;
+
+    if (!_searchMatchIndex) {
+        _searchBar->setMatchCount(-1, -1);
+        _view->setScrollBarMarkers(QBitArray());
+        return;
+    }
+
+    // find out whether the selection is one of the matches
+    int current = -1;
+    ScreenWindow* window = _searchMatchIndex->window();
+    if (window) {
+        int column = 0;
+        int line = 0;
+        window->getSelectionStart(column, line);
+
+        SearchMatch match;
+        if (window->isSelected(column, line) &&
+                _searchMatchIndex->findNext(line + window->currentLine(), column - 1, match) &&
+                match.line == line + window->currentLine() && match.column == column) {
+            current = _searchMatchIndex->matchIndex(match);
+        }
+    }
+
+    _searchBar->setMatchCount(current, _searchMatchIndex->matchCount());
+    _view->setScrollBarMarkers(_searchMatchIndex->lineMarkers(qMax(_view->height(), 1)));
+}
+void SessionController::removeSearchMatchIndex()
+{
+    if (!_searchMatchIndex)
+        return;
+
+    delete _searchMatchIndex;
+    _searchMatchIndex = 0;
+
+    if (_searchBar) {
+        _searchBar->setMatchCount(-1, -1);
+        _searchBar->setSearchProgress(-1);
+    }
+    _view->setScrollBarMarkers(QBitArray());
+}
 void SessionController::highlightMatches(bool highlight)
 {
     if (highlight) {
@@ -1300,7 +1430,7 @@ void SessionController::scrollBackOptionsChanged(int mode, int lines)
         _session->setHistoryType(CompactHistoryType(lines));
         break;
     case Enum::UnlimitedHistory:
-        _session->setHistoryType(HistoryTypeFile());
+        _session->setHistoryType(CompressedHistoryType());
         break;
     }
 }
@@ -1430,7 +1560,9 @@ void SessionController::showDisplayContextMenu(const QPoint& position)
     QPointer<QMenu> popup = qobject_cast<QMenu*>(factory()->container("session-popup-menu", this));
     if (popup) {
         // prepend content-specific actions such as "Open Link", "Copy Email Address" etc.
-        QList<QAction*> contentActions = _view->filterActions(position);
+        // these belong to this menu, see Filter::HotSpot::actions()
+        const QList<QAction*> hotSpotActions = _view->filterActions(position);
+        QList<QAction*> contentActions = hotSpotActions;
         QAction* contentSeparator = new QAction(popup);
         contentSeparator->setSeparator(true);
         contentActions << contentSeparator;
@@ -1471,6 +1603,8 @@ void SessionController::showDisplayContextMenu(const QPoint& position)
 
         if (chosen && chosen->objectName() == "close-session")
             chosen->trigger();
+
+        qDeleteAll(hotSpotActions);
     } else {
         kWarning() << "Unable to display popup menu for session"
                    << _session->title(Session::NameRole)
@@ -1719,12 +1853,31 @@ void SearchHistoryTask::addScreenWindow(Session* session , ScreenWindow* searchW
 }
 void SearchHistoryTask::execute()
 {
-    QMapIterator< SessionPtr , ScreenWindowPtr > iter(_windows);
+    _pendingSessions = _windows.keys();
+    searchNextWindow();
+}
+void SearchHistoryTask::cancel()
+{
+    stopThread();
+    _pendingSessions.clear();
 
-    while (iter.hasNext()) {
-        iter.next();
-        executeOnScreenWindow(iter.key() , iter.value());
+    if (autoDelete())
+        deleteLater();
+}
+void SearchHistoryTask::searchNextWindow()
+{
+    while (!_pendingSessions.isEmpty()) {
+        SessionPtr session = _pendingSessions.takeFirst();
+        ScreenWindowPtr window = _windows.value(session);
+
+        if (session && window) {
+            executeOnScreenWindow(session , window);
+            return;
+        }
     }
+
+    if (autoDelete())
+        deleteLater();
 }
 
 void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window)
@@ -1732,117 +1885,172 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
     Q_ASSERT(session);
     Q_ASSERT(window);
 
-    Emulation* emulation = session->emulation();
+    _session = session;
+    _window = window;
+
+    if (_regExp.isEmpty()) {
+        finishWindow(false);
+        return;
+    }
 
     int selectionColumn = 0;
     int selectionLine = 0;
 
     window->getSelectionEnd(selectionColumn , selectionLine);
 
-    if (!_regExp.isEmpty()) {
-        int pos = -1;
-        const bool forwards = (_direction == ForwardsSearch);
-        int startLine = selectionLine + window->currentLine() + (forwards ? 1 : -1);
-        // Temporary fix for #205495
-        if (startLine < 0) startLine = 0;
-        const int lastLine = window->lineCount() - 1;
-        QString string;
+    const bool forwards = (_direction == ForwardsSearch);
+    const int lastLine = window->lineCount() - 1;
+    // Temporary fix for #205495
+    const int startLine = qBound(0, selectionLine + window->currentLine() + (forwards ? 1 : -1), lastLine);
+
+    // search through the output in blocks, starting at the selection and continuing
+    // from the other end of the output when the top/bottom is reached.
+    // small blocks keep the time spent decoding each one on the GUI thread short.
+    _blocks.clear();
+    if (forwards) {
+        addBlockRanges(startLine, lastLine, true);
+        addBlockRanges(0, startLine - 1, true);
+    } else {
+        addBlockRanges(0, startLine, false);
+        addBlockRanges(startLine + 1, lastLine, false);
+    }
 
+    // lines which are dropped from the top of the output while the search is
+    // running shift the line numbers of the remaining lines.  lines which the
+    // screen has dropped but not yet reported have already been taken away
+    _droppedLines = -window->screen()->droppedLines();
+    connect(session->emulation(), SIGNAL(outputChanged()), this, SLOT(outputChanged()));
+
+    // the thread deletes itself once it has finished
+    _thread = new SearchHistoryThread(_regExp, forwards);
+    connect(_thread, SIGNAL(blockSearched(int,int)), this, SLOT(blockSearched(int,int)));
+    connect(_thread, SIGNAL(finished()), _thread, SLOT(deleteLater()));
+    _thread->start(QThread::LowPriority);
+
+    for (int block = 0; block < BLOCKS_AHEAD && block < _blocks.count(); block++)
+        decodeBlock(block);
+}
+void SearchHistoryTask::addBlockRanges(int firstLine, int lastLine, bool forwards)
+{
+    BlockRange range;
+    range.droppedLines = 0;
+
+    if (forwards) {
+        for (int line = firstLine; line <= lastLine; line += BLOCK_LINES) {
+            range.firstLine = line;
+            range.lastLine = qMin(line + BLOCK_LINES - 1, lastLine);
+            _blocks << range;
+        }
+    } else {
+        for (int line = lastLine; line >= firstLine; line -= BLOCK_LINES) {
+            range.firstLine = qMax(line - BLOCK_LINES + 1, firstLine);
+            range.lastLine = line;
+            _blocks << range;
+        }
+    }
+}
+void SearchHistoryTask::decodeBlock(int block)
+{
+    BlockRange& range = _blocks[block];
+    range.droppedLines = _droppedLines;
+
+    // lines which have been dropped since the search began can no longer be searched
+    const int firstLine = qMax(range.firstLine - _droppedLines, 0);
+    const int lastLine = qMin(range.lastLine - _droppedLines, _window->lineCount() - 1);
+
+    QString string;
+    QList<int> linePositions;
+
+    if (firstLine <= lastLine && mayContainMatch(firstLine, lastLine)) {
         //text stream to read history into string for pattern or regular expression searching
         QTextStream searchStream(&string);
 
         PlainTextDecoder decoder;
         decoder.setRecordLinePositions(true);
 
-        //setup first and last lines depending on search direction
-        int line = startLine;
-
-        //read through and search history in blocks of 10K lines.
-        //this balances the need to retrieve lots of data from the history each time
-        //(for efficient searching)
-        //without using silly amounts of memory if the history is very large.
-        const int maxDelta = qMin(window->lineCount(), 10000);
-        int delta = forwards ? maxDelta : -maxDelta;
-
-        int endLine = line;
-        bool hasWrapped = false;  // set to true when we reach the top/bottom
-        // of the output and continue from the other
-        // end
-
-        //loop through history in blocks of <delta> lines.
-        do {
-            // ensure that application does not appear to hang
-            // if searching through a lengthy output
-            QApplication::processEvents();
-
-            // calculate lines to search in this iteration
-            if (hasWrapped) {
-                if (endLine == lastLine)
-                    line = 0;
-                else if (endLine == 0)
-                    line = lastLine;
-
-                endLine += delta;
-
-                if (forwards)
-                    endLine = qMin(startLine , endLine);
-                else
-                    endLine = qMax(startLine , endLine);
-            } else {
-                endLine += delta;
-
-                if (endLine > lastLine) {
-                    hasWrapped = true;
-                    endLine = lastLine;
-                } else if (endLine < 0) {
-                    hasWrapped = true;
-                    endLine = 0;
-                }
-            }
-
-            decoder.begin(&searchStream);
-            emulation->writeToStream(&decoder, qMin(endLine, line) , qMax(endLine, line));
-            decoder.end();
-
-            // line number search below assumes that the buffer ends with a new-line
-            string.append('\n');
+        decoder.begin(&searchStream);
+        _session->emulation()->writeToStream(&decoder, firstLine, lastLine);
+        decoder.end();
 
-            pos = -1;
-            if (forwards)
-                pos = string.indexOf(_regExp);
-            else
-                pos = string.lastIndexOf(_regExp);
+        linePositions = decoder.linePositions();
+    }
 
-            //if a match is found, position the cursor on that line and update the screen
-            if (pos != -1) {
-                int newLines = 0;
-                QList<int> linePositions = decoder.linePositions();
-                while (newLines < linePositions.count() && linePositions[newLines] <= pos)
-                    newLines++;
+    // line number search in the thread assumes that the buffer ends with a new-line
+    string.append('\n');
 
-                // ignore the new line at the start of the buffer
-                newLines--;
+    _thread->addBlock(block, string, linePositions, firstLine);
+}
+bool SearchHistoryTask::mayContainMatch(int firstLine, int lastLine) const
+{
+    // the index of the history only helps to find literal text
+    if (_regExp.patternSyntax() != QRegExp::FixedString)
+        return true;
 
-                int findPos = qMin(line, endLine) + newLines;
+    return _window->screen()->historyMayContain(_regExp.pattern(), firstLine, lastLine);
+}
+void SearchHistoryTask::blockSearched(int block, int matchLine)
+{
+    // ignore blocks searched by a thread which has since been stopped
+    if (sender() != _thread)
+        return;
 
-                highlightResult(window, findPos);
+    if (!_session || !_window) {
+        stopThread();
+        finishWindow(false);
+        return;
+    }
 
-                emit completed(true);
+    if (matchLine != -1) {
+        // the output may have scrolled since the block was decoded
+        const int line = matchLine - (_droppedLines - _blocks[block].droppedLines);
 
-                return;
-            }
+        //if a match is found, position the cursor on that line and update the screen
+        if (line >= 0) {
+            stopThread();
+            highlightResult(_window, line);
+            finishWindow(true);
+            return;
+        }
+    }
 
-            //clear the current block of text and move to the next one
-            string.clear();
-            line = endLine;
-        } while (startLine != endLine);
+    if (block == _blocks.count() - 1) {
+        stopThread();
 
         // if no match was found, clear selection to indicate this
-        window->clearSelection();
-        window->notifyOutputChanged();
+        _window->clearSelection();
+        _window->notifyOutputChanged();
+
+        finishWindow(false);
+        return;
     }
 
-    emit completed(false);
+    emit progress(100 * (block + 1) / _blocks.count());
+
+    if (block + BLOCKS_AHEAD < _blocks.count())
+        decodeBlock(block + BLOCKS_AHEAD);
+}
+void SearchHistoryTask::outputChanged()
+{
+    // this is called before the screen resets its count of dropped lines
+    if (_window)
+        _droppedLines += _window->screen()->droppedLines();
+}
+void SearchHistoryTask::finishWindow(bool success)
+{
+    emit completed(success);
+
+    searchNextWindow();
+}
+void SearchHistoryTask::stopThread()
+{
+    if (_session)
+        disconnect(_session->emulation(), SIGNAL(outputChanged()), this, SLOT(outputChanged()));
+
+    if (_thread) {
+        disconnect(_thread, SIGNAL(blockSearched(int,int)), this, SLOT(blockSearched(int,int)));
+        _thread->cancel();
+        _thread = 0;
+    }
 }
 void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
 {
@@ -1852,9 +2060,10 @@ void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
     //kDebug() << "Found result at line " << findPos;
 
     //update display to show area of history containing selection
-    window->scrollTo(findPos);
-    window->setSelectionStart(0 , findPos - window->currentLine() , false);
-    window->setSelectionEnd(window->columnCount() , findPos - window->currentLine());
+    //the line moves if it is rewrapped as it is scrolled into view
+    const int line = window->scrollTo(findPos);
+    window->setSelectionStart(0 , line - window->currentLine() , false);
+    window->setSelectionEnd(window->columnCount() , line - window->currentLine());
     window->setTrackOutput(false);
     window->notifyOutputChanged();
 }
@@ -1862,7 +2071,13 @@ void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
 SearchHistoryTask::SearchHistoryTask(QObject* parent)
     : SessionTask(parent)
     , _direction(BackwardsSearch)
+    , _thread(0)
+    , _droppedLines(0)
+{
+}
+SearchHistoryTask::~SearchHistoryTask()
 {
+    stopThread();
 }
 void SearchHistoryTask::setSearchDirection(SearchDirection direction)
 {
@@ -67,6 +67,11 @@ class EditProfileDialog;
 // SaveHistoryTask
 class TerminalCharacterDecoder;
 
+// SearchHistoryTask
+class SearchHistoryThread;
+class SearchMatchIndex;
+struct SearchMatch;
+
 typedef QPointer<Session> SessionPtr;
 
 /**
@@ -269,6 +274,7 @@ private slots:
     // display area
 
     void updateSearchFilter();
+    void updateSearchMatches(); // show the number and positions of the matches found
 
     void zmodemDownload();
     void zmodemUpload();
@@ -289,6 +295,10 @@ private:
     void setupCommonActions();
     void setupExtraActions();
     void removeSearchFilter(); // remove and delete the current search filter if set
+    void removeSearchMatchIndex(); // remove and delete the index of all matches if set
+    // finds the next match in the index of all matches, which must be complete
+    void findIndexedMatch(int direction);
+    void highlightSearchMatch(const SearchMatch& match);
     void setFindNextPrevEnabled(bool enabled);
     void listenForScreenWindowUpdates();
 
@@ -346,6 +356,8 @@ private:
     QWeakPointer<EditProfileDialog> _editProfileDialog;
 
     QString _searchText;
+    QPointer<SearchHistoryTask> _searchTask;
+    SearchMatchIndex* _searchMatchIndex;
 };
 inline bool SessionController::isValid() const
 {
@@ -447,7 +459,6 @@ private:
     QHash<KJob*, SaveJob> _jobSession;
 };
 
-//class SearchHistoryThread;
 /**
  * A task which searches through the output of sessions for matches for a given regular expression.
  * SearchHistoryTask operates on ScreenWindow instances rather than sessions added by addSession().
@@ -456,11 +467,13 @@ private:
  * When execute() is called, the search begins in the direction specified by searchDirection(),
  * starting at the position of the current selection.
  *
+ * The output is matched against the regular expression by a SearchHistoryThread,
+ * so the search continues after execute() returns.  The output is decoded a few
+ * blocks ahead of the thread and progress() is emitted as each block is searched.
+ * A search which is no longer needed can be stopped with cancel().
+ *
  * FIXME - This is not a proper implementation of SessionTask, in that it ignores sessions specified
  * with addSession()
- *
- * TODO - Implementation requirements:
- *          May provide progress feedback to the user when searching very large output logs.
  */
 class SearchHistoryTask : public SessionTask
 {
@@ -482,6 +495,7 @@ public:
      * Constructs a new search task.
      */
     explicit SearchHistoryTask(QObject* parent = 0);
+    virtual ~SearchHistoryTask();
 
     /** Adds a screen window to the list to search when execute() is called. */
     void addScreenWindow(Session* session , ScreenWindow* searchWindow);
@@ -497,28 +511,78 @@ public:
     SearchDirection searchDirection() const;
 
     /**
-     * Performs a search through the session's history, starting at the position
+     * Begins a search through the session's history, starting at the position
      * of the current selection, in the direction specified by setSearchDirection().
      *
      * If it finds a match, the ScreenWindow specified in the constructor is
      * scrolled to the position where the match occurred and the selection
-     * is set to the matching text.  execute() then returns immediately.
+     * is set to the matching text.  The completed() signal is emitted when
+     * the search of each window has finished.
      *
      * To continue the search looking for further matches, call execute() again.
      */
     virtual void execute();
 
+    /**
+     * Stops the search without emitting completed().  If autoDelete() is
+     * true the task is deleted.
+     */
+    void cancel();
+
+signals:
+    /**
+     * Emitted as the search through a window's output proceeds.
+     *
+     * @param percent The percentage of the output which has been searched.
+     */
+    void progress(int percent);
+
+private slots:
+    void blockSearched(int block, int matchLine);
+    void outputChanged();
+
 private:
     typedef QPointer<ScreenWindow> ScreenWindowPtr;
 
+    // a range of lines which is searched as one block
+    struct BlockRange {
+        int firstLine;
+        int lastLine;
+        // the value of _droppedLines when the block was decoded
+        int droppedLines;
+    };
+
+    void searchNextWindow();
     void executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window);
+    void addBlockRanges(int firstLine, int lastLine, bool forwards);
+    void decodeBlock(int block);
+    // returns false if the lines from 'firstLine' to 'lastLine' can not
+    // contain a match, see Screen::historyMayContain()
+    bool mayContainMatch(int firstLine, int lastLine) const;
+    void finishWindow(bool success);
+    void stopThread();
     void highlightResult(ScreenWindowPtr window , int position);
 
     QMap< SessionPtr , ScreenWindowPtr > _windows;
     QRegExp _regExp;
     SearchDirection _direction;
 
-    //static QPointer<SearchHistoryThread> _thread;
+    // the windows which have not been searched yet
+    QList<SessionPtr> _pendingSessions;
+
+    // the window which is being searched
+    SessionPtr _session;
+    ScreenWindowPtr _window;
+    SearchHistoryThread* _thread;
+    QList<BlockRange> _blocks;
+    // the number of lines which have been dropped from the top of the
+    // window's output since the block ranges were calculated
+    int _droppedLines;
+
+    // the number of lines in each block passed to the search thread
+    static const int BLOCK_LINES = 2000;
+    // the number of blocks which are decoded ahead of the search thread
+    static const int BLOCKS_AHEAD = 2;
 };
 }
 
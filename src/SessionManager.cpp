@@ -37,10 +37,15 @@
 #include "Session.h"
 #include "ProfileManager.h"
 #include "History.h"
+#include "HistoryMemoryManager.h"
 #include "Enumeration.h"
 
 using namespace Konsole;
 
+// sessions which keep fewer lines of history than this are searched
+// quickly enough without an index of the history
+static const int MIN_INDEXED_HISTORY_SIZE = 10000;
+
 SessionManager::SessionManager()
 {
     //map finished() signals from sessions
@@ -111,6 +116,8 @@ Session* SessionManager::createSession(Profile::Ptr profile)
     _sessions << session;
     _sessionProfiles.insert(session, profile);
 
+    HistoryMemoryManager::instance()->addSession(session);
+
     return session;
 }
 void SessionManager::profileChanged(Profile::Ptr profile)
@@ -128,6 +135,12 @@ void SessionManager::sessionTerminated(QObject* sessionObject)
     _sessionProfiles.remove(session);
     _sessionRuntimeProfiles.remove(session);
 
+    // the history files of sessions which were saved are kept until the
+    // sessions are restored
+    const PersistentHistoryType* history = dynamic_cast<const PersistentHistoryType*>(&session->historyType());
+    if (history && !_restoreMapping.contains(session))
+        PersistentHistoryScroll::removeFiles(history->fileName());
+
     session->deleteLater();
 }
 
@@ -209,29 +222,54 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
                                    profile->remoteTabTitleFormat());
 
     // History
-    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize)) {
+    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize) ||
+            apply.shouldApply(Profile::PersistentHistory)) {
         const int mode = profile->property<int>(Profile::HistoryMode);
-        switch (mode) {
-        case Enum::NoHistory:
-            session->setHistoryType(HistoryTypeNone());
+        const bool persistent = profile->property<bool>(Profile::PersistentHistory);
+        const PersistentHistoryType* oldHistory = dynamic_cast<const PersistentHistoryType*>(&session->historyType());
+        const QString oldFileName = oldHistory ? oldHistory->fileName() : QString();
+        if (persistent && mode != Enum::NoHistory) {
+            const int lines = (mode == Enum::FixedSizeHistory) ? profile->historySize() : -1;
+            session->setHistoryType(PersistentHistoryType(session->historyFileName(), lines));
+        } else {
+            switch (mode) {
+            case Enum::NoHistory:
+                session->setHistoryType(HistoryTypeNone());
+                break;
+
+            case Enum::FixedSizeHistory: {
+                int lines = profile->historySize();
+                session->setHistoryType(CompactHistoryType(lines));
+            }
             break;
 
-        case Enum::FixedSizeHistory: {
-            int lines = profile->historySize();
-            session->setHistoryType(CompactHistoryType(lines));
-        }
-        break;
+            case Enum::UnlimitedHistory:
+                session->setHistoryType(CompressedHistoryType());
+                break;
+            }
 
-        case Enum::UnlimitedHistory:
-            session->setHistoryType(HistoryTypeFile());
-            break;
+            // only a persistent history leaves files behind
+            if (!oldFileName.isEmpty())
+                PersistentHistoryScroll::removeFiles(oldFileName);
         }
     }
 
+    // the index of the history is only worth its memory if the history is large
+    if (apply.shouldApply(Profile::IndexHistory) || apply.shouldApply(Profile::HistoryMode) ||
+            apply.shouldApply(Profile::HistorySize)) {
+        const int mode = profile->property<int>(Profile::HistoryMode);
+        const bool largeHistory = (mode == Enum::UnlimitedHistory) ||
+                                  (mode == Enum::FixedSizeHistory && profile->historySize() >= MIN_INDEXED_HISTORY_SIZE);
+        session->setHistoryIndexEnabled(profile->property<bool>(Profile::IndexHistory) && largeHistory);
+    }
+
     // Terminal features
     if (apply.shouldApply(Profile::FlowControlEnabled))
         session->setFlowControlEnabled(profile->flowControlEnabled());
 
+    if (apply.shouldApply(Profile::OutputTimeSlicingEnabled))
+        session->setOutputTimeSlicingEnabled(profile->outputTimeSlicingEnabled());
+
     // Encoding
     if (apply.shouldApply(Profile::DefaultEncoding)) {
         QByteArray name = profile->defaultEncoding().toUtf8();
@@ -316,6 +354,14 @@ void SessionManager::restoreSessions(KConfig* config)
             session->restoreSession(sessionGroup);
         }
     }
+
+    // the history files which no restored session picked up, such as those
+    // of sessions which were still running when Konsole crashed, would
+    // otherwise never be removed
+    QStringList historyFileNames;
+    foreach(Session* session, _sessions)
+        historyFileNames << session->historyFileName();
+    PersistentHistoryScroll::removeUnusedFiles(Session::historyDirectory(), historyFileNames);
 }
 
 Session* SessionManager::idToSession(int id)
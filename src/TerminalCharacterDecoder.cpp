@@ -80,14 +80,20 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
     //note:  we build up a QString and send it to the text stream rather writing into the text
     //stream a character at a time because it is more efficient.
     //(since QTextStream always deals with QStrings internally anyway)
-    QString plainText;
-    plainText.reserve(count);
+    *_output << plainText(characters, count, _includeTrailingWhitespace);
+}
+
+QString PlainTextDecoder::plainText(const Character* const characters, int count,
+                                    bool includeTrailingWhitespace)
+{
+    QString text;
+    text.reserve(count);
 
     int outputCount = count;
 
     // if inclusion of trailing whitespace is disabled then find the end of the
     // line
-    if (!_includeTrailingWhitespace) {
+    if (!includeTrailingWhitespace) {
         for (int i = count - 1 ; i >= 0 ; i--) {
             if (!characters[i].isSpace())
                 break;
@@ -109,12 +115,12 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
     }
 
     for (int i = 0; i < outputCount;) {
-        if (characters[i].rendition & RE_EXTENDED_CHAR) {
+        if (characters[i].rendition() & RE_EXTENDED_CHAR) {
             ushort extendedCharLength = 0;
-            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+            const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
             if (chars) {
-                const QString s = QString::fromUtf16(chars, extendedCharLength);
-                plainText.append(s);
+                const QString s = QString::fromUcs4(chars, extendedCharLength);
+                text.append(s);
                 i += qMax(1, string_width(s));
             }
         } else {
@@ -126,14 +132,14 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
             // lost in some situation. One typical example is copying the result
             // of `dialog --infobox "qwe" 10 10` .
             if (characters[i].isRealCharacter || i <= realCharacterGuard) {
-                plainText.append(QChar(characters[i].character));
+                appendCodePoint(text, characters[i].character);
                 i += qMax(1, konsole_wcwidth(characters[i].character));
             } else {
                 ++i;  // should we 'break' directly here?
             }
         }
     }
-    *_output << plainText;
+    return text;
 }
 
 HTMLDecoder::HTMLDecoder() :
@@ -181,15 +187,16 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 
     for (int i = 0; i < count; i++) {
         //check if appearance of character is different from previous char
-        if (characters[i].rendition != _lastRendition  ||
-                characters[i].foregroundColor != _lastForeColor  ||
-                characters[i].backgroundColor != _lastBackColor) {
+        const CharacterStyle& characterStyle = characters[i].style();
+        if (characterStyle.rendition != _lastRendition  ||
+                characterStyle.foregroundColor != _lastForeColor  ||
+                characterStyle.backgroundColor != _lastBackColor) {
             if (_innerSpanOpen)
                 closeSpan(text);
 
-            _lastRendition = characters[i].rendition;
-            _lastForeColor = characters[i].foregroundColor;
-            _lastBackColor = characters[i].backgroundColor;
+            _lastRendition = characterStyle.rendition;
+            _lastForeColor = characterStyle.foregroundColor;
+            _lastBackColor = characterStyle.backgroundColor;
 
             //build up style string
             QString style;
@@ -227,21 +234,21 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 
         //output current character
         if (spaceCount < 2) {
-            if (characters[i].rendition & RE_EXTENDED_CHAR) {
+            if (characters[i].rendition() & RE_EXTENDED_CHAR) {
                 ushort extendedCharLength = 0;
-                const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
+                const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, extendedCharLength);
                 if (chars) {
-                    text.append(QString::fromUtf16(chars, extendedCharLength));
+                    text.append(QString::fromUcs4(chars, extendedCharLength));
                 }
             } else {
                 //escape HTML tag characters and just display others as they are
-                const QChar ch = characters[i].character;
+                const quint32 ch = characters[i].character;
                 if (ch == '<')
                     text.append("&lt;");
                 else if (ch == '>')
                     text.append("&gt;");
                 else
-                    text.append(ch);
+                    appendCodePoint(text, ch);
             }
         } else {
             text.append("&nbsp;"); //HTML truncates multiple spaces, so use a space marker instead
@@ -101,6 +101,13 @@ public:
                             int count,
                             LineProperty properties);
 
+    /**
+     * Returns the plain text of a line of @p count terminal characters, exactly
+     * as decodeLine() writes it to the output stream.
+     */
+    static QString plainText(const Character* const characters, int count,
+                             bool includeTrailingWhitespace = true);
+
 private:
     QTextStream* _output;
     bool _includeTrailingWhitespace;
@@ -39,6 +39,7 @@
 #include <QtGui/QPixmap>
 #include <QScrollBar>
 #include <QStyle>
+#include <QStyleOptionSlider>
 #include <QtCore/QTimer>
 #include <QToolTip>
 #include <QtGui/QAccessible>
@@ -69,6 +70,8 @@
 #include "SessionController.h"
 #include "ExtendedCharTable.h"
 #include "TerminalDisplayAccessible.h"
+#include "UpdateScheduler.h"
+#include "GlyphCache.h"
 #include "SessionManager.h"
 #include "Session.h"
 
@@ -114,9 +117,9 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
     _screenWindow = window;
 
     if (_screenWindow) {
-        connect(_screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateLineProperties()));
-        connect(_screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateImage()));
+        connect(_screenWindow , SIGNAL(outputChanged()) , _updateScheduler , SLOT(scheduleUpdate()));
         _screenWindow->setWindowLines(_lines);
+        _screenWindow->damageAll();
     }
 }
 
@@ -196,6 +199,8 @@ void TerminalDisplay::fontChange(const QFont&)
 
     _fontAscent = fm.ascent();
 
+    _glyphCache->setFont(font(), _fontWidth, _fontHeight);
+
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
     update();
@@ -336,9 +341,16 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _outputSuspendedLabel(0)
     , _lineSpacing(0)
     , _blendColor(qRgba(0, 0, 0, 0xff))
+    , _textLayerSettings(0)
+    , _wallpaperTextLayerEnabled(false)
+    , _textLayerTextBlinking(false)
+    , _textLayerCursorBlinking(false)
     , _filterChain(new TerminalImageFilterChain())
+    , _updateScheduler(new UpdateScheduler(this))
     , _cursorShape(Enum::BlockCursor)
     , _antialiasText(true)
+    , _glyphCache(new GlyphCache())
+    , _glyphCacheEnabled(false)
     , _printerFriendly(false)
     , _sessionController(0)
     , _trimTrailingSpaces(false)
@@ -351,8 +363,12 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
 
     _contentRect = QRect(_margin, _margin, 1, 1);
 
+    // changes to the output are drawn at most once per frame
+    connect(_updateScheduler, SIGNAL(updateRequested()), this, SLOT(updateLineProperties()));
+    connect(_updateScheduler, SIGNAL(updateRequested()), this, SLOT(updateImage()));
+
     // create scroll bar for scrolling output up and down
-    _scrollBar = new QScrollBar(this);
+    _scrollBar = new MarkedScrollBar(this);
     // set the scroll bar's slider to occupy the whole area of the scroll bar initially
     setScroll(0, 0);
     _scrollBar->setCursor(Qt::ArrowCursor);
@@ -413,6 +429,7 @@ TerminalDisplay::~TerminalDisplay()
     delete _gridLayout;
     delete _outputSuspendedLabel;
     delete _filterChain;
+    delete _glyphCache;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -537,7 +554,7 @@ void TerminalDisplay::drawLineCharString(QPainter& painter, int x, int y, const
 {
     const QPen& originalPen = painter.pen();
 
-    if ((attributes->rendition & RE_BOLD) && _boldIntense) {
+    if ((attributes->rendition() & RE_BOLD) && _boldIntense) {
         QPen boldPen(originalPen);
         boldPen.setWidth(3);
         painter.setPen(boldPen);
@@ -593,6 +610,17 @@ void TerminalDisplay::setWallpaper(ColorSchemeWallpaper::Ptr p)
     _wallpaper = p;
 }
 
+void TerminalDisplay::setWallpaperTextLayerEnabled(bool enabled)
+{
+    if (enabled == _wallpaperTextLayerEnabled)
+        return;
+
+    // the layer is created again from the image when it is next needed
+    _wallpaperTextLayerEnabled = enabled;
+    _textLayer = QPixmap();
+    update();
+}
+
 void TerminalDisplay::drawBackground(QPainter& painter, const QRect& rect, const QColor& backgroundColor, bool useOpacitySetting)
 {
     // the area of the widget showing the contents of the terminal display is drawn
@@ -685,18 +713,31 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
                                      bool invertCharacterColor)
 {
     // don't draw text which is currently blinking
-    if (_textBlinking && (style->rendition & RE_BLINK))
+    const quint8 rendition = style->rendition();
+    if (_textBlinking && (rendition & RE_BLINK))
         return;
 
     // setup bold and underline
     bool useBold;
     ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
     if (weight == ColorEntry::UseCurrentFormat)
-        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
+        useBold = ((rendition & RE_BOLD) && _boldIntense) || font().bold();
     else
         useBold = (weight == ColorEntry::Bold) ? true : false;
-    const bool useUnderline = style->rendition & RE_UNDERLINE || font().underline();
-    const bool useItalic = style->rendition & RE_ITALIC || font().italic();
+    const bool useUnderline = rendition & RE_UNDERLINE || font().underline();
+    const bool useItalic = rendition & RE_ITALIC || font().italic();
+
+    const CharacterColor& textColor = (invertCharacterColor ? style->backgroundColor() : style->foregroundColor());
+    const QColor color = textColor.color(_colorTable);
+
+    // text in scripts which need no shaping is copied from the glyph cache
+    if (canUseGlyphCache(painter, rect, text)) {
+        const int fontStyle = (useBold ? GlyphCache::Bold : 0) |
+                              (useItalic ? GlyphCache::Italic : 0) |
+                              (useUnderline ? GlyphCache::Underline : 0);
+        _glyphCache->drawText(painter, rect.topLeft(), text, fontStyle, color);
+        return;
+    }
 
     QFont font = painter.font();
     if (font.bold() != useBold
@@ -709,8 +750,6 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 
     // setup pen
-    const CharacterColor& textColor = (invertCharacterColor ? style->backgroundColor : style->foregroundColor);
-    const QColor color = textColor.color(_colorTable);
     QPen pen = painter.pen();
     if (pen.color() != color) {
         pen.setColor(color);
@@ -747,6 +786,22 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 }
 
+bool TerminalDisplay::canUseGlyphCache(const QPainter& painter, const QRect& rect, const QString& text) const
+{
+    // the glyphs are only cached at the size they are drawn on the screen,
+    // and each glyph must take up exactly one cell
+    if (!_glyphCacheEnabled || _bidiEnabled ||
+            painter.worldTransform().type() != QTransform::TxNone ||
+            rect.width() != text.length() * _fontWidth || isLineCharString(text))
+        return false;
+
+    for (int i = 0; i < text.length(); i++) {
+        if (!GlyphCache::canCache(text[i]))
+            return false;
+    }
+    return true;
+}
+
 void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QRect& rect,
                                        const QString& text,
@@ -755,8 +810,8 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     painter.save();
 
     // setup painter
-    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
-    const QColor backgroundColor = style->backgroundColor.color(_colorTable);
+    const QColor foregroundColor = style->foregroundColor().color(_colorTable);
+    const QColor backgroundColor = style->backgroundColor().color(_colorTable);
 
     // draw background if different from the display's background color
     if (backgroundColor != palette().background().color())
@@ -766,7 +821,7 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     // draw cursor shape if the current character is the cursor
     // this may alter the foreground and background colors
     bool invertCharacterColor = false;
-    if (style->rendition & RE_CURSOR)
+    if (style->rendition() & RE_CURSOR)
         drawCursor(painter, rect, foregroundColor, backgroundColor, invertCharacterColor);
 
     // draw text
@@ -785,8 +840,9 @@ void TerminalDisplay::drawPrinterFriendlyTextFragment(QPainter& painter,
     // Set the colors used to draw to black foreground and white
     // background for printer friendly output when printing
     Character print_style = *style;
-    print_style.foregroundColor = CharacterColor(COLOR_SPACE_RGB, 0x00000000);
-    print_style.backgroundColor = CharacterColor(COLOR_SPACE_RGB, 0xFFFFFFFF);
+    print_style.setFormat(CharacterColor(COLOR_SPACE_RGB, 0x00000000),
+                          CharacterColor(COLOR_SPACE_RGB, 0xFFFFFFFF),
+                          style->rendition());
 
     // draw text
     drawCharacters(painter, rect, text, &print_style, false);
@@ -895,8 +951,154 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
     Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
-    //scroll the display vertically to match internal _image
-    scroll(0 , _fontHeight * (-lines) , scrollRect);
+    if (_wallpaper->isNull()) {
+        //scroll the display vertically to match internal _image
+        scroll(0 , _fontHeight * (-lines) , scrollRect);
+    } else {
+        // the wallpaper does not move with the text, so the text is moved in
+        // the text layer instead, if there is one, and the lines are drawn
+        // again over the wallpaper, see paintEvent()
+        if (_wallpaperTextLayerEnabled) {
+            if (lines > 0)
+                scrollTextLayer(region.top() + lines, region.top(), linesToMove);
+            else
+                scrollTextLayer(region.top(), region.top() - lines, linesToMove);
+        }
+
+        scrollRect.setTop(top);
+        scrollRect.setHeight(region.height() * _fontHeight);
+        update(scrollRect);
+    }
+}
+
+void TerminalDisplay::scrollTextLayer(int sourceLine, int destinationLine, int count)
+{
+    // the layer is drawn again when the image has been resized
+    if (_textLayerImage.size() != _imageSize || _textLayerLines.size() != _lines)
+        return;
+
+    const int top = contentsRect().top() + _contentRect.top();
+    _textLayer.scroll(0, (destinationLine - sourceLine) * _fontHeight,
+                      QRect(0, top + sourceLine * _fontHeight,
+                            _textLayer.width(), count * _fontHeight));
+
+    memmove(_textLayerImage.data() + destinationLine * _columns,
+            _textLayerImage.constData() + sourceLine * _columns,
+            count * _columns * sizeof(Character));
+
+    // the lines which were moved out of are empty, apart from those which
+    // other lines were moved into
+    const QBitArray drawnLines = _textLayerLines;
+    const QVector<LineProperty> lineProperties = _textLayerLineProperties;
+    for (int i = 0; i < count; i++)
+        _textLayerLines.clearBit(sourceLine + i);
+    for (int i = 0; i < count; i++) {
+        _textLayerLines.setBit(destinationLine + i, drawnLines.testBit(sourceLine + i));
+        _scrolledLines.setBit(destinationLine + i, drawnLines.testBit(sourceLine + i));
+        _textLayerLineProperties[destinationLine + i] = lineProperties[sourceLine + i];
+    }
+}
+
+void TerminalDisplay::updateTextLayer(const QRegion& region)
+{
+    const uint settings = textLayerSettings();
+    if (_textLayer.size() != size() || _textLayerImage.size() != _imageSize ||
+            _textLayerLines.size() != _lines || _textLayerSettings != settings) {
+        _textLayer = QPixmap(size());
+        _textLayer.fill(Qt::transparent);
+        _textLayerImage.fill(Character(), _imageSize);
+        _textLayerLineProperties.fill(LINE_DEFAULT, _lines);
+        _textLayerLines = QBitArray(_lines);
+        _scrolledLines = QBitArray(_lines);
+        _textLayerSettings = settings;
+    }
+
+    // blinking only changes the lines with blinking text and the line with
+    // the cursor, so only those are drawn again rather than the whole layer
+    if (_textLayerTextBlinking != _textBlinking) {
+        for (int line = 0; line < qMin(_lines, _blinkingLines.size()); line++) {
+            if (_blinkingLines.testBit(line))
+                _textLayerLines.clearBit(line);
+        }
+        _textLayerTextBlinking = _textBlinking;
+    }
+    if (_textLayerCursorBlinking != _cursorBlinking) {
+        const int cursorLine = cursorPosition().y();
+        if (cursorLine >= 0 && cursorLine < _lines)
+            _textLayerLines.clearBit(cursorLine);
+        _textLayerCursorBlinking = _cursorBlinking;
+    }
+
+    if (!_image)
+        return;
+
+    const int top = contentsRect().top() + _contentRect.top();
+    const QRect bounds = region.boundingRect();
+    const int firstLine = qMax(0, (bounds.top() - top) / _fontHeight);
+    const int lastLine = qMin(_lines - 1, (bounds.bottom() - top) / _fontHeight);
+
+    QPainter painter(&_textLayer);
+    painter.setFont(font());
+
+    for (int line = firstLine; line <= lastLine; line++) {
+        const QRect lineRect(0, top + line * _fontHeight, _textLayer.width(), _fontHeight);
+        if (!region.intersects(lineRect))
+            continue;
+
+        // lines which have only been moved since they were drawn are kept
+        const Character* characters = _image + line * _columns;
+        Character* layerCharacters = _textLayerImage.data() + line * _columns;
+        const LineProperty lineProperty = _lineProperties.value(line, LINE_DEFAULT);
+        if (_scrolledLines.testBit(line) && _textLayerLines.testBit(line) &&
+                _textLayerLineProperties[line] == lineProperty &&
+                qEqual(characters, characters + _columns, layerCharacters))
+            continue;
+
+        painter.setClipRect(lineRect);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(lineRect, Qt::transparent);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        drawContents(painter, lineRect);
+
+        qCopy(characters, characters + _columns, layerCharacters);
+        _textLayerLineProperties[line] = lineProperty;
+        _textLayerLines.setBit(line);
+    }
+
+    _scrolledLines.fill(false);
+}
+
+uint TerminalDisplay::textLayerSettings() const
+{
+    uint hash = qHash(font().key());
+    hash = hash * 31 + qHash(palette().background().color().rgba());
+    for (int i = 0; i < TABLE_COLORS; i++) {
+        hash = hash * 31 + qHash(_colorTable[i].color.rgba());
+        hash = hash * 31 + _colorTable[i].fontWeight;
+    }
+    hash = hash * 31 + qHash(_cursorColor.rgba());
+    hash = hash * 31 + _cursorShape;
+    hash = hash * 31 + _contentRect.left();
+    hash = hash * 31 + _contentRect.top();
+    hash = hash * 31 + _fontWidth;
+    hash = hash * 31 + _fontHeight;
+    hash = hash * 31 + _lineSpacing;
+
+    const bool flags[] = { _boldIntense, _antialiasText, _bidiEnabled, _glyphCacheEnabled,
+                           _fixedFont
+                         };
+    for (uint i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+        hash = hash * 2 + flags[i];
+
+    return hash;
+}
+
+// returns the hotspot at the given position in the image, after the lazy
+// filters in 'chain' have processed the line, or 0 if there is none
+static Filter::HotSpot* hotSpotAt(TerminalImageFilterChain* chain, int line, int column)
+{
+    chain->processLine(line);
+    return chain->hotSpotAt(line, column);
 }
 
 QRegion TerminalDisplay::hotSpotRegion() const
@@ -956,19 +1158,36 @@ void TerminalDisplay::processFilters()
     update(preUpdateHotSpots | postUpdateHotSpots);
 }
 
+// returns true if two characters are drawn with the same colors and
+// rendition, ignoring whether they are extended characters
+static inline bool equalsTextStyle(const Character& a, const Character& b)
+{
+    if (a.styleIndex() == b.styleIndex())
+        return true;
+
+    const CharacterStyle& styleA = a.style();
+    const CharacterStyle& styleB = b.style();
+    return styleA.foregroundColor == styleB.foregroundColor &&
+           styleA.backgroundColor == styleB.backgroundColor &&
+           (styleA.rendition & ~RE_EXTENDED_CHAR) == (styleB.rendition & ~RE_EXTENDED_CHAR);
+}
+
 void TerminalDisplay::updateImage()
 {
     if (!_screenWindow)
         return;
 
+    // let the scheduler know how fast the output is moving, scrolling by
+    // the user does not count
+    _updateScheduler->frameDrawn(qAbs(_screenWindow->outputScrollCount()),
+                                 _screenWindow->windowLines());
+
     // optimization - scroll the existing image where possible and
     // avoid expensive text drawing for parts of the image that
     // can simply be moved up or down
-    if (_wallpaper->isNull()) {
-        scrollImage(_screenWindow->scrollCount() ,
-                    _screenWindow->scrollRegion());
-        _screenWindow->resetScrollCount();
-    }
+    scrollImage(_screenWindow->scrollCount() ,
+                _screenWindow->scrollRegion());
+    _screenWindow->resetScrollCount();
 
     if (!_image) {
         // Create _image.
@@ -992,11 +1211,16 @@ void TerminalDisplay::updateImage()
     const int    tLy = tL.y();
     _hasTextBlinker = false;
 
-    CharacterColor cf;       // undefined
-
     const int linesToUpdate = qMin(this->_lines, qMax(0, lines));
     const int columnsToUpdate = qMin(this->_columns, qMax(0, columns));
 
+    // lines which the screen window reports as unchanged are skipped, which
+    // relies on knowing whether they contain blinking text from an earlier update
+    if (_blinkingLines.size() != linesToUpdate) {
+        _blinkingLines.fill(false, linesToUpdate);
+        _screenWindow->damageAll();
+    }
+
     char* dirtyMask = new char[columnsToUpdate + 2];
     QRegion dirtyRegion;
 
@@ -1009,22 +1233,36 @@ void TerminalDisplay::updateImage()
         const Character* currentLine = &_image[y * this->_columns];
         const Character* const newLine = &newimg[y * columns];
 
+        const LineDamage damage = _screenWindow->lineDamage(y);
+        const bool doubleHeight = _lineProperties.count() > y &&
+                                  (_lineProperties[y] & LINE_DOUBLEHEIGHT);
+
+        // nothing in this line has changed since the last update
+        if (damage.isEmpty() && !doubleHeight) {
+            _hasTextBlinker |= _blinkingLines.testBit(y);
+            continue;
+        }
+
         bool updateLine = false;
+        bool lineHasTextBlinker = false;
 
         // The dirty mask indicates which characters need repainting. We also
         // mark surrounding neighbors dirty, in case the character exceeds
         // its cell boundaries
         memset(dirtyMask, 0, columnsToUpdate + 2);
 
-        for (x = 0 ; x < columnsToUpdate ; ++x) {
-            if (newLine[x] != currentLine[x]) {
-                dirtyMask[x] = true;
+        if (!damage.isEmpty()) {
+            const int lastColumn = qMin(damage.endColumn, columnsToUpdate - 1);
+            for (x = damage.startColumn ; x <= lastColumn ; ++x) {
+                if (newLine[x] != currentLine[x]) {
+                    dirtyMask[x] = true;
+                }
             }
         }
 
         if (!_resizing) // not while _resizing, we're expecting a paintEvent
             for (x = 0; x < columnsToUpdate; ++x) {
-                _hasTextBlinker |= (newLine[x].rendition & RE_BLINK);
+                lineHasTextBlinker |= (newLine[x].rendition() & RE_BLINK);
 
                 // Start drawing if this character or the next one differs.
                 // We also take the next one into account to handle the situation
@@ -1034,9 +1272,6 @@ void TerminalDisplay::updateImage()
                         continue;
                     const bool lineDraw = newLine[x + 0].isLineChar();
                     const bool doubleWidth = (x + 1 == columnsToUpdate) ? false : (newLine[x + 1].character == 0);
-                    const quint8 cr = newLine[x].rendition;
-                    const CharacterColor clipboard = newLine[x].backgroundColor;
-                    if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
                     const int lln = columnsToUpdate - x;
                     for (len = 1; len < lln; ++len) {
                         const Character& ch = newLine[x + len];
@@ -1046,9 +1281,7 @@ void TerminalDisplay::updateImage()
 
                         const bool nextIsDoubleWidth = (x + len + 1 == columnsToUpdate) ? false : (newLine[x + len + 1].character == 0);
 
-                        if (ch.foregroundColor != cf ||
-                                ch.backgroundColor != clipboard ||
-                                (ch.rendition & ~RE_EXTENDED_CHAR) != (cr & ~RE_EXTENDED_CHAR) ||
+                        if (!equalsTextStyle(ch, newLine[x]) ||
                                 !dirtyMask[x + len] ||
                                 ch.isLineChar() != lineDraw ||
                                 nextIsDoubleWidth != doubleWidth)
@@ -1068,12 +1301,14 @@ void TerminalDisplay::updateImage()
                 }
             }
 
+        _blinkingLines.setBit(y, lineHasTextBlinker);
+        _hasTextBlinker |= lineHasTextBlinker;
+
         //both the top and bottom halves of double height _lines must always be redrawn
         //although both top and bottom halves contain the same characters, only
         //the top one is actually
         //drawn.
-        if (_lineProperties.count() > y)
-            updateLine |= (_lineProperties[y] & LINE_DOUBLEHEIGHT);
+        updateLine |= doubleHeight;
 
         // if the characters on the line are different in the old and the new _image
         // then this line must be repainted.
@@ -1113,6 +1348,8 @@ void TerminalDisplay::updateImage()
     }
     _usedColumns = columnsToUpdate;
 
+    _screenWindow->resetDamage();
+
     dirtyRegion |= _inputMethodData.previousPreeditRect;
 
     // update the parts of the display which have changed
@@ -1164,10 +1401,21 @@ void TerminalDisplay::paintEvent(QPaintEvent* pe)
 {
     QPainter paint(this);
 
+    // with a wallpaper, the text may be drawn into a layer which is drawn
+    // over the wallpaper, see scrollImage()
+    const bool useTextLayer = _wallpaperTextLayerEnabled && !_wallpaper->isNull();
+    if (useTextLayer)
+        updateTextLayer(pe->region() & contentsRect());
+    else if (!_textLayer.isNull())
+        _textLayer = QPixmap();
+
     foreach(const QRect & rect, (pe->region() & contentsRect()).rects()) {
         drawBackground(paint, rect, palette().background().color(),
                        true /* use opacity setting */);
-        drawContents(paint, rect);
+        if (useTextLayer)
+            paint.drawPixmap(rect, _textLayer, rect);
+        else
+            drawContents(paint, rect);
     }
     drawInputMethodPreeditString(paint, preeditRect());
     paintFilters(paint);
@@ -1184,6 +1432,10 @@ void TerminalDisplay::printContent(QPainter& painter, bool friendly)
 
     QRect rect(0, 0, size().width(), size().height());
 
+    // the glyph cache only holds glyphs drawn for the screen
+    const bool glyphCacheEnabled = _glyphCacheEnabled;
+    _glyphCacheEnabled = false;
+
     _printerFriendly = friendly;
     if (!friendly) {
         drawBackground(painter, rect, getBackgroundColor(),
@@ -1191,6 +1443,7 @@ void TerminalDisplay::printContent(QPainter& painter, bool friendly)
     }
     drawContents(painter, rect);
     _printerFriendly = false;
+    _glyphCacheEnabled = glyphCacheEnabled;
     setVTFont(savedFont);
 }
 
@@ -1207,6 +1460,11 @@ FilterChain* TerminalDisplay::filterChain() const
     return _filterChain;
 }
 
+UpdateScheduler* TerminalDisplay::updateScheduler() const
+{
+    return _updateScheduler;
+}
+
 void TerminalDisplay::paintFilters(QPainter& painter)
 {
     // get color of character under mouse and use it to draw
@@ -1218,7 +1476,7 @@ void TerminalDisplay::paintFilters(QPainter& painter)
     getCharacterPosition(cursorPos , cursorLine , cursorColumn);
     Character cursorCharacter = _image[loc(cursorColumn, cursorLine)];
 
-    painter.setPen(QPen(cursorCharacter.foregroundColor.color(colorTable())));
+    painter.setPen(QPen(cursorCharacter.foregroundColor().color(colorTable())));
 
     // iterate over hotspots identified by the display's currently active filters
     // and draw appropriate visuals to indicate the presence of the hotspot
@@ -1335,70 +1593,49 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             x--; // Search for start of multi-column character
         for (; x <= rlx; x++) {
             int len = 1;
-            int p = 0;
 
-            // reset our buffer to the number of columns
-            int bufferSize = numberOfColumns;
-            unistr.resize(bufferSize);
-            QChar *disstrU = unistr.data();
+            // reset our buffer, keeping its capacity
+            unistr.resize(0);
 
             // is this a single character or a sequence of characters ?
-            if (_image[loc(x, y)].rendition & RE_EXTENDED_CHAR) {
+            if (_image[loc(x, y)].rendition() & RE_EXTENDED_CHAR) {
                 // sequence of characters
                 ushort extendedCharLength = 0;
-                const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(_image[loc(x, y)].character, extendedCharLength);
+                const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(_image[loc(x, y)].character, extendedCharLength);
                 if (chars) {
                     Q_ASSERT(extendedCharLength > 1);
-                    bufferSize += extendedCharLength - 1;
-                    unistr.resize(bufferSize);
-                    disstrU = unistr.data();
-                    for (int index = 0 ; index < extendedCharLength ; index++) {
-                        Q_ASSERT(p < bufferSize);
-                        disstrU[p++] = chars[index];
-                    }
+                    for (int index = 0 ; index < extendedCharLength ; index++)
+                        appendCodePoint(unistr, chars[index]);
                 }
             } else {
                 // single character
-                const quint16 c = _image[loc(x, y)].character;
-                if (c) {
-                    Q_ASSERT(p < bufferSize);
-                    disstrU[p++] = c; //fontMap(c);
-                }
+                const quint32 c = _image[loc(x, y)].character;
+                if (c)
+                    appendCodePoint(unistr, c); //fontMap(c);
             }
 
             const bool lineDraw = _image[loc(x, y)].isLineChar();
             const bool doubleWidth = (_image[ qMin(loc(x, y) + 1, _imageSize) ].character == 0);
-            const CharacterColor currentForeground = _image[loc(x, y)].foregroundColor;
-            const CharacterColor currentBackground = _image[loc(x, y)].backgroundColor;
-            const quint8 currentRendition = _image[loc(x, y)].rendition;
+            const Character& currentCharacter = _image[loc(x, y)];
 
             while (x + len <= rlx &&
-                    _image[loc(x + len, y)].foregroundColor == currentForeground &&
-                    _image[loc(x + len, y)].backgroundColor == currentBackground &&
-                    (_image[loc(x + len, y)].rendition & ~RE_EXTENDED_CHAR) == (currentRendition & ~RE_EXTENDED_CHAR) &&
+                    equalsTextStyle(_image[loc(x + len, y)], currentCharacter) &&
                     (_image[ qMin(loc(x + len, y) + 1, _imageSize) ].character == 0) == doubleWidth &&
                     _image[loc(x + len, y)].isLineChar() == lineDraw) {
-                const quint16 c = _image[loc(x + len, y)].character;
-                if (_image[loc(x + len, y)].rendition & RE_EXTENDED_CHAR) {
+                const quint32 c = _image[loc(x + len, y)].character;
+                if (_image[loc(x + len, y)].rendition() & RE_EXTENDED_CHAR) {
                     // sequence of characters
                     ushort extendedCharLength = 0;
-                    const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(c, extendedCharLength);
+                    const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(c, extendedCharLength);
                     if (chars) {
                         Q_ASSERT(extendedCharLength > 1);
-                        bufferSize += extendedCharLength - 1;
-                        unistr.resize(bufferSize);
-                        disstrU = unistr.data();
-                        for (int index = 0 ; index < extendedCharLength ; index++) {
-                            Q_ASSERT(p < bufferSize);
-                            disstrU[p++] = chars[index];
-                        }
+                        for (int index = 0 ; index < extendedCharLength ; index++)
+                            appendCodePoint(unistr, chars[index]);
                     }
                 } else {
                     // single character
-                    if (c) {
-                        Q_ASSERT(p < bufferSize);
-                        disstrU[p++] = c; //fontMap(c);
-                    }
+                    if (c)
+                        appendCodePoint(unistr, c); //fontMap(c);
                 }
 
                 if (doubleWidth) // assert((_image[loc(x+len,y)+1].character == 0)), see above if condition
@@ -1413,7 +1650,6 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
                 _fixedFont = false;
             if (doubleWidth)
                 _fixedFont = false;
-            unistr.resize(p);
 
             // Create a text scaling matrix for double width and double height lines.
             QMatrix textScale;
@@ -1659,6 +1895,10 @@ void TerminalDisplay::clearImage()
 {
     for (int i = 0; i <= _imageSize; ++i)
         _image[i] = Screen::DefaultChar;
+
+    // the image no longer matches what the screen window last provided
+    if (_screenWindow)
+        _screenWindow->damageAll();
 }
 
 void TerminalDisplay::calcGeometry()
@@ -1793,9 +2033,9 @@ void TerminalDisplay::scrollBarPositionChanged(int)
     // if the thumb has been moved to the bottom of the _scrollBar then set
     // the display to automatically track new output,
     // that is, scroll down automatically
-    // to how new _lines as they are added
-    const bool atEndOfOutput = (_scrollBar->value() == _scrollBar->maximum());
-    _screenWindow->setTrackOutput(atEndOfOutput);
+    // to how new _lines as they are added.  the window is checked rather than
+    // the scroll bar, whose range is out of date if lines were rewrapped
+    _screenWindow->setTrackOutput(_screenWindow->atEndOfOutput());
 
     updateImage();
 }
@@ -1821,6 +2061,11 @@ void TerminalDisplay::setScroll(int cursor, int slines)
     connect(_scrollBar, SIGNAL(valueChanged(int)), this, SLOT(scrollBarPositionChanged(int)));
 }
 
+void TerminalDisplay::setScrollBarMarkers(const QBitArray& markers)
+{
+    _scrollBar->setMarkers(markers);
+}
+
 void TerminalDisplay::setScrollFullPage(bool fullPage)
 {
     _scrollFullPage = fullPage;
@@ -1895,7 +2140,7 @@ void TerminalDisplay::mousePressEvent(QMouseEvent* ev)
             }
 
             if (_underlineLinks && _openLinksByDirectClick) {
-                Filter::HotSpot* spot = _filterChain->hotSpotAt(charLine, charColumn);
+                Filter::HotSpot* spot = hotSpotAt(_filterChain, charLine, charColumn);
                 if (spot && spot->type() == Filter::HotSpot::Link) {
                     QObject action;
                     action.setObjectName("open-action");
@@ -1918,7 +2163,7 @@ QList<QAction*> TerminalDisplay::filterActions(const QPoint& position)
     int charLine, charColumn;
     getCharacterPosition(position, charLine, charColumn);
 
-    Filter::HotSpot* spot = _filterChain->hotSpotAt(charLine, charColumn);
+    Filter::HotSpot* spot = hotSpotAt(_filterChain, charLine, charColumn);
 
     return spot ? spot->actions() : QList<QAction*>();
 }
@@ -1931,7 +2176,7 @@ void TerminalDisplay::mouseMoveEvent(QMouseEvent* ev)
 
     // handle filters
     // change link hot-spot appearance on mouse-over
-    Filter::HotSpot* spot = _filterChain->hotSpotAt(charLine, charColumn);
+    Filter::HotSpot* spot = hotSpotAt(_filterChain, charLine, charColumn);
     if (spot && spot->type() == Filter::HotSpot::Link) {
         if (_underlineLinks) {
             QRegion previousHotspotArea = _mouseOverHotspotArea;
@@ -2408,8 +2653,8 @@ void TerminalDisplay::mouseDoubleClickEvent(QMouseEvent* ev)
         endSel.setX(x);
 
         // In word selection mode don't select @ (64) if at end of word.
-        if (((_image[i].rendition & RE_EXTENDED_CHAR) == 0) &&
-                (QChar(_image[i].character) == '@') &&
+        if (((_image[i].rendition() & RE_EXTENDED_CHAR) == 0) &&
+                (_image[i].character == '@') &&
                 ((endSel.x() - bgnSel.x()) > 0)) {
             endSel.setX(x - 1);
         }
@@ -2560,11 +2805,11 @@ bool TerminalDisplay::focusNextPrevChild(bool next)
 
 QChar TerminalDisplay::charClass(const Character& ch) const
 {
-    if (ch.rendition & RE_EXTENDED_CHAR) {
+    if (ch.rendition() & RE_EXTENDED_CHAR) {
         ushort extendedCharLength = 0;
-        const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(ch.character, extendedCharLength);
+        const uint* chars = ExtendedCharTable::instance.lookupExtendedChar(ch.character, extendedCharLength);
         if (chars && extendedCharLength > 0) {
-            const QString s = QString::fromUtf16(chars, extendedCharLength);
+            const QString s = QString::fromUcs4(chars, extendedCharLength);
             if (_wordCharacters.contains(s, Qt::CaseInsensitive))
                 return 'a';
             bool allLetterOrNumber = true;
@@ -2574,6 +2819,11 @@ QChar TerminalDisplay::charClass(const Character& ch) const
         }
         return 0;
     } else {
+        // characters outside of the Basic Multilingual Plane are
+        // treated as part of words
+        if (ch.character > 0xFFFF)
+            return 'a';
+
         const QChar qch(ch.character);
         if (qch.isSpace()) return ' ';
 
@@ -3131,6 +3381,58 @@ SessionController* TerminalDisplay::sessionController()
     return _sessionController;
 }
 
+MarkedScrollBar::MarkedScrollBar(QWidget* parent)
+    : QScrollBar(parent)
+{
+}
+void MarkedScrollBar::setMarkers(const QBitArray& markers)
+{
+    if (markers == _markers)
+        return;
+
+    _markers = markers;
+    update();
+}
+void MarkedScrollBar::paintEvent(QPaintEvent* event)
+{
+    QScrollBar::paintEvent(event);
+
+    const int parts = _markers.size();
+    if (parts == 0 || _markers.count(true) == 0)
+        return;
+
+    QStyleOptionSlider option;
+    initStyleOption(&option);
+    const QRect groove = style()->subControlRect(QStyle::CC_ScrollBar, &option,
+                         QStyle::SC_ScrollBarGroove, this);
+
+    QColor color = palette().color(QPalette::Highlight);
+    color.setAlpha(192);
+
+    QPainter painter(this);
+    const int height = qMax(2, groove.height() / parts);
+
+    // draw a marker for each run of marked parts, leaving the middle of the
+    // groove uncovered so that the slider can still be seen
+    const int width = qMax(2, groove.width() / 4);
+    int part = 0;
+    while (part < parts) {
+        if (!_markers.testBit(part)) {
+            part++;
+            continue;
+        }
+
+        const int first = part;
+        while (part < parts && _markers.testBit(part))
+            part++;
+
+        const int top = groove.top() + int(qint64(groove.height()) * first / parts);
+        const int bottom = qMax(top + height, groove.top() + int(qint64(groove.height()) * part / parts));
+        painter.fillRect(groove.left(), top, width, bottom - top, color);
+        painter.fillRect(groove.right() - width + 1, top, width, bottom - top, color);
+    }
+}
+
 AutoScrollHandler::AutoScrollHandler(QWidget* parent)
     : QObject(parent)
     , _timerId(0)
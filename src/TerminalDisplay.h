@@ -23,8 +23,11 @@
 
 // Qt
 #include <QtGui/QColor>
+#include <QtGui/QPixmap>
 #include <QtCore/QPointer>
+#include <QtCore/QBitArray>
 #include <QWidget>
+#include <QScrollBar>
 
 // Konsole
 #include "Character.h"
@@ -41,7 +44,6 @@ class QTimer;
 class QEvent;
 class QGridLayout;
 class QKeyEvent;
-class QScrollBar;
 class QShowEvent;
 class QHideEvent;
 class QTimerEvent;
@@ -51,6 +53,9 @@ namespace Konsole
 class FilterChain;
 class TerminalImageFilterChain;
 class SessionController;
+class UpdateScheduler;
+class GlyphCache;
+class MarkedScrollBar;
 /**
  * A widget which displays output from a terminal emulation and sends input keypresses and mouse activity
  * to the terminal.
@@ -107,6 +112,15 @@ public:
     void setScrollFullPage(bool fullPage);
     bool scrollFullPage() const;
 
+    /**
+     * Marks parts of the output in the display's scroll bar, such as those
+     * which contain matches for a search.  The output is divided into as
+     * many equal parts as there are bits in @p markers and a marker is
+     * drawn for each part whose bit is set.  Pass an empty array to remove
+     * the markers.
+     */
+    void setScrollBarMarkers(const QBitArray& markers);
+
     /**
      * Returns the display's filter chain.  When the image for the display is updated,
      * the text is passed through each filter in the chain.  Each filter can define
@@ -120,25 +134,26 @@ public:
      */
     FilterChain* filterChain() const;
 
+    /**
+     * Returns the scheduler which decides when the display is updated in
+     * response to output from the terminal.  Its statistics() describe how
+     * many updates were requested, coalesced and skipped.
+     */
+    UpdateScheduler* updateScheduler() const;
+
     /**
      * Updates the filters in the display's filter chain.  This will cause
      * the hotspots to be updated to match the current image.
      *
-     * WARNING:  This function can be expensive depending on the
-     * image size and number of filters in the filterChain()
-     *
-     * TODO - This API does not really allow efficient usage.  Revise it so
-     * that the processing can be done in a better way.
-     *
-     * eg:
-     *      - Area of interest may be known ( eg. mouse cursor hovering
-     *      over an area )
+     * Only the lines which have changed since the filters were last updated
+     * are processed, and lazy filters ( see Filter::isLazy() ) do not
+     * process any lines until the user points at them.
      */
     void processFilters();
 
     /**
      * Returns a list of menu actions created by the filters for the content
-     * at the given @p position.
+     * at the given @p position.  The caller takes ownership of the actions.
      */
     QList<QAction*> filterActions(const QPoint& position);
 
@@ -404,6 +419,42 @@ public:
         return _boldIntense;
     }
 
+    /**
+     * Specifies whether text is drawn by copying the glyphs of its characters
+     * from a cache, which is much faster than laying out the text each time
+     * it is drawn.  Text which needs shaping or bidirectional layout is
+     * always laid out.  Glyphs in the cache are anti-aliased in grayscale
+     * only, so the cache is off by default to keep sub-pixel anti-aliasing.
+     * Defaults to false.
+     */
+    void setGlyphCacheEnabled(bool enabled) {
+        _glyphCacheEnabled = enabled;
+    }
+    /**
+     * Returns true if text is drawn from a cache of glyphs.
+     * See setGlyphCacheEnabled()
+     */
+    bool glyphCacheEnabled() const {
+        return _glyphCacheEnabled;
+    }
+
+    /**
+     * Specifies whether the text over a wallpaper is drawn into a layer,
+     * which is moved when the text scrolls so that the scrolled lines need
+     * not be laid out again.  Text in the layer is anti-aliased against a
+     * transparent background, which only allows grayscale anti-aliasing,
+     * so the layer is off by default and the scrolled lines are drawn
+     * again over the wallpaper instead.  Defaults to false.
+     */
+    void setWallpaperTextLayerEnabled(bool enabled);
+    /**
+     * Returns true if the text over a wallpaper is drawn into a layer.
+     * See setWallpaperTextLayerEnabled()
+     */
+    bool wallpaperTextLayerEnabled() const {
+        return _wallpaperTextLayerEnabled;
+    }
+
     /**
      * Sets whether or not the current height and width of the
      * terminal in lines and columns is displayed whilst the widget
@@ -703,6 +754,8 @@ private:
     // draws the characters or line graphics in a text fragment
     void drawCharacters(QPainter& painter, const QRect& rect,  const QString& text,
                         const Character* style, bool invertCharacterColor);
+    // returns true if 'text' can be drawn in 'rect' from the glyph cache
+    bool canUseGlyphCache(const QPainter& painter, const QRect& rect, const QString& text) const;
     // draws a string of line graphics
     void drawLineCharString(QPainter& painter, int x, int y,
                             const QString& str, const Character* attributes);
@@ -734,6 +787,16 @@ private:
     // the left and right are ignored.
     void scrollImage(int lines , const QRect& region);
 
+    // draws the text of the display in 'region' into _textLayer, apart from
+    // the lines which scrollImage() has moved there and which have not changed
+    void updateTextLayer(const QRegion& region);
+    // moves 'count' lines of _textLayer from 'sourceLine' to 'destinationLine'
+    void scrollTextLayer(int sourceLine, int destinationLine, int count);
+    // returns a hash of the settings which affect how the text is drawn, which
+    // are the same for all of the text in _textLayer.  Blinking only affects
+    // some of the lines, see updateTextLayer()
+    uint textLayerSettings() const;
+
     void calcGeometry();
     void propagateSize();
     void updateImageSize();
@@ -812,7 +875,7 @@ private:
     bool _autoCopySelectedText;
     Enum::MiddleClickPasteModeEnum _middleClickPasteMode;
 
-    QScrollBar* _scrollBar;
+    MarkedScrollBar* _scrollBar;
     Enum::ScrollBarPositionEnum _scrollbarLocation;
     bool _scrollFullPage;
     QString     _wordCharacters;
@@ -823,6 +886,7 @@ private:
     bool _textBlinking;   // text is blinking, hide it when drawing
     bool _cursorBlinking;     // cursor is blinking, hide it when drawing
     bool _hasTextBlinker; // has characters to blink
+    QBitArray _blinkingLines; // lines of _image which have characters to blink
     QTimer* _blinkTextTimer;
     QTimer* _blinkCursorTimer;
 
@@ -853,11 +917,32 @@ private:
 
     ColorSchemeWallpaper::Ptr _wallpaper;
 
+    // when there is a wallpaper, which does not move when the text scrolls,
+    // the text is drawn into this layer over a transparent background and
+    // the layer is drawn over the wallpaper.  scrolling then moves the text
+    // in the layer instead of drawing it again
+    QPixmap _textLayer;
+    bool _wallpaperTextLayerEnabled;
+    // the characters and line properties which each line of the layer was
+    // drawn from, for the lines set in _textLayerLines
+    QVector<Character> _textLayerImage;
+    QVector<LineProperty> _textLayerLineProperties;
+    QBitArray _textLayerLines;
+    // lines which have been moved in the layer since it was last painted
+    QBitArray _scrolledLines;
+    uint _textLayerSettings;
+    // whether blinking text and the cursor were hidden when the layer was drawn
+    bool _textLayerTextBlinking;
+    bool _textLayerCursorBlinking;
+
     // list of filters currently applied to the display.  used for links and
     // search highlight
     TerminalImageFilterChain* _filterChain;
     QRegion _mouseOverHotspotArea;
 
+    // limits how often the display is updated in response to output
+    UpdateScheduler* _updateScheduler;
+
     Enum::CursorShapeEnum _cursorShape;
 
     // cursor color. If it is invalid (by default) then the foreground
@@ -872,6 +957,10 @@ private:
 
     bool _antialiasText;   // do we anti-alias or not
 
+    // glyphs of the characters drawn so far, see setGlyphCacheEnabled()
+    GlyphCache* _glyphCache;
+    bool _glyphCacheEnabled;
+
     bool _printerFriendly; // are we currently painting to a printer in black/white mode
 
     //the delay in milliseconds between redrawing blinking text
@@ -891,6 +980,26 @@ private:
     friend class TerminalDisplayAccessible;
 };
 
+/**
+ * A scroll bar which draws markers along its groove for parts of the
+ * output, see TerminalDisplay::setScrollBarMarkers()
+ */
+class MarkedScrollBar : public QScrollBar
+{
+    Q_OBJECT
+
+public:
+    explicit MarkedScrollBar(QWidget* parent);
+
+    void setMarkers(const QBitArray& markers);
+
+protected:
+    virtual void paintEvent(QPaintEvent* event);
+
+private:
+    QBitArray _markers;
+};
+
 class AutoScrollHandler : public QObject
 {
     Q_OBJECT
@@ -0,0 +1,107 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "UpdateScheduler.h"
+
+using namespace Konsole;
+
+UpdateScheduler::UpdateScheduler(QObject* parent)
+    : QObject(parent)
+    , _frameRate(60)
+    , _jumpScrollFactor(1)
+{
+    _timer.setSingleShot(true);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(startFrame()));
+}
+
+void UpdateScheduler::setFrameRate(int framesPerSecond)
+{
+    _frameRate = qMax(1, framesPerSecond);
+}
+
+int UpdateScheduler::frameRate() const
+{
+    return _frameRate;
+}
+
+int UpdateScheduler::frameInterval() const
+{
+    return _jumpScrollFactor * 1000 / _frameRate;
+}
+
+void UpdateScheduler::frameDrawn(int scrolledLines, int lines)
+{
+    if (lines > 0 && scrolledLines >= lines) {
+        // none of the previous frame is visible any more, so the output
+        // is moving too fast to be read - draw fewer frames
+        if (_jumpScrollFactor < MAX_JUMP_SCROLL_FACTOR) {
+            _jumpScrollFactor *= 2;
+            _statistics.jumpScrollFrames++;
+        }
+    } else {
+        _jumpScrollFactor = 1;
+    }
+}
+
+const UpdateScheduler::Statistics& UpdateScheduler::statistics() const
+{
+    return _statistics;
+}
+
+void UpdateScheduler::resetStatistics()
+{
+    _statistics = Statistics();
+}
+
+void UpdateScheduler::scheduleUpdate()
+{
+    _statistics.requests++;
+
+    if (_timer.isActive()) {
+        _statistics.coalescedRequests++;
+        return;
+    }
+
+    // even when no frame has been drawn for a while, wait until control
+    // returns to the event loop so that all pending output is included
+    int delay = 0;
+    if (_lastFrame.isValid()) {
+        const qint64 remaining = frameInterval() - _lastFrame.elapsed();
+        if (remaining > 0)
+            delay = static_cast<int>(remaining);
+    }
+
+    if (delay > 0)
+        _statistics.delayedFrames++;
+
+    _timer.start(delay);
+}
+
+void UpdateScheduler::startFrame()
+{
+    _statistics.frames++;
+    _lastFrame.start();
+
+    emit updateRequested();
+}
+
+#include "UpdateScheduler.moc"
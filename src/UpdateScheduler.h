@@ -0,0 +1,138 @@
+/*
+    This file is part of Konsole, an X terminal.
+
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * Decides when a terminal display should be updated in response to
+ * changes in the output of its session.
+ *
+ * Requests for an update made with scheduleUpdate() are coalesced, and
+ * updateRequested() is emitted no more often than the frame rate allows.
+ * The first change after a quiet period is shown straight away, so that
+ * typing remains responsive.
+ *
+ * When each frame scrolls by a whole screen or more, the output is
+ * arriving faster than it can be read.  The scheduler then lowers the
+ * frame rate, skipping the intermediate frames entirely (a 'jump scroll'),
+ * until the output slows down again.
+ */
+class KONSOLEPRIVATE_EXPORT UpdateScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Counters describing the decisions made by the scheduler, which
+     * can be used to tune it.
+     */
+    struct Statistics {
+        Statistics()
+            : requests(0)
+            , coalescedRequests(0)
+            , frames(0)
+            , delayedFrames(0)
+            , jumpScrollFrames(0) { }
+
+        /** The number of calls to scheduleUpdate() */
+        int requests;
+        /** The number of requests which were merged into an already scheduled frame */
+        int coalescedRequests;
+        /** The number of times updateRequested() was emitted */
+        int frames;
+        /** The number of frames which were held back to respect the frame rate */
+        int delayedFrames;
+        /** The number of frames after which the frame rate was lowered for jump scrolling */
+        int jumpScrollFrames;
+    };
+
+    explicit UpdateScheduler(QObject* parent = 0);
+
+    /**
+     * Sets the maximum number of frames per second.  This should match
+     * the refresh rate of the monitor, there is no benefit in drawing
+     * frames which are never shown.  The default is 60.
+     */
+    void setFrameRate(int framesPerSecond);
+    /** Returns the maximum number of frames per second. See setFrameRate() */
+    int frameRate() const;
+
+    /**
+     * Returns the minimum time in milliseconds between two frames at the
+     * moment, which is longer than the interval given by frameRate() while
+     * jump scrolling.
+     */
+    int frameInterval() const;
+
+    /**
+     * Tells the scheduler how far the frame which was just drawn scrolled,
+     * so that it can decide whether to jump scroll.
+     *
+     * @param scrolledLines The number of lines which the output scrolled
+     * by since the previous frame.
+     * @param lines The number of lines in the display.
+     */
+    void frameDrawn(int scrolledLines, int lines);
+
+    /** Returns the counters describing the decisions made so far. */
+    const Statistics& statistics() const;
+    /** Resets all counters to zero. */
+    void resetStatistics();
+
+public slots:
+    /**
+     * Requests an update of the display.  updateRequested() will be
+     * emitted once the frame rate allows it.
+     */
+    void scheduleUpdate();
+
+signals:
+    /** Emitted when the display should be updated. */
+    void updateRequested();
+
+private slots:
+    void startFrame();
+
+private:
+    // the longest interval between frames while jump scrolling, as a
+    // multiple of the normal frame interval
+    static const int MAX_JUMP_SCROLL_FACTOR = 4;
+
+    QTimer _timer;
+    QElapsedTimer _lastFrame;
+    int _frameRate;
+    int _jumpScrollFactor;
+    Statistics _statistics;
+};
+}
+
+#endif // UPDATESCHEDULER_H
@@ -42,6 +42,7 @@
 #include "TerminalDisplay.h"
 #include "SessionController.h"
 #include "SessionManager.h"
+#include "HistoryMemoryManager.h"
 #include "ProfileManager.h"
 #include "ViewContainer.h"
 #include "ViewSplitter.h"
@@ -519,6 +520,7 @@ void ViewManager::controllerChanged(SessionController* controller)
     _viewSplitter->setFocusProxy(controller->view());
 
     _pluggedController = controller;
+    HistoryMemoryManager::instance()->sessionViewed(controller->session());
     emit activeViewChanged(controller);
 }
 
@@ -779,6 +781,8 @@ void ViewManager::applyProfileToView(TerminalDisplay* view , const Profile::Ptr
     // load font
     view->setAntialias(profile->antiAliasFonts());
     view->setBoldIntense(profile->boldIntense());
+    view->setGlyphCacheEnabled(profile->property<bool>(Profile::CacheGlyphs));
+    view->setWallpaperTextLayerEnabled(profile->property<bool>(Profile::WallpaperTextLayer));
     view->setVTFont(profile->font());
 
     // set scroll-bar position
@@ -121,7 +121,7 @@ void Vt102Emulation::reset()
 
    The pipeline proceeds as follows:
 
-   - Tokenizing the ESC codes (onReceiveChar)
+   - Tokenizing the ESC codes (receiveChars)
    - VT100 code page translation of plain characters (applyCharset)
    - Interpretation of ESC codes (processToken)
 
@@ -197,6 +197,7 @@ void Vt102Emulation::resetTokenizer()
     argc = 0;
     argv[0] = 0;
     argv[1] = 0;
+    _parserState = GroundState;
 }
 
 void Vt102Emulation::addDigit(int digit)
@@ -226,6 +227,21 @@ const int SCS = 16;  // Select Character Set
 const int GRP = 32;  // TODO: Document me
 const int CPS = 64;  // Character which indicates end of window resize
 
+#define CNTL(c) ((c)-'@')
+const int ESC = 27;
+const int DEL = 127;
+const int CSI = ESC + 128;
+
+// Characters outside of Latin-1 are looked up in the transition
+// tables as if they were this character.  It behaves like any other
+// printable character in all of the parser states.
+const int NON_LATIN1_CHAR = 0xa0;
+
+static inline quint16 transition(int action, int state)
+{
+    return (action << 8) | state;
+}
+
 void Vt102Emulation::initTokenizer()
 {
     int i;
@@ -248,148 +264,252 @@ void Vt102Emulation::initTokenizer()
     for (s = (quint8*)"()+*#[]%"; *s; ++s)
         charClass[*s] |= GRP;
 
-    resetTokenizer();
-}
+    // Build the state transition tables.
+    //
+    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
+    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
+    // of course. Guess this originates from a weakly layered handling of the X-on
+    // X-off protocol, which comes really below this level.
+    //
+    // Control characters are therefore executed without leaving the current state
+    // in every state, DEL is ignored everywhere and ESC always starts a new sequence.
+    for (int state = 0; state < ParserStateCount; ++state) {
+        for (i = 0; i < 32; ++i)
+            _parserTransitions[state][i] = transition(ExecuteAction, state);
+        _parserTransitions[state][ESC] = transition(EscapeAction, EscapeState);
+        _parserTransitions[state][DEL] = transition(IgnoreAction, state);
+    }
 
-/* Ok, here comes the nasty part of the decoder.
+    for (i = 32; i < 256; ++i) {
+        if (i == DEL)
+            continue;
 
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+        const int cls = charClass[i];
 
-   This is done by the following defines.
+        _parserTransitions[GroundState][i] = transition(PrintAction, GroundState);
 
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'charClass').
+        if (cls & GRP) {
+            int next = EscapeIntermediateState;
+            if (i == '[')
+                next = CsiEntryState;
+            else if (i == ']')
+                next = OscStringState;
+            _parserTransitions[EscapeState][i] = transition(CollectAction, next);
+        } else {
+            _parserTransitions[EscapeState][i] = transition(EscDispatchAction, GroundState);
+        }
 
-   - 'cc' is the current character
-   - 's' is a pointer to the start of the token buffer
-   - 'p' is the current position within the token buffer
+        _parserTransitions[EscapeIntermediateState][i] = transition(EscIntermediateDispatchAction, GroundState);
+
+        if (cls & DIG) {
+            _parserTransitions[CsiEntryState][i] = transition(ParamDigitAction, CsiParamState);
+            _parserTransitions[CsiParamState][i] = transition(ParamDigitAction, CsiParamState);
+        } else if (i == ';') {
+            _parserTransitions[CsiEntryState][i] = transition(ParamSeparatorAction, CsiParamState);
+            _parserTransitions[CsiParamState][i] = transition(ParamSeparatorAction, CsiParamState);
+        } else {
+            _parserTransitions[CsiEntryState][i] = transition(CsiDispatchAction, GroundState);
+            _parserTransitions[CsiParamState][i] = transition(CsiDispatchAction, GroundState);
+        }
 
-   Note that they need to applied in proper order.
-*/
+        _parserTransitions[CsiExclamationState][i] = transition(CsiExclamationDispatchAction, GroundState);
+        _parserTransitions[OscStringState][i] = transition(CollectAction, OscStringState);
+
+        if (i == 'Y')
+            _parserTransitions[Vt52EscapeState][i] = transition(CollectAction, Vt52CursorRowState);
+        else
+            _parserTransitions[Vt52EscapeState][i] = transition(Vt52DispatchAction, GroundState);
+        _parserTransitions[Vt52CursorRowState][i] = transition(CollectAction, Vt52CursorColumnState);
+        _parserTransitions[Vt52CursorColumnState][i] = transition(Vt52CursorDispatchAction, GroundState);
+    }
 
-#define lec(P,L,C) (p == (P) && s[(L)] == (C))
-#define lun(     ) (p ==  1  && cc >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  && cc == (C))
-#define ees(C)     (p >=  3  && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?')
-#define epe( )     (p >=  3  && s[2] == '!')
-#define egt( )     (p >=  3  && s[2] == '>')
-#define Xpe        (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte        (Xpe      && cc ==  7 )
-#define ces(C)     (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
+    // private parameter markers, ESC[?...  ESC[>...  ESC[!...
+    _parserTransitions[CsiEntryState]['?'] = transition(CollectAction, CsiParamState);
+    _parserTransitions[CsiEntryState]['>'] = transition(CollectAction, CsiParamState);
+    _parserTransitions[CsiEntryState]['!'] = transition(CollectAction, CsiExclamationState);
 
-#define CNTL(c) ((c)-'@')
-const int ESC = 27;
-const int DEL = 127;
+    // 8-bit CSI
+    _parserTransitions[GroundState][CSI] = transition(Csi8Action, GroundState);
+
+    // window title and other xterm attribute changes are terminated by BEL
+    _parserTransitions[OscStringState][CNTL('G')] = transition(OscEndAction, GroundState);
+
+    resetTokenizer();
+}
+
+/* Decoding the incoming character stream
+
+   The tokenizer is a state machine in the style of the DEC ANSI parser
+   described at http://vt100.net/emu/dec_ansi_parser .  Each incoming
+   character is looked up in the transition table of the current state,
+   which yields the action to perform and the state to move to.
+
+   The vast majority of terminal output is plain text, so runs of
+   printable characters in the ground state are passed to the screen
+   directly without looking at the transition tables at all.
+
+   The token buffer (tokenBuffer, tokenBufferPos) still records the
+   characters of the sequence being parsed, both for the sequences which
+   need them (window attribute changes, VT52 cursor positioning) and for
+   reportDecodingError().
+*/
+
+static inline bool isPrintableCharacter(uint cc)
+{
+    return (cc >= 32 && cc < DEL) || cc >= NON_LATIN1_CHAR;
+}
 
-// process an incoming unicode character
 void Vt102Emulation::receiveChar(int cc)
 {
-  if (cc == DEL)
-    return; //VT100: ignore.
+    const uint character = cc;
+    receiveChars(&character, 1);
+}
 
-  if (ces(CTL))
-  {
-    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-        resetTokenizer(); //VT100: CAN or SUB
-    if (cc != ESC)
-    {
-        processToken(TY_CTL(cc+'@' ),0,0);
-        return;
+void Vt102Emulation::receiveChars(const uint* chars, int count)
+{
+    const uint* const end = chars + count;
+
+    while (chars < end) {
+        if (_parserState == GroundState) {
+            const uint* runStart = chars;
+            while (chars < end && isPrintableCharacter(*chars))
+                ++chars;
+
+            if (chars != runStart) {
+                displayCharacters(runStart, chars - runStart);
+                continue;
+            }
+        }
+
+        const uint cc = *chars++;
+        const quint16 next = _parserTransitions[_parserState][cc < 256 ? cc : NON_LATIN1_CHAR];
+
+        _parserState = static_cast<ParserState>(next & 0xff);
+        performAction(next >> 8, cc);
     }
-  }
-  // advance the state
-  addToCurrentToken(cc);
+}
 
-  int* s = tokenBuffer;
-  const int  p = tokenBufferPos;
+void Vt102Emulation::performAction(int action, uint cc)
+{
+    switch (action) {
+    case IgnoreAction:
+        break;
+    case PrintAction:
+        displayCharacters(&cc, 1);
+        break;
+    case ExecuteAction:
+        if (cc == CNTL('X') || cc == CNTL('Z'))
+            resetTokenizer(); //VT100: CAN or SUB
+        processToken(TY_CTL(cc + '@'), 0, 0);
+        break;
+    case EscapeAction:
+        resetTokenizer();
+        addToCurrentToken(cc);
+        _parserState = getMode(MODE_Ansi) ? EscapeState : Vt52EscapeState;
+        break;
+    case Csi8Action:
+        if (getMode(MODE_Ansi)) {
+            resetTokenizer();
+            addToCurrentToken(ESC);
+            addToCurrentToken('[');
+            _parserState = CsiEntryState;
+        } else {
+            displayCharacters(&cc, 1);
+        }
+        break;
+    case CollectAction:
+        addToCurrentToken(cc);
+        break;
+    case ParamDigitAction:
+        addToCurrentToken(cc);
+        addDigit(cc - '0');
+        break;
+    case ParamSeparatorAction:
+        addToCurrentToken(cc);
+        addArgument();
+        break;
+    case EscDispatchAction:
+        addToCurrentToken(cc);
+        processToken(TY_ESC(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case EscIntermediateDispatchAction:
+        addToCurrentToken(cc);
+        if (tokenBuffer[1] == '#')
+            processToken(TY_ESC_DE(cc), 0, 0);
+        else
+            processToken(TY_ESC_CS(tokenBuffer[1], cc), 0, 0);
+        resetTokenizer();
+        break;
+    case CsiDispatchAction:
+        addToCurrentToken(cc);
+        processCsiSequence(cc);
+        resetTokenizer();
+        break;
+    case CsiExclamationDispatchAction:
+        addToCurrentToken(cc);
+        processToken(TY_CSI_PE(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case OscEndAction:
+        addToCurrentToken(cc);
+        processWindowAttributeChange();
+        resetTokenizer();
+        break;
+    case Vt52DispatchAction:
+        addToCurrentToken(cc);
+        processToken(TY_VT52(cc), 0, 0);
+        resetTokenizer();
+        break;
+    case Vt52CursorDispatchAction:
+        addToCurrentToken(cc);
+        processToken(TY_VT52('Y'), tokenBuffer[2], cc);
+        resetTokenizer();
+        break;
+    default:
+        Q_ASSERT(false);
+    }
+}
 
-  if (getMode(MODE_Ansi))
-  {
-    if (lec(1,0,ESC)) { return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('['); return; }
-    if (les(2,1,GRP)) { return; }
-    if (Xte         ) { processWindowAttributeChange(); resetTokenizer(); return; }
-    if (Xpe         ) { return; }
-    if (lec(3,2,'?')) { return; }
-    if (lec(3,2,'>')) { return; }
-    if (lec(3,2,'!')) { return; }
-    if (lun(       )) { processToken( TY_CHR(), applyCharset(cc), 0);   resetTokenizer(); return; }
-    if (lec(2,0,ESC)) { processToken( TY_ESC(s[1]), 0, 0);              resetTokenizer(); return; }
-    if (les(3,1,SCS)) { processToken( TY_ESC_CS(s[1],s[2]), 0, 0);      resetTokenizer(); return; }
-    if (lec(3,1,'#')) { processToken( TY_ESC_DE(s[2]), 0, 0);           resetTokenizer(); return; }
-    if (eps(    CPN)) { processToken( TY_CSI_PN(cc), argv[0],argv[1]);  resetTokenizer(); return; }
+void Vt102Emulation::processCsiSequence(int cc)
+{
+    // tokenBuffer holds ESC '[' followed by the private marker, if any
+    const int marker = tokenBuffer[2];
+    const bool isPrivate = (marker == '?');
+    const bool isSecondary = (marker == '>');
+    const int cls = cc < 256 ? charClass[cc] : 0;
+
+    if (!isPrivate && !isSecondary && (cls & CPN)) {
+        processToken(TY_CSI_PN(cc), argv[0], argv[1]);
+        return;
+    }
 
     // resize = \e[8;<row>;<col>t
-    if (eps(CPS))
-    {
-        processToken( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
-        resetTokenizer();
+    if (!isPrivate && !isSecondary && (cls & CPS)) {
+        processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
         return;
     }
 
-    if (epe(   )) { processToken( TY_CSI_PE(cc), 0, 0); resetTokenizer(); return; }
-    if (ees(DIG)) { addDigit(cc-'0'); return; }
-    if (eec(';')) { addArgument();    return; }
-    for (int i = 0; i <= argc; i++)
-    {
-        if (epp())
-            processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
-        else if (egt())
+    for (int i = 0; i <= argc; i++) {
+        if (isPrivate)
+            processToken(TY_CSI_PR(cc, argv[i]), 0, 0);
+        else if (isSecondary)
             processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
-        {
+        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2) {
             // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
             i += 2;
             processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
             i += 2;
-        }
-        else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
-        {
+        } else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5) {
             // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
             i += 2;
             processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+        } else {
+            processToken(TY_CSI_PS(cc, argv[i]), 0, 0);
         }
-        else
-            processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
-    }
-    resetTokenizer();
-  }
-  else
-  {
-    // VT52 Mode
-    if (lec(1,0,ESC))
-        return;
-    if (les(1,0,CHR))
-    {
-        processToken( TY_CHR(), s[0], 0);
-        resetTokenizer();
-        return;
     }
-    if (lec(2,1,'Y'))
-        return;
-    if (lec(3,1,'Y'))
-        return;
-    if (p < 4)
-    {
-        processToken(TY_VT52(s[1] ), 0, 0);
-        resetTokenizer();
-        return;
-    }
-    processToken(TY_VT52(s[1]), s[2], s[3]);
-    resetTokenizer();
-    return;
-  }
 }
+
 void Vt102Emulation::processWindowAttributeChange()
 {
   // Describes the window or terminal session attribute to change
@@ -1090,13 +1210,27 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 
 // Apply current character map.
 
-unsigned short Vt102Emulation::applyCharset(unsigned short c)
+uint Vt102Emulation::applyCharset(uint c)
 {
     if (CHARSET.graphic && 0x5f <= c && c <= 0x7e) return vt100_graphics[c - 0x5f];
     if (CHARSET.pound && c == '#') return 0xa3;  //This mode is obsolete
     return c;
 }
 
+void Vt102Emulation::displayCharacters(const uint* chars, int count)
+{
+    Screen* screen = _currentScreen;
+
+    // the character map only applies in ANSI mode, and only needs to be
+    // consulted per character when one of the VT100 tricks is active
+    if (getMode(MODE_Ansi) && (CHARSET.graphic || CHARSET.pound)) {
+        for (int i = 0; i < count; i++)
+            screen->displayCharacter(applyCharset(chars[i]));
+    } else {
+        screen->displayCharacters(chars, count);
+    }
+}
+
 /*
    "Charset" related part of the emulation state.
    This configures the VT100 charset filter.
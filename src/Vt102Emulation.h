@@ -72,7 +72,7 @@ struct CharCodes {
  * sequences.
  *
  */
-class Vt102Emulation : public Emulation
+class KONSOLEPRIVATE_EXPORT Vt102Emulation : public Emulation
 {
     Q_OBJECT
 
@@ -98,6 +98,7 @@ protected:
     virtual void setMode(int mode);
     virtual void resetMode(int mode);
     virtual void receiveChar(int cc);
+    virtual void receiveChars(const uint* chars, int count);
 
 private slots:
     //causes changeTitle() to be emitted for each (int,QString) pair in pendingTitleUpdates
@@ -105,7 +106,7 @@ private slots:
     void updateTitle();
 
 private:
-    unsigned short applyCharset(unsigned short c);
+    uint applyCharset(uint c);
     void setCharset(int n, int cs);
     void useCharset(int n);
     void setAndUseCharset(int n, int cs);
@@ -144,6 +145,53 @@ private:
     // for the purposes of decoding terminal output
     int charClass[256];
 
+    // States of the escape sequence parser.  The parser is a
+    // DEC ANSI style state machine, see initTokenizer() for the
+    // transitions between the states.
+    enum ParserState {
+        GroundState,
+        EscapeState,
+        EscapeIntermediateState,
+        CsiEntryState,
+        CsiParamState,
+        CsiExclamationState,
+        OscStringState,
+        Vt52EscapeState,
+        Vt52CursorRowState,
+        Vt52CursorColumnState,
+        ParserStateCount
+    };
+
+    // Actions performed by the parser when moving between states
+    enum ParserAction {
+        IgnoreAction,
+        PrintAction,
+        ExecuteAction,
+        EscapeAction,
+        Csi8Action,
+        CollectAction,
+        ParamDigitAction,
+        ParamSeparatorAction,
+        EscDispatchAction,
+        EscIntermediateDispatchAction,
+        CsiDispatchAction,
+        CsiExclamationDispatchAction,
+        OscEndAction,
+        Vt52DispatchAction,
+        Vt52CursorDispatchAction
+    };
+
+    void performAction(int action, uint cc);
+    void processCsiSequence(int cc);
+    // displays a run of printable characters in the ground state
+    void displayCharacters(const uint* chars, int count);
+
+    ParserState _parserState;
+    // maps the current state and an input character (or 0xA0 for
+    // characters outside of Latin-1) to an action in the high byte
+    // and the next state in the low byte
+    quint16 _parserTransitions[ParserStateCount][256];
+
     void reportDecodingError();
 
     void processToken(int code, int p, int q);
@@ -125,7 +125,7 @@ static int bisearch(unsigned long ucs, const struct interval* table, int max)
  * in ISO 10646.
  */
 
-int konsole_wcwidth(quint16 oucs)
+int konsole_wcwidth(quint32 oucs)
 {
     /* NOTE: It is not possible to compare quint16 with the new last four lines of characters,
      * therefore this cast is now necessary.
@@ -210,15 +210,27 @@ int konsole_wcwidth(quint16 oucs)
              (ucs >= 0xff00 && ucs <= 0xff5f) || /* Fullwidth Forms */
              (ucs >= 0xffe0 && ucs <= 0xffe6) ||
              (ucs >= 0x300a && ucs <= 0x300b) || /* Special character 《 and 》(Unicode Standard Annex #11) */
+             (ucs >= 0x1f300 && ucs <= 0x1f64f) || /* Misc Symbols and Pictographs, Emoticons */
+             (ucs >= 0x1f900 && ucs <= 0x1f9ff) || /* Supplemental Symbols and Pictographs */
              (ucs >= 0x20000 && ucs <= 0x2fffd) ||
              (ucs >= 0x30000 && ucs <= 0x3fffd)));
 }
 
+// returns the code point starting at text[i] and advances i past it,
+// combining surrogate pairs
+static inline quint32 nextCodePoint(const QString& text, int& i)
+{
+    const ushort c = text[i++].unicode();
+    if (QChar(c).isHighSurrogate() && i < text.length() && text[i].isLowSurrogate())
+        return QChar::surrogateToUcs4(c, text[i++].unicode());
+    return c;
+}
+
 int string_width(const QString& text)
 {
     int w = 0;
-    for (int i = 0; i < text.length(); ++i)
-        w += konsole_wcwidth(text[i].unicode());
+    for (int i = 0; i < text.length();)
+        w += konsole_wcwidth(nextCodePoint(text, i));
     return w;
 }
 
@@ -231,7 +243,7 @@ int string_width(const QString& text)
  * the traditional terminal character-width behaviour. It is not
  * otherwise recommended for general use.
  */
-int konsole_wcwidth_cjk(quint16 oucs)
+int konsole_wcwidth_cjk(quint32 oucs)
 {
     /* sorted list of non-overlapping intervals of East Asian Ambiguous
      * characters, generated by
@@ -317,7 +329,7 @@ int konsole_wcwidth_cjk(quint16 oucs)
 int string_width_cjk(const QString& text)
 {
     int w = 0;
-    for (int i = 0; i < text.length(); ++i)
-        w += konsole_wcwidth_cjk(text[i].unicode());
+    for (int i = 0; i < text.length();)
+        w += konsole_wcwidth_cjk(nextCodePoint(text, i));
     return w;
 }
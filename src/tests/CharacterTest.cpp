@@ -0,0 +1,227 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterTest.h"
+
+// System
+#include <string.h>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Screen.h"
+
+using namespace Konsole;
+
+static const int ScreenLines = 50;
+static const int ScreenColumns = 200;
+
+void CharacterTest::fillScreen(Screen* screen)
+{
+    // alternate between a few colors and renditions, roughly as a colored
+    // 'ls' or compiler output would
+    uint text[ScreenColumns];
+    for (int column = 0; column < ScreenColumns; column++)
+        text[column] = 'a' + column % 26;
+
+    for (int line = 0; line < ScreenLines; line++) {
+        screen->setCursorYX(line + 1, 1);
+        for (int column = 0; column < ScreenColumns; column += 20) {
+            screen->setForeColor(COLOR_SPACE_SYSTEM, (line + column / 20) % 8);
+            if (column % 40 == 0)
+                screen->setRendition(RE_BOLD);
+            else
+                screen->resetRendition(RE_BOLD);
+            screen->displayCharacters(text + column, 20);
+        }
+    }
+    screen->setDefaultRendition();
+}
+
+void CharacterTest::testSize()
+{
+    QCOMPARE(sizeof(Character), size_t(8));
+}
+
+void CharacterTest::testDefaultStyle()
+{
+    const Character character('x');
+    QCOMPARE(character.styleIndex(), quint32(0));
+    QCOMPARE(character.rendition(), quint8(DEFAULT_RENDITION));
+    QVERIFY(character.foregroundColor() == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR));
+    QVERIFY(character.backgroundColor() == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR));
+
+    const Character explicitDefault('x',
+                                    CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR),
+                                    CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
+                                    DEFAULT_RENDITION);
+    QCOMPARE(explicitDefault.styleIndex(), quint32(0));
+    QVERIFY(explicitDefault == character);
+}
+
+void CharacterTest::testStyleInterning()
+{
+    const CharacterColor red(COLOR_SPACE_SYSTEM, 1);
+    const CharacterColor blue(COLOR_SPACE_RGB, 0x0000ff);
+
+    const Character first('a', red, blue, RE_BOLD);
+    const Character second('b', red, blue, RE_BOLD);
+    const Character third('c', blue, red, RE_BOLD);
+
+    QVERIFY(first.styleIndex() != 0);
+    QCOMPARE(first.styleIndex(), second.styleIndex());
+    QVERIFY(first.equalsFormat(second));
+    QVERIFY(first.styleIndex() != third.styleIndex());
+    QVERIFY(!first.equalsFormat(third));
+
+    const int count = CharacterStyleTable::instance.count();
+    const Character fourth('d', red, blue, RE_BOLD);
+    QCOMPARE(CharacterStyleTable::instance.count(), count);
+    QCOMPARE(fourth.styleIndex(), first.styleIndex());
+}
+
+void CharacterTest::testStyleAccessors()
+{
+    const CharacterColor green(COLOR_SPACE_SYSTEM, 2);
+    const CharacterColor color256(COLOR_SPACE_256, 200);
+
+    Character character('x');
+    character.setForegroundColor(green);
+    QVERIFY(character.foregroundColor() == green);
+    QVERIFY(character.backgroundColor() == CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR));
+
+    character.setBackgroundColor(color256);
+    character.setRendition(RE_UNDERLINE | RE_ITALIC);
+    QVERIFY(character.foregroundColor() == green);
+    QVERIFY(character.backgroundColor() == color256);
+    QCOMPARE(character.rendition(), quint8(RE_UNDERLINE | RE_ITALIC));
+
+    const Character constructed('x', green, color256, RE_UNDERLINE | RE_ITALIC);
+    QVERIFY(character == constructed);
+
+    character.setFormat(CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_FORE_COLOR),
+                        CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR),
+                        DEFAULT_RENDITION);
+    QCOMPARE(character.styleIndex(), quint32(0));
+}
+
+void CharacterTest::testStyleTableLimit()
+{
+    CharacterStyleTable table(64);
+    const CharacterColor background(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR);
+
+    // styles with RGB colors fill three quarters of the table
+    for (int i = 1; i < 48; i++)
+        QCOMPARE(table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_RGB, i), background)), quint32(i));
+    QCOMPARE(table.count(), 48);
+
+    // then RGB colors are replaced by the closest palette colors
+    const quint32 red = table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_RGB, 0xff0000), background));
+    QVERIFY(table.style(red).foregroundColor == CharacterColor(COLOR_SPACE_256, 196));
+    const quint32 gray = table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_RGB, 0x7f7f80), background));
+    QVERIFY(table.style(gray).foregroundColor == CharacterColor(COLOR_SPACE_256, 244));
+    QCOMPARE(table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_RGB, 0xfe0101), background)), red);
+    QCOMPARE(table.count(), 50);
+
+    // styles with palette colors use the rest of the table
+    for (int i = 0; i < 14; i++)
+        QVERIFY(table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_256, i), background)) != 0);
+    QCOMPARE(table.count(), 64);
+
+    // and once it is full, the default style is used
+    QCOMPARE(table.createStyle(CharacterStyle(CharacterColor(COLOR_SPACE_256, 100), background)), quint32(0));
+    QCOMPARE(table.count(), 64);
+}
+
+void CharacterTest::testScreenStyles()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    fillScreen(&screen);
+
+    QVector<Character> image(ScreenLines * ScreenColumns);
+    screen.getImage(image.data(), image.size(), 0, ScreenLines - 1);
+
+    // bold text is drawn with the intensive variant of its color
+    CharacterColor boldColor(COLOR_SPACE_SYSTEM, 0);
+    boldColor.setIntensive();
+
+    QCOMPARE(image[0].character, quint32('a'));
+    QVERIFY(image[0].foregroundColor() == boldColor);
+    QCOMPARE(image[0].rendition() & RE_BOLD, RE_BOLD);
+    QVERIFY(image[20].foregroundColor() == CharacterColor(COLOR_SPACE_SYSTEM, 1));
+    QCOMPARE(image[20].rendition() & RE_BOLD, 0);
+
+    // selected characters are drawn with their colors swapped
+    screen.setSelectionStart(0, 0, false);
+    screen.setSelectionEnd(1, 0);
+    screen.getImage(image.data(), image.size(), 0, ScreenLines - 1);
+    QVERIFY(image[0].foregroundColor() == image[2].backgroundColor());
+    QVERIFY(image[0].backgroundColor() == image[2].foregroundColor());
+    QCOMPARE(image[0].rendition(), image[2].rendition());
+}
+
+void CharacterTest::testGetImageThroughput()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    fillScreen(&screen);
+    screen.clearSelection();
+
+    QVector<Character> image(ScreenLines * ScreenColumns);
+
+    QBENCHMARK {
+        screen.getImage(image.data(), image.size(), 0, ScreenLines - 1);
+    }
+}
+
+void CharacterTest::testUpdateImageThroughput()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    fillScreen(&screen);
+    screen.clearSelection();
+
+    QVector<Character> oldImage(ScreenLines * ScreenColumns);
+    QVector<Character> newImage(ScreenLines * ScreenColumns);
+    screen.getImage(newImage.data(), newImage.size(), 0, ScreenLines - 1);
+
+    // compare and copy the images in the same way as
+    // TerminalDisplay::updateImage() does for each line
+    int dirtyCells = 0;
+    QBENCHMARK {
+        dirtyCells = 0;
+        for (int line = 0; line < ScreenLines; line++) {
+            Character* currentLine = oldImage.data() + line * ScreenColumns;
+            const Character* newLine = newImage.constData() + line * ScreenColumns;
+
+            for (int column = 0; column < ScreenColumns; column++) {
+                if (newLine[column] != currentLine[column])
+                    dirtyCells++;
+            }
+
+            memcpy((void*)currentLine, (const void*)newLine, ScreenColumns * sizeof(Character));
+        }
+        memset((void*)oldImage.data(), 0, oldImage.size() * sizeof(Character));
+    }
+    QVERIFY(dirtyCells > 0);
+}
+
+QTEST_KDEMAIN_CORE(CharacterTest)
+
+#include "CharacterTest.moc"
@@ -0,0 +1,252 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "FilterTest.h"
+
+// Qt
+#include <QtGui/QAction>
+#include <QtGui/QApplication>
+#include <QtGui/QClipboard>
+
+// KDE
+#include <qtest_kde.h>
+
+using namespace Konsole;
+
+static const int COLUMNS = 20;
+
+// a filter which counts the hotspots it creates
+class CountingFilter : public RegExpFilter
+{
+public:
+    CountingFilter() : count(0) {
+        setRegExp(QRegExp("foo\\d+"));
+    }
+
+    int count;
+
+protected:
+    virtual RegExpFilter::HotSpot* newHotSpot(int startLine, int startColumn,
+            int endLine, int endColumn) {
+        count++;
+        return RegExpFilter::newHotSpot(startLine, startColumn, endLine, endColumn);
+    }
+};
+
+// sets the image of 'chain' to 'lines' and processes it
+static void setLines(TerminalImageFilterChain& chain, const QStringList& lines,
+                     const QVector<LineProperty>& lineProperties = QVector<LineProperty>())
+{
+    QVector<Character> image(lines.count() * COLUMNS);
+    for (int line = 0; line < lines.count(); line++) {
+        for (int column = 0; column < lines[line].length(); column++)
+            image[line * COLUMNS + column] = Character(lines[line][column].unicode());
+    }
+
+    chain.setImage(image.constData(), lines.count(), COLUMNS, lineProperties);
+    chain.process();
+}
+
+// returns the positions of the hotspots found by 'filter', sorted
+static QStringList hotSpotPositions(const Filter* filter)
+{
+    QStringList positions;
+    foreach(Filter::HotSpot* spot, filter->hotSpots()) {
+        positions << QString("%1,%2-%3,%4").arg(spot->startLine()).arg(spot->startColumn())
+                  .arg(spot->endLine()).arg(spot->endColumn());
+    }
+    positions.sort();
+    return positions;
+}
+
+// returns the texts of the hotspots found by 'filter', sorted
+static QStringList hotSpotTexts(const Filter* filter)
+{
+    QStringList texts;
+    foreach(Filter::HotSpot* spot, filter->hotSpots())
+        texts << static_cast<RegExpFilter::HotSpot*>(spot)->capturedTexts().first();
+    texts.sort();
+    return texts;
+}
+
+void FilterTest::testRegExpFilter()
+{
+    TerminalImageFilterChain chain;
+    CountingFilter* filter = new CountingFilter();
+    chain.addFilter(filter);
+
+    setLines(chain, QStringList() << "a foo1" << "" << "foo22 foo3");
+
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,2-0,6" << "2,0-2,5" << "2,6-2,10");
+    QVERIFY(chain.hotSpotAt(2, 7));
+    QVERIFY(!chain.hotSpotAt(1, 2));
+}
+
+void FilterTest::testIncrementalFiltering()
+{
+    TerminalImageFilterChain chain;
+    CountingFilter* filter = new CountingFilter();
+    chain.addFilter(filter);
+
+    setLines(chain, QStringList() << "foo1" << "bar" << "foo2" << "foo3");
+    QCOMPARE(filter->count, 3);
+
+    // the same image does not need to be processed again
+    setLines(chain, QStringList() << "foo1" << "bar" << "foo2" << "foo3");
+    QCOMPARE(filter->count, 3);
+    QCOMPARE(hotSpotPositions(filter).count(), 3);
+
+    // when the text scrolls, the hotspots move with it and only the new
+    // line is processed
+    setLines(chain, QStringList() << "bar" << "foo2" << "foo3" << "foo4");
+    QCOMPARE(filter->count, 4);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "1,0-1,4" << "2,0-2,4" << "3,0-3,4");
+
+    // a changed line loses its hotspots
+    setLines(chain, QStringList() << "bar" << "foo2" << "baz" << "foo4");
+    QCOMPARE(filter->count, 4);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "1,0-1,4" << "3,0-3,4");
+
+    // lines which are joined by wrapping are processed together
+    QVector<LineProperty> wrapped(4, LINE_DEFAULT);
+    wrapped[1] = LINE_WRAPPED;
+    setLines(chain, QStringList() << "bar" << "foo22222222222222222" << "5" << "foo4", wrapped);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "1,0-2,1" << "3,0-3,4");
+    QCOMPARE(filter->count, 5);
+}
+
+void FilterTest::testOutdatedFilter()
+{
+    TerminalImageFilterChain chain;
+    CountingFilter* filter = new CountingFilter();
+    chain.addFilter(filter);
+
+    setLines(chain, QStringList() << "foo1" << "bar1");
+    QVERIFY(!filter->isOutdated());
+    QCOMPARE(hotSpotPositions(filter).count(), 1);
+
+    // changing the regular expression makes the filter find all of its
+    // hotspots again
+    filter->setRegExp(QRegExp("bar\\d"));
+    QVERIFY(filter->isOutdated());
+    setLines(chain, QStringList() << "foo1" << "bar1");
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "1,0-1,4");
+
+    // as does adding a filter to the chain again
+    chain.removeFilter(filter);
+    setLines(chain, QStringList() << "bar2" << "bar3");
+    chain.addFilter(filter);
+    setLines(chain, QStringList() << "bar2" << "bar3");
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,0-0,4" << "1,0-1,4");
+
+    chain.removeFilter(filter);
+    delete filter;
+}
+
+void FilterTest::testLazyFilter()
+{
+    TerminalImageFilterChain chain;
+    CountingFilter* filter = new CountingFilter();
+    filter->setLazy(true);
+    chain.addFilter(filter);
+
+    QVector<LineProperty> wrapped(3, LINE_DEFAULT);
+    wrapped[1] = LINE_WRAPPED;
+    setLines(chain, QStringList() << "foo1" << "foo22222222222222222" << "3", wrapped);
+    QVERIFY(!filter->isOutdated());
+    QCOMPARE(filter->count, 0);
+
+    // lazy filters only process the lines which are asked for, and the
+    // lines which are joined to them by wrapping, once
+    chain.processLine(0);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,0-0,4");
+    chain.processLine(2);
+    chain.processLine(1);
+    chain.processLine(0);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,0-0,4" << "1,0-2,1");
+    QCOMPARE(filter->count, 2);
+
+    // lines which have been processed stay processed when the text scrolls
+    QVector<LineProperty> scrolled(3, LINE_DEFAULT);
+    scrolled[0] = LINE_WRAPPED;
+    setLines(chain, QStringList() << "foo22222222222222222" << "3" << "foo4", scrolled);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,0-1,1");
+    chain.processLine(1);
+    QCOMPARE(filter->count, 2);
+    chain.processLine(2);
+    QCOMPARE(filter->count, 3);
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,0-1,1" << "2,0-2,4");
+}
+
+void FilterTest::testUrlFilter()
+{
+    TerminalImageFilterChain chain;
+    UrlFilter* filter = new UrlFilter();
+    chain.addFilter(filter);
+
+    setLines(chain, QStringList() << "see www.kde.org." << "<me@kde.org> a@b"
+             << "(http://kde.org/a)" << "www..org http:/x"
+             << "me@kde.org,www.x.y" << "xhttp://www.kde.org");
+
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,4-0,15" << "1,1-1,11"
+             << "2,1-2,17" << "4,0-4,10" << "4,11-4,18" << "5,0-5,19");
+    QCOMPARE(hotSpotTexts(filter), QStringList() << "http://kde.org/a"
+             << "me@kde.org" << "me@kde.org" << "www.kde.org" << "www.x.y"
+             << "xhttp://www.kde.org");
+
+    // links are found in lines which are joined by wrapping, whose trailing
+    // whitespace separates them from the text on the next line
+    QVector<LineProperty> wrapped(4, LINE_DEFAULT);
+    wrapped[0] = LINE_WRAPPED;
+    wrapped[2] = LINE_WRAPPED;
+    setLines(chain, QStringList() << "see http://kde.org/a" << "rtifacts/1 here"
+             << "see http://kde.org/ " << "and more", wrapped);
+
+    QCOMPARE(hotSpotPositions(filter), QStringList() << "0,4-1,10" << "2,4-2,19");
+    QCOMPARE(hotSpotTexts(filter), QStringList() << "http://kde.org/"
+             << "http://kde.org/artifacts/1");
+}
+
+void FilterTest::testUrlActions()
+{
+    TerminalImageFilterChain chain;
+    UrlFilter* filter = new UrlFilter();
+    chain.addFilter(filter);
+
+    setLines(chain, QStringList() << "see www.kde.org");
+    QCOMPARE(filter->hotSpots().count(), 1);
+    const QList<QAction*> actions = filter->hotSpots().first()->actions();
+    QCOMPARE(actions.count(), 2);
+
+    // the actions keep working after the hotspot is deleted, which happens
+    // when the output changes while they are shown in a menu
+    setLines(chain, QStringList() << "no links here");
+    QCOMPARE(filter->hotSpots().count(), 0);
+    QCOMPARE(actions[1]->objectName(), QString("copy-action"));
+    actions[1]->trigger();
+    QCOMPARE(QApplication::clipboard()->text(), QString("www.kde.org"));
+
+    qDeleteAll(actions);
+}
+
+QTEST_KDEMAIN(FilterTest , GUI)
+
+#include "FilterTest.moc"
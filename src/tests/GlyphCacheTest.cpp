@@ -0,0 +1,139 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "GlyphCacheTest.h"
+
+// Qt
+#include <QtGui/QFontMetrics>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+
+// KDE
+#include <qtest_kde.h>
+#include <KGlobalSettings>
+
+using namespace Konsole;
+
+// sets up 'cache' to draw glyphs in cells of the size of the characters
+// of the font used for terminals
+static QSize setupCache(GlyphCache& cache)
+{
+    const QFont font = KGlobalSettings::fixedFont();
+    const QFontMetrics metrics(font);
+    const QSize cellSize(metrics.width('M'), metrics.height());
+
+    cache.setFont(font, cellSize.width(), cellSize.height());
+    return cellSize;
+}
+
+// returns true if any pixel in 'rect' of 'image' has been drawn on
+static bool isDrawn(const QImage& image, const QRect& rect)
+{
+    for (int y = rect.top(); y <= rect.bottom(); y++) {
+        for (int x = rect.left(); x <= rect.right(); x++) {
+            if (qAlpha(image.pixel(x, y)) != 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+void GlyphCacheTest::testCanCache()
+{
+    QVERIFY(GlyphCache::canCache(QChar('a')));
+    QVERIFY(GlyphCache::canCache(QChar(' ')));
+    QVERIFY(GlyphCache::canCache(QChar('~')));
+    QVERIFY(GlyphCache::canCache(QChar(0x00E9)));   // e with acute accent
+    QVERIFY(GlyphCache::canCache(QChar(0x0416)));   // Cyrillic Zhe
+    QVERIFY(GlyphCache::canCache(QChar(0x2192)));   // rightwards arrow
+
+    QVERIFY(!GlyphCache::canCache(QChar(0x0007)));  // control character
+    QVERIFY(!GlyphCache::canCache(QChar(0x0301)));  // combining acute accent
+    QVERIFY(!GlyphCache::canCache(QChar(0x05D0)));  // Hebrew Alef
+    QVERIFY(!GlyphCache::canCache(QChar(0x0627)));  // Arabic Alef
+    QVERIFY(!GlyphCache::canCache(QChar(0x0915)));  // Devanagari Ka
+    QVERIFY(!GlyphCache::canCache(QChar(0x202E)));  // right-to-left override
+    QVERIFY(!GlyphCache::canCache(QChar(0x4E00)));  // wide CJK ideograph
+    QVERIFY(!GlyphCache::canCache(QChar(0xD83D)));  // high surrogate
+}
+
+void GlyphCacheTest::testDrawText()
+{
+    GlyphCache cache;
+    const QSize cellSize = setupCache(cache);
+    const int cellWidth = cellSize.width();
+    const int cellHeight = cellSize.height();
+
+    QImage image(8 * cellWidth, cellHeight, QImage::Format_ARGB32_Premultiplied);
+    image.fill(0);
+
+    QPainter painter(&image);
+    cache.drawText(painter, QPoint(cellWidth, 0), "hel lo", 0, Qt::black);
+
+    // each different glyph is drawn once, and spaces are not drawn at all
+    QCOMPARE(cache.glyphCount(), 4);
+    QVERIFY(isDrawn(image, QRect(cellWidth, 0, cellWidth, cellHeight)));
+    QVERIFY(!isDrawn(image, QRect(4 * cellWidth + 2, 0, cellWidth - 4, cellHeight)));
+    QVERIFY(isDrawn(image, QRect(6 * cellWidth, 0, cellWidth, cellHeight)));
+
+    // the same characters are drawn again from the cache
+    cache.drawText(painter, QPoint(0, 0), "hello", 0, Qt::black);
+    QCOMPARE(cache.glyphCount(), 4);
+
+    // but other colors and font styles are separate glyphs
+    cache.drawText(painter, QPoint(0, 0), "h", 0, Qt::red);
+    cache.drawText(painter, QPoint(0, 0), "h", GlyphCache::Bold, Qt::black);
+    cache.drawText(painter, QPoint(0, 0), " ", GlyphCache::Underline, Qt::black);
+    QCOMPARE(cache.glyphCount(), 7);
+
+    setupCache(cache);
+    QCOMPARE(cache.glyphCount(), 0);
+}
+
+void GlyphCacheTest::testFullCache()
+{
+    GlyphCache cache;
+    const QSize cellSize = setupCache(cache);
+    const int cellWidth = cellSize.width();
+    const int cellHeight = cellSize.height();
+
+    QImage image(10 * cellWidth, cellHeight, QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&image);
+
+    // the cache is cleared once it is full, while drawing text which
+    // has glyphs from before and after it is cleared
+    const QString text = "abcdefghij";
+    int glyphCount = 0;
+    for (int color = 0; glyphCount <= cache.glyphCount(); color++) {
+        glyphCount = cache.glyphCount();
+        image.fill(0);
+        cache.drawText(painter, QPoint(0, 0), text, 0, QColor(color, 0, 0));
+
+        for (int i = 0; i < text.length(); i++)
+            QVERIFY(isDrawn(image, QRect(i * cellWidth, 0, cellWidth, cellHeight)));
+    }
+    QVERIFY(glyphCount > 1000);
+    QVERIFY(cache.glyphCount() < text.length());
+}
+
+QTEST_KDEMAIN(GlyphCacheTest , GUI)
+
+#include "GlyphCacheTest.moc"
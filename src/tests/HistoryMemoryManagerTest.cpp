@@ -0,0 +1,103 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "HistoryMemoryManagerTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Emulation.h"
+#include "../History.h"
+#include "../Session.h"
+
+using namespace Konsole;
+
+// gives 'session' a history of 1000 lines in memory and fills half of it
+static void fillHistory(Session* session)
+{
+    session->setHistoryType(CompactHistoryType(1000));
+
+    QByteArray data;
+    for (int line = 0; line < 500; line++) {
+        data += QString("line %1 ").arg(line).toLatin1() + QByteArray(60, 'x') + "\r\n";
+    }
+    session->emulation()->receiveData(data.constData(), data.size());
+}
+
+static bool isInMemory(Session* session)
+{
+    return dynamic_cast<const CompactHistoryType*>(&session->historyType()) != 0;
+}
+
+void HistoryMemoryManagerTest::testEnforceBudget()
+{
+    Session first;
+    Session second;
+    Session third;
+    fillHistory(&first);
+    fillHistory(&second);
+    fillHistory(&third);
+    const qint64 secondUsage = second.historyMemoryUsage();
+    QVERIFY(secondUsage > 0);
+
+    HistoryMemoryManager manager;
+    manager.addSession(&first);
+    manager.addSession(&second);
+    manager.addSession(&third);
+    QCOMPARE(manager.memoryUsage(), first.historyMemoryUsage() + secondUsage + third.historyMemoryUsage());
+
+    // the second session is now the one which was viewed least recently, so
+    // its history is the first to be moved to disk
+    manager.sessionViewed(&first);
+    manager.setMemoryBudget(manager.memoryUsage() - 1);
+    QVERIFY(isInMemory(&first));
+    QVERIFY(!isInMemory(&second));
+    QVERIFY(isInMemory(&third));
+    QCOMPARE(second.historyType().maximumLineCount(), 1000);
+    QVERIFY(manager.memoryUsage() <= manager.memoryBudget());
+
+    // there is room for the history again, but it is only moved back once
+    // the usage stays below three quarters of the budget
+    manager.setMemoryBudget(manager.memoryUsage() + secondUsage + 1);
+    QVERIFY(!isInMemory(&second));
+
+    manager.setMemoryBudget((manager.memoryUsage() + secondUsage) / 3 * 4 + 4096);
+    QVERIFY(isInMemory(&second));
+    QCOMPARE(second.historyType().maximumLineCount(), 1000);
+
+    // a history which has been changed since it was moved, as happens when
+    // the profile is edited, is left as it is
+    manager.sessionViewed(&third);
+    manager.sessionViewed(&first);
+    manager.setMemoryBudget(manager.memoryUsage() - 1);
+    QVERIFY(!isInMemory(&second));
+    QVERIFY(isInMemory(&first));
+
+    second.setHistoryType(CompressedHistoryType(200));
+    manager.setMemoryBudget(0);
+    QVERIFY(!isInMemory(&second));
+    QCOMPARE(second.historyType().maximumLineCount(), 200);
+}
+
+QTEST_KDEMAIN_CORE(HistoryMemoryManagerTest)
+
+#include "HistoryMemoryManagerTest.moc"
@@ -0,0 +1,433 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "HistoryTest.h"
+
+// Qt
+#include <QtCore/QFile>
+
+// KDE
+#include <qtest_kde.h>
+#include <KTempDir>
+
+// Konsole
+#include "../History.h"
+#include "../HistoryIndex.h"
+
+using namespace Konsole;
+
+static void addLine(HistoryScroll* history, const QString& text)
+{
+    TextLine line;
+    for (int i = 0; i < text.length(); i++)
+        line << Character(text[i].unicode());
+
+    history->addCellsVector(line);
+    history->addLine(false);
+}
+
+static QString lineText(HistoryScroll* history, int lineNumber)
+{
+    TextLine line(history->getLineLen(lineNumber));
+    history->getCells(lineNumber, 0, line.size(), line.data());
+
+    QString text;
+    for (int i = 0; i < line.size(); i++)
+        text.append(QChar(line[i].character));
+    return text;
+}
+
+void HistoryTest::testCompactHistoryEviction()
+{
+    CompactHistoryScroll history(10);
+
+    // once full, the oldest lines are dropped as new lines are added
+    for (int i = 0; i < 100; i++)
+        addLine(&history, QString::number(i));
+
+    QCOMPARE(history.getLines(), 11);
+    QCOMPARE(lineText(&history, 0), QString("89"));
+    QCOMPARE(lineText(&history, 10), QString("99"));
+
+    history.setMaxNbLines(5);
+    QCOMPARE(history.getLines(), 5);
+    QCOMPARE(lineText(&history, 0), QString("95"));
+
+    // lines keep their order when the history is allowed to grow again
+    history.setMaxNbLines(1000);
+    for (int i = 100; i < 300; i++)
+        addLine(&history, QString::number(i));
+
+    QCOMPARE(history.getLines(), 205);
+    for (int i = 0; i < history.getLines(); i++)
+        QCOMPARE(lineText(&history, i), QString::number(95 + i));
+
+    addLine(&history, QString());
+    QCOMPARE(history.getLineLen(history.getLines() - 1), 0);
+}
+
+// returns a line in which the foreground color changes every 'runLength' characters
+static TextLine coloredLine(int length, int runLength)
+{
+    TextLine line(length);
+    for (int i = 0; i < length; i++) {
+        line[i] = Character('a' + (i % 26),
+                            CharacterColor(COLOR_SPACE_SYSTEM, (i / runLength) % 8),
+                            CharacterColor(COLOR_SPACE_DEFAULT, DEFAULT_BACK_COLOR));
+    }
+    return line;
+}
+
+void HistoryTest::testCompactHistoryFormats()
+{
+    CompactHistoryScroll history(10);
+    const TextLine line = coloredLine(80, 3);
+    history.addCellsVector(line);
+    history.addLine(false);
+
+    // reading any part of the line gives the original characters and formats
+    for (int start = 0; start < 80; start += 7) {
+        for (int count = 0; start + count <= 80; count += 5) {
+            TextLine result(count);
+            history.getCells(0, start, count, result.data());
+            for (int i = 0; i < count; i++)
+                QVERIFY(result[i] == line[start + i]);
+        }
+    }
+}
+
+void HistoryTest::testCompactHistoryReadThroughput()
+{
+    const int lineCount = 10000;
+    const int columns = 200;
+
+    CompactHistoryScroll history(lineCount);
+    const TextLine line = coloredLine(columns, 4);
+    for (int i = 0; i < lineCount; i++) {
+        history.addCellsVector(line);
+        history.addLine(false);
+    }
+
+    // read back the whole history, as searching or saving it does
+    TextLine result(columns);
+    QBENCHMARK {
+        for (int i = 0; i < history.getLines(); i++)
+            history.getCells(i, 0, history.getLineLen(i), result.data());
+    }
+
+    QVERIFY(result == line);
+}
+
+void HistoryTest::testFileHistory()
+{
+    HistoryScrollFile history(QString());
+
+    // enough lines that most of them have been written out to the file,
+    // while the most recent ones are only held in memory
+    const int lineCount = 5000;
+    for (int i = 0; i < lineCount; i++)
+        addLine(&history, QString("line %1").arg(i));
+
+    QCOMPARE(history.getLines(), lineCount);
+    for (int i = 0; i < lineCount; i += 7)
+        QCOMPARE(lineText(&history, i), QString("line %1").arg(i));
+
+    // reading many lines maps the file, which must still see lines
+    // added afterwards
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < lineCount; i++)
+            QCOMPARE(lineText(&history, i), QString("line %1").arg(i));
+    }
+    for (int i = lineCount; i < 2 * lineCount; i++)
+        addLine(&history, QString("line %1").arg(i));
+    for (int i = 0; i < 2 * lineCount; i += 3)
+        QCOMPARE(lineText(&history, i), QString("line %1").arg(i));
+}
+
+// returns a line with colored runs, trailing spaces and, for some lines,
+// a wide character
+static TextLine mixedLine(int i)
+{
+    TextLine line = coloredLine(i % 3 == 0 ? 80 : 60, 1 + i % 7);
+    for (int column = 40 + i % 20; column < line.size(); column++)
+        line[column] = Character(' ');
+    if (i % 5 == 0) {
+        line[1] = Character(0x1F600);
+        line[2] = Character(0);
+        line[2].isRealCharacter = false;
+    }
+    return line;
+}
+
+void HistoryTest::testCompressedHistory()
+{
+    CompressedHistoryScroll history;
+
+    // enough lines to fill many blocks
+    const int lineCount = 1000;
+    for (int i = 0; i < lineCount; i++) {
+        history.addCellsVector(mixedLine(i));
+        history.addLine(i % 4 == 0);
+    }
+    addLine(&history, QString());
+
+    QCOMPARE(history.getLines(), lineCount + 1);
+    QCOMPARE(history.getLineLen(lineCount), 0);
+
+    // read the lines back in an order which does not follow the blocks
+    for (int step = 0; step < lineCount; step++) {
+        const int i = (step * 379) % lineCount;
+        const TextLine expected = mixedLine(i);
+
+        QCOMPARE(history.getLineLen(i), expected.size());
+        QCOMPARE(history.isWrappedLine(i), i % 4 == 0);
+
+        TextLine result(expected.size());
+        history.getCells(i, 0, result.size(), result.data());
+        for (int column = 0; column < result.size(); column++) {
+            QVERIFY(result[column] == expected[column]);
+            QCOMPARE(bool(result[column].isRealCharacter), bool(expected[column].isRealCharacter));
+        }
+    }
+
+    // the encoded lines are much smaller than the characters they hold
+    QVERIFY(history.compressedSize() > 0);
+    QVERIFY(history.compressedSize() * 2 < lineCount * 60 * int(sizeof(Character)));
+}
+
+void HistoryTest::testCompressedHistoryLimit()
+{
+    CompressedHistoryScroll history(100);
+
+    // enough output that the file is compacted several times
+    const int lineCount = 200000;
+    for (int i = 0; i < lineCount; i++)
+        addLine(&history, QString("line %1").arg(i));
+
+    QCOMPARE(history.getLines(), 100);
+    for (int i = 0; i < history.getLines(); i++)
+        QCOMPARE(lineText(&history, i), QString("line %1").arg(lineCount - 100 + i));
+    QVERIFY(history.compressedSize() < 2 * 1024 * 1024);
+
+    // the same lines remain after changing the limit through the history type
+    HistoryScroll* scroll = CompressedHistoryType(10).scroll(&history);
+    QCOMPARE(scroll, static_cast<HistoryScroll*>(&history));
+    QCOMPARE(history.getType().maximumLineCount(), 10);
+    QCOMPARE(history.getLines(), 10);
+    QCOMPARE(lineText(&history, 9), QString("line %1").arg(lineCount - 1));
+}
+
+void HistoryTest::testMemoryUsage()
+{
+    HistoryScroll* history = new CompactHistoryScroll(10000);
+    for (int i = 0; i < 10000; i++)
+        addLine(history, QString(80, QChar('x')));
+
+    const qint64 memoryUsage = history->memoryUsage();
+    QVERIFY(memoryUsage > 10000 * 80);
+
+    // moving the lines to a compressed history keeps them, using far less memory
+    history = CompressedHistoryType(10000).scroll(history);
+    QVERIFY(dynamic_cast<CompressedHistoryScroll*>(history));
+    QCOMPARE(history->getLines(), 10000);
+    QCOMPARE(lineText(history, 9999), QString(80, QChar('x')));
+    QVERIFY(history->memoryUsage() * 2 < memoryUsage);
+
+    // and moving them back into memory keeps them too
+    history = CompactHistoryType(10000).scroll(history);
+    QVERIFY(dynamic_cast<CompactHistoryScroll*>(history));
+    QCOMPARE(history->getLines(), 10000);
+
+    delete history;
+}
+
+static void compareMixedLine(HistoryScroll* history, int lineNumber, int i)
+{
+    const TextLine expected = mixedLine(i);
+
+    QCOMPARE(history->getLineLen(lineNumber), expected.size());
+    QCOMPARE(history->isWrappedLine(lineNumber), i % 4 == 0);
+
+    TextLine result(expected.size());
+    history->getCells(lineNumber, 0, result.size(), result.data());
+    for (int column = 0; column < result.size(); column++) {
+        QVERIFY(result[column] == expected[column]);
+        QCOMPARE(bool(result[column].isRealCharacter), bool(expected[column].isRealCharacter));
+    }
+}
+
+void HistoryTest::testPersistentHistory()
+{
+    KTempDir directory;
+    const QString fileName = directory.name() + "history";
+
+    // the files are only created once there is something to keep
+    PersistentHistoryScroll* history = new PersistentHistoryScroll(fileName, -1);
+    QCOMPARE(history->getLines(), 0);
+    QVERIFY(!QFile::exists(fileName + ".lines"));
+
+    const int lineCount = 1000;
+    for (int i = 0; i < lineCount; i++) {
+        history->addCellsVector(mixedLine(i));
+        history->addLine(i % 4 == 0);
+    }
+    delete history;
+
+    // only the owner can read the files
+    const QFile::Permissions others = QFile::ReadGroup | QFile::WriteGroup |
+                                      QFile::ReadOther | QFile::WriteOther;
+    QVERIFY(!(QFile::permissions(fileName + ".lines") & others));
+    QVERIFY(!(QFile::permissions(fileName + ".index") & others));
+
+    // the lines are read back from the files
+    history = new PersistentHistoryScroll(fileName, -1);
+    QCOMPARE(history->getLines(), lineCount);
+    for (int i = 0; i < lineCount; i++)
+        compareMixedLine(history, i, i);
+    delete history;
+
+    // a line which was only partly written is dropped
+    QFile::resize(fileName + ".lines", QFile(fileName + ".lines").size() - 1);
+    history = new PersistentHistoryScroll(fileName, 100);
+    QCOMPARE(history->getLines(), 100);
+    compareMixedLine(history, 99, lineCount - 2);
+
+    // enough output that the files are compacted several times
+    const int extraLineCount = 200000;
+    for (int i = 0; i < extraLineCount; i++)
+        addLine(history, QString("line %1").arg(i));
+    QCOMPARE(history->getLines(), 100);
+    QVERIFY(QFile(fileName + ".lines").size() < 2 * 1024 * 1024);
+    delete history;
+
+    history = new PersistentHistoryScroll(fileName, 100);
+    QCOMPARE(history->getLines(), 100);
+    for (int i = 0; i < history->getLines(); i++)
+        QCOMPARE(lineText(history, i), QString("line %1").arg(extraLineCount - 100 + i));
+
+    // lines which are still in use are copied a part at a time while further
+    // lines are added
+    const int keptLineCount = 20000;
+    history->setMaxNbLines(keptLineCount);
+    for (int i = 0; i < extraLineCount; i++)
+        addLine(history, QString("longer line %1").arg(i).leftJustified(60, '.'));
+    QCOMPARE(history->getLines(), keptLineCount);
+    for (int i = 0; i < history->getLines(); i += 97) {
+        QCOMPARE(lineText(history, i), QString("longer line %1")
+                 .arg(extraLineCount - keptLineCount + i).leftJustified(60, '.'));
+    }
+    delete history;
+
+    PersistentHistoryScroll::removeFiles(fileName);
+    QVERIFY(!QFile::exists(fileName + ".lines"));
+    QVERIFY(!QFile::exists(fileName + ".index"));
+}
+
+void HistoryTest::testRemoveUnusedHistoryFiles()
+{
+    KTempDir directory;
+    const QString usedName = directory.name() + "used";
+    const QString openName = directory.name() + "open";
+    const QString unusedName = directory.name() + "unused";
+
+    PersistentHistoryScroll* history = new PersistentHistoryScroll(usedName, 100);
+    addLine(history, "used");
+    delete history;
+    history = new PersistentHistoryScroll(unusedName, 100);
+    addLine(history, "unused");
+    delete history;
+    QVERIFY(QFile::exists(unusedName + ".index"));
+
+    // the files of a history which is open are kept, even if they are not named
+    history = new PersistentHistoryScroll(openName, 100);
+    addLine(history, "open");
+    history->flush();
+
+    PersistentHistoryScroll::removeUnusedFiles(directory.name(), QStringList() << usedName);
+    QVERIFY(QFile::exists(usedName + ".index"));
+    QVERIFY(QFile::exists(usedName + ".lines"));
+    QVERIFY(QFile::exists(openName + ".index"));
+    QVERIFY(QFile::exists(openName + ".lines"));
+    QVERIFY(!QFile::exists(unusedName + ".index"));
+    QVERIFY(!QFile::exists(unusedName + ".lines"));
+
+    delete history;
+}
+
+static void addIndexedLine(HistoryIndex* index, const QString& text, bool wrapped, int lines)
+{
+    TextLine line;
+    for (int i = 0; i < text.length(); i++)
+        line << Character(text[i].unicode());
+
+    index->addLine(line.constData(), line.size(), wrapped, lines);
+}
+
+void HistoryTest::testHistoryIndex()
+{
+    const int bucket = HistoryIndex::LINES_PER_BUCKET;
+
+    // lines which were in the history before the index was created are not indexed
+    HistoryIndex index(10);
+    QVERIFY(index.mayContain("anything", 0, 9));
+    QVERIFY(index.mayContain("anything", 9, 9));
+
+    for (int i = 0; i < 10 * bucket; i++)
+        addIndexedLine(&index, QString("line %1").arg(i), false, 11 + i);
+    const int lines = 10 + 10 * bucket;
+
+    QVERIFY(index.mayContain("line", 10, lines - 1));
+    QVERIFY(index.mayContain("LINE 5", 10, lines - 1));
+    QVERIFY(!index.mayContain("missing", 10, lines - 1));
+    // text which is too short to have trigrams may be anywhere
+    QVERIFY(index.mayContain("xy", 10, lines - 1));
+
+    // the text is only found in the buckets around the line which contains it
+    const int line = 10 + 5 * bucket + 3;
+    const QString text = QString("line %1").arg(line - 10);
+    QVERIFY(index.mayContain(text, line, line));
+    QVERIFY(!index.mayContain(text, 10, 10 + 4 * bucket));
+    QVERIFY(!index.mayContain(text, 10 + 7 * bucket, lines - 1));
+
+    // text which continues on the next line of a wrapped line
+    addIndexedLine(&index, "first half", true, lines + 1);
+    addIndexedLine(&index, "second half", false, lines + 2);
+    QVERIFY(index.mayContain("halfsecond", lines, lines + 1));
+
+    // lines are numbered from the start of the history, which moves on
+    // as lines are dropped, and the dropped lines are eventually forgotten
+    const qint64 memoryUsage = index.memoryUsage();
+    for (int i = 0; i < 20 * bucket; i++)
+        addIndexedLine(&index, QString("other %1").arg(i), false, 4 * bucket);
+
+    QVERIFY(!index.mayContain("line", 0, 4 * bucket - 1));
+    QVERIFY(!index.mayContain("half", 0, 4 * bucket - 1));
+    QVERIFY(index.mayContain("other 1279", 4 * bucket - 1, 4 * bucket - 1));
+    QVERIFY(index.memoryUsage() > 0);
+    QVERIFY(index.memoryUsage() < 2 * memoryUsage);
+
+    index.setLineCount(0);
+    QVERIFY(!index.mayContain("other", 0, 0));
+}
+
+QTEST_KDEMAIN_CORE(HistoryTest)
+
+#include "HistoryTest.moc"
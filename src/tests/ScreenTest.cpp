@@ -0,0 +1,296 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "ScreenTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Screen.h"
+#include "../History.h"
+
+using namespace Konsole;
+
+static const int ScreenLines = 5;
+static const int ScreenColumns = 10;
+
+static bool isDamaged(const Screen& screen, int line, int startColumn, int endColumn)
+{
+    const LineDamage damage = screen.lineDamage(line);
+    return damage.startColumn == startColumn && damage.endColumn == endColumn;
+}
+
+static bool isAllDamaged(const Screen& screen)
+{
+    for (int line = 0; line < screen.getLines(); line++) {
+        if (!isDamaged(screen, line, 0, screen.getColumns() - 1))
+            return false;
+    }
+    return true;
+}
+
+void ScreenTest::testDamageTracking()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    QVERIFY(isAllDamaged(screen));
+
+    // only the cursor position is reported once the damage is reset
+    screen.resetDamage();
+    QVERIFY(isDamaged(screen, 0, 0, 0));
+    for (int line = 1; line < ScreenLines; line++)
+        QVERIFY(screen.lineDamage(line).isEmpty());
+
+    // characters written to the screen, the old and the new cursor position
+    screen.setCursorYX(3, 4);
+    screen.displayCharacter('a');
+    screen.displayCharacter('b');
+    QVERIFY(isDamaged(screen, 0, 0, 0));
+    QVERIFY(screen.lineDamage(1).isEmpty());
+    QVERIFY(isDamaged(screen, 2, 3, 5));
+    QVERIFY(screen.lineDamage(3).isEmpty());
+
+    screen.resetDamage();
+    screen.clearToEndOfLine();
+    QVERIFY(isDamaged(screen, 2, 5, ScreenColumns - 1));
+    QVERIFY(screen.lineDamage(0).isEmpty());
+
+    // scrolling moves every line
+    screen.resetDamage();
+    screen.scrollUp(1);
+    QVERIFY(isAllDamaged(screen));
+
+    // so does a change of the selection
+    screen.resetDamage();
+    screen.setSelectionStart(0, 1, false);
+    QVERIFY(isAllDamaged(screen));
+    screen.resetDamage();
+    screen.clearSelection();
+    QVERIFY(isAllDamaged(screen));
+
+    // and inverting the screen
+    screen.resetDamage();
+    screen.setMode(MODE_Screen);
+    QVERIFY(isAllDamaged(screen));
+
+    screen.resetDamage();
+    screen.resizeImage(ScreenLines + 2, ScreenColumns);
+    QVERIFY(isAllDamaged(screen));
+}
+
+void ScreenTest::testGetImage()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    screen.setCursorYX(3, 4);
+    screen.displayCharacter('a');
+    screen.displayCharacter('b');
+
+    // fetching some of the lines marks the cursor relative to the first of them
+    QVector<Character> image(2 * ScreenColumns);
+    screen.getImage(image.data(), image.size(), 2, 3);
+    QCOMPARE(image[3].character, quint32('a'));
+    QCOMPARE(image[4].character, quint32('b'));
+    QCOMPARE(image[5].rendition() & RE_CURSOR, RE_CURSOR);
+    for (int i = ScreenColumns; i < image.size(); i++)
+        QVERIFY(image[i] == Screen::DefaultChar);
+
+    screen.getImage(image.data(), image.size(), 3, 4);
+    for (int i = 0; i < image.size(); i++)
+        QCOMPARE(image[i].rendition() & RE_CURSOR, 0);
+}
+
+static QString lineText(const Screen& screen, int line)
+{
+    QVector<Character> image(screen.getColumns());
+    screen.getImage(image.data(), image.size(), line, line);
+
+    QString text;
+    for (int i = 0; i < image.size(); i++)
+        text.append(QChar(image[i].character));
+    return text.trimmed();
+}
+
+void ScreenTest::testReflow()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    screen.setReflowLines(true);
+    screen.setScroll(CompactHistoryType(1000));
+
+    // lines of output two and a half times as wide as the screen
+    const int outputLines = 6;
+    for (int line = 0; line < outputLines; line++) {
+        for (int i = 0; i < 25; i++)
+            screen.displayCharacter('a' + line);
+        screen.nextLine();
+    }
+    QCOMPARE(screen.getHistLines(), 14);
+
+    // only the last lines of the history are rewrapped straight away
+    screen.resizeImage(ScreenLines, 25);
+    QCOMPARE(screen.getHistLines(), 11);
+    QCOMPARE(lineText(screen, 9), QString(25, QChar('d')));
+    QCOMPARE(lineText(screen, 10), QString(20, QChar('e')));
+    QCOMPARE(lineText(screen, 11), QString(5, QChar('e')));
+    QCOMPARE(lineText(screen, 12), QString(25, QChar('f')));
+    QCOMPARE(screen.getCursorY(), 2);
+    QCOMPARE(screen.getCursorX(), 0);
+
+    screen.setSelectionStart(0, 6, false);
+    screen.setSelectionEnd(4, 6);
+    QCOMPARE(screen.selectedText(false), QString(5, QChar('c')));
+
+    // the rest as they are scrolled into view, which moves them
+    QCOMPARE(screen.reflowHistory(9), 9);
+    int column = 3;
+    QCOMPARE(screen.reflowHistory(8, &column), 2);
+    QCOMPARE(column, 23);
+    QCOMPARE(screen.getHistLines(), 5);
+
+    // along with the selection
+    QCOMPARE(screen.selectedText(false), QString(5, QChar('c')));
+
+    // the lines before 'd' were rewrapped, which moved the lines after them
+    const Screen::HistoryReflow reflow = screen.lastHistoryReflow();
+    QCOMPARE(reflow.generation, screen.historyGeneration());
+    QCOMPARE(reflow.firstLine, 0);
+    QCOMPARE(reflow.endLine, 9);
+    QCOMPARE(reflow.lineDelta, -6);
+    QCOMPARE(screen.rewrappedHistoryLine(4), 1);
+    for (int line = 0; line < 4; line++)
+        QCOMPARE(lineText(screen, line), QString(25, QChar('a' + line)));
+    QVERIFY(screen.getLineProperties(4, 4)[0] & LINE_WRAPPED);
+
+    // making the screen narrower again splits the lines up as before
+    screen.resizeImage(ScreenLines, ScreenColumns);
+    QCOMPARE(screen.getHistLines(), 14);
+    QCOMPARE(lineText(screen, 0), QString(10, QChar('a')));
+    QCOMPARE(lineText(screen, 2), QString(5, QChar('a')));
+    QCOMPARE(lineText(screen, 13), QString(10, QChar('e')));
+    QCOMPARE(lineText(screen, 14), QString(5, QChar('e')));
+    QCOMPARE(lineText(screen, 15), QString(10, QChar('f')));
+    QCOMPARE(screen.getCursorY(), 4);
+}
+
+void ScreenTest::testReflowWideCharacters()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    screen.setReflowLines(true);
+
+    // the last double width character does not fit on the first line
+    screen.displayCharacter('a');
+    screen.displayCharacter('b');
+    screen.displayCharacter('c');
+    for (uint c = 0x4E00; c < 0x4E04; c++)
+        screen.displayCharacter(c);
+    QVERIFY(screen.getLineProperties(0, 0)[0] & LINE_WRAPPED);
+
+    // a double width character is never split between two lines
+    const int columns = 6;
+    screen.resizeImage(ScreenLines, columns);
+    QVector<Character> image(2 * columns);
+    screen.getImage(image.data(), image.size(), 0, 1);
+    QCOMPARE(image[2].character, quint32('c'));
+    QCOMPARE(image[3].character, quint32(0x4E00));
+    QVERIFY(image[5] == Screen::DefaultChar);
+    QCOMPARE(image[columns].character, quint32(0x4E01));
+    QCOMPARE(image[columns + 2].character, quint32(0x4E02));
+    QCOMPARE(image[columns + 4].character, quint32(0x4E03));
+    QVERIFY(screen.getLineProperties(0, 0)[0] & LINE_WRAPPED);
+    QCOMPARE(screen.getCursorY(), 1);
+}
+
+void ScreenTest::testReflowHistoryWideCharacters()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    screen.setReflowLines(true);
+    screen.setScroll(CompactHistoryType(1000));
+
+    // lines of output which are wrapped before their last double width character
+    const int outputLines = 10;
+    for (int line = 0; line < outputLines; line++) {
+        screen.displayCharacter('a');
+        screen.displayCharacter('b');
+        screen.displayCharacter('c');
+        for (uint c = 0x4E00; c < 0x4E04; c++)
+            screen.displayCharacter(c);
+        screen.nextLine();
+    }
+    QCOMPARE(screen.getHistLines(), 16);
+
+    // the last lines of the history are rewrapped straight away, and a double
+    // width character is never split between two lines
+    int columns = 6;
+    screen.resizeImage(ScreenLines, columns);
+    QCOMPARE(screen.getHistLines(), 16);
+    QVector<Character> image(2 * columns);
+    screen.getImage(image.data(), image.size(), 10, 11);
+    QCOMPARE(image[2].character, quint32('c'));
+    QCOMPARE(image[3].character, quint32(0x4E00));
+    QVERIFY(image[5] == Screen::DefaultChar);
+    QCOMPARE(image[columns].character, quint32(0x4E01));
+    QCOMPARE(image[columns + 4].character, quint32(0x4E03));
+    QVERIFY(screen.getLineProperties(10, 10)[0] & LINE_WRAPPED);
+
+    // as are the other lines once they are scrolled into view
+    QCOMPARE(screen.reflowHistory(0), 0);
+    screen.getImage(image.data(), image.size(), 0, 1);
+    QCOMPARE(image[3].character, quint32(0x4E00));
+    QVERIFY(image[5] == Screen::DefaultChar);
+    QCOMPARE(image[columns].character, quint32(0x4E01));
+
+    // and the history is rewrapped as it was written at the original width
+    columns = ScreenColumns;
+    screen.resizeImage(ScreenLines, columns);
+    QCOMPARE(screen.getHistLines(), 16);
+    image.resize(2 * columns);
+    screen.getImage(image.data(), image.size(), 0, 1);
+    QCOMPARE(image[7].character, quint32(0x4E02));
+    QVERIFY(image[9] == Screen::DefaultChar);
+    QCOMPARE(image[columns].character, quint32(0x4E03));
+}
+
+void ScreenTest::testSetScrollKeepsSelection()
+{
+    Screen screen(ScreenLines, ScreenColumns);
+    screen.setScroll(CompactHistoryType(100));
+    for (int line = 0; line < 10; line++) {
+        screen.displayCharacter('a' + line);
+        screen.nextLine();
+    }
+    QCOMPARE(screen.getHistLines(), 6);
+
+    screen.setSelectionStart(0, 1, false);
+    screen.setSelectionEnd(0, 3);
+    const QString selectedText = screen.selectedText(true);
+    QVERIFY(!selectedText.isEmpty());
+
+    // moving the history to a different kind of storage keeps all of the lines
+    screen.setScroll(CompressedHistoryType(100));
+    QCOMPARE(screen.selectedText(true), selectedText);
+
+    // but the selected lines may no longer be there when some are dropped
+    screen.setScroll(CompactHistoryType(2));
+    QVERIFY(screen.selectedText(true).isEmpty());
+}
+
+QTEST_KDEMAIN_CORE(ScreenTest)
+
+#include "ScreenTest.moc"
@@ -0,0 +1,129 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "SearchHistoryThreadTest.h"
+
+// Qt
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+using namespace Konsole;
+
+// lays out 'lines' as the decoded output would be, with each line
+// ending in a new-line
+static QString decodedText(const QStringList& lines, QList<int>& linePositions)
+{
+    QString text;
+    foreach(const QString& line, lines) {
+        linePositions << text.length();
+        text += line + '\n';
+    }
+    return text;
+}
+
+void SearchHistoryThreadTest::testFindAll()
+{
+    QList<int> linePositions;
+    const QString text = decodedText(QStringList() << "foo bar foo" << "" << "barfoo", linePositions);
+
+    const QVector<SearchMatch> matches = SearchHistoryThread::findAll(QRegExp("foo"), text,
+                                         linePositions, 10);
+    QCOMPARE(matches.count(), 3);
+    QCOMPARE(matches[0].line, 10);
+    QCOMPARE(matches[0].column, 0);
+    QCOMPARE(matches[0].length, 3);
+    QCOMPARE(matches[1].line, 10);
+    QCOMPARE(matches[1].column, 8);
+    QCOMPARE(matches[2].line, 12);
+    QCOMPARE(matches[2].column, 3);
+
+    // empty matches are found once each and a match is not found in the
+    // new-line which ends the text
+    const QVector<SearchMatch> emptyMatches = SearchHistoryThread::findAll(QRegExp("^"), text,
+            linePositions, 0);
+    QCOMPARE(emptyMatches.count(), 1);
+
+    QVERIFY(SearchHistoryThread::findAll(QRegExp("baz"), text, linePositions, 0).isEmpty());
+    QVERIFY(SearchHistoryThread::findAll(QRegExp("foo"), QString("\n"), QList<int>(), 0).isEmpty());
+}
+
+void SearchHistoryThreadTest::testFindAllWideCharacters()
+{
+    // the positions of matches are given in columns, and the characters
+    // before and in this match take up two columns each
+    QList<int> linePositions;
+    const QString wide = QString(QChar(0x4E00)) + QChar(0x4E8C);
+    const QString text = decodedText(QStringList() << wide + "foo" + wide + "x", linePositions);
+
+    const QVector<SearchMatch> matches = SearchHistoryThread::findAll(QRegExp("foo" + wide), text,
+                                         linePositions, 0);
+    QCOMPARE(matches.count(), 1);
+    QCOMPARE(matches[0].column, 4);
+    QCOMPARE(matches[0].length, 7);
+}
+
+void SearchHistoryThreadTest::testSearchBlocks()
+{
+    SearchHistoryThread thread(QRegExp("foo"), true);
+    thread.setFindAll(true);
+    QSignalSpy spy(&thread, SIGNAL(blockSearched(int,int)));
+    thread.start();
+
+    QList<int> firstPositions;
+    thread.addBlock(0, decodedText(QStringList() << "bar" << "a foo", firstPositions), firstPositions, 0);
+    QList<int> secondPositions;
+    thread.addBlock(1, decodedText(QStringList() << "bar", secondPositions), secondPositions, 2);
+
+    for (int i = 0; i < 100 && spy.count() < 2; i++)
+        QTest::qWait(10);
+    QCOMPARE(spy.count(), 2);
+
+    QCOMPARE(spy[0][0].toInt(), 0);
+    QCOMPARE(spy[0][1].toInt(), 1);
+    QCOMPARE(spy[1][0].toInt(), 1);
+    QCOMPARE(spy[1][1].toInt(), -1);
+
+    const QVector<SearchMatch> matches = thread.takeMatches(0);
+    QCOMPARE(matches.count(), 1);
+    QCOMPARE(matches[0].line, 1);
+    QCOMPARE(matches[0].column, 2);
+    QVERIFY(thread.takeMatches(0).isEmpty());
+    QVERIFY(thread.takeMatches(1).isEmpty());
+
+    thread.cancel();
+    QVERIFY(thread.wait(1000));
+}
+
+void SearchHistoryThreadTest::testCancel()
+{
+    SearchHistoryThread thread(QRegExp("foo"), false);
+    thread.start();
+
+    // a thread which is waiting for blocks stops when cancelled
+    thread.cancel();
+    QVERIFY(thread.wait(1000));
+}
+
+QTEST_KDEMAIN_CORE(SearchHistoryThreadTest)
+
+#include "SearchHistoryThreadTest.moc"
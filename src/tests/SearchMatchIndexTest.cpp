@@ -0,0 +1,122 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "SearchMatchIndexTest.h"
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Emulation.h"
+#include "../History.h"
+#include "../ScreenWindow.h"
+#include "../Session.h"
+
+using namespace Konsole;
+
+// passes lines of output 30 columns wide to 'session', every third of which
+// has a match for "match" in column 8, and waits for them to be announced
+static void addOutput(Session* session, int firstLine, int count)
+{
+    QByteArray data;
+    for (int line = firstLine; line < firstLine + count; line++) {
+        data += QString("line %1 ").arg(line, 2, 10, QChar('0')).toLatin1();
+        data += (line % 3 == 0) ? "match" : "-----";
+        data += QByteArray(17, '.') + "\r\n";
+    }
+
+    session->emulation()->receiveData(data.constData(), data.size());
+    QVERIFY(QTest::kWaitForSignal(session->emulation(), SIGNAL(outputChanged()), 5000));
+}
+
+void SearchMatchIndexTest::testFollowOutput()
+{
+    Session session;
+    session.setHistoryType(CompactHistoryType(40));
+    session.emulation()->setImageSize(5, 20);
+    ScreenWindow* window = session.emulation()->createWindow();
+
+    SearchMatchIndex index(&session, window, QRegExp("match"));
+    QVERIFY(index.isComplete());
+    QCOMPARE(index.matchCount(), 0);
+
+    // each line of output takes up two lines of the screen
+    addOutput(&session, 0, 6);
+    QCOMPARE(index.matchCount(), 2);
+    SearchMatch match;
+    QVERIFY(index.findNext(0, 0, match));
+    QCOMPARE(match.line, 0);
+    QCOMPARE(match.column, 8);
+    QCOMPARE(match.length, 5);
+    QVERIFY(index.findNext(match.line, match.column, match));
+    QCOMPARE(match.line, 6);
+    QCOMPARE(index.matchIndex(match), 1);
+    // the search continues from the other end of the output
+    QVERIFY(index.findNext(match.line, match.column, match));
+    QCOMPARE(match.line, 0);
+    QVERIFY(index.findPrevious(0, 0, match));
+    QCOMPARE(match.line, 6);
+
+    // the history holds 40 lines, so the first four lines of output, with
+    // two matches, are dropped from it
+    addOutput(&session, 6, 20);
+    QCOMPARE(window->lineCount(), 45);
+    QCOMPARE(index.matchCount(), 7);
+    QVERIFY(index.findNext(0, 0, match));
+    QCOMPARE(match.line, 4);
+    QCOMPARE(index.matchIndex(match), 0);
+    QVERIFY(index.findPrevious(0, 0, match));
+    QCOMPARE(match.line, 40);
+    QCOMPARE(index.matchIndex(match), 6);
+
+    // after the screen is widened, only the last lines of the history are
+    // rewrapped, so that each line of output takes up a single line
+    session.emulation()->setImageSize(5, 40);
+    QVERIFY(QTest::kWaitForSignal(session.emulation(), SIGNAL(outputChanged()), 5000));
+    QCOMPARE(window->lineCount(), 42);
+    QCOMPARE(index.matchCount(), 7);
+    QVERIFY(index.findNext(0, 0, match));
+    QCOMPARE(match.line, 4);
+    QVERIFY(index.findPrevious(0, 0, match));
+    QCOMPARE(match.line, 37);
+
+    // and the rest once they are scrolled into view, which moves the matches
+    window->scrollTo(0);
+    QCOMPARE(window->lineCount(), 25);
+    QCOMPARE(index.matchCount(), 7);
+    QVERIFY(index.findNext(0, 0, match));
+    QCOMPARE(match.line, 2);
+    QCOMPARE(match.column, 8);
+    QVERIFY(index.findNext(match.line, match.column, match));
+    QCOMPARE(match.line, 5);
+    QCOMPARE(index.matchIndex(match), 1);
+    QVERIFY(index.findPrevious(0, 0, match));
+    QCOMPARE(match.line, 20);
+    QCOMPARE(index.matchIndex(match), 6);
+
+    // the line which the last rewrapped line was moved down to
+    QVERIFY(index.findPrevious(20, 0, match));
+    QCOMPARE(match.line, 17);
+}
+
+QTEST_KDEMAIN_CORE(SearchMatchIndexTest)
+
+#include "SearchMatchIndexTest.moc"
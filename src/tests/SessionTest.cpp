@@ -0,0 +1,114 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "SessionTest.h"
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTextStream>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Emulation.h"
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+QString SessionTest::screenText(Session* session)
+{
+    Emulation* emulation = session->emulation();
+    const int lineCount = emulation->lineCount();
+
+    QString result;
+    QTextStream stream(&result);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    emulation->writeToStream(&decoder, lineCount - emulation->imageSize().height(), lineCount - 1);
+    decoder.end();
+    return result;
+}
+
+void SessionTest::testDisableOutputTimeSlicing()
+{
+    Session session;
+    QVERIFY(session.outputTimeSlicingEnabled());
+
+    // far more output than can be processed in one time slice
+    QByteArray data;
+    const QByteArray line = QByteArray(78, 'x') + "\r\n";
+    while (data.size() < 16 * 1024 * 1024)
+        data += line;
+    data += "end of output";
+
+    QMetaObject::invokeMethod(&session, "onReceiveBlock",
+                              Q_ARG(const char*, data.constData()), Q_ARG(int, data.size()));
+
+    // the output which is still waiting is processed before the setting
+    // changes, without returning to the event loop
+    session.setOutputTimeSlicingEnabled(false);
+    QVERIFY(!session.outputTimeSlicingEnabled());
+    QVERIFY(screenText(&session).contains("end of output"));
+
+    // and output which arrives afterwards follows it
+    const QByteArray more("\r\nmore output");
+    QMetaObject::invokeMethod(&session, "onReceiveBlock",
+                              Q_ARG(const char*, more.constData()), Q_ARG(int, more.size()));
+    const QString text = screenText(&session);
+    QVERIFY(text.indexOf("end of output") < text.indexOf("more output"));
+}
+
+void SessionTest::testSharedOutputTimeSlice()
+{
+    Session first;
+    Session second;
+
+    QByteArray data;
+    const QByteArray line = QByteArray(78, 'x') + "\r\n";
+    while (data.size() < 16 * 1024 * 1024)
+        data += line;
+    data += "end of output";
+
+    // the first session uses up the time slice, so the second one has to
+    // wait for the next pass of the event loop rather than getting a slice
+    // of its own
+    QMetaObject::invokeMethod(&first, "onReceiveBlock",
+                              Q_ARG(const char*, data.constData()), Q_ARG(int, data.size()));
+    QMetaObject::invokeMethod(&second, "onReceiveBlock",
+                              Q_ARG(const char*, data.constData()), Q_ARG(int, data.size()));
+    QVERIFY(!screenText(&first).contains("end of output"));
+    QVERIFY(!screenText(&second).contains('x'));
+
+    // both sessions take turns until all of their output has been processed
+    QElapsedTimer timer;
+    timer.start();
+    while ((!screenText(&first).contains("end of output") ||
+            !screenText(&second).contains("end of output")) && timer.elapsed() < 60000)
+        QCoreApplication::processEvents();
+
+    QVERIFY(screenText(&first).contains("end of output"));
+    QVERIFY(screenText(&second).contains("end of output"));
+}
+
+QTEST_KDEMAIN_CORE(SessionTest)
+
+#include "SessionTest.moc"
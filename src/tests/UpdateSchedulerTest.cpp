@@ -0,0 +1,108 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "UpdateSchedulerTest.h"
+
+// Qt
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+using namespace Konsole;
+
+void UpdateSchedulerTest::testCoalescing()
+{
+    UpdateScheduler scheduler;
+    QSignalSpy spy(&scheduler, SIGNAL(updateRequested()));
+
+    // requests made before control returns to the event loop
+    // result in a single update
+    for (int i = 0; i < 10; i++)
+        scheduler.scheduleUpdate();
+    QCOMPARE(spy.count(), 0);
+
+    QTest::qWait(50);
+    QCOMPARE(spy.count(), 1);
+
+    const UpdateScheduler::Statistics& statistics = scheduler.statistics();
+    QCOMPARE(statistics.requests, 10);
+    QCOMPARE(statistics.coalescedRequests, 9);
+    QCOMPARE(statistics.frames, 1);
+    QCOMPARE(statistics.delayedFrames, 0);
+
+    scheduler.resetStatistics();
+    QCOMPARE(scheduler.statistics().requests, 0);
+}
+
+void UpdateSchedulerTest::testFrameRate()
+{
+    UpdateScheduler scheduler;
+    scheduler.setFrameRate(5);
+    QCOMPARE(scheduler.frameRate(), 5);
+    QCOMPARE(scheduler.frameInterval(), 200);
+
+    QSignalSpy spy(&scheduler, SIGNAL(updateRequested()));
+
+    scheduler.scheduleUpdate();
+    QTest::qWait(20);
+    QCOMPARE(spy.count(), 1);
+
+    // an update requested straight after a frame has to wait
+    // until the frame interval has passed
+    scheduler.scheduleUpdate();
+    scheduler.scheduleUpdate();
+    QTest::qWait(20);
+    QCOMPARE(spy.count(), 1);
+
+    QTest::qWait(400);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(scheduler.statistics().delayedFrames, 1);
+    QCOMPARE(scheduler.statistics().coalescedRequests, 1);
+}
+
+void UpdateSchedulerTest::testJumpScroll()
+{
+    UpdateScheduler scheduler;
+    scheduler.setFrameRate(50);
+    QCOMPARE(scheduler.frameInterval(), 20);
+
+    // frames which scroll by less than a screen keep the full frame rate
+    scheduler.frameDrawn(10, 40);
+    QCOMPARE(scheduler.frameInterval(), 20);
+
+    // the frame rate drops while the output moves faster than it can be read
+    scheduler.frameDrawn(40, 40);
+    QCOMPARE(scheduler.frameInterval(), 40);
+    scheduler.frameDrawn(200, 40);
+    QCOMPARE(scheduler.frameInterval(), 80);
+    scheduler.frameDrawn(200, 40);
+    QCOMPARE(scheduler.frameInterval(), 80);
+    QCOMPARE(scheduler.statistics().jumpScrollFrames, 2);
+
+    // and recovers once it slows down
+    scheduler.frameDrawn(1, 40);
+    QCOMPARE(scheduler.frameInterval(), 20);
+}
+
+QTEST_KDEMAIN_CORE(UpdateSchedulerTest)
+
+#include "UpdateSchedulerTest.moc"
@@ -0,0 +1,223 @@
+/*
+    Copyright 2013 by the Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Vt102EmulationTest.h"
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTextStream>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+QString Vt102EmulationTest::lineText(Vt102Emulation* emulation, int line)
+{
+    QString result;
+    QTextStream stream(&result);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    emulation->writeToStream(&decoder, line, line);
+    decoder.end();
+    return result.trimmed();
+}
+
+void Vt102EmulationTest::testPrintableText()
+{
+    Vt102Emulation emulation;
+    const QByteArray data("hello world\r\nsecond line");
+    emulation.receiveData(data.constData(), data.length());
+
+    QCOMPARE(lineText(&emulation, 0), QString("hello world"));
+    QCOMPARE(lineText(&emulation, 1), QString("second line"));
+}
+
+void Vt102EmulationTest::testEscapeSequences()
+{
+    Vt102Emulation emulation;
+    const QByteArray data("\033[1;31mred\033[0m\033[2Cx\r\n"
+                          "\033]0;window title\007next\r\n"
+                          "abc\033[2D\033[K\r\n"
+                          "\033[3;5Hpos");
+    emulation.receiveData(data.constData(), data.length());
+
+    QCOMPARE(lineText(&emulation, 0), QString("red  x"));
+    QCOMPARE(lineText(&emulation, 1), QString("next"));
+    QCOMPARE(lineText(&emulation, 2), QString("a   pos"));
+}
+
+void Vt102EmulationTest::testSplitSequences()
+{
+    // escape sequences may be split across blocks of output
+    Vt102Emulation emulation;
+    const char* blocks[] = { "ab\033", "[", "3", "1mcd\033]0;ti", "tle\007ef\033[1", "0Cg" };
+    for (uint i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+        emulation.receiveData(blocks[i], qstrlen(blocks[i]));
+
+    QCOMPARE(lineText(&emulation, 0), QString("abcdef          g"));
+}
+
+void Vt102EmulationTest::testLineWrapping()
+{
+    Vt102Emulation emulation;
+    emulation.setImageSize(5, 10);
+
+    // runs of text longer than a line continue on the next line,
+    // mixing wide characters into the run
+    const QByteArray data("0123456789abc\xe4\xb8\xadxyz0123\xe4\xb8\xad\r\n"
+                          "\033[?7lno wrapping here");
+    emulation.setCodec(QTextCodec::codecForName("utf8"));
+    emulation.receiveData(data.constData(), data.length());
+
+    QCOMPARE(lineText(&emulation, 0), QString("0123456789"));
+    QCOMPARE(lineText(&emulation, 1), QString::fromUtf8("abc\xe4\xb8\xadxyz01"));
+    QCOMPARE(lineText(&emulation, 2), QString::fromUtf8("23\xe4\xb8\xad"));
+    QCOMPARE(lineText(&emulation, 3), QString("no wrappie"));
+}
+
+void Vt102EmulationTest::testScrolling()
+{
+    Vt102Emulation emulation;
+    emulation.setImageSize(5, 10);
+
+    // scroll the whole screen, then a region in both directions, then
+    // the whole screen again once the lines have been rotated
+    const QByteArray data("1\r\n2\r\n3\r\n4\r\n5\r\n6\r\n7"
+                          "\033[2;4r\033[4;1H\n"
+                          "\033[2;1H\033M"
+                          "\033[r\033[5;1H\nx");
+    emulation.receiveData(data.constData(), data.length());
+
+    QCOMPARE(lineText(&emulation, 0), QString());
+    QCOMPARE(lineText(&emulation, 1), QString("5"));
+    QCOMPARE(lineText(&emulation, 2), QString("6"));
+    QCOMPARE(lineText(&emulation, 3), QString("7"));
+    QCOMPARE(lineText(&emulation, 4), QString("x"));
+
+    const QByteArray scrollUp("\033[2S");
+    emulation.receiveData(scrollUp.constData(), scrollUp.length());
+    emulation.setImageSize(6, 10);
+
+    QCOMPARE(lineText(&emulation, 0), QString("6"));
+    QCOMPARE(lineText(&emulation, 1), QString("7"));
+    QCOMPARE(lineText(&emulation, 2), QString("x"));
+    for (int line = 3; line < 6; line++)
+        QCOMPARE(lineText(&emulation, line), QString());
+}
+
+void Vt102EmulationTest::testUtf8Decoding()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("utf8"));
+
+    // multi-byte sequences split across blocks of output, followed
+    // by a truncated sequence and a stray continuation byte
+    const char* blocks[] = { "gr\xc3", "\xbc\xc3\x9f \xe2\x82", "\xac ", "\xe2\x82x\x80y" };
+    for (uint i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+        emulation.receiveData(blocks[i], qstrlen(blocks[i]));
+
+    QCOMPARE(lineText(&emulation, 0), QString::fromUtf8("gr\xc3\xbc\xc3\x9f \xe2\x82\xac \xef\xbf\xbdx\xef\xbf\xbdy"));
+}
+
+void Vt102EmulationTest::testZModemDetection()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(zmodemDetected()));
+
+    const QByteArray text("plain text without a transfer request\r\n");
+    emulation.receiveData(text.constData(), text.length());
+    QCOMPARE(spy.count(), 0);
+
+    const QByteArray request("**\030B00000000000000\r\n");
+    emulation.setCodec(QTextCodec::codecForName("utf8"));
+    emulation.receiveData(request.constData(), request.length());
+    QCOMPARE(spy.count(), 1);
+
+    emulation.setCodec(QTextCodec::codecForName("ISO 8859-1"));
+    emulation.receiveData(request.constData(), request.length());
+    QCOMPARE(spy.count(), 2);
+}
+
+void Vt102EmulationTest::testAstralCharacters()
+{
+    Vt102Emulation emulation;
+    emulation.setImageSize(5, 10);
+    emulation.setCodec(QTextCodec::codecForName("utf8"));
+
+    // U+1F600 is two columns wide, U+20000 as well, U+1D11E is one column wide
+    const QByteArray data("a\xf0\x9f\x98\x80" "b\xf0\xa0\x80\x80\xf0\x9d\x84\x9e" "c\033[1;9Hd");
+    emulation.receiveData(data.constData(), data.length());
+
+    QCOMPARE(lineText(&emulation, 0), QString::fromUtf8("a\xf0\x9f\x98\x80" "b\xf0\xa0\x80\x80\xf0\x9d\x84\x9e" "cd"));
+}
+
+void Vt102EmulationTest::testOutputChangedRate()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(outputChanged()));
+
+    // the first change after a quiet period is announced straight away
+    emulation.receiveData("a", 1);
+    QTest::qWait(5);
+    QCOMPARE(spy.count(), 1);
+
+    // after that, output is announced at most once per frame however
+    // often it arrives
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 100; i++) {
+        emulation.receiveData("b", 1);
+        QCoreApplication::processEvents();
+    }
+    const qint64 elapsed = timer.elapsed();
+    QTest::qWait(50);
+
+    QVERIFY(spy.count() >= 2);
+    QVERIFY(spy.count() <= 3 + elapsed / 16);
+}
+
+void Vt102EmulationTest::testReceiveDataThroughput()
+{
+    // output resembling a build log, mostly plain text with
+    // the occasional colored status message
+    QByteArray data;
+    for (int i = 0; i < 20000; i++) {
+        data += "[ 42%] Building CXX object src/CMakeFiles/konsoleprivate.dir/Vt102Emulation.cpp.o\r\n";
+        if (i % 10 == 0)
+            data += "\033[1;32mLinking CXX shared library libkonsoleprivate.so\033[0m\r\n";
+    }
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("utf8"));
+    QBENCHMARK {
+        emulation.receiveData(data.constData(), data.length());
+    }
+}
+
+QTEST_KDEMAIN_CORE(Vt102EmulationTest)
+
+#include "Vt102EmulationTest.moc"
+